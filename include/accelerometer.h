@@ -2,6 +2,8 @@
 #define ACCELEROMETER_H
 
 #include "config.h"
+#include "streaming_stats.h"
+#include "dsp_kernels.h"
 
 class Accelerometer
 {
@@ -17,9 +19,26 @@ public:
      **/
     double *vRealX, *vRealY, *vRealZ;
 
+    /**
+     * Streaming statistics of the raw acceleration data, updated while sampling
+     */
+    StreamingStats statsX, statsY, statsZ;
+
     // Sampling period in microseconds
     unsigned int samplingPeriodUs;
 
+    /**
+     * The samples staged by stageSample() since the last takeBlock(), as x, y, z frames like the IMU gives them,
+     * and the axes of the block takeBlock() returned, dsp::blockSize each
+     */
+    float *frames;
+    int numFrames;
+    float *blockX, *blockY, *blockZ;
+
+    // IMU output data rate in Hz, the FIFO fills at it whatever accSamplingFrequency is, and its period in microseconds
+    float outputDataRate;
+    unsigned int outputPeriodUs;
+
     /**
      * @param _samplerOptions The sampler options
      */
@@ -29,6 +48,24 @@ public:
      * Sample the accelerometer data
      */
     void sampleAccelerometer(bool logData = true);
+
+    /**
+     * Read the next sample from the IMU FIFO into accX, accY and accZ, if there's one
+     * @return false when no new sample was available, leaving accX, accY and accZ untouched
+     */
+    bool readAvailableAcceleration();
+
+    /**
+     * Stage accX, accY and accZ for the block processing
+     * @return Whether the block is full, takeBlock() must then be called before the next sample
+     */
+    bool stageSample();
+
+    /**
+     * Split the staged samples into blockX, blockY and blockZ, and start a new block
+     * @return The number of samples of the block
+     */
+    int takeBlock();
 };
 
 #endif // ACCELEROMETER_H
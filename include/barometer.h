@@ -17,10 +17,6 @@ private:
     float altitudeMeters = 0.0f;
     float temperatureC = 0.0f;
 
-    bool isMoving = false;
-    float movingSpeed = 0.0f;
-    MovingStatus movingStatus = MovingStatus::Stopped;
-
     void getPressure();
 
     void getTemperature();
@@ -28,6 +24,13 @@ private:
 public:
     Barometer(SampleDataPoint *_sampleDataPoint, SamplerConfig *_samplerConfig);
 
+    /**
+     * Barometric altitude from a 3rd order expansion of 44330 * (1 - (p / 101.325)^(1 / 5.255)) around sea level,
+     * to avoid a pow() per sample. Within a few cm below ~1000 m and ~3 m at ~2000 m
+     * @param pressureKpa The pressure in kPa
+     */
+    static float pressureToAltitude(float pressureKpa);
+
     void samplePressure(bool logData = true);
 
     void sampleTemperature();
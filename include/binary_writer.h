@@ -0,0 +1,138 @@
+#ifndef BINARY_WRITER_H
+#define BINARY_WRITER_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "sample.h"
+#include "capture_format.h"
+
+/**
+ * Writes the buffered sample data points as a binary capture file (see capture_format.h), a capture at a time.
+ * The schema is built once from the config, then every capture is written column by column
+ * in the width the data already has, so saving is close to a plain copy to the SD card.
+ * A capture can be written over several calls, each one resumes at the column and byte the previous one stopped at.
+ */
+class BinaryWriter
+{
+private:
+    // The parts of a capture in file order, the large ones can be split between calls
+    enum class CaptureSection
+    {
+        Head,
+        AccX,
+        AccY,
+        AccZ,
+        Envelope,
+        ModelScores,
+        Audio,
+        Done,
+    };
+
+    static constexpr int maxColumns = 32;
+    static constexpr int conversionBufferSize = 64;
+
+    SamplerConfig *samplerConfig;
+
+    capture_format::ColumnDescriptor *columns;
+    uint16_t numColumns;
+    // Column data bytes of a full and of a compact capture, without the streams of the packed columns
+    uint32_t fullCaptureSize;
+    uint32_t compactCaptureSize;
+
+    // Stages the double acc samples as float32, so they're written in a few large blocks
+    float *conversionBuffer;
+
+    Print *output;
+    bool isComplete;
+    uint32_t size;
+
+    // Where the capture being written continues, and the bytes of that section already written
+    CaptureSection captureSection;
+    uint32_t captureOffset;
+
+    /**
+     * Append a column to the schema
+     * @param name Column name, at most capture_format::maxNameLength characters
+     * @param type Stored type
+     * @param count Values per capture
+     * @param scale Physical value per stored unit
+     * @param isInCompact Whether compact captures also store it
+     */
+    void addColumn(const char *name, capture_format::ColumnType type, uint32_t count, float scale, bool isInCompact);
+
+    /**
+     * Write bytes to the output and count them
+     */
+    void put(const void *data, size_t length);
+
+    /**
+     * Write the next bytes of a column, until stepEnd
+     * @param start Bytes of the section before the column, already counted by captureOffset
+     * @return Whether the column is now written completely
+     */
+    bool putBytes(const void *data, uint32_t length, uint32_t stepEnd, uint32_t start = 0);
+
+    /**
+     * Write the next bytes of a zero filled column, until stepEnd
+     * @return Whether the column is now written completely
+     */
+    bool putZeros(uint32_t length, uint32_t stepEnd);
+
+    /**
+     * Write the next doubles of a column as float32 through the conversion buffer, until stepEnd
+     * @return Whether the column is now written completely
+     */
+    bool putFloats(const double *values, int count, uint32_t stepEnd);
+
+    /**
+     * Write the next bytes of a packed column, its byte size then its stream, until stepEnd
+     * @return Whether the column is now written completely
+     */
+    bool putPacked(const uint8_t *packed, uint32_t packedSize, uint32_t stepEnd);
+
+    /**
+     * Write the capture header and the columns compact captures keep, in schema order
+     */
+    void writeHead(const SampleDataPoint &sample);
+
+    /**
+     * Write the next bytes of captureSection, until stepEnd
+     * @return Whether the section is now written completely
+     */
+    bool writeSection(const SampleDataPoint &sample, uint32_t stepEnd);
+
+public:
+    /**
+     * Must be created once the sensors are initialized, as the schema depends on their rates and sizes
+     * @param _samplerConfig The sampler config
+     */
+    BinaryWriter(SamplerConfig *_samplerConfig);
+
+    /**
+     * Write the file header and the schema
+     * @param _output Where to write, e.g. an open file or the capture log
+     */
+    void begin(Print &_output);
+
+    /**
+     * Write one capture block, or its next part when the previous call stopped within it.
+     * A call stops after maxSize bytes, except that the header columns and the peaks aren't split, so it can go over by those
+     * @param sample The capture, unchanged until it's written completely
+     * @param maxSize Bytes to write
+     * @return Whether the capture is now written completely
+     */
+    bool writeCapture(const SampleDataPoint &sample, uint32_t maxSize);
+
+    /**
+     * @return Whether every byte since begin() was written
+     */
+    bool end();
+
+    /**
+     * @return The bytes of the file so far, e.g. the offset the next capture starts at
+     */
+    uint32_t getSize() const { return size; }
+};
+
+#endif // BINARY_WRITER_H
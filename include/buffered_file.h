@@ -0,0 +1,47 @@
+#ifndef BUFFERED_FILE_H
+#define BUFFERED_FILE_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include "config.h"
+
+/**
+ * Stages the Print writes to a new SD file and writes them SamplerOptions::sdWriteSize at a time, the card's best,
+ * so the capture writers reach the card in whole multi-block writes at aligned offsets instead of 512 bytes at
+ * a time through the SD library's one block cache.
+ */
+class BufferedFile : public Print
+{
+private:
+    File *file;
+    uint8_t *buffer;
+    size_t bufferSize;
+    size_t length;
+    bool hasWriteError;
+
+    void writeBuffer();
+
+public:
+    /**
+     * @param _samplerConfig The sampler config, with the SD write size settled
+     */
+    BufferedFile(SamplerConfig *_samplerConfig);
+
+    /**
+     * Stage the writes to a file open for writing, from its start
+     */
+    void begin(File *_file);
+
+    size_t write(uint8_t byte) override;
+    size_t write(const uint8_t *data, size_t size) override;
+    using Print::write;
+
+    /**
+     * Write what's staged. The file stays open
+     * @return Whether every byte since begin() was written
+     */
+    bool end();
+};
+
+#endif // BUFFERED_FILE_H
@@ -0,0 +1,179 @@
+#ifndef CAPTURE_FORMAT_H
+#define CAPTURE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Self-describing binary capture file, the compact alternative to the JSON files (FileFormat::Binary).
+ * Little endian, laid out as:
+ *
+ *   FileHeader
+ *   ColumnDescriptor x numColumns   the schema, i.e. name, type, values per capture and scale of each channel
+ *   CaptureHeader + column data     one block per capture, until the end of the file
+ *
+ * The column data of a capture is every column in schema order, each stored contiguously in its own width.
+ * A packed column (AccStorageMode::Packed, MicEncoding::ImaAdpcm) is instead a uint32 byte size followed by that many
+ * bytes of delta_codec or ima_adpcm stream, so its size varies from capture to capture and CaptureHeader::size is the only total.
+ * Compact captures (inference-gated storage) only carry the columns flagged isInCompact.
+ * Portable so the host decoder (tools/capture_decoder) shares the exact same definitions.
+ */
+namespace capture_format
+{
+    constexpr uint32_t fileMagic = 0x46434453;    // "SDCF"
+    constexpr uint32_t captureMagic = 0x54504143; // "CAPT"
+    constexpr uint16_t formatVersion = 3; // 2 added the packed columns, 3 the text columns
+    constexpr size_t maxNameLength = 19;
+
+    enum class ColumnType : uint8_t
+    {
+        UInt8 = 1,
+        Int16 = 2,
+        Float32 = 3,
+        PackedInt16 = 4, // delta_codec encoded int16 values
+        ImaAdpcm = 5,    // ima_adpcm encoded int16 values
+        Text = 6,        // A NUL padded string of count chars, e.g. the name of the capture's WAV file
+    };
+
+    enum ColumnFlags : uint8_t
+    {
+        isInCompact = 1, // Also stored for compact captures
+    };
+
+    enum CaptureFlags : uint8_t
+    {
+        isCompactCapture = 1,
+    };
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint16_t formatVersion;
+        uint16_t numColumns;
+        float accSamplingFrequency; // Hz
+        float micSamplingRate;      // Hz
+        float envelopeBinHz;        // Width of an envelopeSpectrum bin, 0 without envelope analysis
+        uint32_t reserved;
+    };
+    static_assert(sizeof(FileHeader) == 24, "Written and read as is");
+
+    struct ColumnDescriptor
+    {
+        char name[maxNameLength + 1]; // NUL terminated, e.g. "accX"
+        ColumnType type;
+        uint8_t flags;  // ColumnFlags
+        uint16_t reserved;
+        uint32_t count; // Values per capture
+        float scale;    // Physical value = stored value * scale, e.g. 1 / 32768 for audio in full scale
+    };
+    static_assert(sizeof(ColumnDescriptor) == 32, "Written and read as is");
+
+    struct CaptureHeader
+    {
+        uint32_t magic;
+        uint32_t size; // Bytes of column data following the header
+        uint32_t timestamp; // millis() at the end of the capture
+        uint8_t flags;      // CaptureFlags
+        uint8_t reserved[3];
+    };
+    static_assert(sizeof(CaptureHeader) == 16, "Written and read as is");
+
+    /**
+     * Capture log (SamplerOptions::logFileSize): files preallocated with zeros, holding one record per saved buffer.
+     * A record starts on a logBlockSize boundary with a LogRecordHeader, followed by the payload (a binary capture
+     * file or a JSON document, as the file format option) and zero padding up to the next boundary.
+     * The first block of a record is written last and is its commit marker: only a header with a valid headerCrc
+     * commits a record, so an interrupted one reads as the end of the log, and payloadCrc catches a torn payload.
+     *
+     * After every commit the LogTail is written to logTailFileName, alternating between its two blocks so one of
+     * them is always whole. At boot the log resumes from the newer one in a few block reads instead of a card scan.
+     */
+    constexpr uint32_t logRecordMagic = 0x32474C43; // "CLG2", "CLOG" records had no CRCs
+    constexpr size_t logBlockSize = 512;
+
+    struct LogRecordHeader
+    {
+        uint32_t magic;
+        uint32_t size;       // Payload bytes
+        uint32_t sequence;   // Counts the records across files and boots
+        uint32_t timestamp;  // millis() when the record was committed
+        uint32_t payloadCrc; // checksum::crc32 of the payload
+        uint32_t reserved[2];
+        uint32_t headerCrc; // checksum::crc32 of the header up to here
+    };
+    static_assert(sizeof(LogRecordHeader) == 32, "Written and read as is");
+
+    constexpr const char *logTailFileName = "LOGTAIL.BIN";
+    constexpr uint32_t logTailMagic = 0x4C494154; // "TAIL"
+
+    struct LogTail
+    {
+        uint32_t magic;
+        uint32_t commitCount;         // The block with the larger one is the newer tail
+        uint32_t fileIndex;           // Of the log file, e.g. 3 for CAP00003.LOG
+        uint32_t nextOffset;          // Where the next record goes in it
+        uint32_t nextSequence;
+        uint32_t largestRecordBlocks; // For the roll over, see CaptureLog
+        uint32_t reserved;
+        uint32_t crc;                 // checksum::crc32 of the tail up to here
+    };
+    static_assert(sizeof(LogTail) == 32, "Written and read as is");
+
+    /**
+     * Capture manifest (manifestFileName in the card's root): an index of every saved file or log record, so captures
+     * are found by boot, time or trigger and read with a single seek instead of opening every file.
+     * A ManifestHeader, then one entry appended per file or record once it's closed: a ManifestEntry followed by
+     * numCaptures uint32 offsets of the captures in the payload, i.e. of their CaptureHeader in a binary file,
+     * of their object (or the comma before it) in a JSON document.
+     * The entry CRC covers the entry with crc 0 and its offsets, so an entry torn by a reset reads as the end.
+     *
+     * The files are named by boot (bootCountFileName counts them) and by sequence within the boot, in directories
+     * of filesPerDirectory, e.g. "B00012/S003/00000771.BIN", so names never repeat and no directory grows large.
+     */
+    constexpr const char *manifestFileName = "MANIFEST.BIN";
+    constexpr const char *bootCountFileName = "BOOTCNT.BIN";
+    constexpr uint32_t manifestMagic = 0x4E414D53;      // "SMAN"
+    constexpr uint32_t manifestEntryMagic = 0x544E454D; // "MENT"
+    constexpr uint16_t manifestVersion = 1;
+    constexpr uint32_t filesPerDirectory = 256;
+    constexpr size_t maxPathLength = 31;
+
+    struct ManifestHeader
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t entrySize; // sizeof(ManifestEntry), the offsets follow each entry
+    };
+    static_assert(sizeof(ManifestHeader) == 8, "Written and read as is");
+
+    struct ManifestEntry
+    {
+        uint32_t magic;
+        uint32_t crc;
+        char path[maxPathLength + 1]; // From the card's root, NUL padded
+        uint32_t bootCount;
+        uint32_t sequence;        // Of the file within its boot
+        uint32_t payloadOffset;   // Of the capture file or document, past the LogRecordHeader in a capture log
+        uint32_t payloadSize;
+        uint32_t firstTimestamp;  // millis() of the first and the last capture
+        uint32_t lastTimestamp;
+        uint16_t numCaptures;
+        uint8_t trigger;          // Triggers value of the sampler, e.g. 0 for Interval
+        uint8_t movingStatuses;   // Bit 1 << MovingStatus of every capture
+        uint8_t fileFormat;       // FileFormat value, 0 for Json and 1 for Binary
+        uint8_t reserved[3];
+    };
+    static_assert(sizeof(ManifestEntry) == 72, "Written and read as is");
+
+    /**
+     * Bytes of one value of a column type, 0 for an unknown type. The decoded width for a packed type
+     */
+    size_t typeSize(ColumnType type);
+
+    /**
+     * Whether a column type is stored as a variable size packed stream
+     */
+    bool isPacked(ColumnType type);
+}
+
+#endif // CAPTURE_FORMAT_H
@@ -0,0 +1,159 @@
+#ifndef CAPTURE_LOG_H
+#define CAPTURE_LOG_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include "config.h"
+#include "capture_format.h"
+
+/**
+ * Append-only capture log on the SD card (SamplerOptions::logFileSize, format in capture_format.h).
+ * Each log file is created and zero filled to logFileSize once, then every record overwrites it in place
+ * in whole 512 byte blocks, which the SD library sends straight to the card without caching, FAT allocation
+ * or directory update. The blocks are staged and written SamplerOptions::sdWriteSize at a time, the card's best. A file rolls over before the record that's not expected to fit, and only grows past
+ * logFileSize when a record is larger than every one before it.
+ *
+ * Records are written as a Print between beginRecord() and endRecord(), so the capture writers stream into it.
+ *
+ * It's a journal: a record only counts once its header is committed, and every commit also writes the log tail
+ * (capture_format::LogTail). begin() resumes from the tail right after the last committed record, in the same
+ * file and with the next sequence, so a reset loses only the record being written and never needs a card scan.
+ */
+class CaptureLog : public Print
+{
+private:
+    static constexpr size_t blockSize = capture_format::logBlockSize;
+
+    SamplerConfig *samplerConfig;
+
+    File file;
+    File tailFile;
+    uint32_t fileIndex;
+    char fileName[13];
+    // Byte offset the file's next read or write happens at, to skip the seeks of sequential blocks
+    uint32_t filePosition;
+
+    // The first block of the open record, committed by endRecord() with the header in front of it
+    uint8_t *firstBlock;
+    // The blocks past the first one, written numWriteBlocks at a time
+    uint8_t *blocks;
+    uint32_t numWriteBlocks;
+    uint32_t numStagedBlocks;
+    // The block being filled, the first one or the next staged one
+    uint8_t *currentBlock;
+    size_t currentLength;
+    // File offsets of the open record, of currentBlock and of the first staged block
+    uint32_t recordOffset;
+    uint32_t blockOffset;
+    uint32_t stagedOffset;
+    uint32_t recordSize;
+    uint32_t payloadCrc;
+    uint32_t sequence;
+    // Of the last tail written, its block alternates
+    uint32_t commitCount;
+    bool isRecordOpen;
+    bool hasWriteError;
+
+    // Blocks of the largest record so far, to roll over before a record that's not going to fit
+    uint32_t largestRecordBlocks;
+
+    // Write timing since boot, the variance is what the preallocation is for
+    unsigned long maxWriteUs;
+    unsigned long totalWriteUs;
+    unsigned long numWrites;
+
+    /**
+     * Close the current file, then create and zero fill the next one
+     * @return false when it can't be created or filled
+     */
+    bool openNextFile();
+
+    /**
+     * Read the newer of the two tail blocks
+     * @return false when neither is valid, e.g. on a new card
+     */
+    bool readTail(capture_format::LogTail *tail);
+
+    /**
+     * Write where the next record goes over the older tail block
+     */
+    bool writeTail();
+
+    /**
+     * Reopen the file of the tail and move past the records committed after it was written
+     * @return false when the file is gone or shorter than the tail says
+     */
+    bool resume(const capture_format::LogTail &tail);
+
+    /**
+     * Without a tail: find the last log file, continue its sequence and start the next one
+     */
+    bool startAfterLastFile();
+
+    /**
+     * Move recordOffset and sequence past the committed records from recordOffset on
+     * @param isSequenceKnown false to take the sequence of the first record
+     */
+    void skipCommittedRecords(bool isSequenceKnown);
+
+    /**
+     * Read the header of a record
+     * @return false when there's no committed record at offset
+     */
+    bool readHeader(uint32_t offset, capture_format::LogRecordHeader *header);
+
+    /**
+     * Write whole blocks at a block aligned offset
+     */
+    bool writeBlocks(uint32_t offset, const uint8_t *data, uint32_t numBlocks);
+
+    /**
+     * Write the staged blocks of the record
+     */
+    bool writeStagedBlocks();
+
+public:
+    /**
+     * @param _samplerConfig The sampler config
+     */
+    CaptureLog(SamplerConfig *_samplerConfig);
+
+    /**
+     * Resume the log where the last boot left it, or create the first log file. The SD card must be initialized
+     * @return Whether the log can be written
+     */
+    bool begin();
+
+    /**
+     * Start a record, rolling over to a new file first when the largest record so far wouldn't fit
+     */
+    bool beginRecord();
+
+    /**
+     * Pad the record to a block boundary and commit it by writing its first block with the header
+     * @return Whether every byte of the record was written
+     */
+    bool endRecord();
+
+    /**
+     * @return Name of the log file the record goes to
+     */
+    const char *getFileName() const { return fileName; }
+
+    /**
+     * @return Offset of the record's payload in the log file, past its header
+     */
+    uint32_t getPayloadOffset() const { return recordOffset + sizeof(capture_format::LogRecordHeader); }
+
+    size_t write(uint8_t byte) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+
+    /**
+     * Print the record count and the write latency
+     */
+    void printStats();
+};
+
+#endif // CAPTURE_LOG_H
@@ -0,0 +1,22 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * CRC-32 (IEEE 802.3, the zlib/PNG one) with a 256 entry table in flash.
+ * Portable so the host tools compute the same checksums as the firmware.
+ */
+namespace checksum
+{
+    /**
+     * @param data Bytes to checksum
+     * @param length Number of bytes
+     * @param crc Result of the previous call to checksum a stream in chunks, 0 for the first one
+     * @return The CRC-32 of everything so far, e.g. 0xCBF43926 for "123456789"
+     */
+    uint32_t crc32(const void *data, size_t length, uint32_t crc = 0);
+}
+
+#endif // CHECKSUM_H
@@ -17,6 +17,7 @@ public:
     SamplerOptions *samplerOptions;
     AccOptions *accOptions;
     MicOptions *micOptions;
+    ModelOptions *modelOptions;
 
     /**
      * Basic configuration for the sampler triggers and sensors to be used.
@@ -24,15 +25,19 @@ public:
      * - Triggers: Interval
      * - Data sensors: Accelerometer, Microphone, Barometer
      * - Interval: 5000 milliseconds
+     * - No on-device inference, unless model options are passed
+     * - Every capture stored in full, unless a store score threshold is set
      * The rest will be ignored if their respective triggers are not set.
      */
     SamplerConfig(
         SamplerOptions *_samplerOptions,
         AccOptions *_accOptions,
-        MicOptions *_micOptions)
+        MicOptions *_micOptions,
+        ModelOptions *_modelOptions = nullptr)
         : samplerOptions(_samplerOptions),
           accOptions(_accOptions),
-          micOptions(_micOptions)
+          micOptions(_micOptions),
+          modelOptions(_modelOptions)
     {
         for (unsigned int i = 0; i < samplerOptions->sizeofTriggers; i++)
         {
@@ -52,11 +57,15 @@ public:
             {
                 samplerOptions->hasMicTrigger = true;
             }
+            else if (samplerOptions->triggers[i] == Triggers::AccGoertzel)
+            {
+                samplerOptions->hasGoertzelTrigger = true;
+            }
         }
 
         // Check if triggers has Interval and other triggers at the same time, and if so, show a warning and stop
         if (samplerOptions->hasIntervalTrigger &&
-            (samplerOptions->hasMovementTrigger || samplerOptions->hasAccRawTrigger || samplerOptions->hasMicTrigger))
+            (samplerOptions->hasMovementTrigger || samplerOptions->hasAccRawTrigger || samplerOptions->hasMicTrigger || samplerOptions->hasGoertzelTrigger))
         {
             Serial.println("Cannot have Interval and other triggers at the same time");
             while (1)
@@ -79,9 +88,35 @@ public:
             }
         }
 
-        samplerOptions->hasAccSensor = samplerOptions->hasAccSensor || samplerOptions->hasMovementTrigger || samplerOptions->hasAccRawTrigger;
+        samplerOptions->hasInference = modelOptions != nullptr;
+        samplerOptions->hasStoreGate = samplerOptions->storeScoreThreshold > 0.0f;
+
+        // Without a score function the store gate needs the vibration model
+        if (samplerOptions->hasStoreGate && samplerOptions->storeScoreFunction == nullptr && !samplerOptions->hasInference)
+        {
+            Serial.println("Cannot have storeScoreThreshold without a storeScoreFunction or the model options");
+            while (1)
+                ;
+        }
+
+        samplerOptions->hasCaptureLog = samplerOptions->logFileSize > 0;
+        if (samplerOptions->hasCaptureLog)
+        {
+            // Whole blocks only
+            samplerOptions->logFileSize = (samplerOptions->logFileSize + 511) / 512 * 512;
+        }
+
+        if (samplerOptions->numSaveBuffers < 1)
+        {
+            samplerOptions->numSaveBuffers = 1;
+        }
+        samplerOptions->hasBackgroundSave = samplerOptions->saveToSdCard && samplerOptions->numSaveBuffers > 1;
+
+        samplerOptions->hasAccSensor = samplerOptions->hasAccSensor || samplerOptions->hasMovementTrigger || samplerOptions->hasAccRawTrigger || samplerOptions->hasGoertzelTrigger || samplerOptions->hasInference;
         samplerOptions->hasMicSensor = samplerOptions->hasMicSensor || samplerOptions->hasMicTrigger;
         samplerOptions->hasBarSensor = samplerOptions->hasBarSensor || samplerOptions->hasMovementTrigger;
+
+        samplerOptions->hasWavAudio = samplerOptions->audioToWav && samplerOptions->saveToSdCard && samplerOptions->hasMicSensor;
     }
 };
 
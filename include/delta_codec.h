@@ -0,0 +1,55 @@
+#ifndef DELTA_CODEC_H
+#define DELTA_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Lossless codec of int16 sensor streams, e.g. the acc samples in IMU counts (AccStorageMode::Packed).
+ * The stream is cut in blocks of blockLength values, each one laid out as:
+ *
+ *   BlockMode byte
+ *   payload size    varint
+ *   payload         Verbatim: int16 little endian values
+ *                   Delta, SecondOrder: zigzag varint residuals of a first or second order prediction
+ *
+ * Every block restarts the prediction, so a block decodes on its own and a reader can skip it by its size.
+ * The encoder picks the smallest mode of each block, so a block never takes more than its verbatim size.
+ * Portable so the host tools decode and benchmark with the exact firmware code.
+ */
+namespace delta_codec
+{
+    constexpr int blockLength = 64;
+
+    enum class BlockMode : uint8_t
+    {
+        Verbatim = 0,
+        Delta = 1,       // Predicts the previous value
+        SecondOrder = 2, // Predicts a straight line through the previous two values
+    };
+
+    /**
+     * @param count Number of values
+     * @return The most bytes encode() writes for count values, i.e. the capacity of its output
+     */
+    size_t maxEncodedSize(int count);
+
+    /**
+     * @param values Values to encode
+     * @param count Number of values
+     * @param output At least maxEncodedSize(count) bytes
+     * @return The number of bytes written
+     */
+    size_t encode(const int16_t *values, int count, uint8_t *output);
+
+    /**
+     * @param input Bytes written by encode()
+     * @param size Number of bytes
+     * @param values Decoded values, count of them
+     * @param count Number of values encoded
+     * @return false when the input is truncated, corrupt or doesn't hold exactly count values
+     */
+    bool decode(const uint8_t *input, size_t size, int16_t *values, int count);
+}
+
+#endif // DELTA_CODEC_H
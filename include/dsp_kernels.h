@@ -0,0 +1,162 @@
+#ifndef DSP_KERNELS_H
+#define DSP_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Small fixed point/float kernel library for the audio and vibration paths.
+ * On the Cortex-M4F (nRF52840) the q15 kernels use the DSP extension (SMLALD, QSUB16, SSUB16 + SEL, SSAT), and everywhere else
+ * a bit-exact emulation of it, so the host check (tools/dsp_kernels_check) runs the same code as the device against dsp::reference.
+ * The float kernels run on the FPU. The streaming stages (Goertzel bank, envelope filters, axis statistics) take the acc samples
+ * in blocks of blockSize, so their loops are these kernels instead of per sample calls.
+ */
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#define DSP_USE_M4_INTRINSICS 1
+#else
+#define DSP_USE_M4_INTRINSICS 0
+#endif
+
+namespace dsp
+{
+    // Samples the streaming stages process at once, their scratch buffers are this long
+    constexpr size_t blockSize = 32;
+
+    /**
+     * Transposed direct form II biquad, with RBJ cookbook coefficients
+     */
+    struct Biquad
+    {
+        float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+        float z1 = 0.0f, z2 = 0.0f;
+
+        void setBandPass(float centerHz, float q, float samplingFrequency);
+
+        void setLowPass(float cutoffHz, float q, float samplingFrequency);
+
+        /**
+         * One pole DC blocker, y[n] = x[n] - x[n - 1] + pole * y[n - 1]. Closer to 1 means a lower cut-off frequency
+         */
+        void setDcBlocker(float pole);
+
+        void reset()
+        {
+            z1 = 0.0f;
+            z2 = 0.0f;
+        }
+    };
+
+    /**
+     * Sum of a[i] * b[i]
+     */
+    int64_t dotProductQ15(const int16_t *a, const int16_t *b, size_t length);
+
+    /**
+     * Sum of the squares, e.g. to get the RMS of an audio block
+     */
+    uint64_t energyQ15(const int16_t *input, size_t length);
+
+    /**
+     * Max absolute value. -32768 saturates to 32767
+     */
+    int16_t absMaxQ15(const int16_t *input, size_t length);
+
+    /**
+     * Streaming FIR filter in q15, rounded and saturated to 16 bits. Nothing is filtered without taps, the output is then 0
+     * @param coefficients The filter taps in reverse order, i.e. coefficients[0] multiplies the oldest sample (same as CMSIS-DSP)
+     * @param numTaps Below 65536
+     * @param state Must hold numTaps - 1 + length samples. The first numTaps - 1 carry the history between calls, and must be zeroed before the first call
+     */
+    void firQ15(const int16_t *input, int16_t *output, size_t length, const int16_t *coefficients, size_t numTaps, int16_t *state);
+
+    /**
+     * output = saturate((input * scaleFract) >> (15 - shift)), the same convention as arm_scale_q15
+     * @param shift Extra left shift, between -16 and 15
+     */
+    void scaleQ15(const int16_t *input, int16_t *output, size_t length, int16_t scaleFract, int8_t shift);
+
+    /**
+     * output = saturate(round(input * scale)). Use scale = 32768 / fullScale to map [-fullScale, fullScale) to q15
+     */
+    void floatToQ15(const float *input, int16_t *output, size_t length, float scale);
+
+    /**
+     * output = input * scale. Use scale = fullScale / 32768 to map q15 back to [-fullScale, fullScale)
+     */
+    void q15ToFloat(const int16_t *input, float *output, size_t length, float scale);
+
+    /**
+     * Interleave 3 channels (e.g. acc X, Y and Z) into x0, y0, z0, x1, y1, z1...
+     */
+    void interleave3(const float *x, const float *y, const float *z, float *output, size_t length);
+
+    /**
+     * Deinterleave x0, y0, z0, x1, y1, z1... into 3 channels
+     */
+    void deinterleave3(const float *input, float *x, float *y, float *z, size_t length);
+
+    /**
+     * Run a block through a biquad, carrying its state to the next block. Can be in place
+     */
+    void biquad(Biquad &section, const float *input, float *output, size_t length);
+
+    /**
+     * output = |input|, e.g. the full wave rectification of the envelope. Can be in place
+     */
+    void absolute(const float *input, float *output, size_t length);
+
+    /**
+     * Run a block through a Goertzel detector, s0 = input + coefficient * s1 - s2
+     * @param coefficient 2 * cos(2 * pi * f / fs)
+     * @param s1 The state carried between blocks, s1 then s2
+     */
+    void goertzel(const float *input, size_t length, float coefficient, float *s1, float *s2);
+
+    float sum(const float *input, size_t length);
+
+    /**
+     * Sum of the squares
+     */
+    float energy(const float *input, size_t length);
+
+    /**
+     * @param length At least 1
+     */
+    void minMax(const float *input, size_t length, float *minValue, float *maxValue);
+
+    /**
+     * Sums of the 2nd, 3rd and 4th powers of input - mean
+     */
+    void centralMoments(const float *input, size_t length, float mean, float *m2, float *m3, float *m4);
+
+    /**
+     * In-place radix-2 complex FFT
+     * @param length Must be a power of 2
+     */
+    void fftRadix2(float *real, float *imag, size_t length);
+
+    /**
+     * magnitudes[i] = sqrt(real[i]^2 + imag[i]^2)
+     */
+    void complexMagnitude(const float *real, const float *imag, float *magnitudes, size_t length);
+
+    /**
+     * Multiply in place by a Hann window, to limit the spectral leakage of the FFT
+     */
+    void applyHannWindow(float *data, size_t length);
+
+    /**
+     * Portable scalar implementations. These are the reference the q15 kernels must match bit by bit
+     */
+    namespace reference
+    {
+        int64_t dotProductQ15(const int16_t *a, const int16_t *b, size_t length);
+        uint64_t energyQ15(const int16_t *input, size_t length);
+        int16_t absMaxQ15(const int16_t *input, size_t length);
+        void firQ15(const int16_t *input, int16_t *output, size_t length, const int16_t *coefficients, size_t numTaps, int16_t *state);
+        void scaleQ15(const int16_t *input, int16_t *output, size_t length, int16_t scaleFract, int8_t shift);
+        void floatToQ15(const float *input, int16_t *output, size_t length, float scale);
+    } // namespace reference
+} // namespace dsp
+
+#endif // DSP_KERNELS_H
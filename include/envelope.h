@@ -0,0 +1,57 @@
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include "config.h"
+#include "dsp_kernels.h"
+
+/**
+ * Envelope analysis of one acc axis for bearing fault detection:
+ * band-pass around the structural resonance -> rectification -> low-pass -> decimation,
+ * streamed a block at a time through the dsp kernels during the capture, then an FFT of the decimated envelope at the end.
+ * Only envelopeNumBins magnitudes are kept per capture instead of the raw samples.
+ */
+class EnvelopeAnalyzer
+{
+private:
+    SamplerConfig *samplerConfig;
+
+    dsp::Biquad bandPass;
+    // Two cascaded low-pass sections (4th order) before decimation
+    dsp::Biquad lowPass1, lowPass2;
+    // A block of samples on its way through the filters, dsp::blockSize long
+    float *filtered;
+
+    int16_t decimation;
+    int16_t decimationIndex = 0;
+    int16_t envelopeLength;
+    int16_t envelopeIndex = 0;
+
+    // Decimated envelope, reused as the FFT real part
+    float *envelopeReal;
+    float *envelopeImag;
+
+public:
+    /**
+     * Must be created after the accelerometer so accSamplingFrequency is known
+     * @param _samplerConfig The sampler config
+     */
+    EnvelopeAnalyzer(SamplerConfig *_samplerConfig);
+
+    /**
+     * Clear the filters and the envelope, before a new capture
+     */
+    void reset();
+
+    /**
+     * Feed the next samples of the configured axis
+     */
+    void addSamples(const float *values, size_t length);
+
+    /**
+     * Compute the envelope spectrum of the samples added since the last reset
+     * @param spectrum Destination with envelopeNumBins entries. Bin i is at i * accSamplingFrequency / accNumSamples Hz
+     */
+    void computeSpectrum(float *spectrum);
+};
+
+#endif // ENVELOPE_H
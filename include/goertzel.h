@@ -0,0 +1,70 @@
+#ifndef GOERTZEL_H
+#define GOERTZEL_H
+
+#include "config.h"
+#include "dsp_kernels.h"
+
+/**
+ * Bank of streaming Goertzel detectors, one per configured frequency and axis.
+ * Each detector costs one multiply and two adds per sample, so watching a handful of
+ * known machine frequencies is much cheaper than running a full FFT on every block.
+ * The samples come in blocks, each axis DC blocked then run through every detector with the dsp kernels.
+ */
+class GoertzelBank
+{
+private:
+    SamplerConfig *samplerConfig;
+
+    unsigned short numFrequencies;
+    int16_t blockSize;
+    int16_t blockIndex = 0;
+
+    // 2 * cos(2 * pi * f / fs) for each frequency
+    float *coefficients;
+    // Goertzel state for each frequency and axis, indexed as [frequency * 3 + axis]
+    float *s1, *s2;
+    // Normalized power (amplitude squared) of the last complete block, same indexing as s1/s2
+    float *powers;
+
+    // One pole DC blocker for each axis, so gravity doesn't leak into low frequency bins
+    dsp::Biquad dcBlockers[3];
+    // The DC blocked samples of an axis, dsp::blockSize long
+    float *filtered;
+
+    /**
+     * Close the block: compute the powers and clear the detectors
+     */
+    void completeBlock();
+
+public:
+    /**
+     * Must be created after the accelerometer so accSamplingFrequency is known.
+     * The block size is accNumSamples, which sets the frequency resolution to accSamplingFrequency / accNumSamples.
+     * @param _samplerConfig The sampler config
+     */
+    GoertzelBank(SamplerConfig *_samplerConfig);
+
+    /**
+     * Feed the next accelerometer samples to every detector
+     * @return true when a block was completed and the powers were updated. The samples after it start the next block
+     */
+    bool addSamples(const float *x, const float *y, const float *z, size_t length);
+
+    /**
+     * Check the powers of the last complete block against goertzelThresholds
+     * @return true if any frequency on any axis is above its threshold
+     */
+    bool isTriggered();
+
+    /**
+     * @return The normalized power (amplitude squared, in g^2) of the last complete block
+     */
+    float getPower(unsigned short frequencyIndex, int axis) { return powers[frequencyIndex * 3 + axis]; }
+
+    /**
+     * Clear the detectors state, e.g. after the stream has been interrupted by data collection
+     */
+    void reset();
+};
+
+#endif // GOERTZEL_H
@@ -0,0 +1,84 @@
+#ifndef IMA_ADPCM_H
+#define IMA_ADPCM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * IMA ADPCM (the Microsoft / DVI flavour of WAV files) of mono int16 audio, 4 bits a sample (MicEncoding::ImaAdpcm).
+ * The stream is cut in blocks of blockSize bytes: a 4 byte header with the first sample as is and the step index,
+ * then samplesPerBlock - 1 samples as 4 bit codes, low nibble first. The last block is only as long as needed.
+ * Every block restarts the predictor, so an error doesn't spread past its block.
+ * Portable so the host tools decode and benchmark with the exact firmware code.
+ */
+namespace ima_adpcm
+{
+    constexpr size_t blockHeaderSize = 4;
+    constexpr size_t blockSize = 256;
+    constexpr int samplesPerBlock = (blockSize - blockHeaderSize) * 2 + 1;
+
+    /**
+     * @param numSamples Number of samples
+     * @return The bytes of their encoded stream
+     */
+    size_t encodedSize(int numSamples);
+
+    /**
+     * Encodes a stream as its samples arrive, e.g. from every PDM block
+     */
+    class Encoder
+    {
+    private:
+        uint8_t *output;
+        size_t size;
+        int32_t predictor;
+        int stepIndex;
+        int blockPosition; // Samples in the current block
+
+    public:
+        Encoder();
+
+        /**
+         * Start a new stream
+         * @param _output At least encodedSize() of all the samples to come
+         */
+        void begin(uint8_t *_output);
+
+        /**
+         * Carry on the stream into another output, e.g. once a whole block was written out.
+         * Only between blocks, getSize() then counts from the new output
+         */
+        void setOutput(uint8_t *_output);
+
+        /**
+         * Encode the next samples of the stream
+         */
+        void add(const int16_t *samples, int count);
+
+        /**
+         * @return The bytes of the stream so far
+         */
+        size_t getSize() const { return size; }
+    };
+
+    /**
+     * Decode one block
+     * @param block Start of the block
+     * @param size Bytes of the block, at most blockSize
+     * @param samples At least samplesPerBlock samples
+     * @return The number of samples decoded, 0 when the block is corrupt
+     */
+    int decodeBlock(const uint8_t *block, size_t size, int16_t *samples);
+
+    /**
+     * Decode a whole stream
+     * @param input Bytes written by the Encoder
+     * @param size Number of bytes
+     * @param samples Decoded samples, numSamples of them
+     * @param numSamples Number of samples encoded
+     * @return false when the stream is corrupt or doesn't hold exactly numSamples samples
+     */
+    bool decode(const uint8_t *input, size_t size, int16_t *samples, int numSamples);
+}
+
+#endif // IMA_ADPCM_H
@@ -0,0 +1,115 @@
+#ifndef JSON_CAPTURE_WRITER_H
+#define JSON_CAPTURE_WRITER_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "sample.h"
+#include "json_stream_writer.h"
+
+/**
+ * Writes the buffered sample data points as one JSON document, {"samples": [...]}, a capture at a time.
+ * Streamed through JsonStreamWriter, so only its small buffer is needed whatever the number of samples.
+ * A capture can be written over several calls, each one resumes at the array element the previous one stopped at.
+ */
+class JsonCaptureWriter
+{
+private:
+    // The parts of a capture in document order, the arrays of samples can be split between calls
+    enum class CaptureSection
+    {
+        Head,
+        AccX,
+        AccY,
+        AccZ,
+        Tail,
+        Audio,
+        Done,
+    };
+
+    SamplerConfig *samplerConfig;
+    JsonStreamWriter json;
+    // Unpacks an acc axis with the Packed storage mode, kept between the calls writing the axis
+    int16_t *accCounts;
+    // Decodes a block of audio with the ImaAdpcm encoding, kept between the calls writing the block,
+    // with the stream position of the next block and the samples of this one, decoded and already written
+    int16_t *audioBlock;
+    uint32_t audioPosition;
+    int audioBlockLength;
+    int audioBlockIndex;
+
+    // Where the capture being written continues, and the array elements of that section already written
+    CaptureSection captureSection;
+    int captureElement;
+
+    /**
+     * Write the axis summary fields as a json object member
+     * @param key The member name
+     * @param summary The axis summary
+     */
+    void addSummary(const char *key, const AxisSummary &summary);
+
+    /**
+     * Write the spectral peaks of one axis as a json array member, of [frequencyHz, magnitude, bin] triplets
+     * @param key The member name
+     * @param peaks The accNumPeaks spectral peaks
+     */
+    void addPeaks(const char *key, const SpectralPeak *peaks);
+
+    /**
+     * Write the members before the acc arrays, or the whole object of a compact capture
+     */
+    void writeHead(const SampleDataPoint &sample);
+
+    /**
+     * Write the next elements of an acc axis array, until stepEnd
+     * @return Whether the array is now written completely
+     */
+    bool writeAccAxis(const SampleDataPoint &sample, int axis, size_t stepEnd);
+
+    /**
+     * Write the members after the acc arrays, up to the audio array
+     * @return Whether the capture continues with the audio array
+     */
+    bool writeTail(const SampleDataPoint &sample);
+
+    /**
+     * Write the next elements of the audio array, until stepEnd, then close the capture
+     * @return Whether the array is now written completely
+     */
+    bool writeAudio(const SampleDataPoint &sample, size_t stepEnd);
+
+public:
+    /**
+     * @param _samplerConfig The sampler config
+     */
+    JsonCaptureWriter(SamplerConfig *_samplerConfig);
+
+    /**
+     * Open the document
+     * @param output Where to write, e.g. an open file or the capture log
+     */
+    void begin(Print &output);
+
+    /**
+     * Write one capture into the samples array, or its next part when the previous call stopped within it.
+     * A call stops after maxSize bytes, except that the members between the arrays aren't split, so it can go over by those
+     * @param sample The capture, unchanged until it's written completely
+     * @param maxSize Bytes to write
+     * @return Whether the capture is now written completely
+     */
+    bool writeCapture(const SampleDataPoint &sample, uint32_t maxSize);
+
+    /**
+     * Close the document and write what's still buffered
+     * @return Whether every byte since begin() was written
+     */
+    bool end();
+
+    /**
+     * @return The bytes of the document so far, e.g. the offset the next capture starts at
+     */
+    uint32_t getSize() const { return json.getSize(); }
+};
+
+#endif // JSON_CAPTURE_WRITER_H
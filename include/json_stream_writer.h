@@ -0,0 +1,81 @@
+#ifndef JSON_STREAM_WRITER_H
+#define JSON_STREAM_WRITER_H
+
+#include <Arduino.h>
+
+/**
+ * Writes a JSON document token by token to any Print (e.g. an SD File) through a small output buffer,
+ * so its memory doesn't depend on the document size, unlike building a JsonDocument first.
+ * Commas and nesting are tracked, the caller only opens, names and closes. Keys and strings aren't escaped,
+ * they must be plain identifiers or file names. Numbers are formatted in place without printf: like ArduinoJson,
+ * an exponent below 1e-5 and from 1e9, otherwise at most 9 decimals. The non finite floats,
+ * which JSON can't represent, are written as null.
+ */
+class JsonStreamWriter
+{
+private:
+    static constexpr int bufferSize = 128;
+    static constexpr int maxDepth = 8;
+
+    Print *output = nullptr;
+    char buffer[bufferSize];
+    int bufferLength = 0;
+    size_t numUnwritten = 0;
+    size_t size = 0;
+
+    // Whether a value was already written at each nesting level, i.e. the next one needs a comma
+    bool hasValue[maxDepth + 1];
+    int depth = 0;
+    bool isAfterKey = false;
+
+    void put(char c);
+    void put(const char *text, int length);
+
+    /**
+     * Comma before a value or key when it's not the first of its container
+     */
+    void separate();
+
+    void putUnsigned(uint32_t value);
+    void putFloat(double value, int significantDigits);
+
+public:
+    /**
+     * Start a new document
+     * @param _output Where the document goes, e.g. an open File
+     */
+    void begin(Print &_output);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    /**
+     * Name the next value of the current object
+     */
+    void key(const char *name);
+
+    void value(int32_t number);
+    void value(uint32_t number);
+    void value(bool boolean);
+    // 7 significant digits, i.e. what a float holds
+    void value(float number);
+    // 9 significant digits
+    void value(double number);
+    // Not escaped either, e.g. a file name
+    void value(const char *text);
+
+    /**
+     * @return The bytes of the document so far, buffered or not
+     */
+    size_t getSize() const { return size; }
+
+    /**
+     * Write what's left in the output buffer
+     * @return Whether every byte since begin() was accepted by the output
+     */
+    bool flush();
+};
+
+#endif // JSON_STREAM_WRITER_H
@@ -0,0 +1,44 @@
+#ifndef LAYER_PROFILER_H
+#define LAYER_PROFILER_H
+
+#include <stdint.h>
+
+#include "tensorflow/lite/micro/micro_profiler_interface.h"
+
+/**
+ * TensorFlow Lite Micro profiler recording how long each operator of an Invoke() takes.
+ * The interpreter tags every event with the operator name, so print() gives the per-layer breakdown
+ * of the vibration model. Events past maxEvents are dropped.
+ */
+class LayerProfiler : public tflite::MicroProfilerInterface
+{
+private:
+    static constexpr int maxEvents = 16;
+
+    const char *tags[maxEvents];
+    unsigned long startUs[maxEvents];
+    unsigned long durationUs[maxEvents];
+    int numEvents = 0;
+
+public:
+    uint32_t BeginEvent(const char *tag) override;
+
+    void EndEvent(uint32_t eventHandle) override;
+
+    /**
+     * Forgets the recorded events, to call before every Invoke()
+     */
+    void reset();
+
+    /**
+     * Prints one line per recorded event, with its duration and share of the total
+     */
+    void print();
+
+    /**
+     * Sum of the recorded event durations in microseconds
+     */
+    unsigned long getTotalUs();
+};
+
+#endif // LAYER_PROFILER_H
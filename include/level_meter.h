@@ -0,0 +1,54 @@
+#ifndef LEVEL_METER_H
+#define LEVEL_METER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Streaming audio level meter.
+ * Keeps a short-term (loudness) and a long-term (background) exponential average of the mean square,
+ * updated once per PDM block, so reading the current level never needs to look at the samples again.
+ * Levels are in dBFS, i.e. RMS relative to a full scale int16_t sample (a full scale sine is -3 dBFS).
+ */
+class LevelMeter
+{
+private:
+    // Smoothing per sample, i.e. 1 / (time constant * sampling rate)
+    float shortTermCoefficient = 0.0f;
+    float longTermCoefficient = 0.0f;
+
+    // Written from the PDM callback
+    volatile float shortTermMeanSquare = 0.0f;
+    volatile float longTermMeanSquare = 0.0f;
+
+public:
+    /**
+     * @param samplingRate Audio sampling frequency in Hz
+     * @param shortTermSeconds Time constant of the short-term level
+     * @param longTermSeconds Time constant of the long-term level
+     */
+    void configure(int samplingRate, float shortTermSeconds, float longTermSeconds);
+
+    /**
+     * Update both levels with a new block of samples. Cheap enough to be called from the PDM callback
+     */
+    void update(const int16_t *samples, size_t length);
+
+    float getShortTermMeanSquare() { return shortTermMeanSquare; }
+
+    float getShortTermDbfs() { return toDbfs(shortTermMeanSquare); }
+
+    float getLongTermDbfs() { return toDbfs(longTermMeanSquare); }
+
+    /**
+     * @param meanSquare Mean square normalized to full scale, i.e. 1.0 is a full scale square wave
+     */
+    static float toDbfs(float meanSquare);
+
+    /**
+     * Inverse of toDbfs, so thresholds can be compared against the mean square without a log per check
+     */
+    static float fromDbfs(float dbfs);
+};
+
+#endif // LEVEL_METER_H
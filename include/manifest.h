@@ -0,0 +1,64 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include "config.h"
+#include "sample.h"
+#include "capture_format.h"
+
+/**
+ * Names the files saved to the SD card and indexes them in the capture manifest (format in capture_format.h).
+ * begin() counts the boot on the card, then every file of the boot takes the next sequence number, the capture
+ * files and the WAV files alike, so no name is ever reused, whatever millis() says after a reboot.
+ */
+class Manifest
+{
+private:
+    SamplerConfig *samplerConfig;
+
+    uint32_t bootCount;
+    uint32_t sequence;
+    // Directory the last file was named in, so each one is only checked and created once
+    uint32_t directoryIndex;
+
+public:
+    /**
+     * @param _samplerConfig The sampler config
+     */
+    Manifest(SamplerConfig *_samplerConfig);
+
+    /**
+     * Count this boot and create the manifest on a new card. The SD card must be initialized
+     * @return false when the card can't be written
+     */
+    bool begin();
+
+    /**
+     * Name the next file of the boot, creating its directory when it's the first one in it
+     * @param extension e.g. "bin"
+     * @param path Gets the path from the card's root, capture_format::maxPathLength + 1 chars
+     * @param fileSequence Gets the sequence the file was named with, when not nullptr
+     * @return false when the directory can't be created
+     */
+    bool nextFilePath(const char *extension, char *path, uint32_t *fileSequence = nullptr);
+
+    /**
+     * Index a file or log record once it's closed
+     * @param path Path from the card's root
+     * @param fileSequence The sequence nextFilePath() gave, 0 for a capture log record
+     * @param payloadOffset Offset of the capture file or document in the file
+     * @param payloadSize Its bytes
+     * @param captures The captures it holds
+     * @param captureOffsets Offset of each capture in the payload
+     * @param numCaptures Number of captures
+     * @return Whether the entry was written
+     */
+    bool append(const char *path, uint32_t fileSequence, uint32_t payloadOffset, uint32_t payloadSize,
+                const SampleDataPoint *captures, const uint32_t *captureOffsets, int numCaptures);
+
+    uint32_t getBootCount() const { return bootCount; }
+};
+
+#endif // MANIFEST_H
@@ -3,6 +3,9 @@
 
 #include "config.h"
 #include "sample.h"
+#include "ima_adpcm.h"
+#include "wav_writer.h"
+#include "manifest.h"
 
 class Microphone
 {
@@ -13,13 +16,28 @@ private:
     static const int16_t tempBufferSize = 256; // Temporary buffer size
     int16_t *tempAudioBuffer;                  // Temporary buffer
     int sampleIndex = 0;                       // The current sample index
+    ima_adpcm::Encoder adpcmEncoder;           // Only used with the ImaAdpcm encoding
+    WavWriter *wavWriter;                      // Only used with the WAV audio mode
+    Manifest *manifest;                        // Names the WAV files
+    bool isPdmRunning = false;                 // Whether PDM.begin() has been called
+    bool isLoud = false;                       // Whether the trigger is between attack and release
+
+    // Mic trigger thresholds as mean square, converted once from dBFS so checking them needs no log
+    float attackMeanSquare;
+    float releaseMeanSquare;
+
+    /**
+     * Start the PDM unless it's already running
+     */
+    void startPdm();
 
 public:
     /**
      * @param _sampleDataPoint The sample data point reference
      * @param _samplerOptions The sampler options
+     * @param _manifest Names the WAV files, nullptr without the SD card
      */
-    Microphone(SampleDataPoint *_sampleDataPoint, SamplerConfig *_samplerConfig);
+    Microphone(SampleDataPoint *_sampleDataPoint, SamplerConfig *_samplerConfig, Manifest *_manifest);
 
     void startAudioSampling();
 
@@ -27,7 +45,14 @@ public:
 
     void stopAudioSampling();
 
+    /**
+     * O(1) check of the short-term audio level against the attack/release thresholds
+     */
     bool isTriggered();
+
+    float getShortTermDbfs();
+
+    float getLongTermDbfs();
 };
 
 #endif // MICROPHONE_H
@@ -0,0 +1,40 @@
+#ifndef MODEL_FILE_H
+#define MODEL_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Vibration model file loaded from the SD card at boot: a little endian Header followed by the .tflite flatbuffer.
+ * tools/model_pack writes it from a .tflite file, and the firmware checks it with isValidHeader() and the CRC
+ * before using it, so a truncated or corrupted file falls back to the compiled-in model.
+ */
+namespace model_file
+{
+    constexpr uint32_t magic = 0x4C444D56; // "VMDL"
+    constexpr uint16_t formatVersion = 1;
+    // Larger models wouldn't leave room for the tensor arena and the sample buffers anyway
+    constexpr uint32_t maxModelSize = 96 * 1024;
+    // TensorFlow Lite Micro reads the flatbuffer in place, so it's loaded at this alignment
+    constexpr size_t modelAlignment = 16;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint16_t formatVersion;
+        uint16_t headerSize;   // Offset of the model, to allow for a longer header in later format versions
+        uint32_t modelSize;    // Bytes of the .tflite flatbuffer
+        uint32_t modelVersion; // Set when packing, reported by the firmware so a fleet rollout can be tracked
+        uint32_t modelCrc;     // checksum::crc32() of the modelSize model bytes
+    };
+    static_assert(sizeof(Header) == 20, "The header is read straight from the file");
+
+    /**
+     * @param header Header read from the start of the file
+     * @param fileSize Size of the whole file
+     * @return Whether the header is one this firmware reads and the file holds the whole model
+     */
+    bool isValidHeader(const Header &header, uint32_t fileSize);
+}
+
+#endif // MODEL_FILE_H
@@ -0,0 +1,90 @@
+#ifndef NN_KERNELS_H
+#define NN_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dsp_kernels.h"
+
+/**
+ * int8 kernels for the operators of the vibration model, with the TensorFlow Lite integer semantics
+ * (per-channel conv requantization, symmetric int8 weights, gemmlowp rounding).
+ * The optimized versions sign-extend 4 weights at a time with SXTB16 and multiply-accumulate pairs with SMLAD.
+ * On the Cortex-M4F those are the DSP instructions, everywhere else a bit-exact emulation,
+ * so the host check (tools/nn_kernels_check) runs the same code as the device against the TensorFlow Lite reference kernels.
+ */
+namespace nn
+{
+    struct ConvParams
+    {
+        int inputHeight;
+        int inputWidth;
+        int inputDepth;
+        int filterHeight;
+        int filterWidth;
+        int outputHeight;
+        int outputWidth;
+        int outputDepth;
+        int strideHeight;
+        int strideWidth;
+        int padHeight; // Top padding, the bottom gets whatever is left
+        int padWidth;  // Left padding, the right gets whatever is left
+        int32_t inputOffset;  // -input zero point
+        int32_t outputOffset; // output zero point
+        int32_t activationMin;
+        int32_t activationMax;
+    };
+
+    struct FullyConnectedParams
+    {
+        int inputDepth;
+        int outputDepth;
+        int32_t inputOffset;  // -input zero point
+        int32_t outputOffset; // output zero point
+        int32_t outputMultiplier;
+        int32_t outputShift;
+        int32_t activationMin;
+        int32_t activationMax;
+    };
+
+    /**
+     * Splits a real multiplier into a q31 multiplier and a power of 2 exponent, same as tflite::QuantizeMultiplier
+     */
+    void quantizeMultiplier(double realMultiplier, int32_t *multiplier, int32_t *shift);
+
+    /**
+     * round(value * multiplier * 2^shift) with the gemmlowp double rounding, same as tflite::MultiplyByQuantizedMultiplier
+     */
+    int32_t multiplyByQuantizedMultiplier(int32_t value, int32_t multiplier, int32_t shift);
+
+    /**
+     * int16 entries needed by the scratch argument of conv2dInt8(), one filter patch rounded up to 4
+     */
+    size_t conv2dScratchSize(const ConvParams &params);
+
+    /**
+     * int16 entries needed by the scratch argument of fullyConnectedInt8()
+     */
+    size_t fullyConnectedScratchSize(const FullyConnectedParams &params);
+
+    /**
+     * NHWC convolution of a single image, dilation 1
+     * @param filter OHWI weights
+     * @param bias outputDepth values, or nullptr
+     * @param outputMultipliers, outputShifts Per output channel requantization from quantizeMultiplier()
+     * @param scratch conv2dScratchSize() entries
+     */
+    void conv2dInt8(const ConvParams &params, const int32_t *outputMultipliers, const int32_t *outputShifts,
+                    const int8_t *input, const int8_t *filter, const int32_t *bias, int8_t *output, int16_t *scratch);
+
+    /**
+     * Single batch fully connected layer
+     * @param filter outputDepth rows of inputDepth weights
+     * @param bias outputDepth values, or nullptr
+     * @param scratch fullyConnectedScratchSize() entries
+     */
+    void fullyConnectedInt8(const FullyConnectedParams &params, const int8_t *input, const int8_t *filter,
+                            const int32_t *bias, int8_t *output, int16_t *scratch);
+}
+
+#endif // NN_KERNELS_H
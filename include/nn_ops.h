@@ -0,0 +1,18 @@
+#ifndef NN_OPS_H
+#define NN_OPS_H
+
+#include "tensorflow/lite/micro/micro_common.h"
+
+/**
+ * TensorFlow Lite Micro registrations running the nn kernels, for the op resolver of the vibration classifier.
+ * They only accept what the model uses (int8, single batch, dilation 1, per-channel conv weights)
+ * and fail in Prepare, i.e. AllocateTensors(), for anything else.
+ */
+namespace nn
+{
+    TFLMRegistration registerConv2D();
+
+    TFLMRegistration registerFullyConnected();
+}
+
+#endif // NN_OPS_H
@@ -16,6 +16,11 @@ enum class Triggers
      */
     Movement,
     Microphone,
+    /**
+     * Uses a bank of Goertzel detectors on acc X, Y and Z to trigger data collection
+     * when the amplitude at any of goertzelFrequencies exceeds its goertzelThresholds
+     */
+    AccGoertzel,
 };
 
 enum class DataSensor
@@ -51,6 +56,62 @@ struct MovingTrigger
     MovingDirection movingDirection;
 };
 
+enum class AccAxis
+{
+    X,
+    Y,
+    Z,
+};
+
+enum class AccStorageMode
+{
+    /**
+     * Every raw acc sample of every axis
+     */
+    Raw,
+    /**
+     * Only the accNumPeaks largest spectral peaks and the broadband energy of each axis
+     */
+    Peaks,
+    /**
+     * Every raw acc sample of every axis, losslessly packed in IMU counts (see delta_codec.h) as soon as it's captured.
+     * The buffered captures take the bytes they packed to in a pool per buffer (AccOptions::accPackedPoolSize), so the better
+     * the samples compress, the more captures a buffer holds
+     */
+    Packed,
+};
+
+enum class MicEncoding
+{
+    /**
+     * 16 bit PCM, as the microphone gives it
+     */
+    Pcm,
+    /**
+     * 4 bit IMA ADPCM (see ima_adpcm.h), encoded as the PDM blocks arrive. A quarter of the RAM and SD card space, lossy
+     */
+    ImaAdpcm,
+};
+
+enum class FileFormat
+{
+    /**
+     * One JSON document per file, readable as is
+     */
+    Json,
+    /**
+     * Binary columnar capture file (see capture_format.h), decoded with tools/capture_decoder
+     */
+    Binary,
+};
+
+struct SampleDataPoint;
+
+/**
+ * Scores a capture for the inference-gated storage, the higher the more interesting
+ */
+typedef float (*StoreScoreFunction)(const SampleDataPoint *sampleDataPoint);
+
 enum class LogLevel
 {
     None,
@@ -62,22 +123,68 @@ struct AccOptions
 {
     /**
      * @param _accNumSamples Number of samples to be collected - must be a power of 2. Default is 256
-     * @param _accSamplingFrequency Max acc sampling frequency in Hz. If left default 0 then it will get the max sampling frequency from the IMU
+     * @param _accSamplingFrequency Max acc sampling frequency in Hz. If left default 0 then it will get the max sampling frequency from the IMU. Must be left 0 or be the IMU output data rate with hasInference or hasBackgroundSave
+     * @param _envelopeBandLowHz Lower edge of the envelope analysis band-pass in Hz. Default is 0 for no envelope analysis.
+     * With the envelope analysis the saved captures have the envelope spectrum instead of the raw acc samples (Raw and Packed storage modes)
+     * @param _envelopeBandHighHz Upper edge of the envelope analysis band-pass in Hz, must be below Nyquist. Default is 0 for no envelope analysis
+     * @param _envelopeDecimation Envelope decimation factor - must be a power of 2. Default is 4
+     * @param _envelopeAxis Acc axis used for the envelope analysis. Default is Z
+     * @param _accStorageMode How the acc data of each capture is stored. Default is Raw
+     * @param _accNumPeaks Number of spectral peaks kept per axis with the Peaks storage mode. Default is 8
+     * @param _accCountsPerG IMU counts per g, i.e. the inverse of its resolution, used by the Packed storage mode. Default is 8192, the BMI270 at +-4 g
+     * @param _accPackedPoolSize Bytes of packed acc samples each sample data point buffer holds with the Packed storage mode. A buffer is handed off
+     * once its pool can't fit one more capture at worst or its sampleDataPointBufferSize captures are taken, whichever comes first. Default is 0
+     * for sampleDataPointBufferSize captures at worst, set it lower with a larger sampleDataPointBufferSize to fit as many captures as the samples pack to
      */
     AccOptions(
         int16_t _accNumSamples = 256,
-        int16_t _accSamplingFrequency = 0)
+        int16_t _accSamplingFrequency = 0,
+        float _envelopeBandLowHz = 0.0f,
+        float _envelopeBandHighHz = 0.0f,
+        int16_t _envelopeDecimation = 4,
+        AccAxis _envelopeAxis = AccAxis::Z,
+        AccStorageMode _accStorageMode = AccStorageMode::Raw,
+        int16_t _accNumPeaks = 8,
+        float _accCountsPerG = 8192.0f,
+        uint32_t _accPackedPoolSize = 0)
         : accNumSamples(_accNumSamples),
-          accSamplingFrequency(_accSamplingFrequency)
+          accSamplingFrequency(_accSamplingFrequency),
+          envelopeBandLowHz(_envelopeBandLowHz),
+          envelopeBandHighHz(_envelopeBandHighHz),
+          envelopeDecimation(_envelopeDecimation),
+          envelopeAxis(_envelopeAxis),
+          accStorageMode(_accStorageMode),
+          accNumPeaks(_accNumPeaks),
+          accCountsPerG(_accCountsPerG),
+          accPackedPoolSize(_accPackedPoolSize)
     {
 
         accSamplingLengthMs = 0; // Will be reset in the acc constructor
+
+        hasEnvelope = envelopeBandLowHz > 0.0f && envelopeBandHighHz > envelopeBandLowHz;
+        // A decimation below 1 is reported by the envelope analyzer, it mustn't divide by 0 here first
+        envelopeNumBins = hasEnvelope && envelopeDecimation > 0 ? accNumSamples / envelopeDecimation / 2 : 0;
+        hasRawAcc = accStorageMode != AccStorageMode::Peaks && !hasEnvelope;
     }
 
     int16_t accNumSamples;        // Must be a power of 2
     int16_t accSamplingFrequency; // Hz. Determines maximum frequency
 
+    // Envelope analysis (bearing faults): band-pass around a resonance, rectify, low-pass, decimate and FFT
+    float envelopeBandLowHz;
+    float envelopeBandHighHz;
+    int16_t envelopeDecimation;
+    AccAxis envelopeAxis;
+
+    AccStorageMode accStorageMode;
+    int16_t accNumPeaks; // Used with the Peaks storage mode
+    float accCountsPerG; // Used with the Packed storage mode
+    uint32_t accPackedPoolSize; // Used with the Packed storage mode, set by the sampler when left 0
+
     // Internal i.e. not set by user
+    bool hasEnvelope;        // Whether the envelope band was set
+    int16_t envelopeNumBins; // accNumSamples / envelopeDecimation / 2, each bin is accSamplingFrequency / accNumSamples Hz wide
+    bool hasRawAcc;          // Whether the raw acc samples are saved, i.e. Raw or Packed without the envelope analysis
     int accSamplingLengthMs; // Calculated in acc constructor. e.g. x = 256 samples and sampling frequency y = 100 will result in ~2560 milliseconds of sampling (x / y * 1000 = millisecs)
 };
 
@@ -85,22 +192,56 @@ struct MicOptions
 {
     /**
      * @param _micSamplingRate Audio sampling frequency in Hz. Default is 16000
+     * @param _micEncoding How the audio of each capture is held and stored. Default is Pcm
      */
     MicOptions(
         int16_t _micSamplingRate = 16000,
-        int16_t _micSamplingLengthMs = 2000)
+        int16_t _micSamplingLengthMs = 2000,
+        MicEncoding _micEncoding = MicEncoding::Pcm)
         : micSamplingRate(_micSamplingRate),
-          micSamplingLengthMs(_micSamplingLengthMs)
+          micSamplingLengthMs(_micSamplingLengthMs),
+          micEncoding(_micEncoding)
     {
     }
 
     int16_t micSamplingRate;     // Hz. Determines audio sampling frequency
     int16_t micSamplingLengthMs; // Used when Acc sampling is not set
+    MicEncoding micEncoding;
 
     // Internal i.e. not set by user
     int micNumSamples; // Calculated in the mic constructor e.g. micSamplingRate * accSamplingLengthMs / 1000
 };
 
+struct ModelOptions
+{
+    /**
+     * @param _modelFloorDb Spectrogram level in dB re 1 g mapped to the bottom of the model input range, the top being 0 dB (1 g). Default is -80
+     * @param _modelNormalClass Class of the routine captures. The store score of a capture is 1 minus its probability. Default is 0
+     * @param _modelFileName Model file (see model_file.h) loaded from the SD card at boot, falling back to the compiled-in model when it's missing or invalid. Default is nullptr to use the compiled-in model
+     */
+    ModelOptions(
+        float _modelFloorDb = -80.0f,
+        int16_t _modelNormalClass = 0,
+        const char *_modelFileName = nullptr)
+        : modelFloorDb(_modelFloorDb),
+          modelNormalClass(_modelNormalClass),
+          modelFileName(_modelFileName)
+    {
+        modelNumClasses = 0; // Will be reset in the classifier constructor
+        modelVersion = 0;
+        modelLoadUs = 0;
+    }
+
+    float modelFloorDb;       // Must be negative
+    int16_t modelNormalClass; // Must be below modelNumClasses
+    const char *modelFileName;
+
+    // Internal i.e. not set by user
+    int16_t modelNumClasses;   // Read from the model output tensor in the classifier constructor
+    uint32_t modelVersion;     // Version from the model file header, 0 for the compiled-in model
+    unsigned long modelLoadUs; // Time it took to read and check the model file
+};
+
 struct SamplerOptions
 {
     /**
@@ -111,11 +252,22 @@ struct SamplerOptions
      * @param _movementTriggers Movements that can trigger data collection. Default is Stopped, None
      * @param _sizeofMovementTriggers Size of the movementTriggers array. Default is 0 for no movement trigger or 7 (all possible movements currently) when there's one
      * @param _accThresholdTrigger Raw acc threshold values to trigger data collection. Default is 100, 100, 100 when there's an accRaw trigger or 0, 0, 0 when there's none
-     * @param _audioBufferSizeTrigger Min audio buffer size to trigger data collection. Default is 1000
+     * @param _micAttackDbfs Short-term audio level (dBFS) at or above which the Microphone trigger starts data collection. Default is -30 when there's a Microphone trigger
+     * @param _micReleaseDbfs Short-term audio level (dBFS) below which the Microphone trigger is released. Default is 6 dB below _micAttackDbfs
+     * @param _goertzelFrequencies Frequencies in Hz watched by the AccGoertzel trigger. Default is 10 Hz when there's an AccGoertzel trigger
+     * @param _goertzelThresholds Amplitude in g that each of the goertzelFrequencies must exceed to trigger data collection. Default is 0.05
+     * @param _sizeofGoertzelFrequencies Size of the goertzelFrequencies and goertzelThresholds arrays. Default is 0 for no Goertzel trigger or 1 when there's one
      * @param _intervalInMillis Interval at which allow data collection (milliseconds). Default is 5000
      * @param _sampleDataPointBufferSize Number of whole sample data points to be collected before saving to file. Default is 10
      * @param _logLevel The log level. Default is Info
      * @param _saveToSdCard Whether to save the data to the SD card. Default is true
+     * @param _storeScoreThreshold Store score at or above which a capture is stored in full, the others only as a compact record. Default is 0 to store every capture in full
+     * @param _storeScoreFunction Scores each capture for _storeScoreThreshold. Default is nullptr to use the vibration model, i.e. 1 minus the probability of modelNormalClass
+     * @param _fileFormat Format of the files saved to the SD card. Default is Json
+     * @param _logFileSize Size in bytes the capture log files are preallocated to and roll over at, rounded up to 512 byte blocks. Default is 0 to save each buffer to its own file instead
+     * @param _numSaveBuffers Number of sample data point buffers. Default is 1 to save a full buffer before capturing again, 2 or more to keep capturing while full ones are written in the background
+     * @param _audioToWav Whether the audio of each capture is streamed to its own WAV file on the SD card, the record only naming it. Default is false
+     * @param _benchmarkSdCard Whether to benchmark the SD card at boot even when it has a saved result. Default is false to benchmark only a card without one
      */
     SamplerOptions(
         bool _saveToSdCard = true,
@@ -129,10 +281,28 @@ struct SamplerOptions
         MovingTrigger *_movementTriggers = nullptr,
         unsigned short _sizeofMovementTriggers = 0,
         int16_t _accThresholdTrigger[3] = nullptr,
-        int16_t _audioBufferSizeTrigger = 0)
+        float _micAttackDbfs = 0.0f,
+        float _micReleaseDbfs = 0.0f,
+        float *_goertzelFrequencies = nullptr,
+        float *_goertzelThresholds = nullptr,
+        unsigned short _sizeofGoertzelFrequencies = 0,
+        float _storeScoreThreshold = 0.0f,
+        StoreScoreFunction _storeScoreFunction = nullptr,
+        FileFormat _fileFormat = FileFormat::Json,
+        uint32_t _logFileSize = 0,
+        int16_t _numSaveBuffers = 1,
+        bool _audioToWav = false,
+        bool _benchmarkSdCard = false)
         : saveToSdCard(_saveToSdCard),
           logLevel(_logLevel),
-          sampleDataPointBufferSize(_sampleDataPointBufferSize)
+          sampleDataPointBufferSize(_sampleDataPointBufferSize),
+          fileFormat(_fileFormat),
+          logFileSize(_logFileSize),
+          numSaveBuffers(_numSaveBuffers),
+          audioToWav(_audioToWav),
+          benchmarkSdCard(_benchmarkSdCard),
+          storeScoreThreshold(_storeScoreThreshold),
+          storeScoreFunction(_storeScoreFunction)
 
     {
         if (_triggers == nullptr)
@@ -244,20 +414,62 @@ struct SamplerOptions
             accThresholdTrigger[2] = _accThresholdTrigger[2];
         }
 
-        if (_audioBufferSizeTrigger == 0 && std::find(triggers, triggers + 1, Triggers::Microphone) != triggers + 1)
+        if (_micAttackDbfs == 0.0f)
         {
             if (logLevel >= LogLevel::Info)
-                Serial.println("Setting audioBufferSizeTrigger to 1000");
+                Serial.println("Setting micAttackDbfs to -30");
 
-            audioBufferSizeTrigger = 1000;
+            micAttackDbfs = -30.0f;
         }
         else
         {
             if (logLevel >= LogLevel::Info)
+                Serial.println("Setting micAttackDbfs to user defined");
+
+            micAttackDbfs = _micAttackDbfs;
+        }
+
+        if (_micReleaseDbfs == 0.0f || _micReleaseDbfs > micAttackDbfs)
+        {
+            if (logLevel >= LogLevel::Info)
+                Serial.println("Setting micReleaseDbfs to 6 dB below micAttackDbfs");
+
+            micReleaseDbfs = micAttackDbfs - 6.0f;
+        }
+        else
+        {
+            if (logLevel >= LogLevel::Info)
+                Serial.println("Setting micReleaseDbfs to user defined");
+
+            micReleaseDbfs = _micReleaseDbfs;
+        }
+
+        if (_goertzelFrequencies == nullptr || _goertzelThresholds == nullptr)
+        {
+            if (logLevel >= LogLevel::Info)
+                Serial.println("Setting goertzelFrequencies to default");
+
+            if (std::find(triggers, triggers + sizeofTriggers, Triggers::AccGoertzel) != triggers + sizeofTriggers)
+            {
+                goertzelFrequencies = new float[1]{10.0f};
+                goertzelThresholds = new float[1]{0.05f};
+                sizeofGoertzelFrequencies = 1;
+            }
+            else
             {
-                Serial.println("Setting audioBufferSizeTrigger to default");
+                goertzelFrequencies = nullptr;
+                goertzelThresholds = nullptr;
+                sizeofGoertzelFrequencies = 0;
             }
-            audioBufferSizeTrigger = _audioBufferSizeTrigger;
+        }
+        else
+        {
+            if (logLevel >= LogLevel::Info)
+                Serial.println("Setting goertzelFrequencies to user defined");
+
+            goertzelFrequencies = _goertzelFrequencies;
+            goertzelThresholds = _goertzelThresholds;
+            sizeofGoertzelFrequencies = _sizeofGoertzelFrequencies;
         }
     }
 
@@ -290,27 +502,88 @@ struct SamplerOptions
     unsigned short sizeofMovementTriggers;
 
     /**
-     * Min audio buffer size to trigger data collection.
-     * The first flag that will be checked is the mic hasNewData flag, then it will check this trigger with the tempAudioBuffer size.
-     *
-     * @todo Add more mic trigger conditions, such as min decibels
+     * Attack and release thresholds of the Microphone trigger, compared with the short-term audio level in dBFS.
+     * The trigger fires once the level reaches micAttackDbfs and stays on until it falls below micReleaseDbfs,
+     * so a level hovering around a single threshold doesn't toggle it on every check.
      */
-    int16_t audioBufferSizeTrigger;
+    float micAttackDbfs;
+    float micReleaseDbfs;
+
+    /**
+     * Frequencies (Hz) watched by the AccGoertzel trigger and the amplitude (g) each one must exceed on any axis.
+     * Frequency resolution is accSamplingFrequency / accNumSamples, and frequencies must be below Nyquist
+     */
+    float *goertzelFrequencies;
+    float *goertzelThresholds;
+    unsigned short sizeofGoertzelFrequencies;
 
     int16_t sampleDataPointBufferSize; // Number of whole sample data points to be collected before saving to file
     bool saveToSdCard;
     LogLevel logLevel;
+    FileFormat fileFormat;
+
+    /**
+     * Capture log mode: the buffers are appended as records to large files preallocated up front and written
+     * in whole 512 byte blocks, so a save pays no FAT allocation or directory update (see capture_format.h)
+     */
+    uint32_t logFileSize;
+
+    /**
+     * With more than one buffer, a full one is queued for the SD writer and capture goes on into a free one.
+     * The writer runs a step at a time while the capture waits for the IMU FIFO and while no trigger is met,
+     * and drops a full buffer when none is free (see SdWriter)
+     */
+    int16_t numSaveBuffers;
+
+    /**
+     * WAV audio mode: the audio is written to a file per capture while it's captured, through whole 512 byte sectors,
+     * instead of being held in the buffer. PCM or IMA ADPCM as micEncoding, and the record has the file name
+     */
+    bool audioToWav;
+
+    /**
+     * The SD card is benchmarked once and keeps its best write size (see sd_benchmark.h), this runs it again,
+     * e.g. after a firmware change to the storage path
+     */
+    bool benchmarkSdCard;
+
+    /**
+     * Inference-gated storage: only the captures scoring at least storeScoreThreshold keep their raw data,
+     * the routine ones are stored as a compact record (timestamp, score, class and axis summaries).
+     * The score comes from storeScoreFunction, or from the vibration model when it's nullptr
+     */
+    float storeScoreThreshold;
+    StoreScoreFunction storeScoreFunction;
 
     // Internal - convert triggers into boolean values for faster checking
     bool hasIntervalTrigger = false;
     bool hasAccRawTrigger = false;
     bool hasMovementTrigger = false;
     bool hasMicTrigger = false;
+    bool hasGoertzelTrigger = false;
 
     // Convert sensor data into boolean values for faster checking
     bool hasAccSensor = false;
     bool hasMicSensor = false;
     bool hasBarSensor = false;
+
+    // Whether the vibration model classifies each capture, i.e. the model options were set
+    bool hasInference = false;
+
+    // Whether the captures are scored to choose between full and compact storage, i.e. storeScoreThreshold was set
+    bool hasStoreGate = false;
+
+    // Whether the buffers are appended to the capture log instead of separate files, i.e. logFileSize was set
+    bool hasCaptureLog = false;
+
+    // Whether full buffers are written in the background, i.e. there's more than one
+    bool hasBackgroundSave = false;
+
+    // Whether the audio goes to a WAV file per capture, i.e. audioToWav was set with the microphone and the SD card
+    bool hasWavAudio = false;
+
+    // Bytes the capture log and the capture files are written to the SD card in, the card's best from its benchmark
+    uint32_t sdWriteSize = 512;
 };
 
 #endif // OPTIONS_H
@@ -4,6 +4,9 @@
 #include <Arduino.h>
 
 #include "config.h"
+#include "streaming_stats.h"
+#include "spectral_peaks.h"
+#include "capture_format.h"
 
 struct SampleDataPoint
 {
@@ -11,7 +14,16 @@ struct SampleDataPoint
         : accFrequenciesX(new double[accNumSamples]),
           accFequenciesY(new double[accNumSamples]),
           accFrequenciesZ(new double[accNumSamples]),
-          audioBuffer(nullptr)
+          accPeaksX(nullptr),
+          accPeaksY(nullptr),
+          accPeaksZ(nullptr),
+          accPackedX(nullptr),
+          accPackedY(nullptr),
+          accPackedZ(nullptr),
+          envelopeSpectrum(nullptr),
+          modelScores(nullptr),
+          audioBuffer(nullptr),
+          audioAdpcm(nullptr)
     {
         temperatureC = 0.0;
         pressureKpa = 0.0;
@@ -19,6 +31,20 @@ struct SampleDataPoint
         movingStatus = MovingStatus::Stopped;
         movingDirection = MovingDirection::None;
         movingSpeed = 0;
+        accBroadbandEnergyX = 0.0f;
+        accBroadbandEnergyY = 0.0f;
+        accBroadbandEnergyZ = 0.0f;
+        accPackedSizeX = 0;
+        accPackedSizeY = 0;
+        accPackedSizeZ = 0;
+        modelClass = -1;
+        modelScore = 0.0f;
+        storeScore = 0.0f;
+        isCompact = false;
+        audioLevelDbfs = 0.0f;
+        audioBackgroundDbfs = 0.0f;
+        audioAdpcmSize = 0;
+        audioFileName[0] = '\0';
         timestamp = 0;
 
         for (int i = 0; i < accNumSamples; ++i)
@@ -39,8 +65,49 @@ struct SampleDataPoint
     double *accFequenciesY;
     double *accFrequenciesZ;
 
-    // Audio sensor data
+    // Summary of each acc axis, computed while sampling
+    AxisSummary accSummaryX;
+    AxisSummary accSummaryY;
+    AxisSummary accSummaryZ;
+
+    // Largest spectral peaks and broadband energy of each acc axis, allocated by the sampler only with the Peaks storage mode
+    SpectralPeak *accPeaksX;
+    SpectralPeak *accPeaksY;
+    SpectralPeak *accPeaksZ;
+    float accBroadbandEnergyX;
+    float accBroadbandEnergyY;
+    float accBroadbandEnergyZ;
+
+    // Acc samples of each axis in IMU counts, delta_codec encoded. Allocated by the sampler only with the Packed storage mode,
+    // in which case the buffered sample data points have no accFrequencies and point into the packed pool of their buffer
+    uint8_t *accPackedX;
+    uint8_t *accPackedY;
+    uint8_t *accPackedZ;
+    uint32_t accPackedSizeX;
+    uint32_t accPackedSizeY;
+    uint32_t accPackedSizeZ;
+
+    // Envelope spectrum of the envelopeAxis, allocated by the sampler only when the envelope analysis is enabled
+    float *envelopeSpectrum;
+
+    // Vibration model output, modelScores (modelNumClasses probabilities) is allocated by the sampler only with inference
+    int16_t modelClass; // -1 when not classified
+    float modelScore;   // Probability of modelClass
+    float *modelScores;
+
+    // Inference-gated storage, a compact capture only keeps the timestamp, scores and axis summaries
+    float storeScore;
+    bool isCompact;
+
+    // Audio sensor data, in audioBuffer or with the ImaAdpcm encoding in audioAdpcm (audioAdpcmSize bytes of ima_adpcm stream)
     int16_t *audioBuffer;
+    uint8_t *audioAdpcm;
+    uint32_t audioAdpcmSize;
+    // With the WAV audio mode the audio is only in this file instead, its path from the card's root
+    char audioFileName[capture_format::maxPathLength + 1];
+    // Short-term and long-term (background) audio level at the end of the capture
+    float audioLevelDbfs;
+    float audioBackgroundDbfs;
 
     MovingStatus movingStatus;
     MovingDirection movingDirection;
@@ -2,13 +2,22 @@
 #define SAMPLER_H
 
 #include <Arduino.h>
-#include <ArduinoJson.h>
 
 #include "config.h"
 #include "sample.h"
 #include "accelerometer.h"
 #include "barometer.h"
 #include "microphone.h"
+#include "goertzel.h"
+#include "envelope.h"
+#include "spectral_peaks.h"
+#include "vertical_motion.h"
+#include "vibration_classifier.h"
+#include "sd_writer.h"
+#include "manifest.h"
+#include "sd_benchmark.h"
+#include "delta_codec.h"
+#include "ima_adpcm.h"
 
 class Sampler
 {
@@ -17,8 +26,10 @@ private:
     SamplerConfig *samplerConfig;
     // The sample data point
     SampleDataPoint *sampleDataPoint;
-    // The sample data point buffer
+    // The sample data point buffer being filled, one of saveBuffers
     SampleDataPoint *sampleDataPoints;
+    // The numSaveBuffers sample data point buffers, the others are queued for the SD writer or free
+    SampleDataPoint **saveBuffers;
 
     // Accelerometer instance
     Accelerometer *accelerometer;
@@ -26,6 +37,41 @@ private:
     Barometer *barometer;
     // Microphone instance
     Microphone *microphone;
+    // Goertzel bank instance, only used by the AccGoertzel trigger
+    GoertzelBank *goertzelBank;
+    // Envelope analyzer instance, only used when the envelope band is set
+    EnvelopeAnalyzer *envelopeAnalyzer;
+    // Spectral peak finder instance, only used with the Peaks storage mode
+    SpectralPeakFinder *spectralPeakFinder;
+    // An acc axis in IMU counts, only used with the Packed storage mode
+    int16_t *accCounts;
+    // The packed acc samples of each of saveBuffers, only used with the Packed storage mode
+    uint8_t **accPackedPools;
+    // The pool of sampleDataPoints and its bytes taken so far
+    uint8_t *accPackedPool;
+    uint32_t accPackedPoolUsed;
+    // Packed bytes of one capture at worst, a buffer is handed off when its pool can't fit one more
+    uint32_t accPackedCaptureCapacity;
+    // Barometer + acc fusion, only used by the Movement trigger
+    VerticalMotionFilter *verticalMotionFilter;
+    // Last time the barometer corrected the vertical motion filter
+    unsigned long lastBarometerMillis;
+    // Vibration model instance, only used with inference
+    VibrationClassifier *vibrationClassifier;
+    // Writes the full buffers to the SD card, only used when saving to it
+    SdWriter *sdWriter;
+    // Names the files on the SD card and indexes them, only used when saving to it
+    Manifest *manifest;
+    // Buffer index of the capture whose inference runs during the next capture, -1 when there's none
+    int16_t pendingModelIndex;
+
+    // Pipeline timing for the duty cycle report. Only back to back captures, i.e. the steady state, are totalled
+    unsigned long lastCaptureEndMillis;
+    unsigned long totalCaptureMillis;
+    unsigned long totalGapMillis;
+    unsigned long numSteadyCaptures;
+    unsigned long totalInferenceUs;
+    unsigned long numInferences;
 
     // Time interval for data collection
     // @deprecated once it's changed to be based on events
@@ -35,14 +81,24 @@ private:
     // Used to measure the time it takes to sample the data for frequency analysis
     unsigned long currentMicroseconds;
 
-    // Temporarily stores the sample json to be saved to file
-    JsonDocument jsonDoc;
-
     /**
      * Sample the accelerometer data as well as the audio data
      */
     void sampleFrequencies();
 
+    /**
+     * Quantize an acc axis to IMU counts and pack it
+     * @param values The accNumSamples samples of the axis in g
+     * @param packed At least delta_codec::maxEncodedSize(accNumSamples) bytes
+     * @return The packed size in bytes
+     */
+    uint32_t packAccAxis(const double *values, uint8_t *packed);
+
+    /**
+     * Make the buffer at saveBuffers[index] the one being filled
+     */
+    void useSaveBuffer(int index);
+
     /**
      * Copy the sample data point to the buffer
      * @param destinationSampleDataPoint The "new" sample data point to copy from the current sample data point
@@ -55,21 +111,71 @@ private:
      */
     void resetSampleDataPoint(SampleDataPoint *targetSampleDataPoint);
 
+    /**
+     * Score a sample data point for the inference-gated storage, with the store score function or the vibration model
+     * @param targetSampleDataPoint The sample data point to score
+     * @return The store score, 1 when the model failed so the raw data is kept
+     */
+    float computeStoreScore(const SampleDataPoint *targetSampleDataPoint);
+
+    /**
+     * Set the store score of a sample data point and whether it's only kept as a compact record
+     * @param targetSampleDataPoint The sample data point to gate
+     */
+    void applyStoreGate(SampleDataPoint *targetSampleDataPoint);
+
+    /**
+     * Work done while waiting for the next acc sample: the audio buffer, the inference of the previous capture
+     * and a step of the background SD write
+     */
+    void updatePipeline();
+
+    /**
+     * Run the pending inference and write its results (and store gate) to its buffered sample data point
+     */
+    void completePendingInference();
+
+    /**
+     * Print the steady state duty cycle of the capture pipeline
+     */
+    void printPipelineReport();
+
     /**
      * Save the samples to file when sd card is available
      */
     void saveSamplesToFile();
 
+    /**
+     * Queue the full buffer for the background SD write and continue into a free one
+     */
+    void handOffSamples();
+
     /**
      * Sample the data when the triggers are met
      */
     void sampleData();
 
+    /**
+     * Run the staged acc samples through the axis statistics and the envelope analyzer
+     */
+    void addAccBlock();
+
+    /**
+     * Feed every new acc sample and, at its own rate, the barometer to the vertical motion filter,
+     * then copy the resulting movement state to the sample data point
+     */
+    void updateVerticalMotion();
+
     /**
      * Detect vertical movement based on the barometer and acc data
      */
     bool hasNewMovement();
 
+    /**
+     * Stream one block of acc data through the Goertzel bank and check its thresholds
+     */
+    bool hasGoertzelMatch();
+
 public:
     /**
      * @param _options The sampler options
@@ -0,0 +1,67 @@
+#ifndef SD_BENCHMARK_H
+#define SD_BENCHMARK_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include "options.h"
+
+/**
+ * Sequential write benchmark of the SD card, for the write size the storage path stages its data in
+ * (SamplerOptions::sdWriteSize). Card models differ a lot in how they take small writes, so each card is
+ * benchmarked once and keeps its result in resultFileName, which later boots load instead of benchmarking again.
+ *
+ * Every write size is timed with both ways the sampler writes: appending to a new file, like the file per buffer,
+ * which allocates clusters and updates the directory as it goes, and overwriting a preallocated file, like the
+ * capture log. The 64 byte writes are the baseline: small Print writes going through the SD library's one block cache.
+ */
+namespace sd_benchmark
+{
+    constexpr const char *resultFileName = "SDTUNE.BIN";
+    constexpr const char *scratchFileName = "SDBENCH.TMP";
+    constexpr uint32_t resultMagic = 0x4E545344; // "SDTN"
+
+    // The write sizes tried, the tuned one is always whole 512 byte blocks
+    constexpr uint32_t writeSizes[] = {64, 512, 1024, 2048, 4096, 8192, 16384};
+    constexpr uint32_t minTunedWriteSize = 512;
+    constexpr uint32_t maxWriteSize = 16384;
+    // Bytes written per write size and strategy
+    constexpr uint32_t benchmarkSize = 128 * 1024;
+
+    struct Result
+    {
+        uint32_t magic;
+        uint32_t writeSize;      // The best one
+        uint32_t bytesPerSecond; // Of the slower strategy at that write size
+        uint32_t crc;            // checksum::crc32 of the result up to here
+    };
+    static_assert(sizeof(Result) == 16, "Written and read as is");
+
+    /**
+     * Latency of the writes of one run, from a histogram with power of 2 buckets, so the percentiles are upper bounds
+     */
+    struct Run
+    {
+        uint32_t writeSize;
+        bool isPreallocated;
+        uint32_t bytesPerSecond;
+        uint32_t medianUs;
+        uint32_t p99Us;
+        uint32_t maxUs;
+    };
+
+    /**
+     * Time every write size and strategy on a scratch file, print them, and save the best write size to the card:
+     * the one whose slower strategy is the fastest, the smaller one when within 5 %. The SD card must be initialized
+     * @param logLevel Info prints every run and the result
+     * @return The best write size, 0 when the card can't be written
+     */
+    uint32_t run(LogLevel logLevel);
+
+    /**
+     * @return The write size saved by run(), 0 when the card has none
+     */
+    uint32_t loadWriteSize();
+}
+
+#endif // SD_BENCHMARK_H
@@ -0,0 +1,128 @@
+#ifndef SD_WRITER_H
+#define SD_WRITER_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include "config.h"
+#include "sample.h"
+#include "binary_writer.h"
+#include "json_capture_writer.h"
+#include "capture_log.h"
+#include "manifest.h"
+#include "buffered_file.h"
+
+/**
+ * Saves full sample data point buffers to the SD card, as a file each or as capture log records,
+ * in the configured file format, and indexes each one in the capture manifest. Buffers are queued and written a step at a time
+ * (open, the next SamplerOptions::sdWriteSize bytes of a capture, close), the writers resuming where the previous step stopped,
+ * so every step costs about one card write and the sampler can interleave the writing with capture and keep sampling into another buffer.
+ *
+ * When a buffer fills while every other one is still queued, the storage is behind: the full buffer is dropped,
+ * as capture never waits for the card. The counters tell how often the queue was still busy at a hand-off
+ * (backpressure) and how much was dropped.
+ */
+class SdWriter
+{
+private:
+    enum class Stage
+    {
+        Open,
+        Captures,
+        Close,
+    };
+
+    SamplerConfig *samplerConfig;
+
+    BinaryWriter *binaryWriter;
+    JsonCaptureWriter *jsonCaptureWriter;
+    CaptureLog *captureLog;
+    Manifest *manifest;
+
+    File file;
+    // Between the writers and the file, when it's a file per buffer
+    BufferedFile *bufferedFile;
+    bool isOutputOpen;
+
+    // Manifest entry of the open file or log record
+    char path[capture_format::maxPathLength + 1];
+    uint32_t fileSequence;
+    uint32_t payloadOffset;
+    uint32_t *captureOffsets;
+
+    // Ring of the full buffers, the head one is being written
+    SampleDataPoint **queue;
+    int16_t queueCapacity;
+    int16_t queueHead;
+    int16_t queueLength;
+
+    Stage stage;
+    int16_t captureIndex;
+    // Whether the previous steps already wrote part of the capture at captureIndex
+    bool isCaptureStarted;
+    unsigned long bufferStartMillis;
+
+    unsigned long numWrittenBuffers;
+    unsigned long numFailedBuffers;
+    unsigned long numDroppedBuffers;
+    unsigned long numBackpressureEvents;
+    int16_t maxQueueLength;
+    unsigned long maxStepUs;
+    unsigned long maxBufferMillis;
+
+    /**
+     * Open the file or the log record, then start the document
+     */
+    bool openOutput();
+
+    /**
+     * Write the next sdWriteSize bytes of the capture at captureIndex, the writers continue where the previous step stopped
+     * @return Whether the capture is now written completely
+     */
+    bool writeCaptureStep(const SampleDataPoint &capture);
+
+    /**
+     * End the document, then close the file or commit the log record, and index it
+     * @return Whether everything was written
+     */
+    bool closeOutput();
+
+public:
+    /**
+     * Must be created once the sensors are initialized, as the binary schema depends on their rates and sizes.
+     * The SD card must be initialized
+     * @param _samplerConfig The sampler config
+     * @param _manifest Names and indexes the files
+     */
+    SdWriter(SamplerConfig *_samplerConfig, Manifest *_manifest);
+
+    /**
+     * Queue a full buffer. It mustn't be touched until isQueued() is false again
+     * @return false when the queue is full and the buffer was dropped
+     */
+    bool enqueue(SampleDataPoint *buffer);
+
+    /**
+     * Whether a buffer is still waiting or being written
+     */
+    bool isQueued(const SampleDataPoint *buffer) const;
+
+    bool isIdle() const { return queueLength == 0; }
+
+    /**
+     * Run one step of the write: open, write up to sdWriteSize bytes of a capture or close. Nothing when the queue is empty
+     */
+    void update();
+
+    /**
+     * Write everything queued, blocking
+     */
+    void flush();
+
+    /**
+     * Print the queue and drop counters
+     */
+    void printStats();
+};
+
+#endif // SD_WRITER_H
@@ -0,0 +1,41 @@
+#ifndef SPECTRAL_PEAKS_H
+#define SPECTRAL_PEAKS_H
+
+#include "config.h"
+
+struct SpectralPeak
+{
+    float frequencyHz = 0.0f;
+    float magnitude = 0.0f; // Single sided amplitude in g
+    float bin = 0.0f;       // Interpolated (sub-bin) position, frequencyHz = bin * accSamplingFrequency / accNumSamples
+};
+
+/**
+ * Reduces one axis of a capture to its accNumPeaks largest spectral peaks plus its broadband energy.
+ * Peak positions are refined with a parabolic fit over the 3 bins around each local maximum.
+ */
+class SpectralPeakFinder
+{
+private:
+    SamplerConfig *samplerConfig;
+
+    // FFT scratch, accNumSamples each
+    float *real;
+    float *imag;
+
+public:
+    /**
+     * Must be created after the accelerometer so accSamplingFrequency is known
+     * @param _samplerConfig The sampler config
+     */
+    SpectralPeakFinder(SamplerConfig *_samplerConfig);
+
+    /**
+     * @param samples accNumSamples raw samples of one axis
+     * @param peaks Destination with accNumPeaks entries, sorted by decreasing magnitude. Unused entries are zeroed
+     * @return The broadband energy, i.e. the sum of the squared amplitudes of every bin except DC
+     */
+    float findPeaks(const double *samples, SpectralPeak *peaks);
+};
+
+#endif // SPECTRAL_PEAKS_H
@@ -0,0 +1,50 @@
+#ifndef STREAMING_STATS_H
+#define STREAMING_STATS_H
+
+#include <stddef.h>
+
+/**
+ * Compact summary of one axis of a capture
+ */
+struct AxisSummary
+{
+    float mean = 0.0f;
+    float rms = 0.0f;
+    float peak = 0.0f;       // Max absolute value
+    float peakToPeak = 0.0f; // Max - min
+    float crestFactor = 0.0f; // Peak / RMS
+    float skewness = 0.0f;
+    float kurtosis = 0.0f; // Not the excess kurtosis, i.e. a normal distribution gives 3
+};
+
+/**
+ * Single pass accumulator for the AxisSummary statistics, fed a block at a time.
+ * The dsp kernels take the moments of each block around its own mean, which are then merged into the running ones
+ * (Chan/Pebay), so it's numerically stable and the per sample work is the kernels' loops inside the acquisition.
+ */
+class StreamingStats
+{
+private:
+    unsigned long count = 0;
+    float mean = 0.0f;
+    float m2 = 0.0f;
+    float m3 = 0.0f;
+    float m4 = 0.0f;
+    float sumSquares = 0.0f;
+    float minValue = 0.0f;
+    float maxValue = 0.0f;
+
+public:
+    void reset();
+
+    void add(const float *values, size_t length);
+
+    unsigned long getCount() { return count; }
+
+    /**
+     * Build the summary from the samples added since the last reset
+     */
+    AxisSummary getSummary();
+};
+
+#endif // STREAMING_STATS_H
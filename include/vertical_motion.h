@@ -0,0 +1,72 @@
+#ifndef VERTICAL_MOTION_H
+#define VERTICAL_MOTION_H
+
+#include "options.h"
+
+/**
+ * Fixed cost Kalman filter fusing the barometer altitude with the gravity compensated vertical acceleration.
+ * State is [altitude, vertical speed, acc bias]: the acc drives the prediction at the IMU rate,
+ * and each barometer sample corrects the drift, so the speed reacts within a few acc samples
+ * instead of waiting for metre sized altitude steps.
+ */
+class VerticalMotionFilter
+{
+private:
+    bool hasAltitude = false;
+    bool hasGravity = false;
+
+    // State
+    float altitude = 0.0f;
+    float speed = 0.0f;
+    float accBias = 0.0f;
+    // Low-passed vertical acceleration with the bias removed, for the movement status
+    float acceleration = 0.0f;
+
+    // Symmetric covariance, upper triangle only
+    float p00 = 0.0f, p01 = 0.0f, p02 = 0.0f;
+    float p11 = 0.0f, p12 = 0.0f;
+    float p22 = 0.0f;
+
+    // Low-passed acc vector (in g), i.e. the gravity direction and magnitude
+    float gravity[3] = {0.0f, 0.0f, 0.0f};
+
+    MovingStatus movingStatus = MovingStatus::Stopped;
+    MovingDirection movingDirection = MovingDirection::None;
+
+    /**
+     * Derive the movement status and direction from the speed and acceleration estimates
+     */
+    void updateMovingState();
+
+public:
+    /**
+     * Prediction step, to be called for every acc sample
+     * @param ax, ay, az Raw acceleration in g
+     * @param dt Time since the previous acc sample in seconds
+     */
+    void addAcceleration(float ax, float ay, float az, float dt);
+
+    /**
+     * Correction step, to be called for every barometer sample
+     * @param altitudeMeters The barometer altitude
+     */
+    void addAltitude(float altitudeMeters);
+
+    float getAltitude() { return altitude; }
+
+    /**
+     * @return Vertical speed in m/s, positive is up
+     */
+    float getSpeed() { return speed; }
+
+    /**
+     * @return Vertical acceleration in m/s^2, positive is up
+     */
+    float getAcceleration() { return acceleration; }
+
+    MovingStatus getMovingStatus() { return movingStatus; }
+
+    MovingDirection getMovingDirection() { return movingDirection; }
+};
+
+#endif // VERTICAL_MOTION_H
@@ -0,0 +1,102 @@
+#ifndef VIBRATION_CLASSIFIER_H
+#define VIBRATION_CLASSIFIER_H
+
+#include "config.h"
+
+namespace tflite
+{
+    class MicroInterpreter;
+}
+struct TfLiteTensor;
+
+/**
+ * Runs the bundled vibration model (g_vibration_model_data) on an acc capture with TensorFlow Lite Micro.
+ * The tensor arena is statically sized and the op resolver only registers the operators the model uses.
+ *
+ * Preprocessing and inference are split so the sampler can pipeline them: prepare() turns a capture into
+ * model input right after it's taken, and runPending() invokes the model later, while the next capture
+ * is being acquired. The inputs are double buffered, so a capture can be prepared while the previous one
+ * is still waiting for its inference.
+ */
+class VibrationClassifier
+{
+private:
+    static constexpr int numInputBuffers = 2;
+
+    SamplerConfig *samplerConfig;
+
+    // Aligned copy of the model file, only allocated when the model comes from the SD card
+    uint8_t *modelRegion;
+
+    tflite::MicroInterpreter *interpreter;
+    TfLiteTensor *input;
+    TfLiteTensor *output;
+
+    // Spectrogram FFT scratch, vibration_features::scratchSize floats
+    float *scratch;
+
+    // Prepared model inputs waiting for runPending(), in capture order from inputBuffers[nextPending]
+    int8_t *inputBuffers[numInputBuffers];
+    int nextPending;
+    int numPending;
+
+    unsigned long lastPreprocessingUs;
+    unsigned long lastInferenceUs;
+
+    /**
+     * Read the model file into modelRegion and check its header and CRC
+     * @param fileName Model file on the SD card
+     * @return The model, aligned for TensorFlow Lite Micro, or nullptr when the file is missing or invalid
+     */
+    const unsigned char *loadModelFile(const char *fileName);
+
+    /**
+     * Create the interpreter of a model and allocate its tensors
+     * @param modelData The .tflite flatbuffer
+     * @return Whether the model is supported and its input matches the preprocessing
+     */
+    bool initInterpreter(const unsigned char *modelData);
+
+public:
+    /**
+     * Loads the model, from modelFileName on the SD card when set or else the compiled-in one, and allocates its tensors.
+     * Stops if no model fits the arena with the expected input, and sets modelNumClasses in the model options from the output tensor
+     * @param _samplerConfig The sampler config
+     */
+    VibrationClassifier(SamplerConfig *_samplerConfig);
+
+    /**
+     * Compute the model input of a capture into a free input buffer. When both are taken, the oldest is dropped
+     * @param x, y, z accNumSamples raw samples of each acc axis, in g. They can be reused as soon as this returns
+     */
+    void prepare(const double *x, const double *y, const double *z);
+
+    /**
+     * Whether a prepared capture is waiting for runPending()
+     */
+    bool hasPending();
+
+    /**
+     * Invoke the model on the oldest prepared capture
+     * @param scores Destination with modelNumClasses entries, the output probabilities
+     * @return The index of the most likely class, or -1 when nothing was pending or the inference failed
+     */
+    int16_t runPending(float *scores);
+
+    /**
+     * prepare() and runPending() in one go
+     */
+    int16_t classify(const double *x, const double *y, const double *z, float *scores);
+
+    /**
+     * Duration of the last prepare() call in microseconds
+     */
+    unsigned long getLastPreprocessingUs();
+
+    /**
+     * Duration of the last runPending() call in microseconds, i.e. the model alone
+     */
+    unsigned long getLastInferenceUs();
+};
+
+#endif // VIBRATION_CLASSIFIER_H
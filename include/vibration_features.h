@@ -0,0 +1,35 @@
+#ifndef VIBRATION_FEATURES_H
+#define VIBRATION_FEATURES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Preprocessing of an acc capture into the vibration model input.
+ * Each axis becomes a log-magnitude spectrogram of numFrames frames by numBins bins, laid out as
+ * [frame][bin][axis] (NHWC, the model's 32 x 32 x 3 input) and quantized with the input tensor parameters.
+ * It has no Arduino dependency so the host tools run the exact same preprocessing as the firmware.
+ */
+namespace vibration_features
+{
+    constexpr int numFrames = 32;
+    constexpr int numBins = 32;
+    constexpr int numChannels = 3;
+    constexpr int frameLength = 2 * numBins;
+    constexpr int inputSize = numFrames * numBins * numChannels;
+    // Floats needed by the scratch argument of computeInput()
+    constexpr int scratchSize = 2 * frameLength;
+
+    /**
+     * @param x, y, z numSamples raw samples of each acc axis, in g
+     * @param numSamples Capture length. Frames are spread evenly across it, and shorter captures are zero padded
+     * @param floorDb Level in dB re 1 g mapped to the bottom of the input range, the top is 0 dB (1 g amplitude)
+     * @param inputScale, inputZeroPoint Quantization of the int8 input tensor. The unquantized input goes from 0 to 255
+     * @param input Destination with inputSize entries
+     * @param scratch scratchSize floats
+     */
+    void computeInput(const double *x, const double *y, const double *z, int numSamples, float floorDb,
+                      float inputScale, int32_t inputZeroPoint, int8_t *input, float *scratch);
+}
+
+#endif // VIBRATION_FEATURES_H
@@ -0,0 +1,82 @@
+#ifndef WAV_WRITER_H
+#define WAV_WRITER_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include "config.h"
+#include "ima_adpcm.h"
+
+/**
+ * Streams the audio of one capture to a standard WAV file on the SD card as the PDM delivers it
+ * (SamplerOptions::audioToWav), 16 bit PCM or IMA ADPCM (format 0x11) as MicOptions::micEncoding.
+ * The samples are staged in a 512 byte sector that starts with the header, so every write but the last one
+ * is a whole sector at a sector aligned offset, which the SD library sends straight to the card.
+ * The first sector is kept and written again by end() with the final sizes in its header.
+ */
+class WavWriter
+{
+private:
+    static constexpr size_t sectorSize = 512;
+
+    SamplerConfig *samplerConfig;
+
+    File file;
+    bool isAdpcm;
+    bool hasWriteError;
+
+    // The first sector, with the header in front, then the one being filled past it
+    uint8_t *firstSector;
+    uint8_t *sector;
+    uint8_t *currentSector;
+    size_t currentLength;
+
+    uint32_t numSamples;
+    uint32_t dataSize;
+
+    // ImaAdpcm only: the block being encoded, appended once it's whole
+    ima_adpcm::Encoder adpcmEncoder;
+    uint8_t *adpcmBlock;
+    int blockSamples;
+
+    size_t getHeaderSize() const;
+
+    void writeHeader();
+
+    /**
+     * Append to the data chunk, writing every sector that fills
+     */
+    void append(const uint8_t *data, size_t size);
+
+    /**
+     * Encode samples that don't go past the current ADPCM block
+     */
+    void addToBlock(const int16_t *samples, int count);
+
+public:
+    /**
+     * @param _samplerConfig The sampler config, with the mic sampling rate settled
+     */
+    WavWriter(SamplerConfig *_samplerConfig);
+
+    /**
+     * Create the file, replacing one with the same name, and close the previous one if end() wasn't called.
+     * The SD card must be initialized
+     * @param fileName 8.3 name of the file
+     * @return false when it can't be created
+     */
+    bool begin(const char *fileName);
+
+    /**
+     * Append the next samples of the capture
+     */
+    void add(const int16_t *samples, int count);
+
+    /**
+     * Write the rest and the final header, then close the file
+     * @return Whether the whole file was written
+     */
+    bool end();
+};
+
+#endif // WAV_WRITER_H
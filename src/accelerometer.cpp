@@ -7,7 +7,11 @@ Accelerometer::Accelerometer(SamplerConfig *_samplerConfig)
     : samplerConfig(_samplerConfig),
       vRealX(new double[_samplerConfig->accOptions->accNumSamples]),
       vRealY(new double[_samplerConfig->accOptions->accNumSamples]),
-      vRealZ(new double[_samplerConfig->accOptions->accNumSamples])
+      vRealZ(new double[_samplerConfig->accOptions->accNumSamples]),
+      frames(new float[3 * dsp::blockSize]),
+      blockX(new float[dsp::blockSize]),
+      blockY(new float[dsp::blockSize]),
+      blockZ(new float[dsp::blockSize])
 {
     if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
     {
@@ -17,6 +21,7 @@ Accelerometer::Accelerometer(SamplerConfig *_samplerConfig)
     accX = 0.0;
     accY = 0.0;
     accZ = 0.0;
+    numFrames = 0;
 
     // Start IMU
     if (!IMU.begin())
@@ -27,9 +32,18 @@ Accelerometer::Accelerometer(SamplerConfig *_samplerConfig)
     }
     IMU.setContinuousMode();
 
+    outputDataRate = IMU.accelerationSampleRate();
+    if (outputDataRate <= 0.0f)
+    {
+        Serial.println("IMU output data rate is 0");
+        while (1)
+            ;
+    }
+    outputPeriodUs = round(1000000 / outputDataRate);
+
     if (samplerConfig->accOptions->accSamplingFrequency == 0)
     {
-        samplerConfig->accOptions->accSamplingFrequency = IMU.accelerationSampleRate();
+        samplerConfig->accOptions->accSamplingFrequency = outputDataRate;
     }
     if (samplerConfig->accOptions->accSamplingFrequency == 0)
     {
@@ -37,6 +51,15 @@ Accelerometer::Accelerometer(SamplerConfig *_samplerConfig)
         while (1)
             ;
     }
+    // The pipelined captures are paced by the FIFO, so they can only sample at the output data rate
+    const bool isPipelined = samplerConfig->samplerOptions->hasInference || samplerConfig->samplerOptions->hasBackgroundSave;
+    if (isPipelined && samplerConfig->accOptions->accSamplingFrequency != lround(outputDataRate))
+    {
+        Serial.print("accSamplingFrequency must be the IMU output data rate with the inference or the background save: ");
+        Serial.println(outputDataRate);
+        while (1)
+            ;
+    }
     samplerConfig->accOptions->accSamplingLengthMs = round(static_cast<double>(samplerConfig->accOptions->accNumSamples) / samplerConfig->accOptions->accSamplingFrequency * 1000);
     if (samplerConfig->accOptions->accSamplingLengthMs == 0)
     {
@@ -72,3 +95,30 @@ void Accelerometer::sampleAccelerometer(bool logData)
         accZ = 0.0;
     }
 }
+
+bool Accelerometer::readAvailableAcceleration()
+{
+    if (!IMU.accelerationAvailable())
+    {
+        return false;
+    }
+
+    return IMU.readAcceleration(accX, accY, accZ);
+}
+
+bool Accelerometer::stageSample()
+{
+    float *frame = &frames[3 * numFrames++];
+    frame[0] = accX;
+    frame[1] = accY;
+    frame[2] = accZ;
+    return numFrames == static_cast<int>(dsp::blockSize);
+}
+
+int Accelerometer::takeBlock()
+{
+    const int length = numFrames;
+    dsp::deinterleave3(frames, blockX, blockY, blockZ, length);
+    numFrames = 0;
+    return length;
+}
@@ -0,0 +1,360 @@
+#include <Arduino.h>
+
+#include "binary_writer.h"
+
+using capture_format::ColumnType;
+
+// The summaries and peaks are written straight from memory
+static_assert(sizeof(AxisSummary) == 7 * sizeof(float), "AxisSummary must be 7 packed floats");
+static_assert(sizeof(SpectralPeak) == 3 * sizeof(float), "SpectralPeak must be 3 packed floats");
+
+BinaryWriter::BinaryWriter(SamplerConfig *_samplerConfig)
+    : samplerConfig(_samplerConfig),
+      columns(new capture_format::ColumnDescriptor[maxColumns]),
+      conversionBuffer(new float[conversionBufferSize]),
+      output(nullptr)
+{
+    isComplete = false;
+    size = 0;
+    captureSection = CaptureSection::Head;
+    captureOffset = 0;
+    numColumns = 0;
+    fullCaptureSize = 0;
+    compactCaptureSize = 0;
+
+    // Scalars and summaries, kept by compact captures too. Must match the order of writeHead() and writeSection()
+    addColumn("temperatureC", ColumnType::Float32, 1, 1.0f, true);
+    addColumn("pressureKpa", ColumnType::Float32, 1, 1.0f, true);
+    addColumn("altitudeM", ColumnType::Float32, 1, 1.0f, true);
+    addColumn("movingStatus", ColumnType::UInt8, 1, 1.0f, true);
+    addColumn("movingDirection", ColumnType::UInt8, 1, 1.0f, true);
+    addColumn("movingSpeed", ColumnType::Float32, 1, 1.0f, true);
+    // mean, rms, peak, peakToPeak, crestFactor, skewness, kurtosis
+    addColumn("summaryX", ColumnType::Float32, 7, 1.0f, true);
+    addColumn("summaryY", ColumnType::Float32, 7, 1.0f, true);
+    addColumn("summaryZ", ColumnType::Float32, 7, 1.0f, true);
+    addColumn("audioLevelDbfs", ColumnType::Float32, 1, 1.0f, true);
+    addColumn("audioBackgroundDbfs", ColumnType::Float32, 1, 1.0f, true);
+    if (samplerConfig->samplerOptions->hasInference)
+    {
+        addColumn("modelClass", ColumnType::Int16, 1, 1.0f, true);
+        addColumn("modelScore", ColumnType::Float32, 1, 1.0f, true);
+    }
+    if (samplerConfig->samplerOptions->hasStoreGate)
+    {
+        addColumn("storeScore", ColumnType::Float32, 1, 1.0f, true);
+    }
+    if (samplerConfig->samplerOptions->hasWavAudio)
+    {
+        // The WAV file is written whatever the store score, so compact captures name it too
+        addColumn("audioFile", ColumnType::Text, sizeof(SampleDataPoint::audioFileName), 1.0f, true);
+    }
+
+    // Raw data, full captures only
+    if (samplerConfig->accOptions->accStorageMode == AccStorageMode::Peaks)
+    {
+        addColumn("broadbandEnergy", ColumnType::Float32, 3, 1.0f, false);
+        // frequencyHz, magnitude, bin triplets
+        addColumn("peaksX", ColumnType::Float32, 3 * samplerConfig->accOptions->accNumPeaks, 1.0f, false);
+        addColumn("peaksY", ColumnType::Float32, 3 * samplerConfig->accOptions->accNumPeaks, 1.0f, false);
+        addColumn("peaksZ", ColumnType::Float32, 3 * samplerConfig->accOptions->accNumPeaks, 1.0f, false);
+    }
+    else if (samplerConfig->accOptions->hasRawAcc && samplerConfig->accOptions->accStorageMode == AccStorageMode::Packed)
+    {
+        const float gPerCount = 1.0f / samplerConfig->accOptions->accCountsPerG;
+        addColumn("accX", ColumnType::PackedInt16, samplerConfig->accOptions->accNumSamples, gPerCount, false);
+        addColumn("accY", ColumnType::PackedInt16, samplerConfig->accOptions->accNumSamples, gPerCount, false);
+        addColumn("accZ", ColumnType::PackedInt16, samplerConfig->accOptions->accNumSamples, gPerCount, false);
+    }
+    else if (samplerConfig->accOptions->hasRawAcc)
+    {
+        // The IMU gives floats, so float32 loses nothing
+        addColumn("accX", ColumnType::Float32, samplerConfig->accOptions->accNumSamples, 1.0f, false);
+        addColumn("accY", ColumnType::Float32, samplerConfig->accOptions->accNumSamples, 1.0f, false);
+        addColumn("accZ", ColumnType::Float32, samplerConfig->accOptions->accNumSamples, 1.0f, false);
+    }
+    if (samplerConfig->accOptions->hasEnvelope)
+    {
+        addColumn("envelopeSpectrum", ColumnType::Float32, samplerConfig->accOptions->envelopeNumBins, 1.0f, false);
+    }
+    if (samplerConfig->samplerOptions->hasInference)
+    {
+        addColumn("modelScores", ColumnType::Float32, samplerConfig->modelOptions->modelNumClasses, 1.0f, false);
+    }
+    if (samplerConfig->samplerOptions->hasMicSensor && !samplerConfig->samplerOptions->hasWavAudio)
+    {
+        const ColumnType audioType = samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm ? ColumnType::ImaAdpcm : ColumnType::Int16;
+        addColumn("audio", audioType, samplerConfig->micOptions->micNumSamples, 1.0f / 32768, false);
+    }
+}
+
+void BinaryWriter::addColumn(const char *name, ColumnType type, uint32_t count, float scale, bool isInCompact)
+{
+    capture_format::ColumnDescriptor &column = columns[numColumns++];
+    memset(&column, 0, sizeof(column));
+    strncpy(column.name, name, capture_format::maxNameLength);
+    column.type = type;
+    column.flags = isInCompact ? capture_format::isInCompact : 0;
+    column.count = count;
+    column.scale = scale;
+
+    // Only the byte size of a packed column is known up front, its stream is added per capture
+    const uint32_t size = capture_format::isPacked(type) ? sizeof(uint32_t) : count * capture_format::typeSize(type);
+    fullCaptureSize += size;
+    if (isInCompact)
+        compactCaptureSize += size;
+}
+
+void BinaryWriter::put(const void *data, size_t length)
+{
+    if (output->write(static_cast<const uint8_t *>(data), length) != length)
+    {
+        isComplete = false;
+    }
+    size += length;
+}
+
+bool BinaryWriter::putBytes(const void *data, uint32_t length, uint32_t stepEnd, uint32_t start)
+{
+    const uint32_t offset = captureOffset - start;
+    const uint32_t count = min(length - offset, stepEnd > size ? stepEnd - size : 0);
+    if (count > 0)
+    {
+        put(static_cast<const uint8_t *>(data) + offset, count);
+        captureOffset += count;
+    }
+    if (offset + count < length)
+    {
+        return false;
+    }
+    captureOffset = 0;
+    return true;
+}
+
+bool BinaryWriter::putZeros(uint32_t length, uint32_t stepEnd)
+{
+    memset(conversionBuffer, 0, conversionBufferSize * sizeof(float));
+    while (captureOffset < length)
+    {
+        if (size >= stepEnd)
+        {
+            return false;
+        }
+        const uint32_t count = min(min(length - captureOffset, static_cast<uint32_t>(conversionBufferSize * sizeof(float))), stepEnd - size);
+        put(conversionBuffer, count);
+        captureOffset += count;
+    }
+    captureOffset = 0;
+    return true;
+}
+
+bool BinaryWriter::putFloats(const double *values, int count, uint32_t stepEnd)
+{
+    // captureOffset counts bytes of float32, a step always ends on a whole value
+    for (int start = captureOffset / sizeof(float); start < count; start = captureOffset / sizeof(float))
+    {
+        if (size >= stepEnd)
+        {
+            return false;
+        }
+        const int stepValues = (stepEnd - size + sizeof(float) - 1) / sizeof(float);
+        const int length = min(min(count - start, conversionBufferSize), stepValues);
+        for (int i = 0; i < length; i++)
+        {
+            conversionBuffer[i] = values[start + i];
+        }
+        put(conversionBuffer, length * sizeof(float));
+        captureOffset += length * sizeof(float);
+    }
+    captureOffset = 0;
+    return true;
+}
+
+bool BinaryWriter::putPacked(const uint8_t *packed, uint32_t packedSize, uint32_t stepEnd)
+{
+    // The byte size isn't split, captureOffset then counts it in front of the stream
+    if (captureOffset == 0)
+    {
+        put(&packedSize, sizeof(packedSize));
+        captureOffset = sizeof(packedSize);
+    }
+    return putBytes(packed, packedSize, stepEnd, sizeof(packedSize));
+}
+
+void BinaryWriter::writeHead(const SampleDataPoint &sample)
+{
+    capture_format::CaptureHeader captureHeader;
+    memset(&captureHeader, 0, sizeof(captureHeader));
+    captureHeader.magic = capture_format::captureMagic;
+    captureHeader.size = sample.isCompact ? compactCaptureSize : fullCaptureSize;
+    if (!sample.isCompact && samplerConfig->accOptions->hasRawAcc && samplerConfig->accOptions->accStorageMode == AccStorageMode::Packed)
+    {
+        captureHeader.size += sample.accPackedSizeX + sample.accPackedSizeY + sample.accPackedSizeZ;
+    }
+    if (!sample.isCompact && samplerConfig->samplerOptions->hasMicSensor && !samplerConfig->samplerOptions->hasWavAudio && samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm)
+    {
+        captureHeader.size += sample.audioAdpcmSize;
+    }
+    captureHeader.timestamp = sample.timestamp;
+    captureHeader.flags = sample.isCompact ? capture_format::isCompactCapture : 0;
+    put(&captureHeader, sizeof(captureHeader));
+
+    const float temperatureC = sample.temperatureC;
+    const float pressureKpa = sample.pressureKpa;
+    const float altitudeMeters = sample.altitudeMeters;
+    const uint8_t movingStatus = static_cast<uint8_t>(sample.movingStatus);
+    const uint8_t movingDirection = static_cast<uint8_t>(sample.movingDirection);
+    put(&temperatureC, sizeof(float));
+    put(&pressureKpa, sizeof(float));
+    put(&altitudeMeters, sizeof(float));
+    put(&movingStatus, 1);
+    put(&movingDirection, 1);
+    put(&sample.movingSpeed, sizeof(float));
+    put(&sample.accSummaryX, sizeof(AxisSummary));
+    put(&sample.accSummaryY, sizeof(AxisSummary));
+    put(&sample.accSummaryZ, sizeof(AxisSummary));
+    put(&sample.audioLevelDbfs, sizeof(float));
+    put(&sample.audioBackgroundDbfs, sizeof(float));
+    if (samplerConfig->samplerOptions->hasInference)
+    {
+        put(&sample.modelClass, sizeof(int16_t));
+        put(&sample.modelScore, sizeof(float));
+    }
+    if (samplerConfig->samplerOptions->hasStoreGate)
+    {
+        put(&sample.storeScore, sizeof(float));
+    }
+    if (samplerConfig->samplerOptions->hasWavAudio)
+    {
+        // NUL padded, rather than whatever follows the name in the array
+        char audioFileName[sizeof(sample.audioFileName)];
+        strncpy(audioFileName, sample.audioFileName, sizeof(audioFileName));
+        put(audioFileName, sizeof(audioFileName));
+    }
+}
+
+bool BinaryWriter::writeSection(const SampleDataPoint &sample, uint32_t stepEnd)
+{
+    if (captureSection == CaptureSection::Head)
+    {
+        writeHead(sample);
+        return true;
+    }
+    if (sample.isCompact)
+    {
+        return true;
+    }
+
+    switch (captureSection)
+    {
+    case CaptureSection::AccX:
+    case CaptureSection::AccY:
+    case CaptureSection::AccZ:
+    {
+        const int axis = static_cast<int>(captureSection) - static_cast<int>(CaptureSection::AccX);
+        if (samplerConfig->accOptions->accStorageMode == AccStorageMode::Peaks)
+        {
+            if (axis == 0)
+            {
+                const float broadbandEnergy[3] = {sample.accBroadbandEnergyX, sample.accBroadbandEnergyY, sample.accBroadbandEnergyZ};
+                put(broadbandEnergy, sizeof(broadbandEnergy));
+            }
+            const SpectralPeak *peaks[3] = {sample.accPeaksX, sample.accPeaksY, sample.accPeaksZ};
+            put(peaks[axis], samplerConfig->accOptions->accNumPeaks * sizeof(SpectralPeak));
+            return true;
+        }
+        if (samplerConfig->accOptions->hasRawAcc && samplerConfig->accOptions->accStorageMode == AccStorageMode::Packed)
+        {
+            const uint8_t *packed[3] = {sample.accPackedX, sample.accPackedY, sample.accPackedZ};
+            const uint32_t packedSizes[3] = {sample.accPackedSizeX, sample.accPackedSizeY, sample.accPackedSizeZ};
+            return putPacked(packed[axis], packedSizes[axis], stepEnd);
+        }
+        if (samplerConfig->accOptions->hasRawAcc)
+        {
+            const double *frequencies[3] = {sample.accFrequenciesX, sample.accFequenciesY, sample.accFrequenciesZ};
+            return putFloats(frequencies[axis], samplerConfig->accOptions->accNumSamples, stepEnd);
+        }
+        return true;
+    }
+    case CaptureSection::Envelope:
+        if (!samplerConfig->accOptions->hasEnvelope)
+        {
+            return true;
+        }
+        return putBytes(sample.envelopeSpectrum, samplerConfig->accOptions->envelopeNumBins * sizeof(float), stepEnd);
+    case CaptureSection::ModelScores:
+        if (!samplerConfig->samplerOptions->hasInference)
+        {
+            return true;
+        }
+        return putBytes(sample.modelScores, samplerConfig->modelOptions->modelNumClasses * sizeof(float), stepEnd);
+    case CaptureSection::Audio:
+        // With the WAV audio mode only the file name, in the head
+        if (!samplerConfig->samplerOptions->hasMicSensor || samplerConfig->samplerOptions->hasWavAudio)
+        {
+            return true;
+        }
+        if (samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm)
+        {
+            return putPacked(sample.audioAdpcm, sample.audioAdpcmSize, stepEnd);
+        }
+        if (sample.audioBuffer == nullptr)
+        {
+            // Keep the block size right, the audio just reads as silence
+            return putZeros(samplerConfig->micOptions->micNumSamples * sizeof(int16_t), stepEnd);
+        }
+        return putBytes(sample.audioBuffer, samplerConfig->micOptions->micNumSamples * sizeof(int16_t), stepEnd);
+    default:
+        return true;
+    }
+}
+
+void BinaryWriter::begin(Print &_output)
+{
+    output = &_output;
+
+    capture_format::FileHeader fileHeader;
+    fileHeader.magic = capture_format::fileMagic;
+    fileHeader.formatVersion = capture_format::formatVersion;
+    fileHeader.numColumns = numColumns;
+    fileHeader.accSamplingFrequency = samplerConfig->accOptions->accSamplingFrequency;
+    fileHeader.micSamplingRate = samplerConfig->samplerOptions->hasMicSensor ? samplerConfig->micOptions->micSamplingRate : 0.0f;
+    fileHeader.envelopeBinHz = samplerConfig->accOptions->hasEnvelope ? static_cast<float>(samplerConfig->accOptions->accSamplingFrequency) / samplerConfig->accOptions->accNumSamples : 0.0f;
+    fileHeader.reserved = 0;
+
+    isComplete = output->write(reinterpret_cast<const uint8_t *>(&fileHeader), sizeof(fileHeader)) == sizeof(fileHeader);
+    const size_t schemaSize = numColumns * sizeof(capture_format::ColumnDescriptor);
+    isComplete = isComplete && output->write(reinterpret_cast<const uint8_t *>(columns), schemaSize) == schemaSize;
+    size = sizeof(fileHeader) + schemaSize;
+    captureSection = CaptureSection::Head;
+    captureOffset = 0;
+}
+
+bool BinaryWriter::writeCapture(const SampleDataPoint &sample, uint32_t maxSize)
+{
+    if (!isComplete)
+    {
+        return true;
+    }
+
+    const uint32_t stepEnd = size + maxSize;
+    while (captureSection != CaptureSection::Done)
+    {
+        if (size >= stepEnd || !writeSection(sample, stepEnd))
+        {
+            return false;
+        }
+        captureSection = static_cast<CaptureSection>(static_cast<int>(captureSection) + 1);
+    }
+    captureSection = CaptureSection::Head;
+    return true;
+}
+
+bool BinaryWriter::end()
+{
+    if (!isComplete)
+    {
+        Serial.println("Failed to write the binary capture file");
+    }
+    return isComplete;
+}
@@ -0,0 +1,64 @@
+#include "buffered_file.h"
+
+BufferedFile::BufferedFile(SamplerConfig *_samplerConfig)
+    : file(nullptr),
+      buffer(new uint8_t[_samplerConfig->samplerOptions->sdWriteSize]),
+      bufferSize(_samplerConfig->samplerOptions->sdWriteSize)
+{
+    length = 0;
+    hasWriteError = false;
+}
+
+void BufferedFile::begin(File *_file)
+{
+    file = _file;
+    length = 0;
+    hasWriteError = false;
+}
+
+void BufferedFile::writeBuffer()
+{
+    if (length > 0 && file->write(buffer, length) != length)
+    {
+        hasWriteError = true;
+    }
+    length = 0;
+}
+
+size_t BufferedFile::write(uint8_t byte)
+{
+    return write(&byte, 1);
+}
+
+size_t BufferedFile::write(const uint8_t *data, size_t size)
+{
+    if (file == nullptr)
+    {
+        return 0;
+    }
+
+    size_t written = 0;
+    while (written < size)
+    {
+        const size_t chunk = min(size - written, bufferSize - length);
+        memcpy(buffer + length, data + written, chunk);
+        length += chunk;
+        written += chunk;
+        if (length == bufferSize)
+        {
+            writeBuffer();
+        }
+    }
+    return size;
+}
+
+bool BufferedFile::end()
+{
+    if (file == nullptr)
+    {
+        return false;
+    }
+    writeBuffer();
+    file = nullptr;
+    return !hasWriteError;
+}
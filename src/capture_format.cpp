@@ -0,0 +1,24 @@
+#include "capture_format.h"
+
+size_t capture_format::typeSize(ColumnType type)
+{
+    switch (type)
+    {
+    case ColumnType::UInt8:
+    case ColumnType::Text:
+        return 1;
+    case ColumnType::Int16:
+    case ColumnType::PackedInt16:
+    case ColumnType::ImaAdpcm:
+        return 2;
+    case ColumnType::Float32:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+bool capture_format::isPacked(ColumnType type)
+{
+    return type == ColumnType::PackedInt16 || type == ColumnType::ImaAdpcm;
+}
@@ -0,0 +1,460 @@
+#include "capture_log.h"
+#include "checksum.h"
+
+#include <stddef.h>
+
+namespace
+{
+    // The 5 digits of the 8.3 names
+    constexpr uint32_t maxFileIndex = 99999;
+
+    /**
+     * The names are numbered from 1, so 0 is no file
+     * @return false past maxFileIndex, which has no name
+     */
+    bool formatFileName(char *fileName, size_t size, uint32_t fileIndex)
+    {
+        if (fileIndex > maxFileIndex)
+        {
+            return false;
+        }
+        snprintf(fileName, size, "CAP%05lu.LOG", static_cast<unsigned long>(fileIndex));
+        return true;
+    }
+
+    bool fileExists(uint32_t fileIndex)
+    {
+        char fileName[13];
+        return formatFileName(fileName, sizeof(fileName), fileIndex) && SD.exists(fileName);
+    }
+
+    /**
+     * The files of all the boots are numbered without gaps, so the last one is found in O(log n) lookups:
+     * double the index until a file is missing, then bisect between the last two
+     * @return 0 when there's no log file
+     */
+    uint32_t findLastFileIndex()
+    {
+        if (!fileExists(1))
+        {
+            return 0;
+        }
+        uint32_t existing = 1;
+        uint32_t missing = 2;
+        while (fileExists(missing))
+        {
+            existing = missing;
+            missing *= 2;
+        }
+        while (missing - existing > 1)
+        {
+            const uint32_t middle = existing + (missing - existing) / 2;
+            if (fileExists(middle))
+                existing = middle;
+            else
+                missing = middle;
+        }
+        return existing;
+    }
+} // namespace
+
+CaptureLog::CaptureLog(SamplerConfig *_samplerConfig)
+    : samplerConfig(_samplerConfig),
+      firstBlock(new uint8_t[blockSize]),
+      numWriteBlocks(max(_samplerConfig->samplerOptions->sdWriteSize / static_cast<uint32_t>(blockSize), static_cast<uint32_t>(1)))
+{
+    blocks = new uint8_t[numWriteBlocks * blockSize];
+    numStagedBlocks = 0;
+    fileIndex = 0;
+    fileName[0] = '\0';
+    filePosition = 0;
+    currentBlock = firstBlock;
+    currentLength = 0;
+    recordOffset = 0;
+    blockOffset = 0;
+    stagedOffset = 0;
+    recordSize = 0;
+    payloadCrc = 0;
+    sequence = 0;
+    commitCount = 0;
+    isRecordOpen = false;
+    hasWriteError = false;
+    largestRecordBlocks = 0;
+    maxWriteUs = 0;
+    totalWriteUs = 0;
+    numWrites = 0;
+}
+
+bool CaptureLog::begin()
+{
+    const unsigned long startUs = micros();
+
+    // Not FILE_WRITE, its O_APPEND would add every tail after the previous ones instead of overwriting a block
+    tailFile = SD.open(capture_format::logTailFileName, O_RDWR | O_CREAT);
+    if (!tailFile)
+    {
+        Serial.println("Failed to open the capture log tail");
+        return false;
+    }
+    if (tailFile.size() < 2 * blockSize)
+    {
+        memset(blocks, 0, blockSize);
+        tailFile.seek(0);
+        if (tailFile.write(blocks, blockSize) != blockSize || tailFile.write(blocks, blockSize) != blockSize)
+        {
+            Serial.println("Failed to create the capture log tail");
+            return false;
+        }
+        tailFile.flush();
+    }
+
+    capture_format::LogTail tail;
+    const bool isResumed = readTail(&tail) && resume(tail);
+    if (!isResumed && !startAfterLastFile())
+    {
+        return false;
+    }
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+    {
+        Serial.print(isResumed ? "Capture log resumed in " : "Capture log started in ");
+        Serial.print(fileName);
+        Serial.print(" at record ");
+        Serial.print(sequence);
+        Serial.print(", offset ");
+        Serial.print(recordOffset);
+        Serial.print(", in ");
+        Serial.print(micros() - startUs);
+        Serial.println(" us");
+    }
+    return true;
+}
+
+bool CaptureLog::readTail(capture_format::LogTail *tail)
+{
+    bool isFound = false;
+    for (uint32_t slot = 0; slot < 2; slot++)
+    {
+        capture_format::LogTail slotTail;
+        if (!tailFile.seek(slot * blockSize) || tailFile.read(&slotTail, sizeof(slotTail)) != sizeof(slotTail))
+        {
+            continue;
+        }
+        // Torn by a reset or never written
+        if (slotTail.magic != capture_format::logTailMagic ||
+            slotTail.crc != checksum::crc32(&slotTail, offsetof(capture_format::LogTail, crc)))
+        {
+            continue;
+        }
+        if (!isFound || slotTail.commitCount > tail->commitCount)
+        {
+            *tail = slotTail;
+            isFound = true;
+        }
+    }
+    if (isFound)
+    {
+        commitCount = tail->commitCount;
+    }
+    return isFound;
+}
+
+bool CaptureLog::writeTail()
+{
+    commitCount++;
+    capture_format::LogTail tail;
+    memset(&tail, 0, sizeof(tail));
+    tail.magic = capture_format::logTailMagic;
+    tail.commitCount = commitCount;
+    tail.fileIndex = fileIndex;
+    tail.nextOffset = recordOffset;
+    tail.nextSequence = sequence;
+    tail.largestRecordBlocks = largestRecordBlocks;
+    tail.crc = checksum::crc32(&tail, offsetof(capture_format::LogTail, crc));
+
+    // A whole block over the older tail, so a reset during the write leaves the newer one intact
+    memset(blocks, 0, blockSize);
+    memcpy(blocks, &tail, sizeof(tail));
+    const bool isWritten = tailFile.seek((commitCount % 2) * blockSize) && tailFile.write(blocks, blockSize) == blockSize;
+    tailFile.flush();
+    return isWritten;
+}
+
+bool CaptureLog::resume(const capture_format::LogTail &tail)
+{
+    if (!formatFileName(fileName, sizeof(fileName), tail.fileIndex) || !SD.exists(fileName))
+    {
+        return false;
+    }
+    file = SD.open(fileName, O_RDWR);
+    if (!file || file.size() < tail.nextOffset)
+    {
+        file.close();
+        return false;
+    }
+
+    fileIndex = tail.fileIndex;
+    filePosition = UINT32_MAX;
+    recordOffset = tail.nextOffset;
+    sequence = tail.nextSequence;
+    largestRecordBlocks = tail.largestRecordBlocks;
+    // A reset between a commit and its tail leaves one record past the tail
+    skipCommittedRecords(true);
+    return true;
+}
+
+bool CaptureLog::startAfterLastFile()
+{
+    fileIndex = findLastFileIndex();
+    sequence = 0;
+    if (fileIndex > 0)
+    {
+        formatFileName(fileName, sizeof(fileName), fileIndex);
+        file = SD.open(fileName, O_RDWR);
+        if (file)
+        {
+            recordOffset = 0;
+            skipCommittedRecords(false);
+        }
+    }
+    return openNextFile();
+}
+
+void CaptureLog::skipCommittedRecords(bool isSequenceKnown)
+{
+    capture_format::LogRecordHeader header;
+    while (readHeader(recordOffset, &header) && (!isSequenceKnown || header.sequence == sequence))
+    {
+        const uint32_t recordBlocks = (sizeof(header) + header.size + blockSize - 1) / blockSize;
+        largestRecordBlocks = max(largestRecordBlocks, recordBlocks);
+        recordOffset += recordBlocks * blockSize;
+        sequence = header.sequence + 1;
+        isSequenceKnown = true;
+    }
+}
+
+bool CaptureLog::readHeader(uint32_t offset, capture_format::LogRecordHeader *header)
+{
+    filePosition = UINT32_MAX;
+    if (offset + sizeof(*header) > file.size() || !file.seek(offset) || file.read(header, sizeof(*header)) != sizeof(*header))
+    {
+        return false;
+    }
+    return header->magic == capture_format::logRecordMagic &&
+           header->headerCrc == checksum::crc32(header, offsetof(capture_format::LogRecordHeader, headerCrc));
+}
+
+bool CaptureLog::openNextFile()
+{
+    if (file)
+    {
+        file.close();
+    }
+
+    // 8.3 names, skipping a file created after the tail was last written
+    do
+    {
+        fileIndex++;
+        if (!formatFileName(fileName, sizeof(fileName), fileIndex))
+        {
+            Serial.println("Failed to create the capture log file, every file name is used");
+            return false;
+        }
+    } while (SD.exists(fileName));
+
+    // Not FILE_WRITE, its O_APPEND would move every write to the end instead of over the preallocated blocks
+    file = SD.open(fileName, O_RDWR | O_CREAT);
+    if (!file)
+    {
+        Serial.println("Failed to create the capture log file");
+        return false;
+    }
+
+    // Zero filled so the clusters are allocated now, in one run, and a block without a record header ends the log
+    const unsigned long startMillis = millis();
+    memset(blocks, 0, numWriteBlocks * blockSize);
+    for (uint32_t offset = 0; offset < samplerConfig->samplerOptions->logFileSize; offset += numWriteBlocks * blockSize)
+    {
+        const uint32_t length = min(samplerConfig->samplerOptions->logFileSize - offset, static_cast<uint32_t>(numWriteBlocks * blockSize));
+        if (file.write(blocks, length) != length)
+        {
+            Serial.println("Failed to preallocate the capture log file");
+            file.close();
+            return false;
+        }
+    }
+    file.flush();
+    filePosition = samplerConfig->samplerOptions->logFileSize;
+    recordOffset = 0;
+    // The new file is where the log resumes even before its first record
+    if (tailFile && !writeTail())
+    {
+        Serial.println("Failed to write the capture log tail");
+        return false;
+    }
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+    {
+        Serial.print("Capture log ");
+        Serial.print(fileName);
+        Serial.print(" preallocated in ");
+        Serial.print(millis() - startMillis);
+        Serial.println(" ms");
+    }
+    return true;
+}
+
+bool CaptureLog::writeBlocks(uint32_t offset, const uint8_t *data, uint32_t numBlocks)
+{
+    const unsigned long startUs = micros();
+    if (offset != filePosition && !file.seek(offset))
+    {
+        return false;
+    }
+    const size_t length = numBlocks * blockSize;
+    const bool isWritten = file.write(data, length) == length;
+    // Unknown after a failed write, the next block seeks
+    filePosition = isWritten ? offset + length : UINT32_MAX;
+
+    const unsigned long elapsedUs = micros() - startUs;
+    maxWriteUs = max(maxWriteUs, elapsedUs);
+    totalWriteUs += elapsedUs;
+    numWrites++;
+    return isWritten;
+}
+
+bool CaptureLog::writeStagedBlocks()
+{
+    const bool isWritten = numStagedBlocks == 0 || writeBlocks(stagedOffset, blocks, numStagedBlocks);
+    stagedOffset += numStagedBlocks * blockSize;
+    numStagedBlocks = 0;
+    return isWritten;
+}
+
+bool CaptureLog::beginRecord()
+{
+    if (!file)
+    {
+        return false;
+    }
+    const uint32_t expectedEnd = recordOffset + largestRecordBlocks * blockSize;
+    if (recordOffset > 0 && expectedEnd > samplerConfig->samplerOptions->logFileSize && !openNextFile())
+    {
+        return false;
+    }
+
+    currentBlock = firstBlock;
+    currentLength = sizeof(capture_format::LogRecordHeader);
+    blockOffset = recordOffset;
+    stagedOffset = recordOffset + blockSize;
+    numStagedBlocks = 0;
+    recordSize = 0;
+    payloadCrc = 0;
+    hasWriteError = false;
+    isRecordOpen = true;
+    return true;
+}
+
+size_t CaptureLog::write(uint8_t byte)
+{
+    return write(&byte, 1);
+}
+
+size_t CaptureLog::write(const uint8_t *buffer, size_t size)
+{
+    if (!isRecordOpen)
+    {
+        return 0;
+    }
+
+    payloadCrc = checksum::crc32(buffer, size, payloadCrc);
+    size_t written = 0;
+    while (written < size)
+    {
+        const size_t length = min(size - written, blockSize - currentLength);
+        memcpy(currentBlock + currentLength, buffer + written, length);
+        currentLength += length;
+        written += length;
+
+        if (currentLength == blockSize)
+        {
+            // The first block waits for the commit, the others go out as soon as numWriteBlocks are full
+            if (currentBlock != firstBlock && ++numStagedBlocks == numWriteBlocks && !writeStagedBlocks())
+            {
+                hasWriteError = true;
+            }
+            currentBlock = blocks + numStagedBlocks * blockSize;
+            currentLength = 0;
+            blockOffset += blockSize;
+        }
+    }
+    recordSize += size;
+    return size;
+}
+
+bool CaptureLog::endRecord()
+{
+    if (!isRecordOpen)
+    {
+        return false;
+    }
+    isRecordOpen = false;
+
+    if (currentLength > 0)
+    {
+        memset(currentBlock + currentLength, 0, blockSize - currentLength);
+        if (currentBlock != firstBlock)
+        {
+            numStagedBlocks++;
+        }
+        blockOffset += blockSize;
+    }
+    if (!writeStagedBlocks())
+    {
+        hasWriteError = true;
+    }
+
+    capture_format::LogRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = capture_format::logRecordMagic;
+    header.size = recordSize;
+    header.sequence = sequence;
+    header.timestamp = millis();
+    header.payloadCrc = payloadCrc;
+    header.headerCrc = checksum::crc32(&header, offsetof(capture_format::LogRecordHeader, headerCrc));
+    memcpy(firstBlock, &header, sizeof(header));
+
+    // Only after the rest, so the record is complete once it has a header
+    if (hasWriteError || !writeBlocks(recordOffset, firstBlock, 1))
+    {
+        Serial.println("Failed to write the capture log record");
+        return false;
+    }
+    // Only past logFileSize the file size and so the directory entry change
+    file.flush();
+
+    sequence++;
+    largestRecordBlocks = max(largestRecordBlocks, static_cast<uint32_t>((blockOffset - recordOffset) / blockSize));
+    recordOffset = blockOffset;
+    // The record is committed, a failed tail only costs skipping it again at the next boot
+    if (!writeTail())
+    {
+        Serial.println("Failed to write the capture log tail");
+    }
+    return true;
+}
+
+void CaptureLog::printStats()
+{
+    Serial.print("Capture log: ");
+    Serial.print(sequence);
+    Serial.print(" records, ");
+    Serial.print(numWrites);
+    Serial.print(" writes of up to ");
+    Serial.print(numWriteBlocks * blockSize);
+    Serial.print(" bytes, ");
+    Serial.print(numWrites > 0 ? totalWriteUs / numWrites : 0);
+    Serial.print(" us average, ");
+    Serial.print(maxWriteUs);
+    Serial.println(" us max");
+}
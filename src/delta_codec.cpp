@@ -0,0 +1,169 @@
+#include "delta_codec.h"
+
+namespace
+{
+    // A payload size or a residual, at most 3 varint bytes for 21 bits
+    constexpr int maxVarintSize = 3;
+
+    uint32_t zigzag(int32_t value)
+    {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    int32_t unzigzag(uint32_t value)
+    {
+        return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+
+    size_t varintSize(uint32_t value)
+    {
+        return value < 0x80 ? 1 : (value < 0x4000 ? 2 : 3);
+    }
+
+    size_t writeVarint(uint32_t value, uint8_t *output)
+    {
+        size_t length = 0;
+        while (value >= 0x80)
+        {
+            output[length++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        output[length++] = static_cast<uint8_t>(value);
+        return length;
+    }
+
+    bool readVarint(const uint8_t *input, size_t size, size_t *position, uint32_t *value)
+    {
+        *value = 0;
+        for (int i = 0; i < maxVarintSize; i++)
+        {
+            if (*position >= size)
+                return false;
+            const uint8_t byte = input[(*position)++];
+            *value |= static_cast<uint32_t>(byte & 0x7F) << (7 * i);
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Both predictions restart at 0 on the first value of a block, the second order one is first order on the second value
+    int32_t predict(delta_codec::BlockMode mode, int index, int32_t previous, int32_t beforePrevious)
+    {
+        if (index == 0)
+            return 0;
+        if (mode == delta_codec::BlockMode::Delta || index == 1)
+            return previous;
+        return 2 * previous - beforePrevious;
+    }
+} // namespace
+
+size_t delta_codec::maxEncodedSize(int count)
+{
+    const int numBlocks = (count + blockLength - 1) / blockLength;
+    // Mode byte and a 2 byte payload size per verbatim block
+    return numBlocks * 3 + count * sizeof(int16_t);
+}
+
+size_t delta_codec::encode(const int16_t *values, int count, uint8_t *output)
+{
+    size_t written = 0;
+    for (int start = 0; start < count; start += blockLength)
+    {
+        const int length = count - start < blockLength ? count - start : blockLength;
+        const int16_t *block = values + start;
+
+        // Size both predictions in a single pass, then only encode the smaller one
+        size_t deltaSize = 0;
+        size_t secondOrderSize = 0;
+        for (int i = 0; i < length; i++)
+        {
+            const int32_t previous = i > 0 ? block[i - 1] : 0;
+            const int32_t beforePrevious = i > 1 ? block[i - 2] : 0;
+            deltaSize += varintSize(zigzag(block[i] - predict(BlockMode::Delta, i, previous, beforePrevious)));
+            secondOrderSize += varintSize(zigzag(block[i] - predict(BlockMode::SecondOrder, i, previous, beforePrevious)));
+        }
+
+        const size_t verbatimSize = length * sizeof(int16_t);
+        BlockMode mode = BlockMode::Verbatim;
+        size_t payloadSize = verbatimSize;
+        if (deltaSize < payloadSize)
+        {
+            mode = BlockMode::Delta;
+            payloadSize = deltaSize;
+        }
+        if (secondOrderSize < payloadSize)
+        {
+            mode = BlockMode::SecondOrder;
+            payloadSize = secondOrderSize;
+        }
+
+        output[written++] = static_cast<uint8_t>(mode);
+        written += writeVarint(payloadSize, output + written);
+        if (mode == BlockMode::Verbatim)
+        {
+            for (int i = 0; i < length; i++)
+            {
+                const uint16_t value = static_cast<uint16_t>(block[i]);
+                output[written++] = static_cast<uint8_t>(value);
+                output[written++] = static_cast<uint8_t>(value >> 8);
+            }
+            continue;
+        }
+        for (int i = 0; i < length; i++)
+        {
+            const int32_t previous = i > 0 ? block[i - 1] : 0;
+            const int32_t beforePrevious = i > 1 ? block[i - 2] : 0;
+            written += writeVarint(zigzag(block[i] - predict(mode, i, previous, beforePrevious)), output + written);
+        }
+    }
+    return written;
+}
+
+bool delta_codec::decode(const uint8_t *input, size_t size, int16_t *values, int count)
+{
+    size_t position = 0;
+    for (int start = 0; start < count; start += blockLength)
+    {
+        const int length = count - start < blockLength ? count - start : blockLength;
+        int16_t *block = values + start;
+
+        if (position >= size)
+            return false;
+        const BlockMode mode = static_cast<BlockMode>(input[position++]);
+        uint32_t payloadSize;
+        if (!readVarint(input, size, &position, &payloadSize) || payloadSize > size - position)
+            return false;
+        const size_t payloadEnd = position + payloadSize;
+
+        if (mode == BlockMode::Verbatim)
+        {
+            if (payloadSize != length * sizeof(int16_t))
+                return false;
+            for (int i = 0; i < length; i++)
+            {
+                block[i] = static_cast<int16_t>(input[position] | (input[position + 1] << 8));
+                position += 2;
+            }
+            continue;
+        }
+        if (mode != BlockMode::Delta && mode != BlockMode::SecondOrder)
+            return false;
+
+        for (int i = 0; i < length; i++)
+        {
+            uint32_t residual;
+            if (!readVarint(input, payloadEnd, &position, &residual))
+                return false;
+            const int32_t previous = i > 0 ? block[i - 1] : 0;
+            const int32_t beforePrevious = i > 1 ? block[i - 2] : 0;
+            const int32_t value = predict(mode, i, previous, beforePrevious) + unzigzag(residual);
+            if (value < INT16_MIN || value > INT16_MAX)
+                return false;
+            block[i] = static_cast<int16_t>(value);
+        }
+        if (position != payloadEnd)
+            return false;
+    }
+    return position == size;
+}
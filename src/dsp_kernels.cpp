@@ -0,0 +1,529 @@
+#include <math.h>
+#include <string.h>
+
+#include "dsp_kernels.h"
+
+#if DSP_USE_M4_INTRINSICS
+// Brings in the CMSIS core intrinsics (__SMLALD, __QSUB16, __SSAT)
+#include <Arduino.h>
+#endif
+
+namespace
+{
+#if DSP_USE_M4_INTRINSICS
+    inline uint64_t dualMultiplyAccumulateLong(uint32_t a, uint32_t b, uint64_t accumulator)
+    {
+        return __SMLALD(a, b, accumulator);
+    }
+
+    inline uint32_t saturatingNegatePair(uint32_t pair)
+    {
+        return __QSUB16(0, pair);
+    }
+
+    inline uint32_t maxPair(uint32_t a, uint32_t b)
+    {
+        // SSUB16 sets the GE flags per halfword and SEL picks by them, so both must be one asm block
+        uint32_t result;
+        __asm volatile("ssub16 %0, %1, %2\n\tsel %0, %1, %2" : "=&r"(result) : "r"(a), "r"(b) : "cc");
+        return result;
+    }
+
+    inline int16_t saturateQ15(int32_t value)
+    {
+        return static_cast<int16_t>(__SSAT(value, 16));
+    }
+#else
+    // Bit-exact emulation of SMLALD: both signed halfword products added to the 64 bit accumulator
+    inline uint64_t dualMultiplyAccumulateLong(uint32_t a, uint32_t b, uint64_t accumulator)
+    {
+        const int32_t low = static_cast<int16_t>(a & 0xFFFF) * static_cast<int16_t>(b & 0xFFFF);
+        const int32_t high = static_cast<int16_t>(a >> 16) * static_cast<int16_t>(b >> 16);
+        return accumulator + static_cast<uint64_t>(static_cast<int64_t>(low)) + static_cast<uint64_t>(static_cast<int64_t>(high));
+    }
+
+    inline uint16_t saturatingNegate(uint16_t value)
+    {
+        const int16_t signedValue = static_cast<int16_t>(value);
+        return static_cast<uint16_t>(signedValue == INT16_MIN ? INT16_MAX : -signedValue);
+    }
+
+    // Bit-exact emulation of QSUB16 from 0: each halfword negated, -32768 saturating to 32767
+    inline uint32_t saturatingNegatePair(uint32_t pair)
+    {
+        return saturatingNegate(pair & 0xFFFF) | (static_cast<uint32_t>(saturatingNegate(pair >> 16)) << 16);
+    }
+
+    inline uint16_t maxHalfword(uint16_t a, uint16_t b)
+    {
+        return static_cast<int16_t>(a) >= static_cast<int16_t>(b) ? a : b;
+    }
+
+    // Bit-exact emulation of SSUB16 + SEL: the signed max of each halfword
+    inline uint32_t maxPair(uint32_t a, uint32_t b)
+    {
+        return maxHalfword(a & 0xFFFF, b & 0xFFFF) | (static_cast<uint32_t>(maxHalfword(a >> 16, b >> 16)) << 16);
+    }
+
+    // Bit-exact emulation of SSAT to 16 bits
+    inline int16_t saturateQ15(int32_t value)
+    {
+        return static_cast<int16_t>(value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value));
+    }
+#endif
+
+    inline int16_t saturateQ15Long(int64_t value)
+    {
+        if (value > INT16_MAX)
+        {
+            return INT16_MAX;
+        }
+        if (value < INT16_MIN)
+        {
+            return INT16_MIN;
+        }
+        return static_cast<int16_t>(value);
+    }
+
+    inline int32_t roundToInt32(float value)
+    {
+        // Clamp first so the cast is always defined, saturation to 16 bits happens afterwards
+        if (value > 1073741824.0f)
+        {
+            value = 1073741824.0f;
+        }
+        else if (value < -1073741824.0f)
+        {
+            value = -1073741824.0f;
+        }
+        return static_cast<int32_t>(value >= 0.0f ? value + 0.5f : value - 0.5f);
+    }
+
+    // Load two packed q15 samples. memcpy compiles to a single (unaligned capable) LDR on the M4
+    inline uint32_t readPair(const int16_t *pointer)
+    {
+        uint32_t value;
+        memcpy(&value, pointer, sizeof(value));
+        return value;
+    }
+} // namespace
+
+namespace dsp
+{
+    void Biquad::setBandPass(float centerHz, float q, float samplingFrequency)
+    {
+        const float w0 = 2.0f * static_cast<float>(M_PI) * centerHz / samplingFrequency;
+        const float alpha = sinf(w0) / (2.0f * q);
+        const float a0 = 1.0f + alpha;
+
+        // Constant 0 dB peak gain
+        b0 = alpha / a0;
+        b1 = 0.0f;
+        b2 = -alpha / a0;
+        a1 = -2.0f * cosf(w0) / a0;
+        a2 = (1.0f - alpha) / a0;
+    }
+
+    void Biquad::setLowPass(float cutoffHz, float q, float samplingFrequency)
+    {
+        const float w0 = 2.0f * static_cast<float>(M_PI) * cutoffHz / samplingFrequency;
+        const float alpha = sinf(w0) / (2.0f * q);
+        const float cosW0 = cosf(w0);
+        const float a0 = 1.0f + alpha;
+
+        b0 = (1.0f - cosW0) / 2.0f / a0;
+        b1 = (1.0f - cosW0) / a0;
+        b2 = b0;
+        a1 = -2.0f * cosW0 / a0;
+        a2 = (1.0f - alpha) / a0;
+    }
+
+    void Biquad::setDcBlocker(float pole)
+    {
+        b0 = 1.0f;
+        b1 = -1.0f;
+        b2 = 0.0f;
+        a1 = -pole;
+        a2 = 0.0f;
+    }
+
+    namespace reference
+    {
+        int64_t dotProductQ15(const int16_t *a, const int16_t *b, size_t length)
+        {
+            int64_t accumulator = 0;
+            for (size_t i = 0; i < length; i++)
+            {
+                accumulator += static_cast<int32_t>(a[i]) * b[i];
+            }
+            return accumulator;
+        }
+
+        uint64_t energyQ15(const int16_t *input, size_t length)
+        {
+            uint64_t accumulator = 0;
+            for (size_t i = 0; i < length; i++)
+            {
+                accumulator += static_cast<uint32_t>(static_cast<int32_t>(input[i]) * input[i]);
+            }
+            return accumulator;
+        }
+
+        int16_t absMaxQ15(const int16_t *input, size_t length)
+        {
+            int16_t maxValue = 0;
+            for (size_t i = 0; i < length; i++)
+            {
+                const int16_t value = input[i] == INT16_MIN ? INT16_MAX : static_cast<int16_t>(input[i] < 0 ? -input[i] : input[i]);
+                if (value > maxValue)
+                {
+                    maxValue = value;
+                }
+            }
+            return maxValue;
+        }
+
+        void firQ15(const int16_t *input, int16_t *output, size_t length, const int16_t *coefficients, size_t numTaps, int16_t *state)
+        {
+            if (numTaps == 0)
+            {
+                memset(output, 0, length * sizeof(int16_t));
+                return;
+            }
+
+            memcpy(&state[numTaps - 1], input, length * sizeof(int16_t));
+
+            for (size_t n = 0; n < length; n++)
+            {
+                const int64_t accumulator = reference::dotProductQ15(&state[n], coefficients, numTaps);
+                output[n] = saturateQ15Long((accumulator + (1 << 14)) >> 15);
+            }
+
+            memmove(state, &state[length], (numTaps - 1) * sizeof(int16_t));
+        }
+
+        void scaleQ15(const int16_t *input, int16_t *output, size_t length, int16_t scaleFract, int8_t shift)
+        {
+            const int8_t rightShift = 15 - shift;
+            for (size_t i = 0; i < length; i++)
+            {
+                output[i] = saturateQ15Long((static_cast<int32_t>(input[i]) * scaleFract) >> rightShift);
+            }
+        }
+
+        void floatToQ15(const float *input, int16_t *output, size_t length, float scale)
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                output[i] = saturateQ15Long(roundToInt32(input[i] * scale));
+            }
+        }
+    } // namespace reference
+
+    int64_t dotProductQ15(const int16_t *a, const int16_t *b, size_t length)
+    {
+        uint64_t accumulator = 0;
+        size_t i = 0;
+
+        // Two dual 16 bit MACs per iteration, 64 bit accumulator so long blocks can't overflow
+        for (; i + 4 <= length; i += 4)
+        {
+            accumulator = dualMultiplyAccumulateLong(readPair(&a[i]), readPair(&b[i]), accumulator);
+            accumulator = dualMultiplyAccumulateLong(readPair(&a[i + 2]), readPair(&b[i + 2]), accumulator);
+        }
+
+        int64_t result = static_cast<int64_t>(accumulator);
+        for (; i < length; i++)
+        {
+            result += static_cast<int32_t>(a[i]) * b[i];
+        }
+        return result;
+    }
+
+    uint64_t energyQ15(const int16_t *input, size_t length)
+    {
+        uint64_t accumulator = 0;
+        size_t i = 0;
+
+        for (; i + 4 <= length; i += 4)
+        {
+            const uint32_t pair1 = readPair(&input[i]);
+            const uint32_t pair2 = readPair(&input[i + 2]);
+            accumulator = dualMultiplyAccumulateLong(pair1, pair1, accumulator);
+            accumulator = dualMultiplyAccumulateLong(pair2, pair2, accumulator);
+        }
+
+        for (; i < length; i++)
+        {
+            accumulator += static_cast<uint32_t>(static_cast<int32_t>(input[i]) * input[i]);
+        }
+        return accumulator;
+    }
+
+    int16_t absMaxQ15(const int16_t *input, size_t length)
+    {
+        uint32_t maxValues = 0;
+        size_t i = 0;
+
+        for (; i + 2 <= length; i += 2)
+        {
+            const uint32_t pair = readPair(&input[i]);
+            const uint32_t absPair = maxPair(pair, saturatingNegatePair(pair));
+            maxValues = maxPair(absPair, maxValues);
+        }
+
+        const int16_t low = static_cast<int16_t>(maxValues & 0xFFFF);
+        const int16_t high = static_cast<int16_t>(maxValues >> 16);
+        int16_t maxValue = low > high ? low : high;
+
+        if (i < length)
+        {
+            const int16_t tail = reference::absMaxQ15(&input[i], length - i);
+            maxValue = tail > maxValue ? tail : maxValue;
+        }
+        return maxValue;
+    }
+
+    void firQ15(const int16_t *input, int16_t *output, size_t length, const int16_t *coefficients, size_t numTaps, int16_t *state)
+    {
+        // Without taps there's no history either, numTaps - 1 would wrap around
+        if (numTaps == 0)
+        {
+            memset(output, 0, length * sizeof(int16_t));
+            return;
+        }
+
+        memcpy(&state[numTaps - 1], input, length * sizeof(int16_t));
+
+        for (size_t n = 0; n < length; n++)
+        {
+            const int64_t accumulator = dotProductQ15(&state[n], coefficients, numTaps);
+            // Fits in 32 bits after the shift for any numTaps below 65536
+            output[n] = saturateQ15(static_cast<int32_t>((accumulator + (1 << 14)) >> 15));
+        }
+
+        memmove(state, &state[length], (numTaps - 1) * sizeof(int16_t));
+    }
+
+    void scaleQ15(const int16_t *input, int16_t *output, size_t length, int16_t scaleFract, int8_t shift)
+    {
+        const int8_t rightShift = 15 - shift;
+        for (size_t i = 0; i < length; i++)
+        {
+            output[i] = saturateQ15((static_cast<int32_t>(input[i]) * scaleFract) >> rightShift);
+        }
+    }
+
+    void floatToQ15(const float *input, int16_t *output, size_t length, float scale)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            output[i] = saturateQ15(roundToInt32(input[i] * scale));
+        }
+    }
+
+    void q15ToFloat(const int16_t *input, float *output, size_t length, float scale)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            output[i] = input[i] * scale;
+        }
+    }
+
+    void interleave3(const float *x, const float *y, const float *z, float *output, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            output[0] = x[i];
+            output[1] = y[i];
+            output[2] = z[i];
+            output += 3;
+        }
+    }
+
+    void deinterleave3(const float *input, float *x, float *y, float *z, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            x[i] = input[0];
+            y[i] = input[1];
+            z[i] = input[2];
+            input += 3;
+        }
+    }
+
+    void biquad(Biquad &section, const float *input, float *output, size_t length)
+    {
+        // The state stays in registers for the whole block
+        const float b0 = section.b0, b1 = section.b1, b2 = section.b2, a1 = section.a1, a2 = section.a2;
+        float z1 = section.z1;
+        float z2 = section.z2;
+        for (size_t i = 0; i < length; i++)
+        {
+            const float x = input[i];
+            const float y = b0 * x + z1;
+            z1 = b1 * x - a1 * y + z2;
+            z2 = b2 * x - a2 * y;
+            output[i] = y;
+        }
+        section.z1 = z1;
+        section.z2 = z2;
+    }
+
+    void absolute(const float *input, float *output, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            output[i] = fabsf(input[i]);
+        }
+    }
+
+    void goertzel(const float *input, size_t length, float coefficient, float *s1, float *s2)
+    {
+        float state1 = *s1;
+        float state2 = *s2;
+        for (size_t i = 0; i < length; i++)
+        {
+            const float s0 = input[i] + coefficient * state1 - state2;
+            state2 = state1;
+            state1 = s0;
+        }
+        *s1 = state1;
+        *s2 = state2;
+    }
+
+    float sum(const float *input, size_t length)
+    {
+        float accumulator = 0.0f;
+        for (size_t i = 0; i < length; i++)
+        {
+            accumulator += input[i];
+        }
+        return accumulator;
+    }
+
+    float energy(const float *input, size_t length)
+    {
+        float accumulator = 0.0f;
+        for (size_t i = 0; i < length; i++)
+        {
+            accumulator += input[i] * input[i];
+        }
+        return accumulator;
+    }
+
+    void minMax(const float *input, size_t length, float *minValue, float *maxValue)
+    {
+        float low = input[0];
+        float high = input[0];
+        for (size_t i = 1; i < length; i++)
+        {
+            low = input[i] < low ? input[i] : low;
+            high = input[i] > high ? input[i] : high;
+        }
+        *minValue = low;
+        *maxValue = high;
+    }
+
+    void centralMoments(const float *input, size_t length, float mean, float *m2, float *m3, float *m4)
+    {
+        float sum2 = 0.0f;
+        float sum3 = 0.0f;
+        float sum4 = 0.0f;
+        for (size_t i = 0; i < length; i++)
+        {
+            const float deviation = input[i] - mean;
+            const float deviation2 = deviation * deviation;
+            sum2 += deviation2;
+            sum3 += deviation2 * deviation;
+            sum4 += deviation2 * deviation2;
+        }
+        *m2 = sum2;
+        *m3 = sum3;
+        *m4 = sum4;
+    }
+
+    void fftRadix2(float *real, float *imag, size_t length)
+    {
+        // Bit reversal permutation
+        for (size_t i = 1, j = 0; i < length; i++)
+        {
+            size_t bit = length >> 1;
+            for (; j & bit; bit >>= 1)
+            {
+                j ^= bit;
+            }
+            j ^= bit;
+
+            if (i < j)
+            {
+                float temp = real[i];
+                real[i] = real[j];
+                real[j] = temp;
+                temp = imag[i];
+                imag[i] = imag[j];
+                imag[j] = temp;
+            }
+        }
+
+        // Butterflies, with the twiddles of each stage generated by rotation instead of a sin/cos per butterfly
+        for (size_t size = 2; size <= length; size <<= 1)
+        {
+            const float angle = -2.0f * static_cast<float>(M_PI) / size;
+            const float stepReal = cosf(angle);
+            const float stepImag = sinf(angle);
+            const size_t half = size >> 1;
+
+            float twiddleReal = 1.0f;
+            float twiddleImag = 0.0f;
+            for (size_t k = 0; k < half; k++)
+            {
+                for (size_t i = k; i < length; i += size)
+                {
+                    const size_t j = i + half;
+                    const float productReal = real[j] * twiddleReal - imag[j] * twiddleImag;
+                    const float productImag = real[j] * twiddleImag + imag[j] * twiddleReal;
+                    real[j] = real[i] - productReal;
+                    imag[j] = imag[i] - productImag;
+                    real[i] += productReal;
+                    imag[i] += productImag;
+                }
+
+                const float nextReal = twiddleReal * stepReal - twiddleImag * stepImag;
+                twiddleImag = twiddleReal * stepImag + twiddleImag * stepReal;
+                twiddleReal = nextReal;
+            }
+        }
+    }
+
+    void complexMagnitude(const float *real, const float *imag, float *magnitudes, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            magnitudes[i] = sqrtf(real[i] * real[i] + imag[i] * imag[i]);
+        }
+    }
+
+    void applyHannWindow(float *data, size_t length)
+    {
+        if (length < 2)
+        {
+            return;
+        }
+
+        // Same rotation trick as the FFT, one sin/cos for the whole window
+        const float angle = 2.0f * static_cast<float>(M_PI) / (length - 1);
+        const float stepCos = cosf(angle);
+        const float stepSin = sinf(angle);
+        float currentCos = 1.0f;
+        float currentSin = 0.0f;
+        for (size_t i = 0; i < length; i++)
+        {
+            data[i] *= 0.5f * (1.0f - currentCos);
+
+            const float nextCos = currentCos * stepCos - currentSin * stepSin;
+            currentSin = currentCos * stepSin + currentSin * stepCos;
+            currentCos = nextCos;
+        }
+    }
+} // namespace dsp
@@ -0,0 +1,135 @@
+#include <Arduino.h>
+
+#include "envelope.h"
+#include "dsp_kernels.h"
+
+namespace
+{
+    // Butterworth Q for each of the two cascaded low-pass sections of a 4th order filter
+    constexpr float lowPassQ1 = 0.5412f;
+    constexpr float lowPassQ2 = 1.3066f;
+} // namespace
+
+EnvelopeAnalyzer::EnvelopeAnalyzer(SamplerConfig *_samplerConfig)
+    : samplerConfig(_samplerConfig),
+      decimation(_samplerConfig->accOptions->envelopeDecimation),
+      // A decimation below 1 is rejected below, without dividing by it first
+      envelopeLength(_samplerConfig->accOptions->envelopeDecimation > 0 ? _samplerConfig->accOptions->accNumSamples / _samplerConfig->accOptions->envelopeDecimation : 0),
+      envelopeReal(new float[envelopeLength]),
+      envelopeImag(new float[envelopeLength]),
+      filtered(new float[dsp::blockSize])
+{
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+    {
+        Serial.println("Initializing envelope analyzer");
+    }
+
+    const float samplingFrequency = samplerConfig->accOptions->accSamplingFrequency;
+    const float lowHz = samplerConfig->accOptions->envelopeBandLowHz;
+    const float highHz = samplerConfig->accOptions->envelopeBandHighHz;
+
+    if (highHz >= samplingFrequency / 2.0f)
+    {
+        Serial.println("envelopeBandHighHz must be below the acc Nyquist frequency");
+        while (1)
+            ;
+    }
+    // Power of 2 decimation keeps the envelope length a power of 2 for the FFT
+    if (decimation < 1 || (decimation & (decimation - 1)) != 0 || envelopeLength < 2)
+    {
+        Serial.println("envelopeDecimation must be a power of 2 smaller than accNumSamples");
+        while (1)
+            ;
+    }
+
+    const float centerHz = sqrtf(lowHz * highHz);
+    bandPass.setBandPass(centerHz, centerHz / (highHz - lowHz), samplingFrequency);
+
+    // Anti-aliasing for the decimation, a bit below the decimated Nyquist frequency
+    const float cutoffHz = 0.8f * samplingFrequency / (2.0f * decimation);
+    lowPass1.setLowPass(cutoffHz, lowPassQ1, samplingFrequency);
+    lowPass2.setLowPass(cutoffHz, lowPassQ2, samplingFrequency);
+
+    reset();
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+    {
+        Serial.println("Envelope analyzer (band low Hz, band high Hz, decimation, bins):");
+        Serial.println(lowHz);
+        Serial.println(highHz);
+        Serial.println(decimation);
+        Serial.println(samplerConfig->accOptions->envelopeNumBins);
+        Serial.println("Envelope analyzer initialized\n");
+    }
+}
+
+void EnvelopeAnalyzer::reset()
+{
+    bandPass.reset();
+    lowPass1.reset();
+    lowPass2.reset();
+    decimationIndex = 0;
+    envelopeIndex = 0;
+
+    for (int i = 0; i < envelopeLength; i++)
+    {
+        envelopeReal[i] = 0.0f;
+        envelopeImag[i] = 0.0f;
+    }
+}
+
+void EnvelopeAnalyzer::addSamples(const float *values, size_t length)
+{
+    for (size_t start = 0; start < length; start += dsp::blockSize)
+    {
+        const size_t count = min(length - start, dsp::blockSize);
+
+        // Band-pass then full wave rectification
+        dsp::biquad(bandPass, &values[start], filtered, count);
+        dsp::absolute(filtered, filtered, count);
+
+        // The low-pass has to run at the full rate, only its output is decimated
+        dsp::biquad(lowPass1, filtered, filtered, count);
+        dsp::biquad(lowPass2, filtered, filtered, count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (++decimationIndex < decimation)
+            {
+                continue;
+            }
+            decimationIndex = 0;
+
+            if (envelopeIndex < envelopeLength)
+            {
+                envelopeReal[envelopeIndex++] = filtered[i];
+            }
+        }
+    }
+}
+
+void EnvelopeAnalyzer::computeSpectrum(float *spectrum)
+{
+    // Remove the envelope mean, otherwise the DC bin leaks over the low fault frequencies
+    float mean = 0.0f;
+    for (int i = 0; i < envelopeIndex; i++)
+    {
+        mean += envelopeReal[i];
+    }
+    mean = envelopeIndex > 0 ? mean / envelopeIndex : 0.0f;
+    for (int i = 0; i < envelopeIndex; i++)
+    {
+        envelopeReal[i] -= mean;
+    }
+
+    dsp::applyHannWindow(envelopeReal, envelopeLength);
+    dsp::fftRadix2(envelopeReal, envelopeImag, envelopeLength);
+    dsp::complexMagnitude(envelopeReal, envelopeImag, spectrum, samplerConfig->accOptions->envelopeNumBins);
+
+    // Single sided amplitude, corrected for the Hann window coherent gain (0.5)
+    const float scale = 4.0f / envelopeLength;
+    for (int i = 0; i < samplerConfig->accOptions->envelopeNumBins; i++)
+    {
+        spectrum[i] *= scale;
+    }
+}
@@ -0,0 +1,156 @@
+#include <Arduino.h>
+
+#include "goertzel.h"
+
+namespace
+{
+    // Pole of the DC blocker. Closer to 1 means a lower cut-off frequency
+    constexpr float dcBlockerPole = 0.995f;
+} // namespace
+
+GoertzelBank::GoertzelBank(SamplerConfig *_samplerConfig)
+    : samplerConfig(_samplerConfig),
+      numFrequencies(_samplerConfig->samplerOptions->sizeofGoertzelFrequencies),
+      blockSize(_samplerConfig->accOptions->accNumSamples),
+      coefficients(new float[_samplerConfig->samplerOptions->sizeofGoertzelFrequencies]),
+      s1(new float[_samplerConfig->samplerOptions->sizeofGoertzelFrequencies * 3]),
+      s2(new float[_samplerConfig->samplerOptions->sizeofGoertzelFrequencies * 3]),
+      powers(new float[_samplerConfig->samplerOptions->sizeofGoertzelFrequencies * 3]),
+      filtered(new float[dsp::blockSize])
+{
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+    {
+        Serial.println("Initializing Goertzel bank");
+    }
+
+    if (samplerConfig->accOptions->accSamplingFrequency == 0)
+    {
+        Serial.println("accSamplingFrequency is 0");
+        while (1)
+            ;
+    }
+
+    const float nyquist = samplerConfig->accOptions->accSamplingFrequency / 2.0f;
+    for (unsigned short i = 0; i < numFrequencies; i++)
+    {
+        const float frequency = samplerConfig->samplerOptions->goertzelFrequencies[i];
+        if (frequency <= 0.0f || frequency >= nyquist)
+        {
+            Serial.print("Goertzel frequency out of range (0, Nyquist): ");
+            Serial.println(frequency);
+            while (1)
+                ;
+        }
+
+        coefficients[i] = 2.0f * cosf(2.0f * PI * frequency / samplerConfig->accOptions->accSamplingFrequency);
+
+        if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+        {
+            Serial.print("Goertzel frequency (Hz), threshold (g): ");
+            Serial.print(frequency);
+            Serial.print(", ");
+            Serial.println(samplerConfig->samplerOptions->goertzelThresholds[i]);
+        }
+    }
+
+    reset();
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+    {
+        Serial.println("Goertzel bank initialized\n");
+    }
+}
+
+void GoertzelBank::reset()
+{
+    blockIndex = 0;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        dcBlockers[axis].setDcBlocker(dcBlockerPole);
+        dcBlockers[axis].reset();
+    }
+
+    for (int i = 0; i < numFrequencies * 3; i++)
+    {
+        s1[i] = 0.0f;
+        s2[i] = 0.0f;
+        powers[i] = 0.0f;
+    }
+}
+
+bool GoertzelBank::addSamples(const float *x, const float *y, const float *z, size_t length)
+{
+    const float *input[3] = {x, y, z};
+    bool isBlockComplete = false;
+
+    for (size_t start = 0; start < length;)
+    {
+        // Up to the end of the Goertzel block, so its powers only see its own samples
+        const size_t count = min(min(length - start, dsp::blockSize), static_cast<size_t>(blockSize - blockIndex));
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            dsp::biquad(dcBlockers[axis], &input[axis][start], filtered, count);
+            for (unsigned short i = 0; i < numFrequencies; i++)
+            {
+                dsp::goertzel(filtered, count, coefficients[i], &s1[i * 3 + axis], &s2[i * 3 + axis]);
+            }
+        }
+
+        start += count;
+        blockIndex += count;
+        if (blockIndex == blockSize)
+        {
+            completeBlock();
+            isBlockComplete = true;
+        }
+    }
+
+    return isBlockComplete;
+}
+
+void GoertzelBank::completeBlock()
+{
+    // Power is normalized so a sine of amplitude A gives A^2
+    const float normalization = 4.0f / (static_cast<float>(blockSize) * blockSize);
+    for (unsigned short i = 0; i < numFrequencies; i++)
+    {
+        const float coefficient = coefficients[i];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const int index = i * 3 + axis;
+            powers[index] = (s1[index] * s1[index] + s2[index] * s2[index] - coefficient * s1[index] * s2[index]) * normalization;
+            s1[index] = 0.0f;
+            s2[index] = 0.0f;
+        }
+    }
+    blockIndex = 0;
+}
+
+bool GoertzelBank::isTriggered()
+{
+    for (unsigned short i = 0; i < numFrequencies; i++)
+    {
+        // Thresholds are amplitudes, so compare them squared to avoid a sqrt per detector
+        const float threshold = samplerConfig->samplerOptions->goertzelThresholds[i];
+        const float thresholdSquared = threshold * threshold;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (powers[i * 3 + axis] > thresholdSquared)
+            {
+                if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+                {
+                    Serial.print("Goertzel triggered at (Hz): ");
+                    Serial.print(samplerConfig->samplerOptions->goertzelFrequencies[i]);
+                    Serial.print(" on axis: ");
+                    Serial.println(axis);
+                }
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
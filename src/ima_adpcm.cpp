@@ -0,0 +1,162 @@
+#include "ima_adpcm.h"
+
+namespace
+{
+    const int16_t stepTable[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+        50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+        337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+        2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+        15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+    const int8_t indexTable[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+    int clampStepIndex(int stepIndex)
+    {
+        return stepIndex < 0 ? 0 : (stepIndex > 88 ? 88 : stepIndex);
+    }
+
+    int32_t clampSample(int32_t sample)
+    {
+        return sample < INT16_MIN ? INT16_MIN : (sample > INT16_MAX ? INT16_MAX : sample);
+    }
+
+    // Shared by both sides, so the encoder tracks exactly what the decoder will reconstruct
+    void applyCode(uint8_t code, int32_t *predictor, int *stepIndex)
+    {
+        const int32_t step = stepTable[*stepIndex];
+        int32_t difference = step >> 3;
+        if (code & 4)
+            difference += step;
+        if (code & 2)
+            difference += step >> 1;
+        if (code & 1)
+            difference += step >> 2;
+        *predictor = clampSample(code & 8 ? *predictor - difference : *predictor + difference);
+        *stepIndex = clampStepIndex(*stepIndex + indexTable[code]);
+    }
+} // namespace
+
+size_t ima_adpcm::encodedSize(int numSamples)
+{
+    const int numFullBlocks = numSamples / samplesPerBlock;
+    const int remainder = numSamples % samplesPerBlock;
+    // The header holds the first sample of a block, the others take half a byte
+    return numFullBlocks * blockSize + (remainder > 0 ? blockHeaderSize + remainder / 2 : 0);
+}
+
+ima_adpcm::Encoder::Encoder()
+    : output(nullptr)
+{
+    size = 0;
+    predictor = 0;
+    stepIndex = 0;
+    blockPosition = 0;
+}
+
+void ima_adpcm::Encoder::begin(uint8_t *_output)
+{
+    output = _output;
+    size = 0;
+    predictor = 0;
+    stepIndex = 0;
+    blockPosition = 0;
+}
+
+void ima_adpcm::Encoder::setOutput(uint8_t *_output)
+{
+    output = _output;
+    size = 0;
+}
+
+void ima_adpcm::Encoder::add(const int16_t *samples, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (blockPosition == 0)
+        {
+            // Restart on the sample itself, keeping the step size the previous block adapted to
+            predictor = samples[i];
+            const uint16_t header = static_cast<uint16_t>(samples[i]);
+            output[size++] = static_cast<uint8_t>(header);
+            output[size++] = static_cast<uint8_t>(header >> 8);
+            output[size++] = static_cast<uint8_t>(stepIndex);
+            output[size++] = 0;
+            blockPosition = 1;
+            continue;
+        }
+
+        const int32_t step = stepTable[stepIndex];
+        int32_t difference = samples[i] - predictor;
+        uint8_t code = 0;
+        if (difference < 0)
+        {
+            code = 8;
+            difference = -difference;
+        }
+        if (difference >= step)
+        {
+            code |= 4;
+            difference -= step;
+        }
+        if (difference >= step >> 1)
+        {
+            code |= 2;
+            difference -= step >> 1;
+        }
+        if (difference >= step >> 2)
+        {
+            code |= 1;
+        }
+        applyCode(code, &predictor, &stepIndex);
+
+        // Odd positions start a byte in the low nibble
+        if (blockPosition & 1)
+            output[size++] = code;
+        else
+            output[size - 1] |= code << 4;
+
+        blockPosition = blockPosition + 1 == samplesPerBlock ? 0 : blockPosition + 1;
+    }
+}
+
+int ima_adpcm::decodeBlock(const uint8_t *block, size_t size, int16_t *samples)
+{
+    if (size < blockHeaderSize || size > blockSize || block[2] > 88)
+        return 0;
+
+    int32_t predictor = static_cast<int16_t>(block[0] | (block[1] << 8));
+    int stepIndex = block[2];
+    int numSamples = 0;
+    samples[numSamples++] = static_cast<int16_t>(predictor);
+    for (size_t i = blockHeaderSize; i < size; i++)
+    {
+        applyCode(block[i] & 0x0F, &predictor, &stepIndex);
+        samples[numSamples++] = static_cast<int16_t>(predictor);
+        applyCode(block[i] >> 4, &predictor, &stepIndex);
+        samples[numSamples++] = static_cast<int16_t>(predictor);
+    }
+    return numSamples;
+}
+
+bool ima_adpcm::decode(const uint8_t *input, size_t size, int16_t *samples, int numSamples)
+{
+    if (size != encodedSize(numSamples))
+        return false;
+
+    int16_t blockSamples[samplesPerBlock];
+    int decoded = 0;
+    for (size_t position = 0; position < size; position += blockSize)
+    {
+        const size_t length = size - position < blockSize ? size - position : blockSize;
+        const int count = decodeBlock(input + position, length, blockSamples);
+        if (count == 0)
+            return false;
+        // A short last block ends on a padding nibble when it has an even number of samples
+        for (int i = 0; i < count && decoded < numSamples; i++)
+        {
+            samples[decoded++] = blockSamples[i];
+        }
+    }
+    return decoded == numSamples;
+}
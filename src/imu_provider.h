@@ -16,6 +16,9 @@ namespace
   static float current_velocity[3] = {0.0f, 0.0f, 0.0f};
   static float current_gravity[3] = {0.0f, 0.0f, 0.0f};
   static float current_gyroscope_drift[3] = {0.0f, 0.0f, 0.0f};
+  static float current_magnetic_field[3] = {0.0f, 0.0f, 0.0f};
+  static bool has_magnetic_field = false;
+  static bool use_magnetometer = false;
 
   static int32_t stroke_length = 0;
   static uint8_t stroke_struct_buffer[stroke_struct_byte_count] = {};
@@ -23,21 +26,46 @@ namespace
   static int32_t *stroke_transmit_length = reinterpret_cast<int32_t *>(stroke_struct_buffer + sizeof(int32_t));
   static int8_t *stroke_points = reinterpret_cast<int8_t *>(stroke_struct_buffer + (sizeof(int32_t) * 2));
 
-  // A buffer holding the last 600 sets of 3-channel values from the accelerometer.
-  constexpr int acceleration_data_length = 600 * 3;
+  // The IMU samples read since the last update, the filter keeps its own state so no
+  // longer history is needed. Reads stop once this is full, leaving the rest in the FIFO.
+  constexpr int imu_pending_sample_count = 64;
+
+  // A buffer holding the pending 3-channel values from the accelerometer.
+  constexpr int acceleration_data_length = imu_pending_sample_count * 3;
   float acceleration_data[acceleration_data_length] = {};
   // The next free entry in the data array.
   int acceleration_data_index = 0;
   float acceleration_sample_rate = 0.0f;
 
-  // A buffer holding the last 600 sets of 3-channel values from the gyroscope.
-  constexpr int gyroscope_data_length = 600 * 3;
+  // A buffer holding the pending 3-channel values from the gyroscope, and the
+  // orientation and moving state the filter produced for each of them.
+  constexpr int gyroscope_data_length = imu_pending_sample_count * 3;
   float gyroscope_data[gyroscope_data_length] = {};
   float orientation_data[gyroscope_data_length] = {};
+  bool moving_data[imu_pending_sample_count] = {};
   // The next free entry in the data array.
   int gyroscope_data_index = 0;
+  // The entries in the data array already folded into the drift estimate.
+  int gyroscope_drift_index = 0;
   float gyroscope_sample_rate = 0.0f;
 
+  // Quaternion-based AHRS state (w, x, y, z), rotating the sensor frame into the world frame.
+  constexpr float ahrs_beta = 0.1f;
+  static float ahrs_quaternion[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+  static bool ahrs_initialized = false;
+  // Roll, pitch and yaw in degrees, unwrapped so strokes crossing +/-180 stay continuous.
+  static float current_orientation[3] = {0.0f, 0.0f, 0.0f};
+  // Exponentially weighted sum of the squared orientation steps over ~moving_sample_count samples.
+  static float moving_energy = 0.0f;
+  static int orientation_sample_count = 0;
+
+  // Compatibility path for UpdateStroke(): every stroke_transmit_stride-th orientation,
+  // which is exactly what a stroke of stroke_max_length samples gets projected from.
+  float orientation_history[stroke_transmit_max_length * 3] = {};
+  // The number of orientations stored, and of orientation samples seen, in the history.
+  int orientation_history_count = 0;
+  int orientation_push_count = 0;
+
   enum
   {
     eWaiting = 0,
@@ -45,7 +73,7 @@ namespace
     eDone = 2,
   };
 
-  void SetupIMU()
+  void SetupIMU(bool enable_magnetometer = false)
   {
 
     // Make sure we are pulling measurements into a FIFO.
@@ -55,6 +83,7 @@ namespace
 
     acceleration_sample_rate = IMU.accelerationSampleRate();
     gyroscope_sample_rate = IMU.gyroscopeSampleRate();
+    use_magnetometer = enable_magnetometer;
   }
 
   void ReadAccelerometerAndGyroscope(int *new_accelerometer_samples, int *new_gyroscope_samples)
@@ -63,7 +92,7 @@ namespace
     *new_accelerometer_samples = 0;
     *new_gyroscope_samples = 0;
     // Loop through new samples and add to buffer
-    while (IMU.accelerationAvailable())
+    while ((*new_gyroscope_samples < imu_pending_sample_count) && IMU.accelerationAvailable())
     {
       // Serial.println(">>> AVAILABLE <<<");
       const int gyroscope_index = (gyroscope_data_index % gyroscope_data_length);
@@ -97,7 +126,7 @@ namespace
     // Keep track of whether we stored any new data
     int new_samples = 0;
     // Loop through new samples and add to buffer
-    while (IMU.gyroscopeAvailable())
+    while ((new_samples < imu_pending_sample_count) && IMU.gyroscopeAvailable())
     {
       const int index = (gyroscope_data_index % gyroscope_data_length);
       gyroscope_data_index += 3;
@@ -108,11 +137,45 @@ namespace
         Serial.println("Failed to read gyroscope data");
         break;
       }
+      // Keep the accelerometer slots aligned, a zero vector makes the filter use the gyroscope only
+      float *acceleration = &acceleration_data[index];
+      acceleration[0] = 0.0f;
+      acceleration[1] = 0.0f;
+      acceleration[2] = 0.0f;
+      acceleration_data_index = gyroscope_data_index;
       new_samples += 1;
     }
     return new_samples;
   }
 
+  // The BMM150 is mounted rotated by 90 degrees about Z from the BMI270, and the library returns its axes as is.
+  // Its x axis is the BMI270 y axis and its y axis the BMI270 -x axis, Z is the same for both.
+  void MapMagnetometerToImuFrame(float mx, float my, float mz, float *field)
+  {
+    field[0] = -my;
+    field[1] = mx;
+    field[2] = mz;
+  }
+
+  bool ReadMagnetometer()
+  {
+    // The magnetometer runs slower than the accelerometer and gyroscope,
+    // so only the latest value is kept and reused until the next one.
+    if (!IMU.magneticFieldAvailable())
+    {
+      return false;
+    }
+    float mx, my, mz;
+    if (!IMU.readMagneticField(mx, my, mz))
+    {
+      Serial.println("Failed to read magnetic field data");
+      return false;
+    }
+    MapMagnetometerToImuFrame(mx, my, mz, current_magnetic_field);
+    has_magnetic_field = true;
+    return true;
+  }
+
   float VectorMagnitude(const float *vec)
   {
     const float x = vec[0];
@@ -134,36 +197,202 @@ namespace
 
   float DotProduct(const float *a, const float *b)
   {
-    return (a[0] * b[0], a[1] * b[1], a[2] * b[2]);
+    return (a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]);
   }
 
-  void EstimateGravityDirection(float *gravity)
+  void InitializeOrientation(float ax, float ay, float az)
+  {
+    // Start level with gravity instead of waiting for the filter to converge from identity.
+    const float roll = atan2f(ay, az);
+    const float pitch = atan2f(-ax, sqrtf((ay * ay) + (az * az)));
+    const float cr = cosf(roll * 0.5f);
+    const float sr = sinf(roll * 0.5f);
+    const float cp = cosf(pitch * 0.5f);
+    const float sp = sinf(pitch * 0.5f);
+    ahrs_quaternion[0] = cr * cp;
+    ahrs_quaternion[1] = sr * cp;
+    ahrs_quaternion[2] = cr * sp;
+    ahrs_quaternion[3] = -sr * sp;
+    ahrs_initialized = true;
+  }
+
+  void NormalizeQuaternion(float *q)
   {
-    int samples_to_average = 100;
-    if (samples_to_average >= acceleration_data_index)
+    const float recip_norm = 1.0f / sqrtf((q[0] * q[0]) + (q[1] * q[1]) + (q[2] * q[2]) + (q[3] * q[3]));
+    q[0] *= recip_norm;
+    q[1] *= recip_norm;
+    q[2] *= recip_norm;
+    q[3] *= recip_norm;
+  }
+
+  // Madgwick gradient-descent update, gyroscope in rad/s. A zero accelerometer
+  // vector skips the correction step.
+  void AhrsUpdate(float gx, float gy, float gz, float ax, float ay, float az, float dt)
+  {
+    float *q = ahrs_quaternion;
+    const float q0 = q[0];
+    const float q1 = q[1];
+    const float q2 = q[2];
+    const float q3 = q[3];
+
+    // Rate of change of the quaternion from the gyroscope.
+    float q_dot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float q_dot1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float q_dot2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float q_dot3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    const float acceleration_norm_squared = (ax * ax) + (ay * ay) + (az * az);
+    if (acceleration_norm_squared > 0.0f)
     {
-      samples_to_average = acceleration_data_index;
+      const float recip_norm = 1.0f / sqrtf(acceleration_norm_squared);
+      ax *= recip_norm;
+      ay *= recip_norm;
+      az *= recip_norm;
+
+      const float q0q0 = q0 * q0;
+      const float q1q1 = q1 * q1;
+      const float q2q2 = q2 * q2;
+      const float q3q3 = q3 * q3;
+
+      // Gradient of the error between the measured and the estimated gravity direction.
+      float s0 = 4.0f * q0 * q2q2 + 2.0f * q2 * ax + 4.0f * q0 * q1q1 - 2.0f * q1 * ay;
+      float s1 = 4.0f * q1 * q3q3 - 2.0f * q3 * ax + 4.0f * q0q0 * q1 - 2.0f * q0 * ay - 4.0f * q1 +
+                 8.0f * q1 * q1q1 + 8.0f * q1 * q2q2 + 4.0f * q1 * az;
+      float s2 = 4.0f * q0q0 * q2 + 2.0f * q0 * ax + 4.0f * q2 * q3q3 - 2.0f * q3 * ay - 4.0f * q2 +
+                 8.0f * q2 * q1q1 + 8.0f * q2 * q2q2 + 4.0f * q2 * az;
+      float s3 = 4.0f * q1q1 * q3 - 2.0f * q1 * ax + 4.0f * q2q2 * q3 - 2.0f * q2 * ay;
+      const float s_norm_squared = (s0 * s0) + (s1 * s1) + (s2 * s2) + (s3 * s3);
+      if (s_norm_squared > 0.0f)
+      {
+        const float recip_s_norm = 1.0f / sqrtf(s_norm_squared);
+        q_dot0 -= ahrs_beta * s0 * recip_s_norm;
+        q_dot1 -= ahrs_beta * s1 * recip_s_norm;
+        q_dot2 -= ahrs_beta * s2 * recip_s_norm;
+        q_dot3 -= ahrs_beta * s3 * recip_s_norm;
+      }
     }
 
-    const int start_index = ((acceleration_data_index + (acceleration_data_length - (3 * (samples_to_average + 1)))) % acceleration_data_length);
+    q[0] = q0 + q_dot0 * dt;
+    q[1] = q1 + q_dot1 * dt;
+    q[2] = q2 + q_dot2 * dt;
+    q[3] = q3 + q_dot3 * dt;
+    NormalizeQuaternion(q);
+  }
 
-    float x_total = 0.0f;
-    float y_total = 0.0f;
-    float z_total = 0.0f;
-    for (int i = 0; i < samples_to_average; ++i)
+  // Madgwick update that also corrects heading from the magnetometer. The magnetic
+  // field must be in the same sensor frame as the accelerometer and gyroscope, see MapMagnetometerToImuFrame().
+  void AhrsUpdateWithMagnetometer(float gx, float gy, float gz, float ax, float ay, float az,
+                                  float mx, float my, float mz, float dt)
+  {
+    const float acceleration_norm_squared = (ax * ax) + (ay * ay) + (az * az);
+    const float magnetic_norm_squared = (mx * mx) + (my * my) + (mz * mz);
+    if ((acceleration_norm_squared <= 0.0f) || (magnetic_norm_squared <= 0.0f))
     {
-      const int index = ((start_index + (i * 3)) % acceleration_data_length);
-      const float *entry = &acceleration_data[index];
-      const float x = entry[0];
-      const float y = entry[1];
-      const float z = entry[2];
-      x_total += x;
-      y_total += y;
-      z_total += z;
+      AhrsUpdate(gx, gy, gz, ax, ay, az, dt);
+      return;
+    }
+
+    float *q = ahrs_quaternion;
+    const float q0 = q[0];
+    const float q1 = q[1];
+    const float q2 = q[2];
+    const float q3 = q[3];
+
+    float q_dot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float q_dot1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float q_dot2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float q_dot3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    const float recip_acceleration_norm = 1.0f / sqrtf(acceleration_norm_squared);
+    ax *= recip_acceleration_norm;
+    ay *= recip_acceleration_norm;
+    az *= recip_acceleration_norm;
+    const float recip_magnetic_norm = 1.0f / sqrtf(magnetic_norm_squared);
+    mx *= recip_magnetic_norm;
+    my *= recip_magnetic_norm;
+    mz *= recip_magnetic_norm;
+
+    const float _2q0mx = 2.0f * q0 * mx;
+    const float _2q0my = 2.0f * q0 * my;
+    const float _2q0mz = 2.0f * q0 * mz;
+    const float _2q1mx = 2.0f * q1 * mx;
+    const float _2q0 = 2.0f * q0;
+    const float _2q1 = 2.0f * q1;
+    const float _2q2 = 2.0f * q2;
+    const float _2q3 = 2.0f * q3;
+    const float _2q0q2 = 2.0f * q0 * q2;
+    const float _2q2q3 = 2.0f * q2 * q3;
+    const float q0q0 = q0 * q0;
+    const float q0q1 = q0 * q1;
+    const float q0q2 = q0 * q2;
+    const float q0q3 = q0 * q3;
+    const float q1q1 = q1 * q1;
+    const float q1q2 = q1 * q2;
+    const float q1q3 = q1 * q3;
+    const float q2q2 = q2 * q2;
+    const float q2q3 = q2 * q3;
+    const float q3q3 = q3 * q3;
+
+    // Reference direction of the earth's magnetic field, in the world frame.
+    const float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+    const float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+    const float _2bx = sqrtf((hx * hx) + (hy * hy));
+    const float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+    const float _4bx = 2.0f * _2bx;
+    const float _4bz = 2.0f * _2bz;
+
+    // Residuals of the estimated minus the measured gravity and magnetic field directions.
+    const float fax = 2.0f * q1q3 - _2q0q2 - ax;
+    const float fay = 2.0f * q0q1 + _2q2q3 - ay;
+    const float faz = 1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az;
+    const float fmx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+    const float fmy = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+    const float fmz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+
+    float s0 = -_2q2 * fax + _2q1 * fay - _2bz * q2 * fmx + (-_2bx * q3 + _2bz * q1) * fmy + _2bx * q2 * fmz;
+    float s1 = _2q3 * fax + _2q0 * fay - 4.0f * q1 * faz + _2bz * q3 * fmx + (_2bx * q2 + _2bz * q0) * fmy +
+               (_2bx * q3 - _4bz * q1) * fmz;
+    float s2 = -_2q0 * fax + _2q3 * fay - 4.0f * q2 * faz + (-_4bx * q2 - _2bz * q0) * fmx +
+               (_2bx * q1 + _2bz * q3) * fmy + (_2bx * q0 - _4bz * q2) * fmz;
+    float s3 = _2q1 * fax + _2q2 * fay + (-_4bx * q3 + _2bz * q1) * fmx + (-_2bx * q0 + _2bz * q2) * fmy + _2bx * q1 * fmz;
+    const float s_norm_squared = (s0 * s0) + (s1 * s1) + (s2 * s2) + (s3 * s3);
+    if (s_norm_squared > 0.0f)
+    {
+      const float recip_s_norm = 1.0f / sqrtf(s_norm_squared);
+      q_dot0 -= ahrs_beta * s0 * recip_s_norm;
+      q_dot1 -= ahrs_beta * s1 * recip_s_norm;
+      q_dot2 -= ahrs_beta * s2 * recip_s_norm;
+      q_dot3 -= ahrs_beta * s3 * recip_s_norm;
+    }
+
+    q[0] = q0 + q_dot0 * dt;
+    q[1] = q1 + q_dot1 * dt;
+    q[2] = q2 + q_dot2 * dt;
+    q[3] = q3 + q_dot3 * dt;
+    NormalizeQuaternion(q);
+  }
+
+  float UnwrapDegrees(float angle, float previous)
+  {
+    while ((angle - previous) > 180.0f)
+    {
+      angle -= 360.0f;
     }
-    gravity[0] = x_total / samples_to_average;
-    gravity[1] = y_total / samples_to_average;
-    gravity[2] = z_total / samples_to_average;
+    while ((angle - previous) < -180.0f)
+    {
+      angle += 360.0f;
+    }
+    return angle;
+  }
+
+  void EstimateGravityDirection(float *gravity)
+  {
+    // The filter already tracks gravity, so this is O(1): rotate the world's
+    // up axis into the sensor frame, in g like the accelerometer values.
+    const float *q = ahrs_quaternion;
+    gravity[0] = 2.0f * ((q[1] * q[3]) - (q[0] * q[2]));
+    gravity[1] = 2.0f * ((q[0] * q[1]) + (q[2] * q[3]));
+    gravity[2] = (q[0] * q[0]) - (q[1] * q[1]) - (q[2] * q[2]) + (q[3] * q[3]);
   }
 
   void UpdateVelocity(int new_samples, float *gravity)
@@ -172,7 +401,7 @@ namespace
     const float gravity_y = gravity[1];
     const float gravity_z = gravity[2];
 
-    const int start_index = ((acceleration_data_index + (acceleration_data_length - (3 * (new_samples + 1)))) % acceleration_data_length);
+    const int start_index = ((acceleration_data_index + (acceleration_data_length - (3 * new_samples))) % acceleration_data_length);
 
     const float friction_fudge = 0.98f;
 
@@ -203,111 +432,155 @@ namespace
 
   void EstimateGyroscopeDrift(float *drift)
   {
-    // Estimate and update the drift of the gyroscope when the Ardiuno is not moving
+    // Estimate and update the drift of the gyroscope when the Ardiuno is not moving,
+    // folding in only the samples read since the last call with an exponential average.
+    // Samples far from the current estimate are rotation, not drift, and are skipped.
+    constexpr float drift_smoothing = 1.0f / 20.0f;
+    constexpr float drift_gate = 5.0f; // degrees per second
+
+    int new_samples = (gyroscope_data_index - gyroscope_drift_index) / 3;
+    gyroscope_drift_index = gyroscope_data_index;
+
     const bool isMoving = VectorMagnitude(current_velocity) > 0.1f;
-    if (isMoving)
+    if (isMoving || (new_samples == 0))
     {
       return;
     }
-    int samples_to_average = 20;
-    if (samples_to_average >= gyroscope_data_index)
+    if (new_samples > imu_pending_sample_count)
     {
-      samples_to_average = gyroscope_data_index;
+      new_samples = imu_pending_sample_count;
     }
 
-    const int start_index = ((gyroscope_data_index + (gyroscope_data_length - (3 * (samples_to_average + 1)))) % gyroscope_data_length);
+    const int start_index = ((gyroscope_data_index + (gyroscope_data_length - (3 * new_samples))) % gyroscope_data_length);
 
-    float x_total = 0.0f;
-    float y_total = 0.0f;
-    float z_total = 0.0f;
-    for (int i = 0; i < samples_to_average; ++i)
+    for (int i = 0; i < new_samples; ++i)
     {
       const int index = ((start_index + (i * 3)) % gyroscope_data_length);
       const float *entry = &gyroscope_data[index];
-      const float x = entry[0];
-      const float y = entry[1];
-      const float z = entry[2];
-      x_total += x;
-      y_total += y;
-      z_total += z;
+      const float dx = entry[0] - drift[0];
+      const float dy = entry[1] - drift[1];
+      const float dz = entry[2] - drift[2];
+      if (((dx * dx) + (dy * dy) + (dz * dz)) > (drift_gate * drift_gate))
+      {
+        continue;
+      }
+      drift[0] += dx * drift_smoothing;
+      drift[1] += dy * drift_smoothing;
+      drift[2] += dz * drift_smoothing;
     }
-    drift[0] = x_total / samples_to_average;
-    drift[1] = y_total / samples_to_average;
-    drift[2] = z_total / samples_to_average;
   }
 
   void UpdateOrientation(int new_samples, float *gravity, float *drift)
   {
-    // update the current orientation by integrating the angular velocity over time
+    // update the current orientation by fusing the drift-corrected angular velocity with
+    // the accelerometer (and magnetometer, if enabled) in the AHRS filter, one sample at a time
+    (void)gravity;
     const float drift_x = drift[0];
     const float drift_y = drift[1];
     const float drift_z = drift[2];
 
+    constexpr float moving_threshold = 10.0f;
+    constexpr float moving_decay = 1.0f - (1.0f / moving_sample_count);
+    constexpr float degrees_to_radians = PI / 180.0f;
+    constexpr float radians_to_degrees = 180.0f / PI;
+
     const int start_index = ((gyroscope_data_index + (gyroscope_data_length - (3 * new_samples))) % gyroscope_data_length);
 
-    // The gyroscope values are in degrees-per-second, so to approximate
-    // degrees in the integrated orientation, we need to divide each value
-    // by the number of samples each second.
+    // The gyroscope values are in degrees-per-second, the filter integrates
+    // over the time between two samples.
     const float recip_sample_rate = 1.0f / gyroscope_sample_rate;
 
     for (int i = 0; i < new_samples; ++i)
     {
       const int index = ((start_index + (i * 3)) % gyroscope_data_length);
       const float *entry = &gyroscope_data[index];
-      const float dx = entry[0];
-      const float dy = entry[1];
-      const float dz = entry[2];
+      const float *acceleration = &acceleration_data[index];
+
+      if (!ahrs_initialized && (VectorMagnitude(acceleration) > 0.0f))
+      {
+        InitializeOrientation(acceleration[0], acceleration[1], acceleration[2]);
+      }
 
       // Try to remove sensor errors from the raw gyroscope values.
-      const float dx_minus_drift = dx - drift_x;
-      const float dy_minus_drift = dy - drift_y;
-      const float dz_minus_drift = dz - drift_z;
-
-      // Convert from degrees-per-second to appropriate units for this
-      // time interval.
-      const float dx_normalized = dx_minus_drift * recip_sample_rate;
-      const float dy_normalized = dy_minus_drift * recip_sample_rate;
-      const float dz_normalized = dz_minus_drift * recip_sample_rate;
-
-      // Update orientation based on the gyroscope data.
-      float *current_orientation = &orientation_data[index];
-      const int previous_index = (index + (gyroscope_data_length - 3)) % gyroscope_data_length;
-      const float *previous_orientation = &orientation_data[previous_index];
-      current_orientation[0] = previous_orientation[0] + dx_normalized;
-      current_orientation[1] = previous_orientation[1] + dy_normalized;
-      current_orientation[2] = previous_orientation[2] + dz_normalized;
+      const float gx = (entry[0] - drift_x) * degrees_to_radians;
+      const float gy = (entry[1] - drift_y) * degrees_to_radians;
+      const float gz = (entry[2] - drift_z) * degrees_to_radians;
+
+      if (use_magnetometer && has_magnetic_field)
+      {
+        AhrsUpdateWithMagnetometer(gx, gy, gz, acceleration[0], acceleration[1], acceleration[2],
+                                   current_magnetic_field[0], current_magnetic_field[1], current_magnetic_field[2],
+                                   recip_sample_rate);
+      }
+      else
+      {
+        AhrsUpdate(gx, gy, gz, acceleration[0], acceleration[1], acceleration[2], recip_sample_rate);
+      }
+
+      // Convert the quaternion to roll, pitch and yaw for the stroke projection.
+      const float *q = ahrs_quaternion;
+      const float roll = atan2f(2.0f * ((q[0] * q[1]) + (q[2] * q[3])), 1.0f - 2.0f * ((q[1] * q[1]) + (q[2] * q[2])));
+      float sin_pitch = 2.0f * ((q[0] * q[2]) - (q[3] * q[1]));
+      sin_pitch = (sin_pitch > 1.0f) ? 1.0f : ((sin_pitch < -1.0f) ? -1.0f : sin_pitch);
+      const float pitch = asinf(sin_pitch);
+      const float yaw = atan2f(2.0f * ((q[0] * q[3]) + (q[1] * q[2])), 1.0f - 2.0f * ((q[2] * q[2]) + (q[3] * q[3])));
+
+      float next_orientation[3];
+      next_orientation[0] = UnwrapDegrees(roll * radians_to_degrees, current_orientation[0]);
+      next_orientation[1] = UnwrapDegrees(pitch * radians_to_degrees, current_orientation[1]);
+      next_orientation[2] = UnwrapDegrees(yaw * radians_to_degrees, current_orientation[2]);
+
+      // Running replacement for summing the squared orientation steps over the last
+      // moving_sample_count samples.
+      const float dx = next_orientation[0] - current_orientation[0];
+      const float dy = next_orientation[1] - current_orientation[1];
+      const float dz = next_orientation[2] - current_orientation[2];
+      const float mag_squared = (dx * dx) + (dy * dy) + (dz * dz);
+      moving_energy = (orientation_sample_count == 0) ? 0.0f : (moving_energy * moving_decay) + mag_squared;
+      orientation_sample_count += 1;
+
+      current_orientation[0] = next_orientation[0];
+      current_orientation[1] = next_orientation[1];
+      current_orientation[2] = next_orientation[2];
+
+      float *current_orientation_data = &orientation_data[index];
+      current_orientation_data[0] = next_orientation[0];
+      current_orientation_data[1] = next_orientation[1];
+      current_orientation_data[2] = next_orientation[2];
+      moving_data[index / 3] = (orientation_sample_count >= moving_sample_count) && (moving_energy > moving_threshold);
     }
   }
 
   bool IsMoving(int samples_before)
   {
-    // calculate if the Arduino is move using the mean squared difference
-    // of the current and previous gyroscope data
+    // Look up whether the Arduino was moving samples_before samples ago, as estimated by
+    // UpdateOrientation() from the energy of the orientation changes
     // Note: this is different from how we calulate isMoving in EstimateGyroscopeDrift()
-    constexpr float moving_threshold = 10.0f;
-
-    if ((gyroscope_data_index - samples_before) < moving_sample_count)
+    if ((samples_before >= imu_pending_sample_count) || (samples_before >= orientation_sample_count))
     {
       return false;
     }
 
-    const int start_index = ((gyroscope_data_index + (gyroscope_data_length - (3 * (moving_sample_count + samples_before)))) % gyroscope_data_length);
+    const int index = ((gyroscope_data_index + (gyroscope_data_length - (3 * (samples_before + 1)))) % gyroscope_data_length);
+    return moving_data[index / 3];
+  }
 
-    float total = 0.0f;
-    for (int i = 0; i < moving_sample_count; ++i)
+  void PushOrientationHistory(int samples_before)
+  {
+    // Keep every stroke_transmit_stride-th orientation, the only ones a stroke is projected from
+    orientation_push_count += 1;
+    if ((orientation_push_count % stroke_transmit_stride) != 0)
     {
-      const int index = ((start_index + (i * 3)) % gyroscope_data_length);
-      float *current_orientation = &orientation_data[index];
-      const int previous_index = (index + (gyroscope_data_length - 3)) % gyroscope_data_length;
-      const float *previous_orientation = &orientation_data[previous_index];
-      const float dx = current_orientation[0] - previous_orientation[0];
-      const float dy = current_orientation[1] - previous_orientation[1];
-      const float dz = current_orientation[2] - previous_orientation[2];
-      const float mag_squared = (dx * dx) + (dy * dy) + (dz * dz);
-      total += mag_squared;
+      return;
     }
-    const bool is_moving = (total > moving_threshold);
-    return is_moving;
+
+    const int index = ((gyroscope_data_index + (gyroscope_data_length - (3 * (samples_before + 1)))) % gyroscope_data_length);
+    const float *entry = &orientation_data[index];
+    float *history_entry = &orientation_history[(orientation_history_count % stroke_transmit_max_length) * 3];
+    history_entry[0] = entry[0];
+    history_entry[1] = entry[1];
+    history_entry[2] = entry[2];
+    orientation_history_count += 1;
   }
 
   void UpdateStroke(int new_samples, bool *done_just_triggered)
@@ -323,6 +596,7 @@ namespace
     for (int i = 0; i < new_samples; ++i)
     {
       const int current_head = (new_samples - (i + 1));
+      PushOrientationHistory(current_head);
       const bool is_moving = IsMoving(current_head);
       const int32_t old_state = *stroke_state;
 
@@ -370,31 +644,37 @@ namespace
 
       // Only recalculate the full stroke if it's needed.
       const bool draw_last_point = ((i == (new_samples - 1)) && (*stroke_state == eDrawing));
-      *done_just_triggered = ((old_state != eDone) && (*stroke_state == eDone));
-      if (!(*done_just_triggered || draw_last_point))
+      // A stroke can finish on any of the new samples, so remember it for the caller
+      const bool done_on_this_sample = ((old_state != eDone) && (*stroke_state == eDone));
+      *done_just_triggered = (*done_just_triggered || done_on_this_sample);
+      if (!(done_on_this_sample || draw_last_point))
       {
         Serial.println("continue...");
         continue;
       }
 
-      const int start_index = ((gyroscope_data_index + (gyroscope_data_length - (3 * (stroke_length + current_head)))) % gyroscope_data_length);
+      // The stroke is the last stroke_length samples, of which the history kept every stroke_transmit_stride-th
+      const int stroke_history_length = stroke_length / stroke_transmit_stride;
+      const int history_length = (stroke_history_length < orientation_history_count) ? stroke_history_length : orientation_history_count;
+      const int start_index = (orientation_history_count - history_length);
 
       // accumulate the x, y, and z orintation data
       float x_total = 0.0f;
       float y_total = 0.0f;
       float z_total = 0.0f;
-      for (int j = 0; j < stroke_length; ++j)
+      for (int j = 0; j < history_length; ++j)
       {
-        const int index = ((start_index + (j * 3)) % gyroscope_data_length);
-        const float *entry = &orientation_data[index];
+        const int index = (((start_index + j) % stroke_transmit_max_length) * 3);
+        const float *entry = &orientation_history[index];
         x_total += entry[0];
         y_total += entry[1];
         z_total += entry[2];
       }
 
-      const float x_mean = x_total / stroke_length;
-      const float y_mean = y_total / stroke_length;
-      const float z_mean = z_total / stroke_length;
+      const int mean_length = (history_length > 0) ? history_length : 1;
+      const float x_mean = x_total / mean_length;
+      const float y_mean = y_total / mean_length;
+      const float z_mean = z_total / mean_length;
       constexpr float range = 90.0f;
 
       // Account for the roll orientation of the Arduino
@@ -414,7 +694,7 @@ namespace
       const float yaxisz = -ngy;
       const float yaxisy = ngz;
 
-      *stroke_transmit_length = stroke_length / stroke_transmit_stride;
+      *stroke_transmit_length = history_length;
 
       // project the angular orientation into the 2d X/Y plane
       float x_min;
@@ -423,8 +703,8 @@ namespace
       float y_max;
       for (int j = 0; j < *stroke_transmit_length; ++j)
       {
-        const int orientation_index = ((start_index + ((j * stroke_transmit_stride) * 3)) % gyroscope_data_length);
-        const float *orientation_entry = &orientation_data[orientation_index];
+        const int orientation_index = (((start_index + j) % stroke_transmit_max_length) * 3);
+        const float *orientation_entry = &orientation_history[orientation_index];
 
         const float orientation_x = orientation_entry[0];
         const float orientation_y = orientation_entry[1];
@@ -493,7 +773,7 @@ namespace
       }
 
       // If the stroke is too small, cancel it.
-      if (*done_just_triggered)
+      if (done_on_this_sample)
       {
         const float x_range = (x_max - x_min);
         const float y_range = (y_max - y_min);
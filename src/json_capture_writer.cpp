@@ -0,0 +1,330 @@
+#include "json_capture_writer.h"
+#include "delta_codec.h"
+#include "ima_adpcm.h"
+
+JsonCaptureWriter::JsonCaptureWriter(SamplerConfig *_samplerConfig)
+    : samplerConfig(_samplerConfig),
+      accCounts(_samplerConfig->accOptions->accStorageMode == AccStorageMode::Packed ? new int16_t[_samplerConfig->accOptions->accNumSamples] : nullptr),
+      audioBlock(_samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm && !_samplerConfig->samplerOptions->hasWavAudio ? new int16_t[ima_adpcm::samplesPerBlock] : nullptr)
+{
+    audioPosition = 0;
+    audioBlockLength = 0;
+    audioBlockIndex = 0;
+    captureSection = CaptureSection::Head;
+    captureElement = 0;
+}
+
+void JsonCaptureWriter::begin(Print &output)
+{
+    json.begin(output);
+    json.beginObject();
+    json.key("samples");
+    json.beginArray();
+    captureSection = CaptureSection::Head;
+    captureElement = 0;
+}
+
+bool JsonCaptureWriter::writeCapture(const SampleDataPoint &sample, uint32_t maxSize)
+{
+    const size_t stepEnd = json.getSize() + maxSize;
+    while (captureSection != CaptureSection::Done)
+    {
+        if (json.getSize() >= stepEnd)
+        {
+            return false;
+        }
+
+        switch (captureSection)
+        {
+        case CaptureSection::Head:
+            writeHead(sample);
+            captureSection = sample.isCompact ? CaptureSection::Done : CaptureSection::AccX;
+            break;
+        case CaptureSection::AccX:
+        case CaptureSection::AccY:
+        case CaptureSection::AccZ:
+            if (!writeAccAxis(sample, static_cast<int>(captureSection) - static_cast<int>(CaptureSection::AccX), stepEnd))
+            {
+                return false;
+            }
+            captureSection = static_cast<CaptureSection>(static_cast<int>(captureSection) + 1);
+            break;
+        case CaptureSection::Tail:
+            captureSection = writeTail(sample) ? CaptureSection::Audio : CaptureSection::Done;
+            break;
+        case CaptureSection::Audio:
+            if (!writeAudio(sample, stepEnd))
+            {
+                return false;
+            }
+            captureSection = CaptureSection::Done;
+            break;
+        default:
+            captureSection = CaptureSection::Done;
+            break;
+        }
+    }
+    captureSection = CaptureSection::Head;
+    return true;
+}
+
+void JsonCaptureWriter::writeHead(const SampleDataPoint &sample)
+{
+    json.beginObject();
+    json.key("timestamp");
+    json.value(static_cast<uint32_t>(sample.timestamp));
+
+    if (samplerConfig->samplerOptions->hasStoreGate)
+    {
+        json.key("storeScore");
+        json.value(sample.storeScore);
+        json.key("compact");
+        json.value(sample.isCompact);
+    }
+    if (sample.isCompact)
+    {
+        // Routine capture, only its record is kept
+        if (samplerConfig->samplerOptions->hasInference)
+        {
+            json.key("modelClass");
+            json.value(static_cast<int32_t>(sample.modelClass));
+        }
+        addSummary("summaryX", sample.accSummaryX);
+        addSummary("summaryY", sample.accSummaryY);
+        addSummary("summaryZ", sample.accSummaryZ);
+        if (samplerConfig->samplerOptions->hasWavAudio)
+        {
+            // The WAV file is written whatever the store score
+            json.key("audioFile");
+            json.value(sample.audioFileName);
+        }
+        json.endObject();
+        return;
+    }
+
+    json.key("temperatureC");
+    json.value(sample.temperatureC);
+    json.key("pressureKpa");
+    json.value(sample.pressureKpa);
+    json.key("altitudeM");
+    json.value(sample.altitudeMeters);
+    json.key("movingStatus");
+    json.value(static_cast<int32_t>(sample.movingStatus));
+    json.key("movingDirection");
+    json.value(static_cast<int32_t>(sample.movingDirection));
+    json.key("movingSpeed");
+    json.value(sample.movingSpeed);
+
+    addSummary("summaryX", sample.accSummaryX);
+    addSummary("summaryY", sample.accSummaryY);
+    addSummary("summaryZ", sample.accSummaryZ);
+
+    if (samplerConfig->accOptions->accStorageMode == AccStorageMode::Peaks)
+    {
+        json.key("broadbandEnergyX");
+        json.value(sample.accBroadbandEnergyX);
+        json.key("broadbandEnergyY");
+        json.value(sample.accBroadbandEnergyY);
+        json.key("broadbandEnergyZ");
+        json.value(sample.accBroadbandEnergyZ);
+        addPeaks("peaksX", sample.accPeaksX);
+        addPeaks("peaksY", sample.accPeaksY);
+        addPeaks("peaksZ", sample.accPeaksZ);
+    }
+}
+
+bool JsonCaptureWriter::writeAccAxis(const SampleDataPoint &sample, int axis, size_t stepEnd)
+{
+    if (!samplerConfig->accOptions->hasRawAcc || samplerConfig->accOptions->accStorageMode == AccStorageMode::Peaks)
+    {
+        return true;
+    }
+
+    // One axis at a time, each array has to be complete before the next one starts
+    const bool isPacked = samplerConfig->accOptions->accStorageMode == AccStorageMode::Packed;
+    const int startElement = captureElement;
+    if (startElement == 0)
+    {
+        if (isPacked)
+        {
+            // Same array as Raw, unpacked once for all the calls writing it
+            const uint8_t *packed[3] = {sample.accPackedX, sample.accPackedY, sample.accPackedZ};
+            const uint32_t packedSizes[3] = {sample.accPackedSizeX, sample.accPackedSizeY, sample.accPackedSizeZ};
+            if (!delta_codec::decode(packed[axis], packedSizes[axis], accCounts, samplerConfig->accOptions->accNumSamples))
+            {
+                memset(accCounts, 0, samplerConfig->accOptions->accNumSamples * sizeof(int16_t));
+            }
+        }
+        const char *frequenciesKeys[3] = {"frequenciesX", "frequenciesY", "frequenciesZ"};
+        json.key(frequenciesKeys[axis]);
+        json.beginArray();
+    }
+
+    const double *frequencies[3] = {sample.accFrequenciesX, sample.accFequenciesY, sample.accFrequenciesZ};
+    const double gPerCount = 1.0 / samplerConfig->accOptions->accCountsPerG;
+    for (; captureElement < samplerConfig->accOptions->accNumSamples; captureElement++)
+    {
+        // At least one value per call, so a call that opened the array also moves past it
+        if (captureElement > startElement && json.getSize() >= stepEnd)
+        {
+            return false;
+        }
+        if (isPacked)
+            json.value(accCounts[captureElement] * gPerCount);
+        else
+            json.value(frequencies[axis][captureElement]);
+    }
+    json.endArray();
+    captureElement = 0;
+    return true;
+}
+
+bool JsonCaptureWriter::writeTail(const SampleDataPoint &sample)
+{
+    if (samplerConfig->accOptions->hasEnvelope)
+    {
+        json.key("envelopeBinHz");
+        json.value(static_cast<float>(samplerConfig->accOptions->accSamplingFrequency) / samplerConfig->accOptions->accNumSamples);
+        json.key("envelopeSpectrum");
+        json.beginArray();
+        for (int j = 0; j < samplerConfig->accOptions->envelopeNumBins; j++)
+        {
+            json.value(sample.envelopeSpectrum[j]);
+        }
+        json.endArray();
+    }
+
+    if (samplerConfig->samplerOptions->hasInference)
+    {
+        json.key("modelClass");
+        json.value(static_cast<int32_t>(sample.modelClass));
+        json.key("modelScore");
+        json.value(sample.modelScore);
+        json.key("modelScores");
+        json.beginArray();
+        for (int j = 0; j < samplerConfig->modelOptions->modelNumClasses; j++)
+        {
+            json.value(sample.modelScores[j]);
+        }
+        json.endArray();
+    }
+
+    json.key("audioLevelDbfs");
+    json.value(sample.audioLevelDbfs);
+    json.key("audioBackgroundDbfs");
+    json.value(sample.audioBackgroundDbfs);
+
+    if (samplerConfig->samplerOptions->hasWavAudio)
+    {
+        // Only the name of the capture's WAV file, an array of every sample is what this mode is for avoiding
+        json.key("audioFile");
+        json.value(sample.audioFileName);
+        json.endObject();
+        return false;
+    }
+
+    json.key("audioBuffer");
+    json.beginArray();
+    return true;
+}
+
+bool JsonCaptureWriter::writeAudio(const SampleDataPoint &sample, size_t stepEnd)
+{
+    const int startElement = captureElement;
+    if (samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm)
+    {
+        // Same array as Pcm, decoded a block at a time
+        if (startElement == 0)
+        {
+            audioPosition = 0;
+            audioBlockLength = 0;
+            audioBlockIndex = 0;
+        }
+        while (captureElement < samplerConfig->micOptions->micNumSamples)
+        {
+            if (audioBlockIndex == audioBlockLength)
+            {
+                if (audioPosition >= sample.audioAdpcmSize)
+                {
+                    break;
+                }
+                const size_t length = min(sample.audioAdpcmSize - audioPosition, static_cast<uint32_t>(ima_adpcm::blockSize));
+                audioBlockLength = ima_adpcm::decodeBlock(sample.audioAdpcm + audioPosition, length, audioBlock);
+                audioBlockIndex = 0;
+                audioPosition += ima_adpcm::blockSize;
+                continue;
+            }
+            // At least one value per call, so every call moves on
+            if (captureElement > startElement && json.getSize() >= stepEnd)
+            {
+                return false;
+            }
+            json.value(static_cast<int32_t>(audioBlock[audioBlockIndex++]));
+            captureElement++;
+        }
+    }
+    else
+    {
+        for (; captureElement < samplerConfig->micOptions->micNumSamples; captureElement++)
+        {
+            if (captureElement > startElement && json.getSize() >= stepEnd)
+            {
+                return false;
+            }
+            json.value(static_cast<int32_t>(sample.audioBuffer[captureElement]));
+        }
+    }
+    json.endArray();
+    json.endObject();
+    captureElement = 0;
+    return true;
+}
+
+bool JsonCaptureWriter::end()
+{
+    json.endArray();
+    json.endObject();
+
+    if (!json.flush())
+    {
+        Serial.println("Failed to write the JSON file");
+        return false;
+    }
+    return true;
+}
+
+void JsonCaptureWriter::addSummary(const char *key, const AxisSummary &summary)
+{
+    json.key(key);
+    json.beginObject();
+    json.key("mean");
+    json.value(summary.mean);
+    json.key("rms");
+    json.value(summary.rms);
+    json.key("peak");
+    json.value(summary.peak);
+    json.key("peakToPeak");
+    json.value(summary.peakToPeak);
+    json.key("crestFactor");
+    json.value(summary.crestFactor);
+    json.key("skewness");
+    json.value(summary.skewness);
+    json.key("kurtosis");
+    json.value(summary.kurtosis);
+    json.endObject();
+}
+
+void JsonCaptureWriter::addPeaks(const char *key, const SpectralPeak *peaks)
+{
+    json.key(key);
+    json.beginArray();
+    for (int j = 0; j < samplerConfig->accOptions->accNumPeaks; j++)
+    {
+        json.beginArray();
+        json.value(peaks[j].frequencyHz);
+        json.value(peaks[j].magnitude);
+        json.value(peaks[j].bin);
+        json.endArray();
+    }
+    json.endArray();
+}
@@ -0,0 +1,261 @@
+#include <math.h>
+
+#include "json_stream_writer.h"
+
+namespace
+{
+    const uint32_t powersOf10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+}
+
+void JsonStreamWriter::begin(Print &_output)
+{
+    output = &_output;
+    bufferLength = 0;
+    numUnwritten = 0;
+    size = 0;
+    depth = 0;
+    isAfterKey = false;
+    hasValue[0] = false;
+}
+
+void JsonStreamWriter::put(char c)
+{
+    if (bufferLength == bufferSize)
+    {
+        flush();
+    }
+    buffer[bufferLength++] = c;
+    size++;
+}
+
+void JsonStreamWriter::put(const char *text, int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        put(text[i]);
+    }
+}
+
+bool JsonStreamWriter::flush()
+{
+    if (bufferLength > 0)
+    {
+        const size_t written = output->write(reinterpret_cast<const uint8_t *>(buffer), bufferLength);
+        numUnwritten += bufferLength - written;
+        bufferLength = 0;
+    }
+    return numUnwritten == 0;
+}
+
+void JsonStreamWriter::separate()
+{
+    if (isAfterKey)
+    {
+        isAfterKey = false;
+        return;
+    }
+    if (hasValue[depth])
+    {
+        put(',');
+    }
+    hasValue[depth] = true;
+}
+
+void JsonStreamWriter::beginObject()
+{
+    separate();
+    put('{');
+    hasValue[++depth] = false;
+}
+
+void JsonStreamWriter::endObject()
+{
+    depth--;
+    put('}');
+}
+
+void JsonStreamWriter::beginArray()
+{
+    separate();
+    put('[');
+    hasValue[++depth] = false;
+}
+
+void JsonStreamWriter::endArray()
+{
+    depth--;
+    put(']');
+}
+
+void JsonStreamWriter::key(const char *name)
+{
+    separate();
+    put('"');
+    put(name, strlen(name));
+    put('"');
+    put(':');
+    isAfterKey = true;
+}
+
+void JsonStreamWriter::value(const char *text)
+{
+    separate();
+    put('"');
+    put(text, strlen(text));
+    put('"');
+}
+
+void JsonStreamWriter::putUnsigned(uint32_t number)
+{
+    // Digits come out backwards
+    char digits[10];
+    int length = 0;
+    do
+    {
+        digits[length++] = '0' + number % 10;
+        number /= 10;
+    } while (number != 0);
+
+    while (length > 0)
+    {
+        put(digits[--length]);
+    }
+}
+
+void JsonStreamWriter::value(int32_t number)
+{
+    separate();
+    if (number < 0)
+    {
+        put('-');
+        putUnsigned(static_cast<uint32_t>(-(number + 1)) + 1);
+    }
+    else
+    {
+        putUnsigned(number);
+    }
+}
+
+void JsonStreamWriter::value(uint32_t number)
+{
+    separate();
+    putUnsigned(number);
+}
+
+void JsonStreamWriter::value(bool boolean)
+{
+    separate();
+    if (boolean)
+        put("true", 4);
+    else
+        put("false", 5);
+}
+
+void JsonStreamWriter::value(float number)
+{
+    separate();
+    putFloat(number, 7);
+}
+
+void JsonStreamWriter::value(double number)
+{
+    separate();
+    putFloat(number, 9);
+}
+
+void JsonStreamWriter::putFloat(double number, int significantDigits)
+{
+    if (isnan(number) || isinf(number))
+    {
+        put("null", 4);
+        return;
+    }
+    if (number < 0)
+    {
+        put('-');
+        number = -number;
+    }
+    if (number == 0.0)
+    {
+        put('0');
+        return;
+    }
+
+    // Scientific notation outside of the range the integer part fits
+    int exponent = 0;
+    const bool isScientific = number >= 1e9 || number < 1e-5;
+    if (isScientific)
+    {
+        while (number >= 10.0)
+        {
+            number /= 10.0;
+            exponent++;
+        }
+        while (number < 1.0)
+        {
+            number *= 10.0;
+            exponent--;
+        }
+    }
+
+    uint32_t integral = static_cast<uint32_t>(number);
+    int integralDigits = 1;
+    while (integralDigits < 10 && integral >= powersOf10[integralDigits])
+    {
+        integralDigits++;
+    }
+    int decimals = integral > 0 ? significantDigits - integralDigits : significantDigits;
+    if (integral == 0)
+    {
+        // Leading zeros of the fraction aren't significant
+        for (double scaled = number * 10.0; scaled < 1.0 && decimals < 9; scaled *= 10.0)
+        {
+            decimals++;
+        }
+    }
+    if (decimals < 0)
+    {
+        // More integer digits than significant ones, they're all kept
+        decimals = 0;
+    }
+
+    uint32_t fraction = static_cast<uint32_t>(lround((number - integral) * powersOf10[decimals]));
+    if (fraction >= powersOf10[decimals])
+    {
+        // Rounded up into the integer part
+        fraction -= powersOf10[decimals];
+        integral++;
+        if (isScientific && integral == 10)
+        {
+            integral = 1;
+            exponent++;
+        }
+    }
+    putUnsigned(integral);
+
+    if (fraction > 0)
+    {
+        while (fraction % 10 == 0)
+        {
+            fraction /= 10;
+            decimals--;
+        }
+        put('.');
+        for (int i = decimals - 1; i > 0 && fraction < powersOf10[i]; i--)
+        {
+            put('0');
+        }
+        putUnsigned(fraction);
+    }
+
+    if (isScientific)
+    {
+        put('e');
+        if (exponent < 0)
+        {
+            put('-');
+            exponent = -exponent;
+        }
+        putUnsigned(exponent);
+    }
+}
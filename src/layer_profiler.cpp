@@ -0,0 +1,61 @@
+#include <Arduino.h>
+
+#include "layer_profiler.h"
+
+uint32_t LayerProfiler::BeginEvent(const char *tag)
+{
+    if (numEvents >= maxEvents)
+    {
+        return maxEvents;
+    }
+
+    tags[numEvents] = tag;
+    durationUs[numEvents] = 0;
+    startUs[numEvents] = micros();
+    return numEvents++;
+}
+
+void LayerProfiler::EndEvent(uint32_t eventHandle)
+{
+    if (eventHandle >= static_cast<uint32_t>(numEvents))
+    {
+        return;
+    }
+
+    durationUs[eventHandle] = micros() - startUs[eventHandle];
+}
+
+void LayerProfiler::reset()
+{
+    numEvents = 0;
+}
+
+void LayerProfiler::print()
+{
+    const unsigned long totalUs = getTotalUs();
+    for (int i = 0; i < numEvents; i++)
+    {
+        Serial.print("  ");
+        Serial.print(i);
+        Serial.print(" ");
+        Serial.print(tags[i]);
+        Serial.print(": ");
+        Serial.print(durationUs[i]);
+        Serial.print(" us (");
+        Serial.print(totalUs > 0 ? 100.0f * durationUs[i] / totalUs : 0.0f, 1);
+        Serial.println("%)");
+    }
+    Serial.print("  Total: ");
+    Serial.print(totalUs);
+    Serial.println(" us");
+}
+
+unsigned long LayerProfiler::getTotalUs()
+{
+    unsigned long totalUs = 0;
+    for (int i = 0; i < numEvents; i++)
+    {
+        totalUs += durationUs[i];
+    }
+    return totalUs;
+}
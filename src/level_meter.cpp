@@ -0,0 +1,48 @@
+#include <math.h>
+
+#include "level_meter.h"
+#include "dsp_kernels.h"
+
+namespace
+{
+    constexpr float fullScaleSquared = 32768.0f * 32768.0f;
+    // Floor for silent blocks, so the log never sees 0
+    constexpr float minMeanSquare = 1e-12f;
+} // namespace
+
+void LevelMeter::configure(int samplingRate, float shortTermSeconds, float longTermSeconds)
+{
+    shortTermCoefficient = 1.0f / (shortTermSeconds * samplingRate);
+    longTermCoefficient = 1.0f / (longTermSeconds * samplingRate);
+    shortTermMeanSquare = minMeanSquare;
+    longTermMeanSquare = minMeanSquare;
+}
+
+void LevelMeter::update(const int16_t *samples, size_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    const float blockMeanSquare = static_cast<float>(dsp::energyQ15(samples, length)) / (fullScaleSquared * length);
+
+    // First order approximation of 1 - exp(-length / (tau * rate)), good while a block is shorter than tau
+    float shortTermAlpha = shortTermCoefficient * length;
+    float longTermAlpha = longTermCoefficient * length;
+    shortTermAlpha = shortTermAlpha > 1.0f ? 1.0f : shortTermAlpha;
+    longTermAlpha = longTermAlpha > 1.0f ? 1.0f : longTermAlpha;
+
+    shortTermMeanSquare = shortTermMeanSquare + shortTermAlpha * (blockMeanSquare - shortTermMeanSquare);
+    longTermMeanSquare = longTermMeanSquare + longTermAlpha * (blockMeanSquare - longTermMeanSquare);
+}
+
+float LevelMeter::toDbfs(float meanSquare)
+{
+    return 10.0f * log10f(meanSquare > minMeanSquare ? meanSquare : minMeanSquare);
+}
+
+float LevelMeter::fromDbfs(float dbfs)
+{
+    return powf(10.0f, dbfs / 10.0f);
+}
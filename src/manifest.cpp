@@ -0,0 +1,150 @@
+#include "manifest.h"
+#include "checksum.h"
+
+Manifest::Manifest(SamplerConfig *_samplerConfig)
+    : samplerConfig(_samplerConfig)
+{
+    bootCount = 0;
+    sequence = 0;
+    directoryIndex = UINT32_MAX;
+}
+
+bool Manifest::begin()
+{
+    // Not FILE_WRITE, its O_APPEND would add a count after the previous one instead of replacing it
+    File bootCountFile = SD.open(capture_format::bootCountFileName, O_RDWR | O_CREAT);
+    if (!bootCountFile)
+    {
+        Serial.println("Failed to open the boot count file");
+        return false;
+    }
+    uint32_t previousBootCount = 0;
+    if (bootCountFile.read(&previousBootCount, sizeof(previousBootCount)) != sizeof(previousBootCount))
+    {
+        previousBootCount = 0;
+    }
+    bootCount = previousBootCount + 1;
+    const bool isCounted = bootCountFile.seek(0) &&
+                           bootCountFile.write(reinterpret_cast<const uint8_t *>(&bootCount), sizeof(bootCount)) == sizeof(bootCount);
+    bootCountFile.close();
+    if (!isCounted)
+    {
+        Serial.println("Failed to write the boot count file");
+        return false;
+    }
+
+    if (!SD.exists(capture_format::manifestFileName))
+    {
+        File manifestFile = SD.open(capture_format::manifestFileName, FILE_WRITE);
+        capture_format::ManifestHeader header;
+        header.magic = capture_format::manifestMagic;
+        header.version = capture_format::manifestVersion;
+        header.entrySize = sizeof(capture_format::ManifestEntry);
+        const bool isCreated = manifestFile && manifestFile.write(reinterpret_cast<const uint8_t *>(&header), sizeof(header)) == sizeof(header);
+        manifestFile.close();
+        if (!isCreated)
+        {
+            Serial.println("Failed to create the capture manifest");
+            return false;
+        }
+    }
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+    {
+        Serial.print("Boot ");
+        Serial.print(bootCount);
+        Serial.println(" on this SD card");
+    }
+    return true;
+}
+
+bool Manifest::nextFilePath(const char *extension, char *path, uint32_t *fileSequence)
+{
+    // 8.3 names, e.g. B00012/S003/00000771.BIN, so at most 7 digits of boot count and 8 of sequence
+    const unsigned long boot = bootCount;
+    const unsigned long next = sequence + 1;
+    if (boot > 9999999 || next > 99999999)
+    {
+        Serial.println("Failed to name the file, every 8.3 name of the boot is used");
+        return false;
+    }
+    sequence = next;
+
+    char directory[capture_format::maxPathLength + 1];
+    snprintf(directory, sizeof(directory), "B%05lu/S%03lu", boot, next / capture_format::filesPerDirectory);
+    if (sequence / capture_format::filesPerDirectory != directoryIndex)
+    {
+        if (!SD.exists(directory) && !SD.mkdir(directory))
+        {
+            Serial.print("Failed to create the directory ");
+            Serial.println(directory);
+            return false;
+        }
+        directoryIndex = sequence / capture_format::filesPerDirectory;
+    }
+
+    snprintf(path, capture_format::maxPathLength + 1, "B%05lu/S%03lu/%08lu.%.3s", boot, next / capture_format::filesPerDirectory, next, extension);
+    if (fileSequence != nullptr)
+    {
+        *fileSequence = sequence;
+    }
+    return true;
+}
+
+bool Manifest::append(const char *path, uint32_t fileSequence, uint32_t payloadOffset, uint32_t payloadSize,
+                      const SampleDataPoint *captures, const uint32_t *captureOffsets, int numCaptures)
+{
+    capture_format::ManifestEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.magic = capture_format::manifestEntryMagic;
+    strncpy(entry.path, path, capture_format::maxPathLength);
+    entry.bootCount = bootCount;
+    entry.sequence = fileSequence;
+    entry.payloadOffset = payloadOffset;
+    entry.payloadSize = payloadSize;
+    entry.numCaptures = numCaptures;
+    entry.fileFormat = static_cast<uint8_t>(samplerConfig->samplerOptions->fileFormat);
+    if (numCaptures > 0)
+    {
+        entry.firstTimestamp = captures[0].timestamp;
+        entry.lastTimestamp = captures[numCaptures - 1].timestamp;
+    }
+    for (int i = 0; i < numCaptures; i++)
+    {
+        entry.movingStatuses |= 1 << static_cast<int>(captures[i].movingStatus);
+    }
+
+    // The trigger checkTriggers() goes by, in its order
+    Triggers trigger = Triggers::Interval;
+    if (samplerConfig->samplerOptions->hasIntervalTrigger)
+        trigger = Triggers::Interval;
+    else if (samplerConfig->samplerOptions->hasMovementTrigger)
+        trigger = Triggers::Movement;
+    else if (samplerConfig->samplerOptions->hasAccRawTrigger)
+        trigger = Triggers::AccRaw;
+    else if (samplerConfig->samplerOptions->hasMicTrigger)
+        trigger = Triggers::Microphone;
+    else if (samplerConfig->samplerOptions->hasGoertzelTrigger)
+        trigger = Triggers::AccGoertzel;
+    entry.trigger = static_cast<uint8_t>(trigger);
+
+    const size_t offsetsSize = numCaptures * sizeof(uint32_t);
+    entry.crc = checksum::crc32(captureOffsets, offsetsSize, checksum::crc32(&entry, sizeof(entry)));
+
+    // Opened for each entry, so closing it updates the directory entry and a reset loses at most the entry being written
+    File manifestFile = SD.open(capture_format::manifestFileName, FILE_WRITE);
+    if (!manifestFile)
+    {
+        Serial.println("Failed to open the capture manifest");
+        return false;
+    }
+    const bool isWritten = manifestFile.write(reinterpret_cast<const uint8_t *>(&entry), sizeof(entry)) == sizeof(entry) &&
+                           manifestFile.write(reinterpret_cast<const uint8_t *>(captureOffsets), offsetsSize) == offsetsSize;
+    manifestFile.close();
+    if (!isWritten)
+    {
+        Serial.println("Failed to write the capture manifest entry");
+        return false;
+    }
+    return true;
+}
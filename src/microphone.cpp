@@ -1,27 +1,36 @@
 #include <Arduino.h>
 
 #include "microphone.h"
+#include "level_meter.h"
 #include "PDM.h"
 
 namespace microphone
 {
+    // Time constants of the level meter in seconds
+    constexpr float shortTermLevelSeconds = 0.125f;
+    constexpr float longTermLevelSeconds = 10.0f;
+
     // Create static buffer for PDM samples
     int16_t *localTempAudioBuffer;
     // Whether new data is available
     volatile bool hasNewData = false;
+    // Updated on every PDM block, so the level is always current even when the buffer isn't being copied
+    LevelMeter levelMeter;
 
     void onPDMdataCallback()
     {
         int bytesAvailable = PDM.available();
         PDM.read(localTempAudioBuffer, bytesAvailable);
+        levelMeter.update(localTempAudioBuffer, bytesAvailable / sizeof(int16_t));
         hasNewData = true;
     }
 } // namespace
 
-Microphone::Microphone(SampleDataPoint *_sampleDataPoint, SamplerConfig *_samplerConfig)
+Microphone::Microphone(SampleDataPoint *_sampleDataPoint, SamplerConfig *_samplerConfig, Manifest *_manifest)
     : sampleDataPoint(_sampleDataPoint),
       samplerConfig(_samplerConfig),
-      tempAudioBuffer(new int16_t[tempBufferSize])
+      tempAudioBuffer(new int16_t[tempBufferSize]),
+      manifest(_manifest)
 {
     if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
     {
@@ -46,17 +55,33 @@ Microphone::Microphone(SampleDataPoint *_sampleDataPoint, SamplerConfig *_sample
         samplerConfig->micOptions->micNumSamples = round(static_cast<double>(samplerConfig->micOptions->micSamplingRate * samplerConfig->micOptions->micSamplingLengthMs) / 1000);
     }
     // Re-initialize the sampleDataPoint audio buffer here because micNumSamples is now known
-    sampleDataPoint->audioBuffer = new int16_t[samplerConfig->micOptions->micNumSamples];
+    if (samplerConfig->samplerOptions->hasWavAudio)
+    {
+        // The audio goes straight to the file, the sample data point only has its name
+        wavWriter = new WavWriter(samplerConfig);
+    }
+    else if (samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm)
+    {
+        sampleDataPoint->audioAdpcm = new uint8_t[ima_adpcm::encodedSize(samplerConfig->micOptions->micNumSamples)];
+    }
+    else
+    {
+        sampleDataPoint->audioBuffer = new int16_t[samplerConfig->micOptions->micNumSamples];
+    }
 
     // Set the static buffer to the local buffer so the static callback can access it
     microphone::localTempAudioBuffer = tempAudioBuffer;
 
+    microphone::levelMeter.configure(samplerConfig->micOptions->micSamplingRate, microphone::shortTermLevelSeconds, microphone::longTermLevelSeconds);
+    attackMeanSquare = LevelMeter::fromDbfs(samplerConfig->samplerOptions->micAttackDbfs);
+    releaseMeanSquare = LevelMeter::fromDbfs(samplerConfig->samplerOptions->micReleaseDbfs);
+
     PDM.onReceive(microphone::onPDMdataCallback);
 
-    // For mic trigger, the PDM will be always on
+    // For mic trigger, the PDM will be always on. The capture, and its WAV file, only starts with startAudioSampling()
     if (samplerConfig->samplerOptions->hasMicTrigger)
     {
-        startAudioSampling();
+        startPdm();
     }
 
     if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
@@ -73,15 +98,37 @@ void Microphone::startAudioSampling()
         Serial.println("Sampling audio from microphone...");
     }
 
-    if (samplerConfig->samplerOptions->hasIntervalTrigger)
+    sampleIndex = 0;
+    if (samplerConfig->samplerOptions->hasWavAudio)
     {
-        if (!PDM.begin(1, samplerConfig->micOptions->micSamplingRate))
+        if (!manifest->nextFilePath("wav", sampleDataPoint->audioFileName) || !wavWriter->begin(sampleDataPoint->audioFileName))
         {
-            Serial.println("Failed to start PDM!");
-            while (1)
-                ;
+            Serial.println("Failed to create the WAV file");
+            sampleDataPoint->audioFileName[0] = '\0';
         }
     }
+    else if (samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm)
+    {
+        adpcmEncoder.begin(sampleDataPoint->audioAdpcm);
+    }
+
+    // With the mic trigger the PDM is already running since the constructor
+    startPdm();
+}
+
+void Microphone::startPdm()
+{
+    if (isPdmRunning)
+    {
+        return;
+    }
+    if (!PDM.begin(1, samplerConfig->micOptions->micSamplingRate))
+    {
+        Serial.println("Failed to start PDM!");
+        while (1)
+            ;
+    }
+    isPdmRunning = true;
 }
 
 void Microphone::stopAudioSampling()
@@ -89,11 +136,43 @@ void Microphone::stopAudioSampling()
     // Call bufferCallback one last time to get the remaining samples before stopping PDM
     bufferCallback();
 
+    if (samplerConfig->samplerOptions->hasWavAudio)
+    {
+        // Like the other modes, samples the PDM didn't deliver in time are silence
+        static const int16_t silence[32] = {};
+        while (sampleIndex < samplerConfig->micOptions->micNumSamples)
+        {
+            const int count = min(samplerConfig->micOptions->micNumSamples - sampleIndex, 32);
+            wavWriter->add(silence, count);
+            sampleIndex += count;
+        }
+        if (sampleDataPoint->audioFileName[0] != '\0' && !wavWriter->end())
+        {
+            Serial.println("Failed to write the WAV file");
+        }
+    }
+    else if (samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm)
+    {
+        // Samples the PDM didn't deliver in time are silence, like the zeros left in a reset PCM buffer
+        static const int16_t silence[32] = {};
+        while (sampleIndex < samplerConfig->micOptions->micNumSamples)
+        {
+            const int count = min(samplerConfig->micOptions->micNumSamples - sampleIndex, 32);
+            adpcmEncoder.add(silence, count);
+            sampleIndex += count;
+        }
+        sampleDataPoint->audioAdpcmSize = adpcmEncoder.getSize();
+    }
+
     if (!samplerConfig->samplerOptions->hasMicTrigger)
     {
         PDM.end();
+        isPdmRunning = false;
     }
 
+    sampleDataPoint->audioLevelDbfs = getShortTermDbfs();
+    sampleDataPoint->audioBackgroundDbfs = getLongTermDbfs();
+
     if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
     {
         Serial.println("Audio from microphone sampled\n");
@@ -102,7 +181,8 @@ void Microphone::stopAudioSampling()
 
 /**
  * Used for both Interval and Microphone triggers.
- * Copy the tempAudioBuffer to the sampleDataPoint audioBuffer on each callback.
+ * Copy the tempAudioBuffer to the sampleDataPoint audioBuffer on each callback, or encode it with the ImaAdpcm encoding,
+ * or append it to the WAV file.
  */
 void Microphone::bufferCallback()
 {
@@ -111,9 +191,25 @@ void Microphone::bufferCallback()
 
     microphone::hasNewData = false;
 
-    for (int i = 0; i < tempBufferSize && sampleIndex < samplerConfig->micOptions->micNumSamples; i++)
+    if (samplerConfig->samplerOptions->hasWavAudio)
+    {
+        // At most a sector write per PDM block
+        const int count = min(static_cast<int>(tempBufferSize), samplerConfig->micOptions->micNumSamples - sampleIndex);
+        wavWriter->add(tempAudioBuffer, count);
+        sampleIndex += count;
+    }
+    else if (samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm)
     {
-        sampleDataPoint->audioBuffer[sampleIndex++] = tempAudioBuffer[i];
+        const int count = min(static_cast<int>(tempBufferSize), samplerConfig->micOptions->micNumSamples - sampleIndex);
+        adpcmEncoder.add(tempAudioBuffer, count);
+        sampleIndex += count;
+    }
+    else
+    {
+        for (int i = 0; i < tempBufferSize && sampleIndex < samplerConfig->micOptions->micNumSamples; i++)
+        {
+            sampleDataPoint->audioBuffer[sampleIndex++] = tempAudioBuffer[i];
+        }
     }
 
     // Reset the temp buffer
@@ -125,22 +221,43 @@ void Microphone::bufferCallback()
 
 /**
  * Used only with the Microphone trigger.
- * Microphone has a particular way to check for triggers.
- * Check if the microphone has new data and if the audioBufferSizeTrigger is equal or greater than tempAudioBuffer
- *
- * @todo Add more mic trigger conditions, such as min decibels
+ * The level meter is updated by the PDM callback, so this only compares the current short-term level
+ * with the attack threshold, or with the release threshold once it has been triggered.
  */
 bool Microphone::isTriggered()
 {
-    int lastDataIndex = 0;
-    for (int i = 0; i < tempBufferSize; i++)
+    const float shortTermMeanSquare = microphone::levelMeter.getShortTermMeanSquare();
+
+    if (!isLoud && shortTermMeanSquare >= attackMeanSquare)
     {
-        if (tempAudioBuffer[i] != 0)
+        isLoud = true;
+
+        if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+        {
+            Serial.print("Mic triggered at (dBFS): ");
+            Serial.println(LevelMeter::toDbfs(shortTermMeanSquare));
+        }
+    }
+    else if (isLoud && shortTermMeanSquare < releaseMeanSquare)
+    {
+        isLoud = false;
+
+        if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
         {
-            lastDataIndex = i;
+            Serial.print("Mic released at (dBFS): ");
+            Serial.println(LevelMeter::toDbfs(shortTermMeanSquare));
         }
     }
 
-    return microphone::hasNewData &&
-           samplerConfig->samplerOptions->audioBufferSizeTrigger >= lastDataIndex;
+    return isLoud;
+}
+
+float Microphone::getShortTermDbfs()
+{
+    return microphone::levelMeter.getShortTermDbfs();
+}
+
+float Microphone::getLongTermDbfs()
+{
+    return microphone::levelMeter.getLongTermDbfs();
 }
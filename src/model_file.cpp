@@ -0,0 +1,12 @@
+#include "model_file.h"
+
+bool model_file::isValidHeader(const Header &header, uint32_t fileSize)
+{
+    return header.magic == magic &&
+           header.formatVersion == formatVersion &&
+           header.headerSize >= sizeof(Header) &&
+           header.modelSize > 0 &&
+           header.modelSize <= maxModelSize &&
+           header.headerSize <= fileSize &&
+           header.modelSize <= fileSize - header.headerSize;
+}
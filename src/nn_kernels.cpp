@@ -0,0 +1,221 @@
+#include <math.h>
+#include <string.h>
+
+#include "nn_kernels.h"
+
+#if DSP_USE_M4_INTRINSICS
+// Brings in the CMSIS core intrinsics (__SXTB16, __ROR, __SMLAD)
+#include <Arduino.h>
+#endif
+
+namespace
+{
+#if DSP_USE_M4_INTRINSICS
+    inline uint32_t signExtendBytes02(uint32_t value)
+    {
+        return __SXTB16(value);
+    }
+
+    inline uint32_t rotateRight8(uint32_t value)
+    {
+        return __ROR(value, 8);
+    }
+
+    inline int32_t dualMultiplyAccumulate(uint32_t a, uint32_t b, int32_t accumulator)
+    {
+        return static_cast<int32_t>(__SMLAD(a, b, static_cast<uint32_t>(accumulator)));
+    }
+#else
+    // Bit-exact emulation of SXTB16: bytes 0 and 2 sign extended into the low and high halfwords
+    inline uint32_t signExtendBytes02(uint32_t value)
+    {
+        const uint16_t low = static_cast<uint16_t>(static_cast<int16_t>(static_cast<int8_t>(value & 0xFF)));
+        const uint16_t high = static_cast<uint16_t>(static_cast<int16_t>(static_cast<int8_t>((value >> 16) & 0xFF)));
+        return low | (static_cast<uint32_t>(high) << 16);
+    }
+
+    inline uint32_t rotateRight8(uint32_t value)
+    {
+        return (value >> 8) | (value << 24);
+    }
+
+    // Bit-exact emulation of SMLAD: both signed halfword products added to the accumulator
+    inline int32_t dualMultiplyAccumulate(uint32_t a, uint32_t b, int32_t accumulator)
+    {
+        const int32_t low = static_cast<int16_t>(a & 0xFFFF) * static_cast<int16_t>(b & 0xFFFF);
+        const int32_t high = static_cast<int16_t>(a >> 16) * static_cast<int16_t>(b >> 16);
+        return static_cast<int32_t>(static_cast<uint32_t>(accumulator) + static_cast<uint32_t>(low) + static_cast<uint32_t>(high));
+    }
+#endif
+
+    // memcpy compiles to a single (unaligned capable) LDR on the M4
+    inline uint32_t readWord(const void *pointer)
+    {
+        uint32_t value;
+        memcpy(&value, pointer, sizeof(value));
+        return value;
+    }
+
+    /**
+     * Slot of element i in a patch reordered for dotPatch(): each group of 4 is stored as p0, p2, p1, p3,
+     * which is the halfword order SXTB16 produces from 4 packed int8 weights. The tail stays in order
+     */
+    inline size_t patchSlot(size_t i, size_t numBlocks)
+    {
+        static const uint8_t slots[4] = {0, 2, 1, 3};
+        return i < numBlocks * 4 ? (i & ~static_cast<size_t>(3)) + slots[i & 3] : i;
+    }
+
+    /**
+     * weights . patch, where the patch already has the input offset applied and was reordered with patchSlot()
+     */
+    inline int32_t dotPatch(const int8_t *weights, const int16_t *patch, size_t numBlocks, size_t length, int32_t accumulator)
+    {
+        for (size_t block = 0; block < numBlocks; block++)
+        {
+            const uint32_t packedWeights = readWord(&weights[block * 4]);
+            const uint32_t weights02 = signExtendBytes02(packedWeights);
+            const uint32_t weights13 = signExtendBytes02(rotateRight8(packedWeights));
+            accumulator = dualMultiplyAccumulate(weights02, readWord(&patch[block * 4]), accumulator);
+            accumulator = dualMultiplyAccumulate(weights13, readWord(&patch[block * 4 + 2]), accumulator);
+        }
+        for (size_t i = numBlocks * 4; i < length; i++)
+        {
+            accumulator += weights[i] * patch[i];
+        }
+        return accumulator;
+    }
+
+    inline int8_t requantize(int32_t accumulator, int32_t multiplier, int32_t shift, int32_t outputOffset, int32_t activationMin, int32_t activationMax)
+    {
+        int32_t value = nn::multiplyByQuantizedMultiplier(accumulator, multiplier, shift) + outputOffset;
+        value = value < activationMin ? activationMin : value;
+        value = value > activationMax ? activationMax : value;
+        return static_cast<int8_t>(value);
+    }
+
+    int32_t saturatingRoundingDoublingHighMul(int32_t a, int32_t b)
+    {
+        const bool isOverflow = a == b && a == INT32_MIN;
+        const int64_t product = static_cast<int64_t>(a) * b;
+        const int32_t nudge = product >= 0 ? (1 << 30) : (1 - (1 << 30));
+        const int32_t high = static_cast<int32_t>((product + nudge) / (1LL << 31));
+        return isOverflow ? INT32_MAX : high;
+    }
+
+    int32_t roundingDivideByPowerOfTwo(int32_t value, int32_t exponent)
+    {
+        const int32_t mask = static_cast<int32_t>((1LL << exponent) - 1);
+        const int32_t remainder = value & mask;
+        const int32_t threshold = (mask >> 1) + (value < 0 ? 1 : 0);
+        return (value >> exponent) + (remainder > threshold ? 1 : 0);
+    }
+} // namespace
+
+namespace nn
+{
+    void quantizeMultiplier(double realMultiplier, int32_t *multiplier, int32_t *shift)
+    {
+        if (realMultiplier == 0.0)
+        {
+            *multiplier = 0;
+            *shift = 0;
+            return;
+        }
+
+        int exponent;
+        const double fraction = frexp(realMultiplier, &exponent);
+        int64_t fixedPoint = static_cast<int64_t>(round(fraction * (1LL << 31)));
+        if (fixedPoint == (1LL << 31))
+        {
+            fixedPoint /= 2;
+            exponent++;
+        }
+        if (exponent < -31)
+        {
+            exponent = 0;
+            fixedPoint = 0;
+        }
+        *multiplier = static_cast<int32_t>(fixedPoint);
+        *shift = exponent;
+    }
+
+    int32_t multiplyByQuantizedMultiplier(int32_t value, int32_t multiplier, int32_t shift)
+    {
+        const int32_t leftShift = shift > 0 ? shift : 0;
+        const int32_t rightShift = shift > 0 ? 0 : -shift;
+        return roundingDivideByPowerOfTwo(saturatingRoundingDoublingHighMul(value * (1 << leftShift), multiplier), rightShift);
+    }
+
+    size_t conv2dScratchSize(const ConvParams &params)
+    {
+        const size_t patchLength = params.filterHeight * params.filterWidth * params.inputDepth;
+        return (patchLength + 3) & ~static_cast<size_t>(3);
+    }
+
+    size_t fullyConnectedScratchSize(const FullyConnectedParams &params)
+    {
+        return (params.inputDepth + 3) & ~3;
+    }
+
+    void conv2dInt8(const ConvParams &params, const int32_t *outputMultipliers, const int32_t *outputShifts,
+                    const int8_t *input, const int8_t *filter, const int32_t *bias, int8_t *output, int16_t *scratch)
+    {
+        const size_t patchLength = params.filterHeight * params.filterWidth * params.inputDepth;
+        const size_t numBlocks = patchLength / 4;
+
+        for (int outY = 0; outY < params.outputHeight; outY++)
+        {
+            for (int outX = 0; outX < params.outputWidth; outX++)
+            {
+                // Gather the patch once (im2col) with the input offset applied, so every output channel
+                // reuses it. Padding is the input zero point, i.e. 0 once offset
+                const int inYOrigin = outY * params.strideHeight - params.padHeight;
+                const int inXOrigin = outX * params.strideWidth - params.padWidth;
+                size_t i = 0;
+                for (int filterY = 0; filterY < params.filterHeight; filterY++)
+                {
+                    const int inY = inYOrigin + filterY;
+                    for (int filterX = 0; filterX < params.filterWidth; filterX++)
+                    {
+                        const int inX = inXOrigin + filterX;
+                        const bool isInside = inY >= 0 && inY < params.inputHeight && inX >= 0 && inX < params.inputWidth;
+                        const int8_t *pixel = isInside ? &input[(inY * params.inputWidth + inX) * params.inputDepth] : input;
+                        for (int inChannel = 0; inChannel < params.inputDepth; inChannel++, i++)
+                        {
+                            scratch[patchSlot(i, numBlocks)] = isInside ? static_cast<int16_t>(pixel[inChannel] + params.inputOffset) : 0;
+                        }
+                    }
+                }
+
+                int8_t *outputPixel = &output[(outY * params.outputWidth + outX) * params.outputDepth];
+                const int8_t *filterRow = filter;
+                for (int outChannel = 0; outChannel < params.outputDepth; outChannel++, filterRow += patchLength)
+                {
+                    const int32_t accumulator = dotPatch(filterRow, scratch, numBlocks, patchLength, bias != nullptr ? bias[outChannel] : 0);
+                    outputPixel[outChannel] = requantize(accumulator, outputMultipliers[outChannel], outputShifts[outChannel],
+                                                         params.outputOffset, params.activationMin, params.activationMax);
+                }
+            }
+        }
+    }
+
+    void fullyConnectedInt8(const FullyConnectedParams &params, const int8_t *input, const int8_t *filter,
+                            const int32_t *bias, int8_t *output, int16_t *scratch)
+    {
+        const size_t length = params.inputDepth;
+        const size_t numBlocks = length / 4;
+
+        for (size_t i = 0; i < length; i++)
+        {
+            scratch[patchSlot(i, numBlocks)] = static_cast<int16_t>(input[i] + params.inputOffset);
+        }
+
+        for (int outChannel = 0; outChannel < params.outputDepth; outChannel++)
+        {
+            const int32_t accumulator = dotPatch(&filter[outChannel * length], scratch, numBlocks, length, bias != nullptr ? bias[outChannel] : 0);
+            output[outChannel] = requantize(accumulator, params.outputMultiplier, params.outputShift,
+                                            params.outputOffset, params.activationMin, params.activationMax);
+        }
+    }
+}
@@ -0,0 +1,215 @@
+#include <math.h>
+
+#include "tensorflow/lite/c/builtin_op_data.h"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/kernels/kernel_util.h"
+#include "tensorflow/lite/micro/kernels/kernel_util.h"
+#include "tensorflow/lite/micro/micro_context.h"
+
+#include "nn_ops.h"
+#include "nn_kernels.h"
+
+namespace
+{
+    struct ConvOpData
+    {
+        nn::ConvParams params;
+        int32_t *outputMultipliers;
+        int32_t *outputShifts;
+        int scratchIndex;
+    };
+
+    struct FullyConnectedOpData
+    {
+        nn::FullyConnectedParams params;
+        int scratchIndex;
+    };
+
+    int32_t quantizeActivation(const TfLiteTensor *output, float value)
+    {
+        return output->params.zero_point + static_cast<int32_t>(roundf(value / output->params.scale));
+    }
+
+    // Same clamping as tflite::CalculateActivationRangeQuantized for int8
+    void getActivationRange(TfLiteFusedActivation activation, const TfLiteTensor *output, int32_t *activationMin, int32_t *activationMax)
+    {
+        int32_t low = INT8_MIN;
+        int32_t high = INT8_MAX;
+        if (activation == kTfLiteActRelu)
+        {
+            low = quantizeActivation(output, 0.0f);
+        }
+        else if (activation == kTfLiteActRelu6)
+        {
+            low = quantizeActivation(output, 0.0f);
+            high = quantizeActivation(output, 6.0f);
+        }
+        else if (activation == kTfLiteActReluN1To1)
+        {
+            low = quantizeActivation(output, -1.0f);
+            high = quantizeActivation(output, 1.0f);
+        }
+        *activationMin = low > INT8_MIN ? low : INT8_MIN;
+        *activationMax = high < INT8_MAX ? high : INT8_MAX;
+    }
+
+    int getPadding(int inputSize, int filterSize, int stride, int outputSize)
+    {
+        const int totalPadding = (outputSize - 1) * stride + filterSize - inputSize;
+        return totalPadding > 0 ? totalPadding / 2 : 0;
+    }
+
+    void *convInit(TfLiteContext *context, const char *buffer, size_t length)
+    {
+        (void)buffer;
+        (void)length;
+        return context->AllocatePersistentBuffer(context, sizeof(ConvOpData));
+    }
+
+    TfLiteStatus convPrepare(TfLiteContext *context, TfLiteNode *node)
+    {
+        ConvOpData *data = static_cast<ConvOpData *>(node->user_data);
+        const TfLiteConvParams *convParams = static_cast<const TfLiteConvParams *>(node->builtin_data);
+        tflite::MicroContext *microContext = tflite::GetMicroContext(context);
+
+        TfLiteTensor *input = microContext->AllocateTempInputTensor(node, 0);
+        TfLiteTensor *filter = microContext->AllocateTempInputTensor(node, 1);
+        TfLiteTensor *output = microContext->AllocateTempOutputTensor(node, 0);
+        TF_LITE_ENSURE(context, input != nullptr && filter != nullptr && output != nullptr);
+        TF_LITE_ENSURE_TYPES_EQ(context, input->type, kTfLiteInt8);
+        TF_LITE_ENSURE_TYPES_EQ(context, filter->type, kTfLiteInt8);
+        TF_LITE_ENSURE_TYPES_EQ(context, output->type, kTfLiteInt8);
+        TF_LITE_ENSURE_EQ(context, input->dims->data[0], 1);
+        TF_LITE_ENSURE_EQ(context, convParams->dilation_width_factor, 1);
+        TF_LITE_ENSURE_EQ(context, convParams->dilation_height_factor, 1);
+        TF_LITE_ENSURE_EQ(context, filter->quantization.type, kTfLiteAffineQuantization);
+
+        nn::ConvParams &params = data->params;
+        params.inputHeight = input->dims->data[1];
+        params.inputWidth = input->dims->data[2];
+        params.inputDepth = input->dims->data[3];
+        params.filterHeight = filter->dims->data[1];
+        params.filterWidth = filter->dims->data[2];
+        params.outputHeight = output->dims->data[1];
+        params.outputWidth = output->dims->data[2];
+        params.outputDepth = output->dims->data[3];
+        params.strideHeight = convParams->stride_height;
+        params.strideWidth = convParams->stride_width;
+        params.padHeight = getPadding(params.inputHeight, params.filterHeight, params.strideHeight, params.outputHeight);
+        params.padWidth = getPadding(params.inputWidth, params.filterWidth, params.strideWidth, params.outputWidth);
+        params.inputOffset = -input->params.zero_point;
+        params.outputOffset = output->params.zero_point;
+        getActivationRange(convParams->activation, output, &params.activationMin, &params.activationMax);
+        TF_LITE_ENSURE_EQ(context, filter->dims->data[3], params.inputDepth);
+
+        // Per-channel requantization, with the same double precision math as tflite::PopulateConvolutionQuantizationParams
+        const TfLiteAffineQuantization *filterQuantization = static_cast<const TfLiteAffineQuantization *>(filter->quantization.params);
+        const bool isPerChannel = filterQuantization->scale->size > 1;
+        TF_LITE_ENSURE(context, !isPerChannel || filterQuantization->scale->size == params.outputDepth);
+        data->outputMultipliers = static_cast<int32_t *>(context->AllocatePersistentBuffer(context, params.outputDepth * sizeof(int32_t)));
+        data->outputShifts = static_cast<int32_t *>(context->AllocatePersistentBuffer(context, params.outputDepth * sizeof(int32_t)));
+        TF_LITE_ENSURE(context, data->outputMultipliers != nullptr && data->outputShifts != nullptr);
+        for (int i = 0; i < params.outputDepth; i++)
+        {
+            const double filterScale = static_cast<double>(filterQuantization->scale->data[isPerChannel ? i : 0]);
+            const double effectiveScale = static_cast<double>(input->params.scale) * filterScale / static_cast<double>(output->params.scale);
+            nn::quantizeMultiplier(effectiveScale, &data->outputMultipliers[i], &data->outputShifts[i]);
+        }
+
+        TF_LITE_ENSURE_STATUS(context->RequestScratchBufferInArena(context, nn::conv2dScratchSize(params) * sizeof(int16_t), &data->scratchIndex));
+
+        microContext->DeallocateTempTfLiteTensor(input);
+        microContext->DeallocateTempTfLiteTensor(filter);
+        microContext->DeallocateTempTfLiteTensor(output);
+        return kTfLiteOk;
+    }
+
+    TfLiteStatus convEval(TfLiteContext *context, TfLiteNode *node)
+    {
+        const ConvOpData *data = static_cast<const ConvOpData *>(node->user_data);
+
+        const TfLiteEvalTensor *input = tflite::micro::GetEvalInput(context, node, 0);
+        const TfLiteEvalTensor *filter = tflite::micro::GetEvalInput(context, node, 1);
+        const TfLiteEvalTensor *bias = tflite::NumInputs(node) == 3 ? tflite::micro::GetEvalInput(context, node, 2) : nullptr;
+        TfLiteEvalTensor *output = tflite::micro::GetEvalOutput(context, node, 0);
+
+        nn::conv2dInt8(data->params, data->outputMultipliers, data->outputShifts,
+                       tflite::micro::GetTensorData<int8_t>(input),
+                       tflite::micro::GetTensorData<int8_t>(filter),
+                       bias != nullptr ? tflite::micro::GetTensorData<int32_t>(bias) : nullptr,
+                       tflite::micro::GetTensorData<int8_t>(output),
+                       static_cast<int16_t *>(context->GetScratchBuffer(context, data->scratchIndex)));
+        return kTfLiteOk;
+    }
+
+    void *fullyConnectedInit(TfLiteContext *context, const char *buffer, size_t length)
+    {
+        (void)buffer;
+        (void)length;
+        return context->AllocatePersistentBuffer(context, sizeof(FullyConnectedOpData));
+    }
+
+    TfLiteStatus fullyConnectedPrepare(TfLiteContext *context, TfLiteNode *node)
+    {
+        FullyConnectedOpData *data = static_cast<FullyConnectedOpData *>(node->user_data);
+        const TfLiteFullyConnectedParams *fullyConnectedParams = static_cast<const TfLiteFullyConnectedParams *>(node->builtin_data);
+        tflite::MicroContext *microContext = tflite::GetMicroContext(context);
+
+        TfLiteTensor *input = microContext->AllocateTempInputTensor(node, 0);
+        TfLiteTensor *filter = microContext->AllocateTempInputTensor(node, 1);
+        TfLiteTensor *output = microContext->AllocateTempOutputTensor(node, 0);
+        TF_LITE_ENSURE(context, input != nullptr && filter != nullptr && output != nullptr);
+        TF_LITE_ENSURE_TYPES_EQ(context, input->type, kTfLiteInt8);
+        TF_LITE_ENSURE_TYPES_EQ(context, filter->type, kTfLiteInt8);
+        TF_LITE_ENSURE_TYPES_EQ(context, output->type, kTfLiteInt8);
+        // Symmetric weights, as the int8 quantization spec requires
+        TF_LITE_ENSURE_EQ(context, filter->params.zero_point, 0);
+
+        nn::FullyConnectedParams &params = data->params;
+        params.inputDepth = filter->dims->data[1];
+        params.outputDepth = filter->dims->data[0];
+        TF_LITE_ENSURE_EQ(context, static_cast<int>(tflite::NumElements(input)), params.inputDepth);
+        params.inputOffset = -input->params.zero_point;
+        params.outputOffset = output->params.zero_point;
+        getActivationRange(fullyConnectedParams->activation, output, &params.activationMin, &params.activationMax);
+
+        // Same rounding of the scales as tflite::GetQuantizedConvolutionMultipler
+        const double inputProductScale = static_cast<double>(input->params.scale * filter->params.scale);
+        nn::quantizeMultiplier(inputProductScale / static_cast<double>(output->params.scale), &params.outputMultiplier, &params.outputShift);
+
+        TF_LITE_ENSURE_STATUS(context->RequestScratchBufferInArena(context, nn::fullyConnectedScratchSize(params) * sizeof(int16_t), &data->scratchIndex));
+
+        microContext->DeallocateTempTfLiteTensor(input);
+        microContext->DeallocateTempTfLiteTensor(filter);
+        microContext->DeallocateTempTfLiteTensor(output);
+        return kTfLiteOk;
+    }
+
+    TfLiteStatus fullyConnectedEval(TfLiteContext *context, TfLiteNode *node)
+    {
+        const FullyConnectedOpData *data = static_cast<const FullyConnectedOpData *>(node->user_data);
+
+        const TfLiteEvalTensor *input = tflite::micro::GetEvalInput(context, node, 0);
+        const TfLiteEvalTensor *filter = tflite::micro::GetEvalInput(context, node, 1);
+        const TfLiteEvalTensor *bias = tflite::NumInputs(node) == 3 ? tflite::micro::GetEvalInput(context, node, 2) : nullptr;
+        TfLiteEvalTensor *output = tflite::micro::GetEvalOutput(context, node, 0);
+
+        nn::fullyConnectedInt8(data->params,
+                               tflite::micro::GetTensorData<int8_t>(input),
+                               tflite::micro::GetTensorData<int8_t>(filter),
+                               bias != nullptr ? tflite::micro::GetTensorData<int32_t>(bias) : nullptr,
+                               tflite::micro::GetTensorData<int8_t>(output),
+                               static_cast<int16_t *>(context->GetScratchBuffer(context, data->scratchIndex)));
+        return kTfLiteOk;
+    }
+} // namespace
+
+TFLMRegistration nn::registerConv2D()
+{
+    return tflite::micro::RegisterOp(convInit, convPrepare, convEval);
+}
+
+TFLMRegistration nn::registerFullyConnected()
+{
+    return tflite::micro::RegisterOp(fullyConnectedInit, fullyConnectedPrepare, fullyConnectedEval);
+}
@@ -1,15 +1,30 @@
 #include <Arduino.h>
-#include <ArduinoJson.h>
 #include <SPI.h>
 #include <SD.h>
 
 #include "sampler.h"
 
+namespace
+{
+    // The LPS22HB one-shot read blocks, so the barometer corrects the vertical motion filter at a lower rate than the IMU
+    constexpr unsigned long barometerPeriodMs = 40;
+} // namespace
+
 Sampler::Sampler(SamplerConfig *_samplerConfig)
     : samplerConfig(_samplerConfig),
       sampleDataPoint(new SampleDataPoint(_samplerConfig->accOptions->accNumSamples)),
-      sampleDataPoints(new SampleDataPoint[_samplerConfig->samplerOptions->sampleDataPointBufferSize])
+      saveBuffers(new SampleDataPoint *[_samplerConfig->samplerOptions->numSaveBuffers])
 {
+    for (int b = 0; b < samplerConfig->samplerOptions->numSaveBuffers; b++)
+    {
+        saveBuffers[b] = new SampleDataPoint[samplerConfig->samplerOptions->sampleDataPointBufferSize];
+    }
+    accPackedPools = nullptr;
+    accPackedPool = nullptr;
+    accPackedPoolUsed = 0;
+    accPackedCaptureCapacity = 0;
+    sampleDataPoints = saveBuffers[0];
+
     if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
         Serial.println("\nInitializing sampler\n");
 
@@ -23,6 +38,39 @@ Sampler::Sampler(SamplerConfig *_samplerConfig)
         }
         if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
             Serial.println("SD card initialized");
+
+        // Before anything is saved, every file name depends on the boot count
+        manifest = new Manifest(samplerConfig);
+        if (!manifest->begin())
+        {
+            while (1)
+                ;
+        }
+
+        // Before the writers stage their data, a new card is benchmarked once for its best write size
+        uint32_t sdWriteSize = samplerConfig->samplerOptions->benchmarkSdCard ? 0 : sd_benchmark::loadWriteSize();
+        if (sdWriteSize == 0)
+        {
+            sdWriteSize = sd_benchmark::run(samplerConfig->samplerOptions->logLevel);
+        }
+        if (sdWriteSize > 0)
+        {
+            samplerConfig->samplerOptions->sdWriteSize = sdWriteSize;
+        }
+        if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+        {
+            Serial.print("SD write size: ");
+            Serial.print(samplerConfig->samplerOptions->sdWriteSize);
+            Serial.println(" bytes");
+        }
+    }
+    else if (samplerConfig->samplerOptions->hasInference && samplerConfig->modelOptions->modelFileName != nullptr)
+    {
+        // Only needed for the model file, which falls back to the compiled-in model without it
+        if (!SD.begin(A0))
+        {
+            Serial.println("Failed to initialize SD card for the vibration model file");
+        }
     }
     else
     {
@@ -34,14 +82,138 @@ Sampler::Sampler(SamplerConfig *_samplerConfig)
     {
         accelerometer = new Accelerometer(samplerConfig);
     }
+    if (samplerConfig->samplerOptions->hasGoertzelTrigger)
+    {
+        goertzelBank = new GoertzelBank(samplerConfig);
+    }
+    if (samplerConfig->samplerOptions->hasAccSensor && samplerConfig->accOptions->accStorageMode == AccStorageMode::Peaks)
+    {
+        spectralPeakFinder = new SpectralPeakFinder(samplerConfig);
+
+        const int16_t accNumPeaks = samplerConfig->accOptions->accNumPeaks;
+        sampleDataPoint->accPeaksX = new SpectralPeak[accNumPeaks];
+        sampleDataPoint->accPeaksY = new SpectralPeak[accNumPeaks];
+        sampleDataPoint->accPeaksZ = new SpectralPeak[accNumPeaks];
+        for (int b = 0; b < samplerConfig->samplerOptions->numSaveBuffers; b++)
+        {
+            for (int i = 0; i < samplerConfig->samplerOptions->sampleDataPointBufferSize; i++)
+            {
+                saveBuffers[b][i].accPeaksX = new SpectralPeak[accNumPeaks];
+                saveBuffers[b][i].accPeaksY = new SpectralPeak[accNumPeaks];
+                saveBuffers[b][i].accPeaksZ = new SpectralPeak[accNumPeaks];
+            }
+        }
+    }
+    if (samplerConfig->samplerOptions->hasAccSensor && samplerConfig->accOptions->accStorageMode == AccStorageMode::Packed)
+    {
+        accCounts = new int16_t[samplerConfig->accOptions->accNumSamples];
+
+        // Sized for the worst case, so a capture always fits whatever its data
+        const size_t packedCapacity = delta_codec::maxEncodedSize(samplerConfig->accOptions->accNumSamples);
+        sampleDataPoint->accPackedX = new uint8_t[packedCapacity];
+        sampleDataPoint->accPackedY = new uint8_t[packedCapacity];
+        sampleDataPoint->accPackedZ = new uint8_t[packedCapacity];
+
+        // The buffered captures take only what they packed to, in their buffer's pool
+        accPackedCaptureCapacity = 3 * packedCapacity;
+        if (samplerConfig->accOptions->accPackedPoolSize == 0)
+        {
+            samplerConfig->accOptions->accPackedPoolSize = samplerConfig->samplerOptions->sampleDataPointBufferSize * accPackedCaptureCapacity;
+        }
+        if (samplerConfig->accOptions->accPackedPoolSize < accPackedCaptureCapacity)
+        {
+            Serial.print("accPackedPoolSize must fit at least one capture: ");
+            Serial.println(accPackedCaptureCapacity);
+            while (1)
+                ;
+        }
+        accPackedPools = new uint8_t *[samplerConfig->samplerOptions->numSaveBuffers];
+        for (int b = 0; b < samplerConfig->samplerOptions->numSaveBuffers; b++)
+        {
+            // Without the raw acc samples, i.e. with the envelope analysis, nothing is packed
+            accPackedPools[b] = samplerConfig->accOptions->hasRawAcc ? new uint8_t[samplerConfig->accOptions->accPackedPoolSize] : nullptr;
+            for (int i = 0; i < samplerConfig->samplerOptions->sampleDataPointBufferSize; i++)
+            {
+                // The buffered captures only keep the packed samples, which is where the RAM is saved
+                delete[] saveBuffers[b][i].accFrequenciesX;
+                delete[] saveBuffers[b][i].accFequenciesY;
+                delete[] saveBuffers[b][i].accFrequenciesZ;
+                saveBuffers[b][i].accFrequenciesX = nullptr;
+                saveBuffers[b][i].accFequenciesY = nullptr;
+                saveBuffers[b][i].accFrequenciesZ = nullptr;
+            }
+        }
+        accPackedPool = accPackedPools[0];
+    }
+    if (samplerConfig->samplerOptions->hasAccSensor && samplerConfig->accOptions->hasEnvelope)
+    {
+        envelopeAnalyzer = new EnvelopeAnalyzer(samplerConfig);
+
+        sampleDataPoint->envelopeSpectrum = new float[samplerConfig->accOptions->envelopeNumBins]();
+        for (int b = 0; b < samplerConfig->samplerOptions->numSaveBuffers; b++)
+        {
+            for (int i = 0; i < samplerConfig->samplerOptions->sampleDataPointBufferSize; i++)
+            {
+                saveBuffers[b][i].envelopeSpectrum = new float[samplerConfig->accOptions->envelopeNumBins]();
+            }
+        }
+    }
+    if (samplerConfig->samplerOptions->hasInference)
+    {
+        vibrationClassifier = new VibrationClassifier(samplerConfig);
+
+        sampleDataPoint->modelScores = new float[samplerConfig->modelOptions->modelNumClasses]();
+        for (int b = 0; b < samplerConfig->samplerOptions->numSaveBuffers; b++)
+        {
+            for (int i = 0; i < samplerConfig->samplerOptions->sampleDataPointBufferSize; i++)
+            {
+                saveBuffers[b][i].modelScores = new float[samplerConfig->modelOptions->modelNumClasses]();
+            }
+        }
+    }
     if (samplerConfig->samplerOptions->hasBarSensor)
     {
         barometer = new Barometer(sampleDataPoint, samplerConfig);
     }
     if (samplerConfig->samplerOptions->hasMicSensor)
     {
-        microphone = new Microphone(sampleDataPoint, samplerConfig);
+        microphone = new Microphone(sampleDataPoint, samplerConfig, samplerConfig->samplerOptions->saveToSdCard ? manifest : nullptr);
+
+        // After the microphone, which settles micNumSamples. The WAV audio mode keeps no audio in the buffer
+        const bool isWav = samplerConfig->samplerOptions->hasWavAudio;
+        const bool isAdpcm = samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm;
+        const size_t adpcmSize = ima_adpcm::encodedSize(samplerConfig->micOptions->micNumSamples);
+        for (int b = 0; b < samplerConfig->samplerOptions->numSaveBuffers; b++)
+        {
+            for (int i = 0; i < samplerConfig->samplerOptions->sampleDataPointBufferSize; i++)
+            {
+                if (isWav)
+                    continue;
+                if (isAdpcm)
+                    saveBuffers[b][i].audioAdpcm = new uint8_t[adpcmSize];
+                else
+                    saveBuffers[b][i].audioBuffer = new int16_t[samplerConfig->micOptions->micNumSamples]();
+            }
+        }
+    }
+    if (samplerConfig->samplerOptions->hasMovementTrigger)
+    {
+        verticalMotionFilter = new VerticalMotionFilter();
+    }
+    if (samplerConfig->samplerOptions->saveToSdCard)
+    {
+        // After the sensors, which settle the sampling rates written in the binary file header
+        sdWriter = new SdWriter(samplerConfig, manifest);
     }
+    lastBarometerMillis = 0;
+
+    pendingModelIndex = -1;
+    lastCaptureEndMillis = 0;
+    totalCaptureMillis = 0;
+    totalGapMillis = 0;
+    numSteadyCaptures = 0;
+    totalInferenceUs = 0;
+    numInferences = 0;
 
     previousMillis = 0;
     currentMillis = 0;
@@ -66,6 +238,10 @@ Sampler::Sampler(SamplerConfig *_samplerConfig)
         {
             Serial.println("Mic");
         }
+        if (samplerConfig->samplerOptions->hasGoertzelTrigger)
+        {
+            Serial.println("AccGoertzel");
+        }
         Serial.println();
         Serial.println("Data sensors:");
         if (samplerConfig->samplerOptions->hasAccSensor)
@@ -91,6 +267,21 @@ Sampler::Sampler(SamplerConfig *_samplerConfig)
         Serial.println("Mic Options (MicSamplingRate, MicNumSamples):");
         Serial.println(samplerConfig->micOptions->micSamplingRate);
         Serial.println(samplerConfig->micOptions->micNumSamples);
+        if (samplerConfig->samplerOptions->hasInference)
+        {
+            Serial.println("Model Options (ModelFloorDb, ModelNormalClass, ModelNumClasses, ModelVersion, ModelLoadUs):");
+            Serial.println(samplerConfig->modelOptions->modelFloorDb);
+            Serial.println(samplerConfig->modelOptions->modelNormalClass);
+            Serial.println(samplerConfig->modelOptions->modelNumClasses);
+            Serial.println(samplerConfig->modelOptions->modelVersion);
+            Serial.println(samplerConfig->modelOptions->modelLoadUs);
+        }
+        if (samplerConfig->samplerOptions->hasStoreGate)
+        {
+            Serial.println("Store gate (StoreScoreThreshold, HasStoreScoreFunction):");
+            Serial.println(samplerConfig->samplerOptions->storeScoreThreshold);
+            Serial.println(samplerConfig->samplerOptions->storeScoreFunction != nullptr);
+        }
         Serial.println();
     }
 }
@@ -104,17 +295,86 @@ void Sampler::copyFromSampleDataPoint(SampleDataPoint *destinationSampleDataPoin
     destinationSampleDataPoint->movingStatus = sampleDataPoint->movingStatus;
     destinationSampleDataPoint->movingDirection = sampleDataPoint->movingDirection;
     destinationSampleDataPoint->movingSpeed = sampleDataPoint->movingSpeed;
+    destinationSampleDataPoint->accSummaryX = sampleDataPoint->accSummaryX;
+    destinationSampleDataPoint->accSummaryY = sampleDataPoint->accSummaryY;
+    destinationSampleDataPoint->accSummaryZ = sampleDataPoint->accSummaryZ;
+    destinationSampleDataPoint->audioLevelDbfs = sampleDataPoint->audioLevelDbfs;
+    destinationSampleDataPoint->audioBackgroundDbfs = sampleDataPoint->audioBackgroundDbfs;
+    destinationSampleDataPoint->modelClass = sampleDataPoint->modelClass;
+    destinationSampleDataPoint->modelScore = sampleDataPoint->modelScore;
+    destinationSampleDataPoint->storeScore = sampleDataPoint->storeScore;
+    destinationSampleDataPoint->isCompact = sampleDataPoint->isCompact;
+
+    if (samplerConfig->samplerOptions->hasInference)
+    {
+        for (int j = 0; j < samplerConfig->modelOptions->modelNumClasses; j++)
+        {
+            destinationSampleDataPoint->modelScores[j] = sampleDataPoint->modelScores[j];
+        }
+    }
 
-    for (int j = 0; j < samplerConfig->accOptions->accNumSamples; j++)
+    // Compact captures are stored without their raw data, so there's no point copying it
+    if (sampleDataPoint->isCompact)
     {
-        destinationSampleDataPoint->accFrequenciesX[j] = sampleDataPoint->accFrequenciesX[j];
-        destinationSampleDataPoint->accFequenciesY[j] = sampleDataPoint->accFequenciesY[j];
-        destinationSampleDataPoint->accFrequenciesZ[j] = sampleDataPoint->accFrequenciesZ[j];
+        return;
     }
 
-    for (int j = 0; j < samplerConfig->micOptions->micNumSamples; j++)
+    if (samplerConfig->accOptions->accStorageMode == AccStorageMode::Peaks)
     {
-        destinationSampleDataPoint->audioBuffer[j] = sampleDataPoint->audioBuffer[j];
+        destinationSampleDataPoint->accBroadbandEnergyX = sampleDataPoint->accBroadbandEnergyX;
+        destinationSampleDataPoint->accBroadbandEnergyY = sampleDataPoint->accBroadbandEnergyY;
+        destinationSampleDataPoint->accBroadbandEnergyZ = sampleDataPoint->accBroadbandEnergyZ;
+        for (int j = 0; j < samplerConfig->accOptions->accNumPeaks; j++)
+        {
+            destinationSampleDataPoint->accPeaksX[j] = sampleDataPoint->accPeaksX[j];
+            destinationSampleDataPoint->accPeaksY[j] = sampleDataPoint->accPeaksY[j];
+            destinationSampleDataPoint->accPeaksZ[j] = sampleDataPoint->accPeaksZ[j];
+        }
+    }
+    else if (samplerConfig->accOptions->hasRawAcc && samplerConfig->accOptions->accStorageMode == AccStorageMode::Packed)
+    {
+        // Appended to the pool at their actual size, there's always room for one capture at worst
+        destinationSampleDataPoint->accPackedSizeX = sampleDataPoint->accPackedSizeX;
+        destinationSampleDataPoint->accPackedSizeY = sampleDataPoint->accPackedSizeY;
+        destinationSampleDataPoint->accPackedSizeZ = sampleDataPoint->accPackedSizeZ;
+        destinationSampleDataPoint->accPackedX = accPackedPool + accPackedPoolUsed;
+        destinationSampleDataPoint->accPackedY = destinationSampleDataPoint->accPackedX + sampleDataPoint->accPackedSizeX;
+        destinationSampleDataPoint->accPackedZ = destinationSampleDataPoint->accPackedY + sampleDataPoint->accPackedSizeY;
+        memcpy(destinationSampleDataPoint->accPackedX, sampleDataPoint->accPackedX, sampleDataPoint->accPackedSizeX);
+        memcpy(destinationSampleDataPoint->accPackedY, sampleDataPoint->accPackedY, sampleDataPoint->accPackedSizeY);
+        memcpy(destinationSampleDataPoint->accPackedZ, sampleDataPoint->accPackedZ, sampleDataPoint->accPackedSizeZ);
+        accPackedPoolUsed += sampleDataPoint->accPackedSizeX + sampleDataPoint->accPackedSizeY + sampleDataPoint->accPackedSizeZ;
+    }
+    else if (samplerConfig->accOptions->hasRawAcc)
+    {
+        for (int j = 0; j < samplerConfig->accOptions->accNumSamples; j++)
+        {
+            destinationSampleDataPoint->accFrequenciesX[j] = sampleDataPoint->accFrequenciesX[j];
+            destinationSampleDataPoint->accFequenciesY[j] = sampleDataPoint->accFequenciesY[j];
+            destinationSampleDataPoint->accFrequenciesZ[j] = sampleDataPoint->accFrequenciesZ[j];
+        }
+    }
+
+    for (int j = 0; j < samplerConfig->accOptions->envelopeNumBins; j++)
+    {
+        destinationSampleDataPoint->envelopeSpectrum[j] = sampleDataPoint->envelopeSpectrum[j];
+    }
+
+    if (samplerConfig->samplerOptions->hasWavAudio)
+    {
+        strcpy(destinationSampleDataPoint->audioFileName, sampleDataPoint->audioFileName);
+    }
+    else if (samplerConfig->samplerOptions->hasMicSensor && samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm)
+    {
+        destinationSampleDataPoint->audioAdpcmSize = sampleDataPoint->audioAdpcmSize;
+        memcpy(destinationSampleDataPoint->audioAdpcm, sampleDataPoint->audioAdpcm, sampleDataPoint->audioAdpcmSize);
+    }
+    else if (samplerConfig->samplerOptions->hasMicSensor)
+    {
+        for (int j = 0; j < samplerConfig->micOptions->micNumSamples; j++)
+        {
+            destinationSampleDataPoint->audioBuffer[j] = sampleDataPoint->audioBuffer[j];
+        }
     }
 }
 
@@ -127,83 +387,203 @@ void Sampler::resetSampleDataPoint(SampleDataPoint *targetSampleDataPoint)
     targetSampleDataPoint->movingStatus = MovingStatus::Stopped;
     targetSampleDataPoint->movingDirection = MovingDirection::None;
     targetSampleDataPoint->movingSpeed = 0;
-
-    for (int j = 0; j < samplerConfig->accOptions->accNumSamples; j++)
+    targetSampleDataPoint->accSummaryX = AxisSummary();
+    targetSampleDataPoint->accSummaryY = AxisSummary();
+    targetSampleDataPoint->accSummaryZ = AxisSummary();
+    targetSampleDataPoint->audioLevelDbfs = 0.0f;
+    targetSampleDataPoint->audioBackgroundDbfs = 0.0f;
+    targetSampleDataPoint->modelClass = -1;
+    targetSampleDataPoint->modelScore = 0.0f;
+    targetSampleDataPoint->storeScore = 0.0f;
+    targetSampleDataPoint->isCompact = false;
+
+    if (samplerConfig->accOptions->accStorageMode == AccStorageMode::Peaks)
     {
-        targetSampleDataPoint->accFrequenciesX[j] = 0.0;
-        targetSampleDataPoint->accFequenciesY[j] = 0.0;
-        targetSampleDataPoint->accFrequenciesZ[j] = 0.0;
+        targetSampleDataPoint->accBroadbandEnergyX = 0.0f;
+        targetSampleDataPoint->accBroadbandEnergyY = 0.0f;
+        targetSampleDataPoint->accBroadbandEnergyZ = 0.0f;
+        for (int j = 0; j < samplerConfig->accOptions->accNumPeaks; j++)
+        {
+            targetSampleDataPoint->accPeaksX[j] = SpectralPeak();
+            targetSampleDataPoint->accPeaksY[j] = SpectralPeak();
+            targetSampleDataPoint->accPeaksZ[j] = SpectralPeak();
+        }
     }
-
-    for (int j = 0; j < samplerConfig->micOptions->micNumSamples; j++)
+    else if (samplerConfig->accOptions->accStorageMode == AccStorageMode::Packed)
     {
-        targetSampleDataPoint->audioBuffer[j] = 0;
+        targetSampleDataPoint->accPackedSizeX = 0;
+        targetSampleDataPoint->accPackedSizeY = 0;
+        targetSampleDataPoint->accPackedSizeZ = 0;
     }
-}
-
-void Sampler::saveSamplesToFile()
-{
-    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
-        Serial.println("Saving samples to file");
-
-    jsonDoc.clear();
-    JsonArray jsonSamples = jsonDoc["samples"].to<JsonArray>();
-    for (int i = 0; i < samplerConfig->samplerOptions->sampleDataPointBufferSize; i++)
+    else
     {
-        if (sampleDataPoints[i].timestamp == 0)
+        for (int j = 0; j < samplerConfig->accOptions->accNumSamples; j++)
         {
-            break;
+            targetSampleDataPoint->accFrequenciesX[j] = 0.0;
+            targetSampleDataPoint->accFequenciesY[j] = 0.0;
+            targetSampleDataPoint->accFrequenciesZ[j] = 0.0;
         }
-        JsonObject jsonSample = jsonSamples.add<JsonObject>();
-        jsonSample["timestamp"] = sampleDataPoints[i].timestamp;
-        jsonSample["temperatureC"] = sampleDataPoints[i].temperatureC;
-        jsonSample["pressureKpa"] = sampleDataPoints[i].pressureKpa;
-        jsonSample["altitudeM"] = sampleDataPoints[i].altitudeMeters;
-        jsonSample["movingStatus"] = (int)sampleDataPoints[i].movingStatus;
-        jsonSample["movingDirection"] = (int)sampleDataPoints[i].movingDirection;
-        jsonSample["movingSpeed"] = sampleDataPoints[i].movingSpeed;
-
-        JsonArray frequenciesX = jsonSample["frequenciesX"].to<JsonArray>();
-        JsonArray frequenciesY = jsonSample["frequenciesY"].to<JsonArray>();
-        JsonArray frequenciesZ = jsonSample["frequenciesZ"].to<JsonArray>();
-        for (int j = 0; j < samplerConfig->accOptions->accNumSamples; j++)
+    }
+
+    for (int j = 0; j < samplerConfig->accOptions->envelopeNumBins; j++)
+    {
+        targetSampleDataPoint->envelopeSpectrum[j] = 0.0f;
+    }
+
+    if (samplerConfig->samplerOptions->hasInference)
+    {
+        for (int j = 0; j < samplerConfig->modelOptions->modelNumClasses; j++)
         {
-            frequenciesX.add(sampleDataPoints[i].accFrequenciesX[j]);
-            frequenciesY.add(sampleDataPoints[i].accFequenciesY[j]);
-            frequenciesZ.add(sampleDataPoints[i].accFrequenciesZ[j]);
+            targetSampleDataPoint->modelScores[j] = 0.0f;
         }
+    }
 
-        JsonArray audioBuffer = jsonSample["audioBuffer"].to<JsonArray>();
+    if (samplerConfig->samplerOptions->hasWavAudio)
+    {
+        targetSampleDataPoint->audioFileName[0] = '\0';
+    }
+    else if (samplerConfig->samplerOptions->hasMicSensor && samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm)
+    {
+        targetSampleDataPoint->audioAdpcmSize = 0;
+    }
+    else if (samplerConfig->samplerOptions->hasMicSensor)
+    {
         for (int j = 0; j < samplerConfig->micOptions->micNumSamples; j++)
         {
-            audioBuffer.add(sampleDataPoints[i].audioBuffer[j]);
+            targetSampleDataPoint->audioBuffer[j] = 0;
         }
     }
+}
 
-    // if (samplerConfig->samplerOptions->logLevel >= LogLevel::Verbose)
-    //     serializeJsonPretty(jsonDoc, Serial);
+float Sampler::computeStoreScore(const SampleDataPoint *targetSampleDataPoint)
+{
+    if (samplerConfig->samplerOptions->storeScoreFunction != nullptr)
+    {
+        return samplerConfig->samplerOptions->storeScoreFunction(targetSampleDataPoint);
+    }
 
-    // while (1)
-    //     ;
+    if (targetSampleDataPoint->modelClass < 0)
+    {
+        return 1.0f;
+    }
 
-    char filename[13];
-    snprintf(filename, sizeof(filename), "%lu.txt", millis() % 100000000);
-    File file = SD.open(filename, FILE_WRITE);
-    if (!file)
+    return 1.0f - targetSampleDataPoint->modelScores[samplerConfig->modelOptions->modelNormalClass];
+}
+
+void Sampler::applyStoreGate(SampleDataPoint *targetSampleDataPoint)
+{
+    targetSampleDataPoint->storeScore = computeStoreScore(targetSampleDataPoint);
+    targetSampleDataPoint->isCompact = targetSampleDataPoint->storeScore < samplerConfig->samplerOptions->storeScoreThreshold;
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
     {
-        Serial.println("Failed to open file for writing");
+        Serial.print("Store score ");
+        Serial.print(targetSampleDataPoint->storeScore);
+        Serial.println(targetSampleDataPoint->isCompact ? ", keeping a compact record" : ", keeping the raw data");
+    }
+}
+
+void Sampler::updatePipeline()
+{
+    if (samplerConfig->samplerOptions->hasMicSensor)
+        microphone->bufferCallback();
+
+    if (pendingModelIndex >= 0)
+        completePendingInference();
+
+    if (samplerConfig->samplerOptions->hasBackgroundSave)
+        sdWriter->update();
+}
+
+void Sampler::completePendingInference()
+{
+    SampleDataPoint *pendingSampleDataPoint = &sampleDataPoints[pendingModelIndex];
+    pendingModelIndex = -1;
+
+    pendingSampleDataPoint->modelClass = vibrationClassifier->runPending(pendingSampleDataPoint->modelScores);
+    pendingSampleDataPoint->modelScore = pendingSampleDataPoint->modelClass >= 0 ? pendingSampleDataPoint->modelScores[pendingSampleDataPoint->modelClass] : 0.0f;
+    totalInferenceUs += vibrationClassifier->getLastInferenceUs();
+    numInferences++;
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+    {
+        Serial.print("Vibration class ");
+        Serial.print(pendingSampleDataPoint->modelClass);
+        Serial.print(" with score ");
+        Serial.print(pendingSampleDataPoint->modelScore);
+        Serial.print(" in ");
+        Serial.print(vibrationClassifier->getLastInferenceUs());
+        Serial.println(" us");
+    }
+
+    if (samplerConfig->samplerOptions->hasStoreGate)
+        applyStoreGate(pendingSampleDataPoint);
+}
+
+void Sampler::printPipelineReport()
+{
+    Serial.print("Pipeline: average inference ");
+    Serial.print(numInferences > 0 ? totalInferenceUs / numInferences : 0);
+    Serial.print(" us, ");
+    if (numSteadyCaptures == 0)
+    {
+        Serial.println("no back to back captures yet");
         return;
     }
+    Serial.print("average capture ");
+    Serial.print(totalCaptureMillis / numSteadyCaptures);
+    Serial.print(" ms, average gap ");
+    Serial.print(totalGapMillis / numSteadyCaptures);
+    Serial.print(" ms, duty cycle ");
+    Serial.print(100.0f * totalCaptureMillis / (totalCaptureMillis + totalGapMillis), 1);
+    Serial.println("%");
+}
 
-    serializeJson(jsonDoc, file);
+void Sampler::saveSamplesToFile()
+{
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+        Serial.println("Saving samples to file");
 
-    file.close();
-    jsonDoc.clear();
+    sdWriter->enqueue(sampleDataPoints);
+    sdWriter->flush();
 
     if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
         Serial.println("Samples saved to file");
 }
 
+void Sampler::handOffSamples()
+{
+    if (sdWriter->enqueue(sampleDataPoints))
+    {
+        // There's always a free one, the queue holds every buffer but one
+        for (int b = 0; b < samplerConfig->samplerOptions->numSaveBuffers; b++)
+        {
+            if (saveBuffers[b] != sampleDataPoints && !sdWriter->isQueued(saveBuffers[b]))
+            {
+                useSaveBuffer(b);
+                break;
+            }
+        }
+    }
+    else
+    {
+        // The card is behind, this buffer is reused as is, which drops its captures
+        Serial.println("SD writer queue full, dropping the buffer");
+    }
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+        sdWriter->printStats();
+}
+
+void Sampler::useSaveBuffer(int index)
+{
+    sampleDataPoints = saveBuffers[index];
+    if (accPackedPools != nullptr)
+    {
+        accPackedPool = accPackedPools[index];
+    }
+}
+
 void Sampler::sampleFrequencies()
 {
     if (!samplerConfig->samplerOptions->hasAccSensor)
@@ -213,21 +593,56 @@ void Sampler::sampleFrequencies()
     {
         Serial.println("Sampling frequency data...");
     }
+
+    accelerometer->statsX.reset();
+    accelerometer->statsY.reset();
+    accelerometer->statsZ.reset();
+
+    if (samplerConfig->accOptions->hasEnvelope)
+        envelopeAnalyzer->reset();
+
+    const bool isPipelined = samplerConfig->samplerOptions->hasInference || samplerConfig->samplerOptions->hasBackgroundSave;
+    const unsigned long captureStartMillis = millis();
+    // Back to back captures continue right where the FIFO left off, otherwise its samples are stale
+    const bool isBackToBack = lastCaptureEndMillis != 0 &&
+                              captureStartMillis - lastCaptureEndMillis <= static_cast<unsigned long>(samplerConfig->accOptions->accSamplingLengthMs);
+    if (isPipelined && !isBackToBack)
+    {
+        while (accelerometer->readAvailableAcceleration())
+            ;
+    }
+
     for (int i = 0; i < samplerConfig->accOptions->accNumSamples; i++)
     {
         currentMicroseconds = micros();
 
-        accelerometer->sampleAccelerometer();
+        if (isPipelined)
+        {
+            // Paced by the IMU FIFO, which keeps filling while the previous capture is classified and saved in between samples.
+            // At the output data rate, the Accelerometer makes sure it's accSamplingFrequency
+            while (!accelerometer->readAvailableAcceleration())
+                updatePipeline();
+        }
+        else
+        {
+            accelerometer->sampleAccelerometer();
+        }
 
         accelerometer->vRealX[i] = accelerometer->accX;
         accelerometer->vRealY[i] = accelerometer->accY;
         accelerometer->vRealZ[i] = accelerometer->accZ;
 
+        if (accelerometer->stageSample())
+            addAccBlock();
+
         // Reset the last axies raw data
         accelerometer->accX = 0.0;
         accelerometer->accY = 0.0;
         accelerometer->accZ = 0.0;
 
+        if (isPipelined)
+            continue;
+
         if (samplerConfig->samplerOptions->hasMicSensor)
             // Call it once now then keep calling it until the next sample
             microphone->bufferCallback();
@@ -239,8 +654,55 @@ void Sampler::sampleFrequencies()
         }; // wait for next sample
     }
 
+    // The last, partial block
+    addAccBlock();
+
     // Add the frequencies to `sample.frequencies` variables
     sampleDataPoint->timestamp = millis();
+    sampleDataPoint->accSummaryX = accelerometer->statsX.getSummary();
+    sampleDataPoint->accSummaryY = accelerometer->statsY.getSummary();
+    sampleDataPoint->accSummaryZ = accelerometer->statsZ.getSummary();
+
+    if (samplerConfig->accOptions->hasEnvelope)
+        envelopeAnalyzer->computeSpectrum(sampleDataPoint->envelopeSpectrum);
+
+    if (samplerConfig->accOptions->accStorageMode == AccStorageMode::Peaks)
+    {
+        sampleDataPoint->accBroadbandEnergyX = spectralPeakFinder->findPeaks(accelerometer->vRealX, sampleDataPoint->accPeaksX);
+        sampleDataPoint->accBroadbandEnergyY = spectralPeakFinder->findPeaks(accelerometer->vRealY, sampleDataPoint->accPeaksY);
+        sampleDataPoint->accBroadbandEnergyZ = spectralPeakFinder->findPeaks(accelerometer->vRealZ, sampleDataPoint->accPeaksZ);
+    }
+    else if (samplerConfig->accOptions->hasRawAcc && samplerConfig->accOptions->accStorageMode == AccStorageMode::Packed)
+    {
+        sampleDataPoint->accPackedSizeX = packAccAxis(accelerometer->vRealX, sampleDataPoint->accPackedX);
+        sampleDataPoint->accPackedSizeY = packAccAxis(accelerometer->vRealY, sampleDataPoint->accPackedY);
+        sampleDataPoint->accPackedSizeZ = packAccAxis(accelerometer->vRealZ, sampleDataPoint->accPackedZ);
+    }
+
+    if (isPipelined)
+    {
+        const unsigned long captureEndMillis = millis();
+        if (isBackToBack)
+        {
+            totalCaptureMillis += captureEndMillis - captureStartMillis;
+            totalGapMillis += captureStartMillis - lastCaptureEndMillis;
+            numSteadyCaptures++;
+        }
+        lastCaptureEndMillis = captureEndMillis;
+
+        if (samplerConfig->samplerOptions->hasInference)
+        {
+            // Only the preprocessing runs now, the inference runs while the next capture is acquired.
+            // The previous capture is normally classified by now, unless the FIFO never ran dry
+            vibrationClassifier->prepare(accelerometer->vRealX, accelerometer->vRealY, accelerometer->vRealZ);
+            if (pendingModelIndex >= 0)
+                completePendingInference();
+        }
+
+        if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+            printPipelineReport();
+    }
+
     for (int i = 0; i < samplerConfig->accOptions->accNumSamples; i++)
     {
         sampleDataPoint->accFrequenciesX[i] = accelerometer->vRealX[i];
@@ -259,9 +721,77 @@ void Sampler::sampleFrequencies()
     }
 }
 
+uint32_t Sampler::packAccAxis(const double *values, uint8_t *packed)
+{
+    // The IMU reports whole counts scaled to g, so rounding back to counts is exact
+    for (int i = 0; i < samplerConfig->accOptions->accNumSamples; i++)
+    {
+        const long counts = lround(values[i] * samplerConfig->accOptions->accCountsPerG);
+        accCounts[i] = static_cast<int16_t>(counts < INT16_MIN ? INT16_MIN : (counts > INT16_MAX ? INT16_MAX : counts));
+    }
+    return delta_codec::encode(accCounts, samplerConfig->accOptions->accNumSamples, packed);
+}
+
+void Sampler::updateVerticalMotion()
+{
+    // The FIFO fills at the IMU output data rate, not at accSamplingFrequency
+    const float samplingPeriodS = accelerometer->outputPeriodUs / 1000000.0f;
+    while (accelerometer->readAvailableAcceleration())
+    {
+        verticalMotionFilter->addAcceleration(accelerometer->accX, accelerometer->accY, accelerometer->accZ, samplingPeriodS);
+    }
+
+    if (lastBarometerMillis == 0 || millis() - lastBarometerMillis >= barometerPeriodMs)
+    {
+        lastBarometerMillis = millis();
+        barometer->samplePressure(false);
+        verticalMotionFilter->addAltitude(barometer->getAltitudeMeters());
+    }
+
+    const MovingStatus movingStatus = verticalMotionFilter->getMovingStatus();
+    const MovingDirection movingDirection = verticalMotionFilter->getMovingDirection();
+    sampleDataPoint->movingSpeed = fabsf(verticalMotionFilter->getSpeed());
+
+    if (movingStatus == sampleDataPoint->movingStatus && movingDirection == sampleDataPoint->movingDirection)
+    {
+        return;
+    }
+
+    sampleDataPoint->movingStatus = movingStatus;
+    sampleDataPoint->movingDirection = movingDirection;
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+    {
+        Serial.print("Moving status: ");
+        switch (movingStatus)
+        {
+        case MovingStatus::Stopped:
+            Serial.println("Stopped");
+            break;
+        case MovingStatus::Accelerating:
+            Serial.println("Accelerating");
+            break;
+        case MovingStatus::Steady:
+            Serial.println("Steady");
+            break;
+        case MovingStatus::Stopping:
+            Serial.println("Stopping");
+            break;
+        default:
+            Serial.println("Unknown");
+            break;
+        }
+        Serial.print("Moving direction: ");
+        Serial.println(movingDirection == MovingDirection::Up ? "Up" : (movingDirection == MovingDirection::Down ? "Down" : "None"));
+        Serial.print("Moving speed: ");
+        Serial.print(sampleDataPoint->movingSpeed);
+        Serial.println(" m/s\n");
+    }
+}
+
 /**
  * The reason to have this here intead of in the accelerometer/barometer class is because
- * it's possible that acc data will also be included at some point, to improve the detection of movement.
+ * the movement state comes from fusing the acc data with the barometer altitude.
  */
 bool Sampler::hasNewMovement()
 {
@@ -273,7 +803,7 @@ bool Sampler::hasNewMovement()
     static MovingTrigger lastTrigger = {sampleDataPoint->movingStatus, sampleDataPoint->movingDirection};
     bool hasNewTrigger = false;
 
-    barometer->samplePressure(false);
+    updateVerticalMotion();
 
     for (int i = 0; i < samplerConfig->samplerOptions->sizeofMovementTriggers; i++)
     {
@@ -296,6 +826,56 @@ bool Sampler::hasNewMovement()
     return hasNewTrigger;
 }
 
+void Sampler::addAccBlock()
+{
+    const int length = accelerometer->takeBlock();
+    accelerometer->statsX.add(accelerometer->blockX, length);
+    accelerometer->statsY.add(accelerometer->blockY, length);
+    accelerometer->statsZ.add(accelerometer->blockZ, length);
+
+    if (samplerConfig->accOptions->hasEnvelope)
+    {
+        switch (samplerConfig->accOptions->envelopeAxis)
+        {
+        case AccAxis::X:
+            envelopeAnalyzer->addSamples(accelerometer->blockX, length);
+            break;
+        case AccAxis::Y:
+            envelopeAnalyzer->addSamples(accelerometer->blockY, length);
+            break;
+        case AccAxis::Z:
+            envelopeAnalyzer->addSamples(accelerometer->blockZ, length);
+            break;
+        }
+    }
+}
+
+bool Sampler::hasGoertzelMatch()
+{
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Verbose)
+    {
+        Serial.println("Streaming acc data through the Goertzel bank...");
+    }
+
+    bool isBlockComplete = false;
+    while (!isBlockComplete)
+    {
+        currentMicroseconds = micros();
+
+        accelerometer->sampleAccelerometer(false);
+        if (accelerometer->stageSample())
+        {
+            const int length = accelerometer->takeBlock();
+            isBlockComplete = goertzelBank->addSamples(accelerometer->blockX, accelerometer->blockY, accelerometer->blockZ, length);
+        }
+
+        while (micros() < (currentMicroseconds + accelerometer->samplingPeriodUs))
+            ; // wait for next sample
+    }
+
+    return goertzelBank->isTriggered();
+}
+
 void Sampler::checkTriggers()
 {
     if (samplerConfig->samplerOptions->logLevel >= LogLevel::Verbose)
@@ -329,6 +909,10 @@ void Sampler::checkTriggers()
     {
         startDataCollection = microphone->isTriggered();
     }
+    else if (samplerConfig->samplerOptions->hasGoertzelTrigger)
+    {
+        startDataCollection = hasGoertzelMatch();
+    }
 
     if (samplerConfig->samplerOptions->logLevel >= LogLevel::Verbose)
     {
@@ -337,11 +921,25 @@ void Sampler::checkTriggers()
 
     if (!startDataCollection)
     {
-        delay(100);
+        if (samplerConfig->samplerOptions->hasBackgroundSave && !sdWriter->isIdle())
+        {
+            // Write rather than idle, checking the triggers again after every step
+            sdWriter->update();
+            return;
+        }
+        // The Goertzel bank and the vertical motion filter must see a continuous acc stream
+        if (!samplerConfig->samplerOptions->hasGoertzelTrigger && !samplerConfig->samplerOptions->hasMovementTrigger)
+            delay(100);
         return;
     }
 
     sampleData();
+
+    if (samplerConfig->samplerOptions->hasGoertzelTrigger)
+    {
+        // The stream was interrupted by data collection, so start the next block from scratch
+        goertzelBank->reset();
+    }
 }
 
 void Sampler::sampleData()
@@ -359,12 +957,9 @@ void Sampler::sampleData()
 
     if (samplerConfig->samplerOptions->hasMicSensor)
     {
-        // If it has mic trigger then it's already started
-        if (!samplerConfig->samplerOptions->hasMicTrigger)
-        {
-            // Audio sampling is asynchronous, so it won't block sampleFrequencies
-            microphone->startAudioSampling();
-        }
+        // Audio sampling is asynchronous, so it won't block sampleFrequencies.
+        // If it has mic trigger then the PDM is already running and this only rewinds the audio buffer
+        microphone->startAudioSampling();
 
         // If it has mic but no acc sensor, then wait for the mic to sample the expected number of samples as it would be done in sampleFrequencies() otherwise
         if (!samplerConfig->samplerOptions->hasAccSensor)
@@ -390,6 +985,10 @@ void Sampler::sampleData()
         microphone->stopAudioSampling();
     }
 
+    // With inference the store gate waits for the model result, see completePendingInference()
+    if (samplerConfig->samplerOptions->hasStoreGate && !samplerConfig->samplerOptions->hasInference)
+        applyStoreGate(sampleDataPoint);
+
     // while (1)
     //     ;
 
@@ -412,6 +1011,9 @@ void Sampler::sampleData()
             copyFromSampleDataPoint(&sampleDataPoints[i]);
             resetSampleDataPoint(sampleDataPoint);
 
+            if (samplerConfig->samplerOptions->hasInference)
+                pendingModelIndex = i;
+
             if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
             {
                 Serial.println("Sample added");
@@ -421,13 +1023,23 @@ void Sampler::sampleData()
         }
     }
 
-    // Log data and reset the buffer when it's full
-    if (sampleDataPoints[samplerConfig->samplerOptions->sampleDataPointBufferSize - 1].timestamp != 0)
+    // Log data and reset the buffer when it's full, or when its packed pool can't fit one more capture at worst
+    const bool isPackedPoolFull = accPackedPool != nullptr &&
+                                  accPackedPoolUsed + accPackedCaptureCapacity > samplerConfig->accOptions->accPackedPoolSize;
+    if (sampleDataPoints[samplerConfig->samplerOptions->sampleDataPointBufferSize - 1].timestamp != 0 || isPackedPoolFull)
     {
         if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
             Serial.println("\nBuffer full. Saving to file and resetting buffer");
 
-        if (samplerConfig->samplerOptions->saveToSdCard)
+        // The last capture can't wait for the next one to be classified
+        if (pendingModelIndex >= 0)
+            completePendingInference();
+
+        if (samplerConfig->samplerOptions->hasBackgroundSave)
+        {
+            handOffSamples();
+        }
+        else if (samplerConfig->samplerOptions->saveToSdCard)
         {
             saveSamplesToFile();
             if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
@@ -442,11 +1054,12 @@ void Sampler::sampleData()
         if (samplerConfig->samplerOptions->logLevel >= LogLevel::Verbose)
             Serial.println("Resetting buffer\n");
 
-        // Reset each sample in the buffer data points
+        // Reset each sample in the buffer data points, i.e. the free buffer capture continues into
         for (int i = 0; i < samplerConfig->samplerOptions->sampleDataPointBufferSize; i++)
         {
             resetSampleDataPoint(&sampleDataPoints[i]);
         }
+        accPackedPoolUsed = 0;
 
         if (samplerConfig->samplerOptions->logLevel >= LogLevel::Verbose)
             Serial.println("Buffer reset\n");
@@ -0,0 +1,215 @@
+#include "sd_benchmark.h"
+#include "checksum.h"
+
+#include <stddef.h>
+
+namespace
+{
+    // Bucket b holds the latencies from 2^b to 2^(b + 1) - 1 us, the last one everything above
+    constexpr int numLatencyBuckets = 31;
+    // A larger write size stages more RAM, so it has to be more than 1/20 faster
+    constexpr uint32_t toleranceDivisor = 20;
+
+    int latencyBucket(unsigned long us)
+    {
+        int bucket = 0;
+        while (us > 1 && bucket < numLatencyBuckets - 1)
+        {
+            us >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+
+    /**
+     * @param permille e.g. 990 for the 99th percentile
+     * @return Upper bound of the bucket the percentile falls in
+     */
+    uint32_t percentileUs(const uint32_t *histogram, uint32_t numWrites, uint32_t permille)
+    {
+        const uint32_t rank = max(static_cast<uint32_t>((static_cast<uint64_t>(numWrites) * permille + 999) / 1000), static_cast<uint32_t>(1));
+        uint32_t numBelow = 0;
+        for (int bucket = 0; bucket < numLatencyBuckets; bucket++)
+        {
+            numBelow += histogram[bucket];
+            if (numBelow >= rank)
+            {
+                return (static_cast<uint32_t>(1) << (bucket + 1)) - 1;
+            }
+        }
+        return UINT32_MAX;
+    }
+
+    /**
+     * Write sd_benchmark::benchmarkSize bytes to a new scratch file, timing each write and the close
+     * @return false when the card can't be written
+     */
+    bool timeRun(const uint8_t *data, uint32_t writeSize, bool isPreallocated, sd_benchmark::Run *run)
+    {
+        if (SD.exists(sd_benchmark::scratchFileName))
+        {
+            SD.remove(sd_benchmark::scratchFileName);
+        }
+        // Not FILE_WRITE, its O_APPEND would add the timed writes after the preallocated ones
+        File file = SD.open(sd_benchmark::scratchFileName, O_RDWR | O_CREAT);
+        if (!file)
+        {
+            return false;
+        }
+        if (isPreallocated)
+        {
+            // Not timed, like the preallocation of a log file
+            for (uint32_t offset = 0; offset < sd_benchmark::benchmarkSize; offset += sd_benchmark::maxWriteSize)
+            {
+                if (file.write(data, sd_benchmark::maxWriteSize) != sd_benchmark::maxWriteSize)
+                {
+                    file.close();
+                    return false;
+                }
+            }
+            file.flush();
+            if (!file.seek(0))
+            {
+                file.close();
+                return false;
+            }
+        }
+
+        uint32_t histogram[numLatencyBuckets] = {};
+        uint32_t numWrites = 0;
+        unsigned long maxUs = 0;
+        const unsigned long startUs = micros();
+        for (uint32_t offset = 0; offset < sd_benchmark::benchmarkSize; offset += writeSize)
+        {
+            const unsigned long writeStartUs = micros();
+            if (file.write(data, writeSize) != writeSize)
+            {
+                file.close();
+                return false;
+            }
+            const unsigned long elapsedUs = micros() - writeStartUs;
+            histogram[latencyBucket(elapsedUs)]++;
+            maxUs = max(maxUs, elapsedUs);
+            numWrites++;
+        }
+        // With what's left in the cache and the directory update, as every saved file pays them
+        file.close();
+        const unsigned long totalUs = max(micros() - startUs, 1UL);
+
+        run->writeSize = writeSize;
+        run->isPreallocated = isPreallocated;
+        run->bytesPerSecond = static_cast<uint32_t>(static_cast<uint64_t>(sd_benchmark::benchmarkSize) * 1000000 / totalUs);
+        run->medianUs = min(percentileUs(histogram, numWrites, 500), static_cast<uint32_t>(maxUs));
+        run->p99Us = min(percentileUs(histogram, numWrites, 990), static_cast<uint32_t>(maxUs));
+        run->maxUs = maxUs;
+        return true;
+    }
+
+    void printRun(const sd_benchmark::Run &run)
+    {
+        Serial.print(run.writeSize);
+        Serial.print(run.isPreallocated ? " byte writes, preallocated: " : " byte writes, appended: ");
+        Serial.print(run.bytesPerSecond / 1024);
+        Serial.print(" KB/s, median <= ");
+        Serial.print(run.medianUs);
+        Serial.print(" us, p99 <= ");
+        Serial.print(run.p99Us);
+        Serial.print(" us, max ");
+        Serial.print(run.maxUs);
+        Serial.println(" us");
+    }
+
+    bool saveResult(uint32_t writeSize, uint32_t bytesPerSecond)
+    {
+        sd_benchmark::Result result;
+        memset(&result, 0, sizeof(result));
+        result.magic = sd_benchmark::resultMagic;
+        result.writeSize = writeSize;
+        result.bytesPerSecond = bytesPerSecond;
+        result.crc = checksum::crc32(&result, offsetof(sd_benchmark::Result, crc));
+
+        // Not FILE_WRITE, its O_APPEND would add the result after the previous one instead of replacing it
+        File resultFile = SD.open(sd_benchmark::resultFileName, O_RDWR | O_CREAT);
+        const bool isSaved = resultFile && resultFile.seek(0) &&
+                             resultFile.write(reinterpret_cast<const uint8_t *>(&result), sizeof(result)) == sizeof(result);
+        resultFile.close();
+        return isSaved;
+    }
+} // namespace
+
+uint32_t sd_benchmark::run(LogLevel logLevel)
+{
+    if (logLevel >= LogLevel::Info)
+    {
+        Serial.println("Benchmarking SD card writes");
+    }
+
+    uint8_t *data = new uint8_t[maxWriteSize];
+    for (uint32_t i = 0; i < maxWriteSize; i++)
+    {
+        data[i] = static_cast<uint8_t>(i * 31 + 7);
+    }
+
+    uint32_t bestWriteSize = 0;
+    uint32_t bestBytesPerSecond = 0;
+    bool isWritable = true;
+    for (size_t i = 0; i < sizeof(writeSizes) / sizeof(writeSizes[0]) && isWritable; i++)
+    {
+        // Both strategies are used with the tuned size, so it's only as good as the slower one
+        uint32_t slowerBytesPerSecond = UINT32_MAX;
+        for (int strategy = 0; strategy < 2 && isWritable; strategy++)
+        {
+            Run run;
+            isWritable = timeRun(data, writeSizes[i], strategy == 1, &run);
+            if (isWritable)
+            {
+                slowerBytesPerSecond = min(slowerBytesPerSecond, run.bytesPerSecond);
+                if (logLevel >= LogLevel::Info)
+                {
+                    printRun(run);
+                }
+            }
+        }
+        if (isWritable && writeSizes[i] >= minTunedWriteSize &&
+            slowerBytesPerSecond > bestBytesPerSecond + bestBytesPerSecond / toleranceDivisor)
+        {
+            bestWriteSize = writeSizes[i];
+            bestBytesPerSecond = slowerBytesPerSecond;
+        }
+    }
+    SD.remove(scratchFileName);
+    delete[] data;
+
+    if (!isWritable || !saveResult(bestWriteSize, bestBytesPerSecond))
+    {
+        Serial.println("Failed to benchmark the SD card");
+        return 0;
+    }
+    if (logLevel >= LogLevel::Info)
+    {
+        Serial.print("SD card best write size: ");
+        Serial.print(bestWriteSize);
+        Serial.print(" bytes, ");
+        Serial.print(bestBytesPerSecond / 1024);
+        Serial.println(" KB/s");
+    }
+    return bestWriteSize;
+}
+
+uint32_t sd_benchmark::loadWriteSize()
+{
+    if (!SD.exists(resultFileName))
+    {
+        return 0;
+    }
+    File resultFile = SD.open(resultFileName, FILE_READ);
+    Result result;
+    const bool isRead = resultFile && resultFile.read(&result, sizeof(result)) == sizeof(result);
+    resultFile.close();
+
+    const bool isValid = isRead && result.magic == resultMagic &&
+                         result.crc == checksum::crc32(&result, offsetof(Result, crc)) &&
+                         result.writeSize >= minTunedWriteSize && result.writeSize <= maxWriteSize &&
+                         result.writeSize % minTunedWriteSize == 0;
+    return isValid ? result.writeSize : 0;
+}
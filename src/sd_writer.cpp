@@ -0,0 +1,260 @@
+#include "sd_writer.h"
+
+SdWriter::SdWriter(SamplerConfig *_samplerConfig, Manifest *_manifest)
+    : samplerConfig(_samplerConfig),
+      binaryWriter(nullptr),
+      jsonCaptureWriter(nullptr),
+      captureLog(nullptr),
+      manifest(_manifest),
+      bufferedFile(nullptr),
+      captureOffsets(new uint32_t[_samplerConfig->samplerOptions->sampleDataPointBufferSize])
+{
+    if (samplerConfig->samplerOptions->fileFormat == FileFormat::Binary)
+    {
+        binaryWriter = new BinaryWriter(samplerConfig);
+    }
+    else
+    {
+        jsonCaptureWriter = new JsonCaptureWriter(samplerConfig);
+    }
+
+    if (samplerConfig->samplerOptions->hasCaptureLog)
+    {
+        captureLog = new CaptureLog(samplerConfig);
+        if (!captureLog->begin())
+        {
+            while (1)
+                ;
+        }
+    }
+    else
+    {
+        bufferedFile = new BufferedFile(samplerConfig);
+    }
+
+    // Every buffer but the one being filled can wait here
+    queueCapacity = max(samplerConfig->samplerOptions->numSaveBuffers - 1, 1);
+    queue = new SampleDataPoint *[queueCapacity];
+    queueHead = 0;
+    queueLength = 0;
+    isOutputOpen = false;
+    path[0] = '\0';
+    fileSequence = 0;
+    payloadOffset = 0;
+
+    stage = Stage::Open;
+    captureIndex = 0;
+    isCaptureStarted = false;
+    bufferStartMillis = 0;
+
+    numWrittenBuffers = 0;
+    numFailedBuffers = 0;
+    numDroppedBuffers = 0;
+    numBackpressureEvents = 0;
+    maxQueueLength = 0;
+    maxStepUs = 0;
+    maxBufferMillis = 0;
+}
+
+bool SdWriter::enqueue(SampleDataPoint *buffer)
+{
+    if (queueLength > 0)
+    {
+        // The previous buffer isn't written yet, the card is slower than the captures right now
+        numBackpressureEvents++;
+    }
+    if (queueLength == queueCapacity)
+    {
+        numDroppedBuffers++;
+        return false;
+    }
+
+    queue[(queueHead + queueLength) % queueCapacity] = buffer;
+    queueLength++;
+    maxQueueLength = max(maxQueueLength, queueLength);
+    return true;
+}
+
+bool SdWriter::isQueued(const SampleDataPoint *buffer) const
+{
+    for (int i = 0; i < queueLength; i++)
+    {
+        if (queue[(queueHead + i) % queueCapacity] == buffer)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SdWriter::openOutput()
+{
+    Print *output;
+    if (captureLog != nullptr)
+    {
+        if (!captureLog->beginRecord())
+        {
+            Serial.println("Failed to start the capture log record");
+            return false;
+        }
+        output = captureLog;
+        strncpy(path, captureLog->getFileName(), sizeof(path));
+        fileSequence = 0;
+        payloadOffset = captureLog->getPayloadOffset();
+    }
+    else
+    {
+        if (!manifest->nextFilePath(binaryWriter != nullptr ? "bin" : "txt", path, &fileSequence))
+        {
+            return false;
+        }
+        payloadOffset = 0;
+        file = SD.open(path, FILE_WRITE);
+        if (!file)
+        {
+            Serial.println("Failed to open file for writing");
+            return false;
+        }
+        bufferedFile->begin(&file);
+        output = bufferedFile;
+    }
+
+    if (binaryWriter != nullptr)
+        binaryWriter->begin(*output);
+    else
+        jsonCaptureWriter->begin(*output);
+    isOutputOpen = true;
+    return true;
+}
+
+bool SdWriter::writeCaptureStep(const SampleDataPoint &capture)
+{
+    if (!isCaptureStarted)
+    {
+        captureOffsets[captureIndex] = binaryWriter != nullptr ? binaryWriter->getSize() : jsonCaptureWriter->getSize();
+        isCaptureStarted = true;
+    }
+
+    const uint32_t stepSize = samplerConfig->samplerOptions->sdWriteSize;
+    const bool isWritten = binaryWriter != nullptr ? binaryWriter->writeCapture(capture, stepSize) : jsonCaptureWriter->writeCapture(capture, stepSize);
+    if (isWritten)
+    {
+        isCaptureStarted = false;
+    }
+    return isWritten;
+}
+
+bool SdWriter::closeOutput()
+{
+    isOutputOpen = false;
+    bool isWritten = binaryWriter != nullptr ? binaryWriter->end() : jsonCaptureWriter->end();
+    const uint32_t payloadSize = binaryWriter != nullptr ? binaryWriter->getSize() : jsonCaptureWriter->getSize();
+
+    if (captureLog != nullptr)
+    {
+        isWritten = captureLog->endRecord() && isWritten;
+    }
+    else
+    {
+        isWritten = bufferedFile->end() && isWritten;
+        file.close();
+    }
+
+    // Only what was written completely is indexed, the host tools can trust every entry
+    if (isWritten)
+    {
+        isWritten = manifest->append(path, fileSequence, payloadOffset, payloadSize, queue[queueHead], captureOffsets, captureIndex);
+    }
+    return isWritten;
+}
+
+void SdWriter::update()
+{
+    if (queueLength == 0)
+    {
+        return;
+    }
+
+    const unsigned long startUs = micros();
+    const SampleDataPoint *buffer = queue[queueHead];
+    bool isBufferDone = false;
+
+    switch (stage)
+    {
+    case Stage::Open:
+        bufferStartMillis = millis();
+        if (openOutput())
+        {
+            captureIndex = 0;
+            isCaptureStarted = false;
+            stage = Stage::Captures;
+        }
+        else
+        {
+            numFailedBuffers++;
+            isBufferDone = true;
+        }
+        break;
+    case Stage::Captures:
+        if (captureIndex < samplerConfig->samplerOptions->sampleDataPointBufferSize && buffer[captureIndex].timestamp != 0)
+        {
+            if (writeCaptureStep(buffer[captureIndex]))
+            {
+                captureIndex++;
+            }
+        }
+        else
+        {
+            stage = Stage::Close;
+        }
+        break;
+    case Stage::Close:
+        if (closeOutput())
+            numWrittenBuffers++;
+        else
+            numFailedBuffers++;
+        maxBufferMillis = max(maxBufferMillis, millis() - bufferStartMillis);
+        isBufferDone = true;
+        break;
+    }
+
+    if (isBufferDone)
+    {
+        stage = Stage::Open;
+        queueHead = (queueHead + 1) % queueCapacity;
+        queueLength--;
+    }
+    maxStepUs = max(maxStepUs, micros() - startUs);
+}
+
+void SdWriter::flush()
+{
+    while (queueLength > 0)
+    {
+        update();
+    }
+}
+
+void SdWriter::printStats()
+{
+    Serial.print("SD writer: ");
+    Serial.print(numWrittenBuffers);
+    Serial.print(" buffers written, ");
+    Serial.print(numFailedBuffers);
+    Serial.print(" failed, ");
+    Serial.print(numDroppedBuffers);
+    Serial.print(" dropped, ");
+    Serial.print(numBackpressureEvents);
+    Serial.print(" hand-offs behind, max queue ");
+    Serial.print(maxQueueLength);
+    Serial.print(", max step ");
+    Serial.print(maxStepUs);
+    Serial.print(" us, max buffer ");
+    Serial.print(maxBufferMillis);
+    Serial.println(" ms");
+
+    if (captureLog != nullptr)
+    {
+        captureLog->printStats();
+    }
+}
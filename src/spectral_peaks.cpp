@@ -0,0 +1,90 @@
+#include <Arduino.h>
+
+#include "spectral_peaks.h"
+#include "dsp_kernels.h"
+
+SpectralPeakFinder::SpectralPeakFinder(SamplerConfig *_samplerConfig)
+    : samplerConfig(_samplerConfig),
+      real(new float[_samplerConfig->accOptions->accNumSamples]),
+      imag(new float[_samplerConfig->accOptions->accNumSamples])
+{
+    if (samplerConfig->accOptions->accNumPeaks <= 0)
+    {
+        Serial.println("accNumPeaks must be greater than 0");
+        while (1)
+            ;
+    }
+}
+
+float SpectralPeakFinder::findPeaks(const double *samples, SpectralPeak *peaks)
+{
+    const int numSamples = samplerConfig->accOptions->accNumSamples;
+    const int numBins = numSamples / 2;
+    const int numPeaks = samplerConfig->accOptions->accNumPeaks;
+    const float binHz = static_cast<float>(samplerConfig->accOptions->accSamplingFrequency) / numSamples;
+
+    // Remove the mean (gravity) so the DC bin doesn't leak into the low frequency peaks
+    double mean = 0.0;
+    for (int i = 0; i < numSamples; i++)
+    {
+        mean += samples[i];
+    }
+    mean /= numSamples;
+    for (int i = 0; i < numSamples; i++)
+    {
+        real[i] = static_cast<float>(samples[i] - mean);
+        imag[i] = 0.0f;
+    }
+
+    dsp::applyHannWindow(real, numSamples);
+    dsp::fftRadix2(real, imag, numSamples);
+
+    // Single sided amplitude corrected for the Hann coherent gain, stored back in the real scratch
+    const float scale = 4.0f / numSamples;
+    dsp::complexMagnitude(real, imag, real, numBins);
+    float broadbandEnergy = 0.0f;
+    for (int k = 0; k < numBins; k++)
+    {
+        real[k] *= scale;
+        if (k > 0)
+        {
+            broadbandEnergy += real[k] * real[k];
+        }
+    }
+
+    for (int i = 0; i < numPeaks; i++)
+    {
+        peaks[i] = SpectralPeak();
+    }
+
+    // Keep the largest local maxima with an insertion into the (small) sorted peaks array
+    for (int k = 1; k < numBins - 1; k++)
+    {
+        const float previous = real[k - 1];
+        const float current = real[k];
+        const float next = real[k + 1];
+        if (current <= previous || current < next || current <= peaks[numPeaks - 1].magnitude)
+        {
+            continue;
+        }
+
+        // Parabolic interpolation of the true peak position and height
+        const float denominator = previous - 2.0f * current + next;
+        const float delta = denominator != 0.0f ? 0.5f * (previous - next) / denominator : 0.0f;
+
+        SpectralPeak peak;
+        peak.bin = k + delta;
+        peak.frequencyHz = peak.bin * binHz;
+        peak.magnitude = current - 0.25f * (previous - next) * delta;
+
+        int position = numPeaks - 1;
+        while (position > 0 && peaks[position - 1].magnitude < peak.magnitude)
+        {
+            peaks[position] = peaks[position - 1];
+            position--;
+        }
+        peaks[position] = peak;
+    }
+
+    return broadbandEnergy;
+}
@@ -0,0 +1,77 @@
+#include <Arduino.h>
+
+#include "streaming_stats.h"
+#include "dsp_kernels.h"
+
+void StreamingStats::reset()
+{
+    count = 0;
+    mean = 0.0f;
+    m2 = 0.0f;
+    m3 = 0.0f;
+    m4 = 0.0f;
+    sumSquares = 0.0f;
+    minValue = 0.0f;
+    maxValue = 0.0f;
+}
+
+void StreamingStats::add(const float *values, size_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    const float nB = static_cast<float>(length);
+    const float meanB = dsp::sum(values, length) / nB;
+    float m2B, m3B, m4B;
+    dsp::centralMoments(values, length, meanB, &m2B, &m3B, &m4B);
+    float minB, maxB;
+    dsp::minMax(values, length, &minB, &maxB);
+    sumSquares += dsp::energy(values, length);
+
+    minValue = count == 0 || minB < minValue ? minB : minValue;
+    maxValue = count == 0 || maxB > maxValue ? maxB : maxValue;
+
+    // Merge the block (B) into the samples so far (A) with the pairwise update of the central moments
+    const float nA = static_cast<float>(count);
+    count += length;
+    const float n = static_cast<float>(count);
+
+    const float delta = meanB - mean;
+    const float deltaN = delta / n;
+    const float deltaN2 = deltaN * deltaN;
+    const float term1 = delta * deltaN * nA * nB;
+
+    // Order matters: m4 uses the previous m2 and m3, m3 uses the previous m2
+    mean += deltaN * nB;
+    m4 += m4B + term1 * deltaN2 * (nA * nA - nA * nB + nB * nB) + 6.0f * deltaN2 * (nA * nA * m2B + nB * nB * m2) + 4.0f * deltaN * (nA * m3B - nB * m3);
+    m3 += m3B + term1 * deltaN * (nA - nB) + 3.0f * deltaN * (nA * m2B - nB * m2);
+    m2 += m2B + term1;
+}
+
+AxisSummary StreamingStats::getSummary()
+{
+    AxisSummary summary;
+    if (count == 0)
+    {
+        return summary;
+    }
+
+    const float n = static_cast<float>(count);
+
+    summary.mean = mean;
+    summary.rms = sqrtf(sumSquares / n);
+    summary.peak = fabsf(minValue) > fabsf(maxValue) ? fabsf(minValue) : fabsf(maxValue);
+    summary.peakToPeak = maxValue - minValue;
+    summary.crestFactor = summary.rms > 0.0f ? summary.peak / summary.rms : 0.0f;
+
+    // A constant signal has no spread, so leave the shape statistics at 0
+    if (m2 > 0.0f)
+    {
+        summary.skewness = sqrtf(n) * m3 / (m2 * sqrtf(m2));
+        summary.kurtosis = n * m4 / (m2 * m2);
+    }
+
+    return summary;
+}
@@ -0,0 +1,164 @@
+#include <math.h>
+
+#include "vertical_motion.h"
+
+namespace
+{
+    constexpr float standardGravity = 9.80665f;
+
+    // Time constant of the gravity estimate. Much longer than an elevator acceleration phase
+    constexpr float gravitySeconds = 10.0f;
+    // Time constant of the acceleration used for the movement status
+    constexpr float accelerationSeconds = 0.05f;
+
+    // Noise model: acc white noise (m/s^2), acc bias random walk (m/s^2 per sqrt(s)), barometer altitude noise (m)
+    constexpr float accNoise = 0.3f;
+    constexpr float accBiasNoise = 0.01f;
+    constexpr float altitudeNoise = 0.25f;
+    constexpr float initialVariance = 100.0f;
+
+    // Movement status thresholds
+    constexpr float movingSpeedThreshold = 0.15f;       // m/s
+    constexpr float movingAccelerationThreshold = 0.2f; // m/s^2
+} // namespace
+
+void VerticalMotionFilter::addAcceleration(float ax, float ay, float az, float dt)
+{
+    if (!hasGravity)
+    {
+        gravity[0] = ax;
+        gravity[1] = ay;
+        gravity[2] = az;
+        hasGravity = true;
+    }
+    else
+    {
+        const float alpha = dt / gravitySeconds;
+        gravity[0] += alpha * (ax - gravity[0]);
+        gravity[1] += alpha * (ay - gravity[1]);
+        gravity[2] += alpha * (az - gravity[2]);
+    }
+
+    const float gravityMagnitude = sqrtf(gravity[0] * gravity[0] + gravity[1] * gravity[1] + gravity[2] * gravity[2]);
+    if (gravityMagnitude < 0.0001f)
+    {
+        return;
+    }
+
+    // Project on the gravity direction and remove 1 g, which makes it positive up.
+    // Only the direction comes from the low-passed acc, otherwise a long elevator acceleration would leak
+    // into the gravity estimate. Any scale/offset error of the acc is tracked by the bias state instead
+    const float alongGravity = (ax * gravity[0] + ay * gravity[1] + az * gravity[2]) / gravityMagnitude;
+    const float input = (alongGravity - 1.0f) * standardGravity;
+
+    // Nothing to integrate from until the barometer gave a first altitude
+    if (!hasAltitude)
+    {
+        return;
+    }
+
+    // Predict: x = F x + B u with F = [[1, dt, -dt^2/2], [0, 1, -dt], [0, 0, 1]]
+    const float halfDt2 = 0.5f * dt * dt;
+    const float netAcceleration = input - accBias;
+    altitude += speed * dt + halfDt2 * netAcceleration;
+    speed += dt * netAcceleration;
+
+    const float accelerationAlpha = dt / (accelerationSeconds + dt);
+    acceleration += accelerationAlpha * (netAcceleration - acceleration);
+
+    // P = F P F' + Q, written out for the 6 unique entries
+    const float e = -halfDt2;
+    const float f = -dt;
+    const float a00 = p00 + dt * p01 + e * p02;
+    const float a01 = p01 + dt * p11 + e * p12;
+    const float a02 = p02 + dt * p12 + e * p22;
+    const float a11 = p11 + f * p12;
+    const float a12 = p12 + f * p22;
+
+    const float accVariance = accNoise * accNoise;
+    const float dt2 = dt * dt;
+    p00 = a00 + dt * a01 + e * a02 + 0.25f * dt2 * dt2 * accVariance;
+    p01 = a01 + f * a02 + 0.5f * dt2 * dt * accVariance;
+    p02 = a02;
+    p11 = a11 + f * a12 + dt2 * accVariance;
+    p12 = a12;
+    p22 = p22 + accBiasNoise * accBiasNoise * dt;
+
+    updateMovingState();
+}
+
+void VerticalMotionFilter::addAltitude(float altitudeMeters)
+{
+    if (!hasAltitude)
+    {
+        altitude = altitudeMeters;
+        speed = 0.0f;
+        accBias = 0.0f;
+        p00 = initialVariance;
+        p01 = 0.0f;
+        p02 = 0.0f;
+        p11 = 1.0f;
+        p12 = 0.0f;
+        p22 = 1.0f;
+        hasAltitude = true;
+        return;
+    }
+
+    // Update with H = [1, 0, 0]
+    const float innovation = altitudeMeters - altitude;
+    const float s = p00 + altitudeNoise * altitudeNoise;
+    const float k0 = p00 / s;
+    const float k1 = p01 / s;
+    const float k2 = p02 / s;
+
+    altitude += k0 * innovation;
+    speed += k1 * innovation;
+    accBias += k2 * innovation;
+
+    // P = (I - K H) P
+    p11 -= k1 * p01;
+    p12 -= k1 * p02;
+    p22 -= k2 * p02;
+    p00 -= k0 * p00;
+    p01 -= k0 * p01;
+    p02 -= k0 * p02;
+}
+
+void VerticalMotionFilter::updateMovingState()
+{
+    const bool isMoving = fabsf(speed) >= movingSpeedThreshold;
+    const bool isAccelerating = fabsf(acceleration) >= movingAccelerationThreshold;
+    const MovingDirection accelerationDirection = acceleration > 0.0f ? MovingDirection::Up : MovingDirection::Down;
+
+    if (isMoving)
+    {
+        movingDirection = speed > 0.0f ? MovingDirection::Up : MovingDirection::Down;
+        if (!isAccelerating)
+        {
+            movingStatus = MovingStatus::Steady;
+        }
+        else
+        {
+            movingStatus = accelerationDirection == movingDirection ? MovingStatus::Accelerating : MovingStatus::Stopping;
+        }
+    }
+    else if (isAccelerating)
+    {
+        // Below the speed threshold: either starting from rest, or the end of a stop where
+        // the acceleration opposes the direction we were moving in
+        if (movingStatus == MovingStatus::Stopped || movingStatus == MovingStatus::Accelerating || movingDirection == accelerationDirection)
+        {
+            movingDirection = accelerationDirection;
+            movingStatus = MovingStatus::Accelerating;
+        }
+        else
+        {
+            movingStatus = MovingStatus::Stopping;
+        }
+    }
+    else
+    {
+        movingDirection = MovingDirection::None;
+        movingStatus = MovingStatus::Stopped;
+    }
+}
@@ -0,0 +1,291 @@
+#include <Arduino.h>
+#include <SD.h>
+#include <TensorFlowLite.h>
+
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+#include "checksum.h"
+#include "layer_profiler.h"
+#include "model_file.h"
+#include "nn_ops.h"
+#include "vibration_classifier.h"
+#include "vibration_features.h"
+#include "vibration_model_data.h"
+
+namespace
+{
+    // Largest activations are the 32x32x3 input and the 16x16x16 output of the first conv (~7 KB),
+    // the rest is the interpreter's own bookkeeping. The actual usage is printed at Verbose
+    constexpr size_t tensorArenaSize = 24 * 1024;
+    alignas(16) uint8_t tensorArena[tensorArenaSize];
+
+    // Conv2D, Mean, FullyConnected and Softmax, the only operators in the model.
+    // Conv2D and FullyConnected (nearly all the MACs) run the SXTB16/SMLAD kernels of nn_kernels
+    tflite::MicroMutableOpResolver<4> opResolver;
+
+    LayerProfiler layerProfiler;
+
+    // Read size when streaming the model file through the CRC, one SD block
+    constexpr size_t modelReadChunkSize = 512;
+} // namespace
+
+VibrationClassifier::VibrationClassifier(SamplerConfig *_samplerConfig)
+    : samplerConfig(_samplerConfig),
+      scratch(new float[vibration_features::scratchSize])
+{
+    for (int i = 0; i < numInputBuffers; i++)
+    {
+        inputBuffers[i] = new int8_t[vibration_features::inputSize];
+    }
+    nextPending = 0;
+    numPending = 0;
+    lastPreprocessingUs = 0;
+    lastInferenceUs = 0;
+
+    modelRegion = nullptr;
+    interpreter = nullptr;
+
+    opResolver.AddConv2D(nn::registerConv2D());
+    opResolver.AddMean();
+    opResolver.AddFullyConnected(nn::registerFullyConnected());
+    opResolver.AddSoftmax();
+
+    bool isModelReady = false;
+    if (samplerConfig->modelOptions->modelFileName != nullptr)
+    {
+        const unsigned char *modelData = loadModelFile(samplerConfig->modelOptions->modelFileName);
+        isModelReady = modelData != nullptr && initInterpreter(modelData);
+        if (!isModelReady)
+        {
+            delete[] modelRegion;
+            modelRegion = nullptr;
+            samplerConfig->modelOptions->modelVersion = 0;
+
+            if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+                Serial.println("Falling back to the compiled-in vibration model");
+        }
+    }
+#if VIBRATION_MODEL_BUNDLED
+    if (!isModelReady)
+    {
+        isModelReady = initInterpreter(g_vibration_model_data);
+    }
+#endif
+    if (!isModelReady)
+    {
+        Serial.println("No usable vibration model!");
+        while (1)
+            ;
+    }
+
+    samplerConfig->modelOptions->modelNumClasses = output->dims->data[output->dims->size - 1];
+    if (samplerConfig->modelOptions->modelNormalClass < 0 || samplerConfig->modelOptions->modelNormalClass >= samplerConfig->modelOptions->modelNumClasses)
+    {
+        Serial.println("modelNormalClass is not one of the vibration model classes!");
+        while (1)
+            ;
+    }
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Verbose)
+    {
+        Serial.print("Vibration model arena used bytes: ");
+        Serial.println(interpreter->arena_used_bytes());
+    }
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+        Serial.println("Vibration classifier initialized");
+}
+
+const unsigned char *VibrationClassifier::loadModelFile(const char *fileName)
+{
+    const unsigned long startUs = micros();
+
+    File file = SD.open(fileName, FILE_READ);
+    if (!file)
+    {
+        if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+        {
+            Serial.print("Vibration model file not found: ");
+            Serial.println(fileName);
+        }
+        return nullptr;
+    }
+
+    model_file::Header header;
+    if (file.read(reinterpret_cast<uint8_t *>(&header), sizeof(header)) != static_cast<int>(sizeof(header)) ||
+        !model_file::isValidHeader(header, file.size()) ||
+        !file.seek(header.headerSize))
+    {
+        file.close();
+        if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+            Serial.println("Vibration model file header is not valid");
+        return nullptr;
+    }
+
+    // new only guarantees 8 byte alignment, so the region is over-allocated and the model placed at the next boundary
+    modelRegion = new uint8_t[header.modelSize + model_file::modelAlignment - 1];
+    const uintptr_t regionAddress = reinterpret_cast<uintptr_t>(modelRegion);
+    uint8_t *modelData = reinterpret_cast<uint8_t *>((regionAddress + model_file::modelAlignment - 1) & ~(model_file::modelAlignment - 1));
+
+    uint32_t crc = 0;
+    for (uint32_t offset = 0; offset < header.modelSize; offset += modelReadChunkSize)
+    {
+        const size_t chunkSize = min(static_cast<size_t>(header.modelSize - offset), modelReadChunkSize);
+        if (file.read(modelData + offset, chunkSize) != static_cast<int>(chunkSize))
+        {
+            break;
+        }
+        crc = checksum::crc32(modelData + offset, chunkSize, crc);
+    }
+    file.close();
+
+    if (crc != header.modelCrc)
+    {
+        if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+            Serial.println("Vibration model file CRC doesn't match");
+        return nullptr;
+    }
+
+    samplerConfig->modelOptions->modelVersion = header.modelVersion;
+    samplerConfig->modelOptions->modelLoadUs = micros() - startUs;
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+    {
+        Serial.print("Vibration model version ");
+        Serial.print(header.modelVersion);
+        Serial.print(" (");
+        Serial.print(header.modelSize);
+        Serial.print(" bytes) loaded from the SD card in ");
+        Serial.print(samplerConfig->modelOptions->modelLoadUs);
+        Serial.println(" us");
+    }
+    return modelData;
+}
+
+bool VibrationClassifier::initInterpreter(const unsigned char *modelData)
+{
+    const tflite::Model *model = tflite::GetModel(modelData);
+    if (model->version() != TFLITE_SCHEMA_VERSION)
+    {
+        Serial.println("Vibration model schema version not supported");
+        return false;
+    }
+
+    delete interpreter;
+    interpreter = new tflite::MicroInterpreter(model, opResolver, tensorArena, tensorArenaSize, nullptr, &layerProfiler);
+    if (interpreter->AllocateTensors() != kTfLiteOk)
+    {
+        Serial.println("Failed to allocate the vibration model tensors");
+        return false;
+    }
+
+    input = interpreter->input(0);
+    output = interpreter->output(0);
+    if (input->type != kTfLiteInt8 || input->dims->size != 4 ||
+        input->dims->data[1] != vibration_features::numFrames ||
+        input->dims->data[2] != vibration_features::numBins ||
+        input->dims->data[3] != vibration_features::numChannels ||
+        output->type != kTfLiteInt8)
+    {
+        Serial.println("Vibration model input or output doesn't match the preprocessing");
+        return false;
+    }
+    return true;
+}
+
+void VibrationClassifier::prepare(const double *x, const double *y, const double *z)
+{
+    const unsigned long startUs = micros();
+
+    if (numPending == numInputBuffers)
+    {
+        if (samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+            Serial.println("Vibration model fell behind, dropping the oldest capture");
+
+        nextPending = (nextPending + 1) % numInputBuffers;
+        numPending--;
+    }
+
+    // The arena planner reuses the input tensor memory for activations, so the input is only copied there right before Invoke()
+    int8_t *inputBuffer = inputBuffers[(nextPending + numPending) % numInputBuffers];
+    vibration_features::computeInput(x, y, z, samplerConfig->accOptions->accNumSamples, samplerConfig->modelOptions->modelFloorDb,
+                                     input->params.scale, input->params.zero_point, inputBuffer, scratch);
+    numPending++;
+
+    lastPreprocessingUs = micros() - startUs;
+}
+
+bool VibrationClassifier::hasPending()
+{
+    return numPending > 0;
+}
+
+int16_t VibrationClassifier::runPending(float *scores)
+{
+    for (int i = 0; i < samplerConfig->modelOptions->modelNumClasses; i++)
+    {
+        scores[i] = 0.0f;
+    }
+    if (numPending == 0)
+    {
+        return -1;
+    }
+
+    const unsigned long startUs = micros();
+
+    memcpy(input->data.int8, inputBuffers[nextPending], vibration_features::inputSize);
+    nextPending = (nextPending + 1) % numInputBuffers;
+    numPending--;
+
+    layerProfiler.reset();
+    if (interpreter->Invoke() != kTfLiteOk)
+    {
+        Serial.println("Vibration model inference failed");
+        lastInferenceUs = micros() - startUs;
+        return -1;
+    }
+
+    int16_t bestClass = 0;
+    for (int i = 0; i < samplerConfig->modelOptions->modelNumClasses; i++)
+    {
+        scores[i] = (output->data.int8[i] - output->params.zero_point) * output->params.scale;
+        if (scores[i] > scores[bestClass])
+        {
+            bestClass = i;
+        }
+    }
+
+    lastInferenceUs = micros() - startUs;
+
+    if (samplerConfig->samplerOptions->logLevel >= LogLevel::Verbose)
+    {
+        Serial.println("Vibration model layers:");
+        layerProfiler.print();
+    }
+    // The inference of a capture runs during the next one, so it has to fit in a capture to keep up
+    if (lastInferenceUs >= static_cast<unsigned long>(samplerConfig->accOptions->accSamplingLengthMs) * 1000 &&
+        samplerConfig->samplerOptions->logLevel >= LogLevel::Info)
+    {
+        Serial.print("Vibration model inference takes longer than the capture: ");
+        Serial.print(lastInferenceUs);
+        Serial.println(" us");
+    }
+    return bestClass;
+}
+
+int16_t VibrationClassifier::classify(const double *x, const double *y, const double *z, float *scores)
+{
+    prepare(x, y, z);
+    return runPending(scores);
+}
+
+unsigned long VibrationClassifier::getLastPreprocessingUs()
+{
+    return lastPreprocessingUs;
+}
+
+unsigned long VibrationClassifier::getLastInferenceUs()
+{
+    return lastInferenceUs;
+}
@@ -0,0 +1,63 @@
+#include <math.h>
+
+#include "vibration_features.h"
+#include "dsp_kernels.h"
+
+namespace
+{
+    void addAxis(const double *samples, int numSamples, int channel, float floorDb,
+                 float inputScale, int32_t inputZeroPoint, int8_t *input, float *scratch)
+    {
+        using namespace vibration_features;
+
+        float *real = scratch;
+        float *imag = scratch + frameLength;
+
+        // Remove the mean (gravity) of the whole capture so it doesn't dominate the lowest bin
+        double mean = 0.0;
+        for (int i = 0; i < numSamples; i++)
+        {
+            mean += samples[i];
+        }
+        mean = numSamples > 0 ? mean / numSamples : 0.0;
+
+        const float hop = numSamples > frameLength ? static_cast<float>(numSamples - frameLength) / (numFrames - 1) : 0.0f;
+        // Single sided amplitude corrected for the Hann coherent gain, so 0 dB is a 1 g sine
+        const float scale = 4.0f / frameLength;
+        const float pixelsPerDb = 255.0f / -floorDb;
+
+        for (int frame = 0; frame < numFrames; frame++)
+        {
+            const int start = static_cast<int>(frame * hop + 0.5f);
+            for (int i = 0; i < frameLength; i++)
+            {
+                const int index = start + i;
+                real[i] = index < numSamples ? static_cast<float>(samples[index] - mean) : 0.0f;
+                imag[i] = 0.0f;
+            }
+
+            dsp::applyHannWindow(real, frameLength);
+            dsp::fftRadix2(real, imag, frameLength);
+            dsp::complexMagnitude(real, imag, real, numBins);
+
+            for (int bin = 0; bin < numBins; bin++)
+            {
+                const float db = 20.0f * log10f(real[bin] * scale + 1e-9f);
+                float pixel = (db - floorDb) * pixelsPerDb;
+                pixel = pixel < 0.0f ? 0.0f : (pixel > 255.0f ? 255.0f : pixel);
+
+                int32_t quantized = static_cast<int32_t>(lroundf(pixel / inputScale)) + inputZeroPoint;
+                quantized = quantized < -128 ? -128 : (quantized > 127 ? 127 : quantized);
+                input[(frame * numBins + bin) * numChannels + channel] = static_cast<int8_t>(quantized);
+            }
+        }
+    }
+} // namespace
+
+void vibration_features::computeInput(const double *x, const double *y, const double *z, int numSamples, float floorDb,
+                                      float inputScale, int32_t inputZeroPoint, int8_t *input, float *scratch)
+{
+    addAxis(x, numSamples, 0, floorDb, inputScale, inputZeroPoint, input, scratch);
+    addAxis(y, numSamples, 1, floorDb, inputScale, inputZeroPoint, input, scratch);
+    addAxis(z, numSamples, 2, floorDb, inputScale, inputZeroPoint, input, scratch);
+}
@@ -10,7 +10,12 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
-unsigned char g_vibration_model_data[] = {
+#include "vibration_model_data.h"
+
+#if VIBRATION_MODEL_BUNDLED
+
+// Aligned so TensorFlow Lite Micro can read the flatbuffer in place
+alignas(16) const unsigned char g_vibration_model_data[] = {
   0x1c, 0x00, 0x00, 0x00, 0x54, 0x46, 0x4c, 0x33, 0x14, 0x00, 0x20, 0x00,
   0x1c, 0x00, 0x18, 0x00, 0x14, 0x00, 0x10, 0x00, 0x0c, 0x00, 0x00, 0x00,
   0x08, 0x00, 0x04, 0x00, 0x14, 0x00, 0x00, 0x00, 0x1c, 0x00, 0x00, 0x00,
@@ -2617,4 +2622,6 @@ unsigned char g_vibration_model_data[] = {
   0x08, 0x00, 0x04, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
   0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03
 };
-unsigned int g_vibration_model_data_len = 31256;
+const int g_vibration_model_data_len = 31256;
+
+#endif // VIBRATION_MODEL_BUNDLED
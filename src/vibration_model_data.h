@@ -18,6 +18,12 @@ limitations under the License.
 #ifndef ELEV_VIBRATION_MODEL_DATA_H_
 #define ELEV_VIBRATION_MODEL_DATA_H_
 
+// Build with -D VIBRATION_MODEL_BUNDLED=0 to leave the compiled-in model out of flash,
+// the model then has to be loaded from the SD card (ModelOptions::modelFileName)
+#ifndef VIBRATION_MODEL_BUNDLED
+#define VIBRATION_MODEL_BUNDLED 1
+#endif
+
 extern const unsigned char g_vibration_model_data[];
 extern const int g_vibration_model_data_len;
 
@@ -0,0 +1,220 @@
+#include "wav_writer.h"
+
+namespace
+{
+    constexpr size_t pcmHeaderSize = 44;
+    // The fmt chunk of IMA ADPCM has 4 more bytes for samplesPerBlock, then comes a fact chunk with the sample count
+    constexpr size_t adpcmHeaderSize = 60;
+
+    uint8_t *putTag(uint8_t *output, const char *tag)
+    {
+        memcpy(output, tag, 4);
+        return output + 4;
+    }
+
+    uint8_t *putUint16(uint8_t *output, uint16_t value)
+    {
+        output[0] = static_cast<uint8_t>(value);
+        output[1] = static_cast<uint8_t>(value >> 8);
+        return output + 2;
+    }
+
+    uint8_t *putUint32(uint8_t *output, uint32_t value)
+    {
+        output = putUint16(output, static_cast<uint16_t>(value));
+        return putUint16(output, static_cast<uint16_t>(value >> 16));
+    }
+} // namespace
+
+WavWriter::WavWriter(SamplerConfig *_samplerConfig)
+    : samplerConfig(_samplerConfig),
+      firstSector(new uint8_t[sectorSize]),
+      sector(new uint8_t[sectorSize]),
+      adpcmBlock(new uint8_t[ima_adpcm::blockSize])
+{
+    isAdpcm = samplerConfig->micOptions->micEncoding == MicEncoding::ImaAdpcm;
+    hasWriteError = false;
+    currentSector = firstSector;
+    currentLength = 0;
+    numSamples = 0;
+    dataSize = 0;
+    blockSamples = 0;
+}
+
+size_t WavWriter::getHeaderSize() const
+{
+    return isAdpcm ? adpcmHeaderSize : pcmHeaderSize;
+}
+
+void WavWriter::writeHeader()
+{
+    const uint32_t samplingRate = samplerConfig->micOptions->micSamplingRate;
+
+    uint8_t *output = putTag(firstSector, "RIFF");
+    output = putUint32(output, getHeaderSize() - 8 + dataSize);
+    output = putTag(output, "WAVE");
+    output = putTag(output, "fmt ");
+    if (isAdpcm)
+    {
+        output = putUint32(output, 20);
+        output = putUint16(output, 0x11);
+        output = putUint16(output, 1);
+        output = putUint32(output, samplingRate);
+        output = putUint32(output, samplingRate * ima_adpcm::blockSize / ima_adpcm::samplesPerBlock);
+        output = putUint16(output, ima_adpcm::blockSize);
+        output = putUint16(output, 4);
+        output = putUint16(output, 2);
+        output = putUint16(output, ima_adpcm::samplesPerBlock);
+        output = putTag(output, "fact");
+        output = putUint32(output, 4);
+        output = putUint32(output, numSamples);
+    }
+    else
+    {
+        output = putUint32(output, 16);
+        output = putUint16(output, 1);
+        output = putUint16(output, 1);
+        output = putUint32(output, samplingRate);
+        output = putUint32(output, samplingRate * sizeof(int16_t));
+        output = putUint16(output, sizeof(int16_t));
+        output = putUint16(output, 16);
+    }
+    output = putTag(output, "data");
+    putUint32(output, dataSize);
+}
+
+bool WavWriter::begin(const char *fileName)
+{
+    // A capture that never reached end() keeps its placeholder header, like one cut short by a reset
+    if (file)
+    {
+        file.close();
+    }
+
+    // Not FILE_WRITE, its O_APPEND would move the final header to the end of the file
+    if (SD.exists(fileName))
+    {
+        SD.remove(fileName);
+    }
+    file = SD.open(fileName, O_RDWR | O_CREAT);
+    if (!file)
+    {
+        return false;
+    }
+
+    hasWriteError = false;
+    numSamples = 0;
+    dataSize = 0;
+    blockSamples = 0;
+    if (isAdpcm)
+    {
+        adpcmEncoder.begin(adpcmBlock);
+    }
+
+    // A file cut short by a reset still starts with a header, its sizes are 0
+    writeHeader();
+    currentSector = firstSector;
+    currentLength = getHeaderSize();
+    return true;
+}
+
+void WavWriter::append(const uint8_t *data, size_t size)
+{
+    size_t written = 0;
+    while (written < size)
+    {
+        const size_t length = min(size - written, sectorSize - currentLength);
+        memcpy(currentSector + currentLength, data + written, length);
+        currentLength += length;
+        written += length;
+
+        if (currentLength == sectorSize)
+        {
+            // The first sector is written now with the placeholder header, and kept for end()
+            if (file.write(currentSector, sectorSize) != sectorSize)
+            {
+                hasWriteError = true;
+            }
+            currentSector = sector;
+            currentLength = 0;
+        }
+    }
+    dataSize += size;
+}
+
+void WavWriter::addToBlock(const int16_t *samples, int count)
+{
+    adpcmEncoder.add(samples, count);
+    blockSamples += count;
+    if (blockSamples == ima_adpcm::samplesPerBlock)
+    {
+        append(adpcmBlock, ima_adpcm::blockSize);
+        adpcmEncoder.setOutput(adpcmBlock);
+        blockSamples = 0;
+    }
+}
+
+void WavWriter::add(const int16_t *samples, int count)
+{
+    if (!file)
+    {
+        return;
+    }
+    numSamples += count;
+
+    if (!isAdpcm)
+    {
+        // Both targets are little-endian like the WAV data chunk
+        append(reinterpret_cast<const uint8_t *>(samples), count * sizeof(int16_t));
+        return;
+    }
+    // In pieces that end on block boundaries, so every block is appended as soon as it's whole
+    int added = 0;
+    while (added < count)
+    {
+        const int length = min(count - added, ima_adpcm::samplesPerBlock - blockSamples);
+        addToBlock(samples + added, length);
+        added += length;
+    }
+}
+
+bool WavWriter::end()
+{
+    if (!file)
+    {
+        return false;
+    }
+
+    // Players expect whole ADPCM blocks, the fact chunk keeps the actual number of samples
+    if (isAdpcm)
+    {
+        static const int16_t silence[32] = {};
+        while (blockSamples > 0)
+        {
+            addToBlock(silence, min(ima_adpcm::samplesPerBlock - blockSamples, 32));
+        }
+    }
+
+    writeHeader();
+    if (currentSector == firstSector)
+    {
+        // The whole file fits in the first sector
+        if (file.write(firstSector, currentLength) != currentLength)
+        {
+            hasWriteError = true;
+        }
+    }
+    else
+    {
+        if (currentLength > 0 && file.write(currentSector, currentLength) != currentLength)
+        {
+            hasWriteError = true;
+        }
+        if (!file.seek(0) || file.write(firstSector, sectorSize) != sectorSize)
+        {
+            hasWriteError = true;
+        }
+    }
+    file.close();
+    return !hasWriteError;
+}
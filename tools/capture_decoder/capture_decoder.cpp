@@ -0,0 +1,321 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "capture_decoder.h"
+#include "checksum.h"
+#include "delta_codec.h"
+#include "ima_adpcm.h"
+
+using capture_format::ColumnType;
+
+namespace capture_decoder
+{
+    size_t CaptureReader::read(void *output, size_t size)
+    {
+        if (memory == nullptr)
+        {
+            file.read(reinterpret_cast<char *>(output), size);
+            return static_cast<size_t>(file.gcount());
+        }
+        const size_t length = std::min(size, memorySize - memoryPosition);
+        memcpy(output, memory + memoryPosition, length);
+        memoryPosition += length;
+        return length;
+    }
+
+    bool CaptureReader::seek(uint64_t offset)
+    {
+        if (memory == nullptr)
+        {
+            file.clear();
+            return static_cast<bool>(file.seekg(offset));
+        }
+        if (offset > memorySize)
+            return false;
+        memoryPosition = static_cast<size_t>(offset);
+        return true;
+    }
+
+    bool CaptureReader::open(const std::string &path, uint64_t _payloadOffset)
+    {
+        memory = nullptr;
+        payloadOffset = _payloadOffset;
+        file.open(path, std::ios::binary);
+        if (!file)
+        {
+            error = "can't open " + path;
+            return false;
+        }
+        return readSchema();
+    }
+
+    bool CaptureReader::open(const uint8_t *data, size_t size)
+    {
+        memory = data;
+        memorySize = size;
+        memoryPosition = 0;
+        payloadOffset = 0;
+        return readSchema();
+    }
+
+    bool CaptureReader::readSchema()
+    {
+        error.clear();
+        columns.clear();
+        fullCaptureSize = 0;
+        compactCaptureSize = 0;
+
+        if (!seek(payloadOffset) || read(&fileHeader, sizeof(fileHeader)) != sizeof(fileHeader) || fileHeader.magic != capture_format::fileMagic)
+        {
+            error = "not a capture file";
+            return false;
+        }
+        // Version 1 files are the same without packed columns, version 2 without text columns
+        if (fileHeader.formatVersion < 1 || fileHeader.formatVersion > capture_format::formatVersion)
+        {
+            error = "format version " + std::to_string(fileHeader.formatVersion) + " not supported";
+            return false;
+        }
+
+        for (int i = 0; i < fileHeader.numColumns; i++)
+        {
+            capture_format::ColumnDescriptor descriptor;
+            if (read(&descriptor, sizeof(descriptor)) != sizeof(descriptor))
+            {
+                error = "truncated schema";
+                return false;
+            }
+            const size_t size = capture_format::typeSize(descriptor.type);
+            if (size == 0)
+            {
+                error = "column " + std::to_string(i) + " has an unknown type";
+                return false;
+            }
+            descriptor.name[capture_format::maxNameLength] = '\0';
+
+            Column column;
+            column.name = descriptor.name;
+            column.type = descriptor.type;
+            column.isInCompact = (descriptor.flags & capture_format::isInCompact) != 0;
+            column.count = descriptor.count;
+            column.scale = descriptor.scale;
+            columns.push_back(column);
+
+            // The packed streams vary, only their size fields are fixed
+            const uint32_t storedSize = capture_format::isPacked(column.type) ? sizeof(uint32_t) : column.count * size;
+            fullCaptureSize += storedSize;
+            if (column.isInCompact)
+                compactCaptureSize += storedSize;
+        }
+        return true;
+    }
+
+    bool CaptureReader::next(Capture *capture)
+    {
+        capture_format::CaptureHeader captureHeader;
+        const size_t headerSize = read(&captureHeader, sizeof(captureHeader));
+        if (headerSize != sizeof(captureHeader))
+        {
+            if (headerSize != 0)
+                error = "truncated capture header";
+            return false;
+        }
+
+        capture->timestamp = captureHeader.timestamp;
+        capture->isCompact = (captureHeader.flags & capture_format::isCompactCapture) != 0;
+        const uint32_t minSize = capture->isCompact ? compactCaptureSize : fullCaptureSize;
+        if (captureHeader.magic != capture_format::captureMagic || captureHeader.size < minSize)
+        {
+            error = "corrupt capture at timestamp " + std::to_string(captureHeader.timestamp);
+            return false;
+        }
+
+        capture->data.resize(captureHeader.size);
+        if (read(capture->data.data(), captureHeader.size) != captureHeader.size)
+        {
+            error = "truncated capture at timestamp " + std::to_string(captureHeader.timestamp);
+            return false;
+        }
+
+        capture->columnOffsets.resize(columns.size());
+        size_t offset = 0;
+        for (size_t i = 0; i < columns.size(); i++)
+        {
+            if (capture->isCompact && !columns[i].isInCompact)
+            {
+                capture->columnOffsets[i] = SIZE_MAX;
+                continue;
+            }
+            capture->columnOffsets[i] = offset;
+            if (!capture_format::isPacked(columns[i].type))
+            {
+                offset += columns[i].count * capture_format::typeSize(columns[i].type);
+                continue;
+            }
+            uint32_t packedSize = 0;
+            if (offset + sizeof(packedSize) <= capture->data.size())
+                memcpy(&packedSize, capture->data.data() + offset, sizeof(packedSize));
+            offset += sizeof(packedSize) + packedSize;
+            if (offset > capture->data.size())
+                break;
+        }
+        if (offset != capture->data.size())
+        {
+            error = "corrupt capture at timestamp " + std::to_string(captureHeader.timestamp);
+            return false;
+        }
+        return true;
+    }
+
+    bool CaptureReader::seekCapture(uint32_t offset)
+    {
+        error.clear();
+        if (!seek(payloadOffset + offset))
+        {
+            error = "can't seek to " + std::to_string(offset);
+            return false;
+        }
+        return true;
+    }
+
+    int CaptureReader::findColumn(const std::string &name) const
+    {
+        for (size_t i = 0; i < columns.size(); i++)
+        {
+            if (columns[i].name == name)
+                return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    bool CaptureReader::hasColumn(const Capture &capture, int column) const
+    {
+        return column >= 0 && column < static_cast<int>(columns.size()) && capture.columnOffsets[column] != SIZE_MAX;
+    }
+
+    std::vector<float> CaptureReader::getValues(const Capture &capture, int column) const
+    {
+        std::vector<float> values;
+        if (!hasColumn(capture, column) || columns[column].type == ColumnType::Text)
+            return values;
+
+        const Column &descriptor = columns[column];
+        const uint8_t *data = capture.data.data() + capture.columnOffsets[column];
+        values.resize(descriptor.count);
+        if (capture_format::isPacked(descriptor.type))
+        {
+            // next() checked the stream is within the capture
+            uint32_t packedSize;
+            memcpy(&packedSize, data, sizeof(packedSize));
+            std::vector<int16_t> packedValues(descriptor.count);
+            const bool isDecoded = descriptor.type == ColumnType::ImaAdpcm
+                                       ? ima_adpcm::decode(data + sizeof(packedSize), packedSize, packedValues.data(), descriptor.count)
+                                       : delta_codec::decode(data + sizeof(packedSize), packedSize, packedValues.data(), descriptor.count);
+            if (!isDecoded)
+            {
+                values.clear();
+                return values;
+            }
+            for (uint32_t i = 0; i < descriptor.count; i++)
+            {
+                values[i] = packedValues[i] * descriptor.scale;
+            }
+            return values;
+        }
+        for (uint32_t i = 0; i < descriptor.count; i++)
+        {
+            // memcpy as the columns have no alignment within the block
+            if (descriptor.type == ColumnType::UInt8)
+            {
+                values[i] = data[i] * descriptor.scale;
+            }
+            else if (descriptor.type == ColumnType::Int16)
+            {
+                int16_t value;
+                memcpy(&value, data + i * sizeof(value), sizeof(value));
+                values[i] = value * descriptor.scale;
+            }
+            else
+            {
+                float value;
+                memcpy(&value, data + i * sizeof(value), sizeof(value));
+                values[i] = value * descriptor.scale;
+            }
+        }
+        return values;
+    }
+
+    std::string CaptureReader::getText(const Capture &capture, int column) const
+    {
+        if (!hasColumn(capture, column) || columns[column].type != ColumnType::Text)
+            return std::string();
+
+        const char *text = reinterpret_cast<const char *>(capture.data.data() + capture.columnOffsets[column]);
+        return std::string(text, strnlen(text, columns[column].count));
+    }
+
+    bool readManifest(const std::string &path, std::vector<ManifestRecord> *records, std::string *error)
+    {
+        error->clear();
+        std::ifstream file(path, std::ios::binary);
+        capture_format::ManifestHeader header;
+        if (!file || !file.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != capture_format::manifestMagic)
+        {
+            *error = "not a capture manifest";
+            return false;
+        }
+        if (header.version != capture_format::manifestVersion || header.entrySize != sizeof(capture_format::ManifestEntry))
+        {
+            *error = "manifest version " + std::to_string(header.version) + " not supported";
+            return false;
+        }
+
+        ManifestRecord record;
+        while (file.read(reinterpret_cast<char *>(&record.entry), sizeof(record.entry)))
+        {
+            record.captureOffsets.resize(record.entry.numCaptures);
+            const size_t offsetsSize = record.captureOffsets.size() * sizeof(uint32_t);
+            if (record.entry.magic != capture_format::manifestEntryMagic ||
+                !file.read(reinterpret_cast<char *>(record.captureOffsets.data()), offsetsSize))
+            {
+                *error = "torn entry after " + std::to_string(records->size()) + " entries";
+                break;
+            }
+            const uint32_t crc = record.entry.crc;
+            record.entry.crc = 0;
+            if (checksum::crc32(record.captureOffsets.data(), offsetsSize, checksum::crc32(&record.entry, sizeof(record.entry))) != crc)
+            {
+                *error = "corrupt entry after " + std::to_string(records->size()) + " entries";
+                break;
+            }
+            record.entry.crc = crc;
+            record.entry.path[capture_format::maxPathLength] = '\0';
+            records->push_back(record);
+        }
+        if (error->empty() && file.gcount() != 0)
+            *error = "torn entry after " + std::to_string(records->size()) + " entries";
+        return true;
+    }
+
+    const char *typeName(ColumnType type)
+    {
+        switch (type)
+        {
+        case ColumnType::UInt8:
+            return "uint8";
+        case ColumnType::Int16:
+            return "int16";
+        case ColumnType::Float32:
+            return "float32";
+        case ColumnType::PackedInt16:
+            return "packed int16";
+        case ColumnType::ImaAdpcm:
+            return "ima adpcm";
+        case ColumnType::Text:
+            return "text";
+        }
+        return "unknown";
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef CAPTURE_DECODER_H
+#define CAPTURE_DECODER_H
+
+#include <stdint.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "capture_format.h"
+
+/**
+ * Host reader of the binary capture files (capture_format.h), from a file or from memory, e.g. a mapped file.
+ * The schema is read from the file itself, so files of any firmware config decode without it.
+ */
+namespace capture_decoder
+{
+    struct Column
+    {
+        std::string name;
+        capture_format::ColumnType type;
+        bool isInCompact;
+        uint32_t count;
+        float scale;
+    };
+
+    struct Capture
+    {
+        uint32_t timestamp;
+        bool isCompact;
+        std::vector<uint8_t> data;
+        // Byte offset of each column in data, SIZE_MAX for the columns a compact capture doesn't carry
+        std::vector<size_t> columnOffsets;
+    };
+
+    // A manifest entry and its capture offsets
+    struct ManifestRecord
+    {
+        capture_format::ManifestEntry entry;
+        std::vector<uint32_t> captureOffsets;
+    };
+
+    class CaptureReader
+    {
+    private:
+        std::ifstream file;
+        // Instead of the file after open() from memory
+        const uint8_t *memory = nullptr;
+        size_t memorySize = 0;
+        size_t memoryPosition = 0;
+        // Where the capture file starts, past the LogRecordHeader in a capture log
+        uint64_t payloadOffset = 0;
+        capture_format::FileHeader fileHeader;
+        std::vector<Column> columns;
+        uint32_t fullCaptureSize = 0;
+        uint32_t compactCaptureSize = 0;
+        std::string error;
+
+        /**
+         * @return The bytes read, fewer at the end
+         */
+        size_t read(void *output, size_t size);
+        bool seek(uint64_t offset);
+        bool readSchema();
+
+    public:
+        /**
+         * Open a capture file and read its header and schema
+         * @param payloadOffset Where the capture file starts, e.g. ManifestEntry::payloadOffset of a capture log record
+         * @return false when it can't be read or isn't a capture file, see getError()
+         */
+        bool open(const std::string &path, uint64_t payloadOffset = 0);
+
+        /**
+         * Same from a capture file in memory, which must outlive the reader
+         * @param data Where the capture file starts
+         * @param size Its bytes
+         */
+        bool open(const uint8_t *data, size_t size);
+
+        /**
+         * Go straight to a capture, for the next call to next()
+         * @param offset Offset of its CaptureHeader in the capture file, e.g. from the manifest
+         */
+        bool seekCapture(uint32_t offset);
+
+        /**
+         * Read the next capture
+         * @return false at the end of the file, or on a corrupt or truncated capture, see getError()
+         */
+        bool next(Capture *capture);
+
+        /**
+         * Index of a column in the schema, -1 when the file doesn't have it
+         */
+        int findColumn(const std::string &name) const;
+
+        /**
+         * Whether a capture stores a column
+         */
+        bool hasColumn(const Capture &capture, int column) const;
+
+        /**
+         * Physical values of a column, i.e. stored values times the column scale, unpacking the packed columns.
+         * Empty when the capture doesn't store it, its packed stream is corrupt or it's a text column
+         */
+        std::vector<float> getValues(const Capture &capture, int column) const;
+
+        /**
+         * String of a text column, e.g. the name of the capture's WAV file.
+         * Empty when the capture doesn't store it or the column isn't text
+         */
+        std::string getText(const Capture &capture, int column) const;
+
+        const capture_format::FileHeader &getFileHeader() const { return fileHeader; }
+        const std::vector<Column> &getColumns() const { return columns; }
+        // Empty unless open() or next() failed
+        const std::string &getError() const { return error; }
+    };
+
+    /**
+     * Read the entries of a capture manifest, up to the end or to an entry torn by a reset
+     * @param records Gets the entries in the order they were written
+     * @param error Gets why the manifest can't be read, or why the entries stop before its end
+     * @return false when it can't be read or isn't a manifest
+     */
+    bool readManifest(const std::string &path, std::vector<ManifestRecord> *records, std::string *error);
+
+    const char *typeName(capture_format::ColumnType type);
+}
+
+#endif // CAPTURE_DECODER_H
@@ -0,0 +1,183 @@
+/**
+ * Decoder of the binary capture files the sampler saves with FileFormat::Binary.
+ * Prints the file header, the schema and a capture count, or with --csv every capture as one CSV row
+ * (a column with several values per capture spans name_0..name_n-1, left empty for compact captures,
+ * and a text column such as audioFile is one string).
+ *
+ *   pio run -e capture_decoder && .pio/build/capture_decoder/program <file.bin> [--csv] [--columns accX,modelClass]
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "capture_decoder.h"
+
+namespace
+{
+    struct Options
+    {
+        const char *path = nullptr;
+        bool isCsv = false;
+        const char *columns = nullptr; // Comma separated, nullptr for all
+    };
+
+    bool parseOptions(int argc, char **argv, Options *options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--csv") == 0)
+                options->isCsv = true;
+            else if (strcmp(argv[i], "--columns") == 0 && i + 1 < argc)
+                options->columns = argv[++i];
+            else if (argv[i][0] != '-' && options->path == nullptr)
+                options->path = argv[i];
+            else
+                return false;
+        }
+        return options->path != nullptr;
+    }
+
+    bool selectColumns(const capture_decoder::CaptureReader &reader, const char *names, std::vector<int> *selected)
+    {
+        if (names == nullptr)
+        {
+            for (size_t i = 0; i < reader.getColumns().size(); i++)
+                selected->push_back(static_cast<int>(i));
+            return true;
+        }
+
+        std::stringstream stream(names);
+        std::string name;
+        while (std::getline(stream, name, ','))
+        {
+            const int column = reader.findColumn(name);
+            if (column < 0)
+            {
+                fprintf(stderr, "No column %s in the file\n", name.c_str());
+                return false;
+            }
+            selected->push_back(column);
+        }
+        return true;
+    }
+
+    void printCsvHeader(const capture_decoder::CaptureReader &reader, const std::vector<int> &selected)
+    {
+        printf("timestamp,compact");
+        for (int column : selected)
+        {
+            const capture_decoder::Column &descriptor = reader.getColumns()[column];
+            if (descriptor.count == 1 || descriptor.type == capture_format::ColumnType::Text)
+            {
+                printf(",%s", descriptor.name.c_str());
+                continue;
+            }
+            for (uint32_t i = 0; i < descriptor.count; i++)
+                printf(",%s_%u", descriptor.name.c_str(), i);
+        }
+        printf("\n");
+    }
+
+    void printCsvRow(const capture_decoder::CaptureReader &reader, const capture_decoder::Capture &capture, const std::vector<int> &selected)
+    {
+        printf("%u,%d", capture.timestamp, capture.isCompact ? 1 : 0);
+        for (int column : selected)
+        {
+            const bool isText = reader.getColumns()[column].type == capture_format::ColumnType::Text;
+            const uint32_t count = isText ? 1u : reader.getColumns()[column].count;
+            if (!reader.hasColumn(capture, column))
+            {
+                for (uint32_t i = 0; i < count; i++)
+                    printf(",");
+                continue;
+            }
+            if (isText)
+            {
+                printf(",%s", reader.getText(capture, column).c_str());
+                continue;
+            }
+            const std::vector<float> values = reader.getValues(capture, column);
+            if (values.size() != count)
+            {
+                // A corrupt packed stream, empty fields keep the later columns in place
+                fprintf(stderr, "Capture at %u ms: %s can't be decoded\n", capture.timestamp, reader.getColumns()[column].name.c_str());
+                for (uint32_t i = 0; i < count; i++)
+                    printf(",");
+                continue;
+            }
+            for (float value : values)
+                printf(",%.9g", value);
+        }
+        printf("\n");
+    }
+
+    void printSummary(const capture_decoder::CaptureReader &reader)
+    {
+        const capture_format::FileHeader &header = reader.getFileHeader();
+        printf("Format version %u, acc %.1f Hz, mic %.1f Hz, envelope bin %.3f Hz\n",
+               header.formatVersion, header.accSamplingFrequency, header.micSamplingRate, header.envelopeBinHz);
+        printf("%-20s %-8s %8s %12s %s\n", "column", "type", "count", "scale", "compact");
+        for (const capture_decoder::Column &column : reader.getColumns())
+        {
+            printf("%-20s %-8s %8u %12.6g %s\n", column.name.c_str(), capture_decoder::typeName(column.type),
+                   column.count, column.scale, column.isInCompact ? "yes" : "no");
+        }
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options))
+    {
+        fprintf(stderr, "Usage: %s <file.bin> [--csv] [--columns name,name,...]\n", argv[0]);
+        return 2;
+    }
+
+    capture_decoder::CaptureReader reader;
+    if (!reader.open(options.path))
+    {
+        fprintf(stderr, "%s: %s\n", options.path, reader.getError().c_str());
+        return 1;
+    }
+
+    std::vector<int> selected;
+    if (!selectColumns(reader, options.columns, &selected))
+        return 1;
+
+    if (options.isCsv)
+        printCsvHeader(reader, selected);
+    else
+        printSummary(reader);
+
+    capture_decoder::Capture capture;
+    int numFull = 0;
+    int numCompact = 0;
+    uint32_t firstTimestamp = 0;
+    uint32_t lastTimestamp = 0;
+    while (reader.next(&capture))
+    {
+        if (numFull + numCompact == 0)
+            firstTimestamp = capture.timestamp;
+        lastTimestamp = capture.timestamp;
+        capture.isCompact ? numCompact++ : numFull++;
+
+        if (options.isCsv)
+            printCsvRow(reader, capture, selected);
+    }
+
+    if (!options.isCsv)
+    {
+        printf("Captures: %d full, %d compact, timestamps %u to %u ms\n", numFull, numCompact, firstTimestamp, lastTimestamp);
+    }
+    if (!reader.getError().empty())
+    {
+        // The captures before the damage were still decoded
+        fprintf(stderr, "%s: %s\n", options.path, reader.getError().c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef CAPTURE_LOG_HOST_ARDUINO_H
+#define CAPTURE_LOG_HOST_ARDUINO_H
+
+/**
+ * The little of the Arduino core that the capture log and the options need, to run them on the host
+ */
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+using std::max;
+using std::min;
+
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t byte) = 0;
+
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t written = 0;
+        for (size_t i = 0; i < size; i++)
+            written += write(buffer[i]);
+        return written;
+    }
+
+    size_t print(const char *text) { return write(reinterpret_cast<const uint8_t *>(text), strlen(text)); }
+    size_t print(int number) { return print(static_cast<long>(number)); }
+    size_t print(unsigned int number) { return print(static_cast<unsigned long>(number)); }
+    size_t print(long number) { return printf("%ld", number); }
+    size_t print(unsigned long number) { return printf("%lu", number); }
+    size_t print(double number, int digits = 2) { return printf("%.*f", digits, number); }
+
+    template <typename T>
+    size_t println(T value) { return print(value) + println(); }
+    size_t println(double number, int digits) { return print(number, digits) + println(); }
+    size_t println() { return print("\n"); }
+};
+
+// Prints to stdout
+class HostSerial : public Print
+{
+public:
+    size_t write(uint8_t byte) override { return fputc(byte, stdout) == EOF ? 0 : 1; }
+    using Print::write;
+};
+
+extern HostSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+
+#endif // CAPTURE_LOG_HOST_ARDUINO_H
@@ -0,0 +1,68 @@
+#ifndef CAPTURE_LOG_HOST_SD_H
+#define CAPTURE_LOG_HOST_SD_H
+
+/**
+ * SD library stand-in over a host directory, which also plays the card: every write is tallied by whether
+ * it covers whole 512 byte blocks, as those are the ones the SD library sends straight to the card
+ */
+#include <string>
+
+#include "Arduino.h"
+
+#define FILE_READ 0x01
+#define FILE_WRITE 0x17 // O_READ | O_WRITE | O_APPEND | O_CREAT, as the SD library
+#define O_RDWR 0x03
+#define O_APPEND 0x04
+#define O_CREAT 0x10
+
+struct BlockDeviceStats
+{
+    unsigned long numBlockWrites = 0;   // Writes of whole blocks at block aligned offsets
+    unsigned long numPartialWrites = 0; // Writes the card would have to read, modify and write
+    unsigned long numBytesWritten = 0;
+};
+
+class File : public Print
+{
+private:
+    FILE *stream = nullptr;
+    bool isAppend = false;
+
+public:
+    File() {}
+    File(FILE *_stream, bool _isAppend) : stream(_stream), isAppend(_isAppend) {}
+
+    size_t write(uint8_t byte) override { return write(&byte, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+
+    int read(void *buffer, uint16_t size);
+    bool seek(uint32_t position);
+    uint32_t position();
+    uint32_t size();
+    void flush();
+    void close();
+    operator bool() const { return stream != nullptr; }
+};
+
+class SDClass
+{
+private:
+    std::string root;
+
+public:
+    BlockDeviceStats stats;
+
+    // Host only: the directory the card's root maps to
+    bool begin(const std::string &_root);
+
+    File open(const char *path, uint8_t mode = FILE_READ);
+    bool exists(const char *path);
+    bool remove(const char *path);
+    // Creates the missing parents too, like the SD library
+    bool mkdir(const char *path);
+};
+
+extern SDClass SD;
+
+#endif // CAPTURE_LOG_HOST_SD_H
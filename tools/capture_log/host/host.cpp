@@ -0,0 +1,115 @@
+#include <chrono>
+#include <filesystem>
+
+#include "Arduino.h"
+#include "SD.h"
+
+HostSerial Serial;
+SDClass SD;
+
+namespace
+{
+    const auto startTime = std::chrono::steady_clock::now();
+    constexpr uint32_t blockSize = 512;
+}
+
+unsigned long millis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+size_t File::write(const uint8_t *buffer, size_t size)
+{
+    if (stream == nullptr)
+        return 0;
+    if (isAppend)
+        fseek(stream, 0, SEEK_END);
+
+    const uint32_t start = position();
+    if (start % blockSize == 0 && size % blockSize == 0)
+        SD.stats.numBlockWrites += size / blockSize;
+    else
+        SD.stats.numPartialWrites++;
+
+    const size_t written = fwrite(buffer, 1, size, stream);
+    SD.stats.numBytesWritten += written;
+    return written;
+}
+
+int File::read(void *buffer, uint16_t size)
+{
+    return stream != nullptr ? static_cast<int>(fread(buffer, 1, size, stream)) : -1;
+}
+
+bool File::seek(uint32_t position)
+{
+    // Like the SD library, no seeking past the end
+    return stream != nullptr && position <= size() && fseek(stream, position, SEEK_SET) == 0;
+}
+
+uint32_t File::position()
+{
+    return stream != nullptr ? static_cast<uint32_t>(ftell(stream)) : 0;
+}
+
+uint32_t File::size()
+{
+    if (stream == nullptr)
+        return 0;
+    const long current = ftell(stream);
+    fseek(stream, 0, SEEK_END);
+    const long end = ftell(stream);
+    fseek(stream, current, SEEK_SET);
+    return static_cast<uint32_t>(end);
+}
+
+void File::flush()
+{
+    if (stream != nullptr)
+        fflush(stream);
+}
+
+void File::close()
+{
+    if (stream != nullptr)
+        fclose(stream);
+    stream = nullptr;
+}
+
+bool SDClass::begin(const std::string &_root)
+{
+    root = _root;
+    return std::filesystem::is_directory(root);
+}
+
+File SDClass::open(const char *path, uint8_t mode)
+{
+    const std::string fullPath = root + "/" + path;
+    const bool isExisting = std::filesystem::exists(fullPath);
+    if (!isExisting && !(mode & O_CREAT))
+        return File();
+    FILE *stream = fopen(fullPath.c_str(), mode == FILE_READ ? "rb" : (isExisting ? "r+b" : "w+b"));
+    return File(stream, (mode & O_APPEND) != 0);
+}
+
+bool SDClass::exists(const char *path)
+{
+    return std::filesystem::exists(root + "/" + path);
+}
+
+bool SDClass::remove(const char *path)
+{
+    return std::filesystem::remove(root + "/" + path);
+}
+
+bool SDClass::mkdir(const char *path)
+{
+    std::error_code error;
+    std::filesystem::create_directories(root + "/" + path, error);
+    return !error;
+}
@@ -0,0 +1,270 @@
+/**
+ * Host check of the capture log (SamplerOptions::logFileSize), and extraction of its records.
+ *
+ * check: records of random sizes go through CaptureLog into a temporary directory standing in for the SD card
+ * (host/SD.h), with small files so they roll over. Then it reboots: after an interrupted record, after a commit
+ * whose tail wasn't written and without a tail at all. Exits with 1 unless every write covered whole blocks,
+ * every file kept its preallocated size and every record reads back intact and in sequence across the boots.
+ *
+ * extract: writes each intact record of a log file as its own capture file, "<sequence>.bin" or "<sequence>.txt"
+ * by the extension the firmware gives them, for capture_decoder and vibration_model_check.
+ *
+ *   pio run -e capture_log && .pio/build/capture_log/program check
+ *   pio run -e capture_log && .pio/build/capture_log/program extract <CAP00001.LOG> <output dir>
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "SD.h"
+#include "capture_format.h"
+#include "capture_log.h"
+#include "checksum.h"
+
+namespace
+{
+    constexpr uint32_t logFileSize = 64 * 1024;
+    constexpr int numRecords = 200;
+    constexpr int numResumedRecords = 40;
+    constexpr int numRestartedRecords = 10;
+
+    uint32_t randomState = 0x2468ace0;
+
+    // Fixed seed LCG, so every run sees the same records
+    uint32_t nextRandom()
+    {
+        randomState = randomState * 1664525u + 1013904223u;
+        return randomState >> 8;
+    }
+
+    typedef std::function<void(const capture_format::LogRecordHeader &header, const std::vector<uint8_t> &payload, bool isIntact)> RecordCallback;
+
+    /**
+     * Read the records of a log file until the first block without a committed record header
+     * @return The number of records read, -1 when the file can't be opened
+     */
+    int readRecords(const std::filesystem::path &path, const RecordCallback &callback)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return -1;
+
+        int numRead = 0;
+        capture_format::LogRecordHeader header;
+        std::vector<uint8_t> payload;
+        for (uint64_t offset = 0;; numRead++)
+        {
+            file.seekg(offset);
+            if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != capture_format::logRecordMagic ||
+                header.headerCrc != checksum::crc32(&header, offsetof(capture_format::LogRecordHeader, headerCrc)))
+                break;
+            payload.resize(header.size);
+            if (!file.read(reinterpret_cast<char *>(payload.data()), header.size))
+                break;
+            callback(header, payload, checksum::crc32(payload.data(), payload.size()) == header.payloadCrc);
+
+            const uint64_t recordBytes = sizeof(header) + header.size;
+            offset += (recordBytes + capture_format::logBlockSize - 1) / capture_format::logBlockSize * capture_format::logBlockSize;
+        }
+        return numRead;
+    }
+
+    int check()
+    {
+        const std::filesystem::path root = std::filesystem::temp_directory_path() / "capture_log_check";
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root);
+        SD.begin(root.string());
+
+        SamplerOptions samplerOptions(true, LogLevel::None);
+        samplerOptions.logFileSize = logFileSize;
+        // A few blocks per write, like a card tuned by sd_benchmark
+        samplerOptions.sdWriteSize = 2048;
+        AccOptions accOptions;
+        MicOptions micOptions;
+        SamplerConfig samplerConfig(&samplerOptions, &accOptions, &micOptions);
+
+        // Mostly similar sizes like the saved buffers, plus an occasional larger one that grows a file
+        std::vector<std::vector<uint8_t>> records;
+        auto writeRecord = [&](CaptureLog *captureLog)
+        {
+            const int i = static_cast<int>(records.size());
+            const size_t size = (i % 37 == 36) ? 20000 + nextRandom() % 30000 : 3000 + nextRandom() % 6000;
+            records.emplace_back(size);
+            for (size_t j = 0; j < size; j++)
+                records[i][j] = static_cast<uint8_t>(nextRandom());
+
+            captureLog->beginRecord();
+            // Byte by byte and in odd chunks, like the JSON and binary writers
+            size_t written = 0;
+            while (written < size)
+            {
+                const size_t chunk = std::min<size_t>(size - written, nextRandom() % 3 == 0 ? 1 : 1 + nextRandom() % 700);
+                captureLog->write(records[i].data() + written, chunk);
+                written += chunk;
+            }
+            if (!captureLog->endRecord())
+            {
+                printf("Failed to write record %d\n", i);
+                return false;
+            }
+            return true;
+        };
+        auto listLogFiles = [&]()
+        {
+            std::vector<std::filesystem::path> paths;
+            for (const auto &entry : std::filesystem::directory_iterator(root))
+            {
+                if (entry.path().extension() == ".LOG")
+                    paths.push_back(entry.path());
+            }
+            std::sort(paths.begin(), paths.end());
+            return paths;
+        };
+        // Each boot gets a new CaptureLog, the previous one is dropped as is, like by a reset
+        auto boot = [&](const char *name)
+        {
+            CaptureLog *captureLog = new CaptureLog(&samplerConfig);
+            const unsigned long startUs = micros();
+            const bool isStarted = captureLog->begin();
+            const unsigned long elapsedUs = micros() - startUs;
+            if (!isStarted)
+            {
+                printf("Failed to start the log %s\n", name);
+                return static_cast<CaptureLog *>(nullptr);
+            }
+            printf("Boot %s: %s in %lu us\n", name, captureLog->getFileName(), elapsedUs);
+            return captureLog;
+        };
+
+        bool isPassing = true;
+        CaptureLog *captureLog = boot("on a new card");
+        if (captureLog == nullptr)
+            return 1;
+        for (int i = 0; i < numRecords; i++)
+        {
+            if (!writeRecord(captureLog))
+                return 1;
+        }
+
+        // Interrupted record: a reboot before endRecord() must resume right after the last committed one, in its file
+        captureLog->beginRecord();
+        std::vector<uint8_t> unfinished(20000, 0xab);
+        captureLog->write(unfinished.data(), unfinished.size());
+        const std::string lastFileName = captureLog->getFileName();
+        const size_t numFilesBefore = listLogFiles().size();
+        captureLog = boot("after an interrupted record");
+        if (captureLog == nullptr)
+            return 1;
+        if (lastFileName != captureLog->getFileName() || listLogFiles().size() != numFilesBefore)
+        {
+            printf("The log didn't resume in %s\n", lastFileName.c_str());
+            isPassing = false;
+        }
+        for (int i = 0; i < numResumedRecords - 1; i++)
+        {
+            if (!writeRecord(captureLog))
+                return 1;
+        }
+
+        // Reset between a commit and its tail: the tail from before the commit must be rolled forward
+        const std::filesystem::path tailPath = root / capture_format::logTailFileName;
+        const std::filesystem::path savedTailPath = root / "TAIL.SAV";
+        std::filesystem::copy_file(tailPath, savedTailPath);
+        if (!writeRecord(captureLog))
+            return 1;
+        std::filesystem::copy_file(savedTailPath, tailPath, std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::remove(savedTailPath);
+        captureLog = boot("with a stale tail");
+        if (captureLog == nullptr || !writeRecord(captureLog))
+            return 1;
+
+        // Lost tail: a new file after the last one, with the sequence going on
+        std::filesystem::remove(tailPath);
+        captureLog = boot("without a tail");
+        if (captureLog == nullptr)
+            return 1;
+        for (int i = 0; i < numRestartedRecords; i++)
+        {
+            if (!writeRecord(captureLog))
+                return 1;
+        }
+
+        const int numWritten = static_cast<int>(records.size());
+        int numFiles = 0;
+        int numRead = 0;
+        for (const auto &path : listLogFiles())
+        {
+            numFiles++;
+            if (std::filesystem::file_size(path) < logFileSize)
+            {
+                printf("%s is smaller than its preallocation\n", path.filename().c_str());
+                isPassing = false;
+            }
+            readRecords(path, [&](const capture_format::LogRecordHeader &header, const std::vector<uint8_t> &payload, bool isIntact)
+                        {
+                if (!isIntact || header.sequence != static_cast<uint32_t>(numRead) || numRead >= numWritten || payload != records[numRead])
+                {
+                    printf("Record %u in %s doesn't match\n", header.sequence, path.filename().c_str());
+                    isPassing = false;
+                }
+                numRead++; });
+        }
+        if (numRead != numWritten)
+        {
+            printf("Read %d records back out of %d\n", numRead, numWritten);
+            isPassing = false;
+        }
+        if (SD.stats.numPartialWrites != 0)
+        {
+            printf("%lu writes weren't whole blocks\n", SD.stats.numPartialWrites);
+            isPassing = false;
+        }
+
+        printf("Records: %d written over 4 boots, %d read back, over %d files of %u bytes\n", numWritten, numRead, numFiles, logFileSize);
+        printf("Card writes: %lu whole blocks, %lu partial\n", SD.stats.numBlockWrites, SD.stats.numPartialWrites);
+        printf("capture log: %s\n", isPassing ? "PASS" : "FAIL");
+        std::filesystem::remove_all(root);
+        return isPassing ? 0 : 1;
+    }
+
+    int extract(const char *logPath, const char *outputDirectory)
+    {
+        std::filesystem::create_directories(outputDirectory);
+        const int numRead = readRecords(logPath, [&](const capture_format::LogRecordHeader &header, const std::vector<uint8_t> &payload, bool isIntact)
+                                        {
+            if (!isIntact)
+            {
+                fprintf(stderr, "Record %u is corrupt, skipped\n", header.sequence);
+                return;
+            }
+            uint32_t magic = 0;
+            memcpy(&magic, payload.data(), std::min(payload.size(), sizeof(magic)));
+            const std::string name = std::to_string(header.sequence) + (magic == capture_format::fileMagic ? ".bin" : ".txt");
+            std::ofstream output(std::filesystem::path(outputDirectory) / name, std::ios::binary);
+            output.write(reinterpret_cast<const char *>(payload.data()), payload.size()); });
+        if (numRead < 0)
+        {
+            fprintf(stderr, "Can't open %s\n", logPath);
+            return 1;
+        }
+        printf("Extracted %d records to %s\n", numRead, outputDirectory);
+        return 0;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "check") == 0)
+        return check();
+    if (argc == 4 && strcmp(argv[1], "extract") == 0)
+        return extract(argv[2], argv[3]);
+
+    fprintf(stderr, "Usage: %s check | extract <log file> <output dir>\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,185 @@
+/**
+ * Lists the capture manifest of an SD card (capture_format.h) and reads single captures straight from it.
+ * Without --capture, prints the entries matching the filters: the file, its boot and sequence, the time range,
+ * the number of captures, the trigger and the movement states. With --capture <entry>:<index>, seeks to that
+ * capture of the entry numbered in the listing and prints it, its columns for a binary file, its object for JSON,
+ * without reading the rest of the file.
+ *
+ *   pio run -e capture_manifest && .pio/build/capture_manifest/program <card dir> [--boot 12] [--from ms] [--to ms] [--trigger Interval]
+ *   pio run -e capture_manifest && .pio/build/capture_manifest/program <card dir> --capture 3:0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "capture_decoder.h"
+
+namespace
+{
+    // As the firmware enums
+    const char *const triggerNames[] = {"Interval", "AccRaw", "Movement", "Microphone", "AccGoertzel"};
+    const char *const movingStatusNames[] = {"Stopped", "Accelerating", "Steady", "Stopping"};
+    constexpr int binaryFileFormat = 1;
+
+    struct Options
+    {
+        const char *cardDirectory = nullptr;
+        long boot = -1;
+        uint32_t fromMillis = 0;
+        uint32_t toMillis = UINT32_MAX;
+        const char *trigger = nullptr;
+        const char *capture = nullptr; // <entry>:<index>
+    };
+
+    bool parseOptions(int argc, char **argv, Options *options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const bool hasValue = i + 1 < argc;
+            if (strcmp(argv[i], "--boot") == 0 && hasValue)
+                options->boot = atol(argv[++i]);
+            else if (strcmp(argv[i], "--from") == 0 && hasValue)
+                options->fromMillis = strtoul(argv[++i], nullptr, 10);
+            else if (strcmp(argv[i], "--to") == 0 && hasValue)
+                options->toMillis = strtoul(argv[++i], nullptr, 10);
+            else if (strcmp(argv[i], "--trigger") == 0 && hasValue)
+                options->trigger = argv[++i];
+            else if (strcmp(argv[i], "--capture") == 0 && hasValue)
+                options->capture = argv[++i];
+            else if (argv[i][0] != '-' && options->cardDirectory == nullptr)
+                options->cardDirectory = argv[i];
+            else
+                return false;
+        }
+        return options->cardDirectory != nullptr;
+    }
+
+    const char *triggerName(uint8_t trigger)
+    {
+        return trigger < sizeof(triggerNames) / sizeof(triggerNames[0]) ? triggerNames[trigger] : "unknown";
+    }
+
+    bool isMatching(const capture_format::ManifestEntry &entry, const Options &options)
+    {
+        return (options.boot < 0 || entry.bootCount == static_cast<uint32_t>(options.boot)) &&
+               entry.lastTimestamp >= options.fromMillis && entry.firstTimestamp <= options.toMillis &&
+               (options.trigger == nullptr || strcmp(triggerName(entry.trigger), options.trigger) == 0);
+    }
+
+    void printEntries(const std::vector<capture_decoder::ManifestRecord> &records, const Options &options)
+    {
+        printf("%5s %6s %8s  %-28s %8s %21s  %-11s %s\n", "entry", "boot", "sequence", "path", "captures", "time (ms)", "trigger", "movement");
+        int numMatching = 0;
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            const capture_format::ManifestEntry &entry = records[i].entry;
+            if (!isMatching(entry, options))
+                continue;
+            numMatching++;
+
+            std::string movement;
+            for (int status = 0; status < 4; status++)
+            {
+                if (entry.movingStatuses & (1 << status))
+                    movement += (movement.empty() ? "" : ",") + std::string(movingStatusNames[status]);
+            }
+            printf("%5zu %6u %8u  %-28s %8u %10u-%-10u  %-11s %s\n", i, entry.bootCount, entry.sequence, entry.path,
+                   entry.numCaptures, entry.firstTimestamp, entry.lastTimestamp, triggerName(entry.trigger), movement.c_str());
+        }
+        printf("%d of %zu entries\n", numMatching, records.size());
+    }
+
+    bool printBinaryCapture(const std::string &path, const capture_format::ManifestEntry &entry, uint32_t offset)
+    {
+        capture_decoder::CaptureReader reader;
+        capture_decoder::Capture capture;
+        if (!reader.open(path, entry.payloadOffset) || !reader.seekCapture(offset) || !reader.next(&capture))
+        {
+            fprintf(stderr, "%s: %s\n", path.c_str(), reader.getError().c_str());
+            return false;
+        }
+
+        printf("timestamp: %u\ncompact: %d\n", capture.timestamp, capture.isCompact ? 1 : 0);
+        for (size_t column = 0; column < reader.getColumns().size(); column++)
+        {
+            if (!reader.hasColumn(capture, static_cast<int>(column)))
+                continue;
+            printf("%s:", reader.getColumns()[column].name.c_str());
+            if (reader.getColumns()[column].type == capture_format::ColumnType::Text)
+            {
+                printf(" %s", reader.getText(capture, static_cast<int>(column)).c_str());
+            }
+            for (float value : reader.getValues(capture, static_cast<int>(column)))
+                printf(" %.9g", value);
+            printf("\n");
+        }
+        return true;
+    }
+
+    /**
+     * Print the JSON object of a capture, which ends where the next one starts or before the closing "]}"
+     */
+    bool printJsonCapture(const std::string &path, const capture_decoder::ManifestRecord &record, size_t index)
+    {
+        const capture_format::ManifestEntry &entry = record.entry;
+        const uint32_t start = record.captureOffsets[index];
+        const uint32_t end = index + 1 < record.captureOffsets.size() ? record.captureOffsets[index + 1] : entry.payloadSize - 2;
+        std::ifstream file(path, std::ios::binary);
+        std::string text(end > start ? end - start : 0, '\0');
+        if (!file || !file.seekg(entry.payloadOffset + start) || !file.read(&text[0], text.size()))
+        {
+            fprintf(stderr, "%s: can't read the capture\n", path.c_str());
+            return false;
+        }
+        // Every capture but the first starts with the comma that separates it from the previous one
+        printf("%s\n", text.c_str() + (text.compare(0, 1, ",") == 0 ? 1 : 0));
+        return true;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options))
+    {
+        fprintf(stderr, "Usage: %s <card dir> [--boot count] [--from ms] [--to ms] [--trigger name] [--capture entry:index]\n", argv[0]);
+        return 2;
+    }
+
+    const std::filesystem::path card(options.cardDirectory);
+    std::vector<capture_decoder::ManifestRecord> records;
+    std::string error;
+    if (!capture_decoder::readManifest((card / capture_format::manifestFileName).string(), &records, &error))
+    {
+        fprintf(stderr, "%s: %s\n", options.cardDirectory, error.c_str());
+        return 1;
+    }
+    if (!error.empty())
+        fprintf(stderr, "Manifest: %s, the rest is ignored\n", error.c_str());
+
+    if (options.capture == nullptr)
+    {
+        printEntries(records, options);
+        return 0;
+    }
+
+    size_t entryIndex = 0;
+    size_t captureIndex = 0;
+    if (sscanf(options.capture, "%zu:%zu", &entryIndex, &captureIndex) != 2 || entryIndex >= records.size() ||
+        captureIndex >= records[entryIndex].captureOffsets.size())
+    {
+        fprintf(stderr, "No capture %s in the manifest\n", options.capture);
+        return 1;
+    }
+    const capture_decoder::ManifestRecord &record = records[entryIndex];
+    const std::string path = (card / record.entry.path).string();
+    const bool isPrinted = record.entry.fileFormat == binaryFileFormat
+                               ? printBinaryCapture(path, record.entry, record.captureOffsets[captureIndex])
+                               : printJsonCapture(path, record, captureIndex);
+    return isPrinted ? 0 : 1;
+}
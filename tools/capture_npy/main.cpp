@@ -0,0 +1,686 @@
+/**
+ * Converts a directory of device capture files to NumPy on every core, for analysis without parsing them in Python.
+ * Reads the JSON documents (FileFormat::Json), the binary capture files (FileFormat::Binary, through
+ * capture_decoder.h) and the capture logs (SamplerOptions::logFileSize, a conversion per record), each one memory
+ * mapped, and writes a .npy per channel of each file: timestamp.npy, then one per column or JSON key, with a row per
+ * capture, e.g. frequenciesX.npy as float32 (captures, samples), summaryX.mean.npy as float32 (captures,),
+ * audioFile.npy as fixed width unicode. A capture that doesn't carry a channel, e.g. a compact one, has NaN in it.
+ * The output mirrors the input tree, a directory per file: <output dir>/B00001/S000/00000001.bin/accX.npy, and
+ * <output dir>/CAP00001.LOG/12/accX.npy for record 12 of a log. Load them with numpy.load(path, mmap_mode="r").
+ *
+ * Prints the input MB/s. --scaling converts everything again with 1, 2, 4... threads up to --threads, to check
+ * the conversion keeps up with the disk rather than the parsing.
+ *
+ *   pio run -e capture_npy && .pio/build/capture_npy/program <input dir> <output dir> [--threads 8] [--scaling]
+ */
+#include <fcntl.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "capture_decoder.h"
+#include "checksum.h"
+
+namespace
+{
+    struct Options
+    {
+        const char *inputDirectory = nullptr;
+        const char *outputDirectory = nullptr;
+        int numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        bool isScaling = false;
+    };
+
+    bool parseOptions(int argc, char **argv, Options *options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+                options->numThreads = std::max(1, atoi(argv[++i]));
+            else if (strcmp(argv[i], "--scaling") == 0)
+                options->isScaling = true;
+            else if (argv[i][0] != '-' && options->inputDirectory == nullptr)
+                options->inputDirectory = argv[i];
+            else if (argv[i][0] != '-' && options->outputDirectory == nullptr)
+                options->outputDirectory = argv[i];
+            else
+                return false;
+        }
+        return options->inputDirectory != nullptr && options->outputDirectory != nullptr;
+    }
+
+    /**
+     * Read-only mapping of a whole file, unmapped when it goes out of scope
+     */
+    class MappedFile
+    {
+    private:
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+
+    public:
+        ~MappedFile()
+        {
+            if (data != nullptr)
+                munmap(const_cast<uint8_t *>(data), size);
+        }
+
+        bool open(const std::string &path)
+        {
+            const int descriptor = ::open(path.c_str(), O_RDONLY);
+            if (descriptor < 0)
+                return false;
+            struct stat status;
+            if (fstat(descriptor, &status) != 0 || status.st_size == 0)
+            {
+                close(descriptor);
+                return false;
+            }
+            size = static_cast<size_t>(status.st_size);
+            void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            // The mapping keeps its own reference to the file
+            close(descriptor);
+            if (mapping == MAP_FAILED)
+                return false;
+            // Read once from start to end, so the kernel can read ahead and drop the pages behind
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            data = static_cast<const uint8_t *>(mapping);
+            return true;
+        }
+
+        const uint8_t *getData() const { return data; }
+        size_t getSize() const { return size; }
+    };
+
+    // A channel of one converted file, a row of count values per capture
+    struct Channel
+    {
+        std::string name;
+        bool isText = false;
+        uint32_t count = 0;
+        std::vector<float> values;
+        std::vector<std::string> texts;
+    };
+
+    /**
+     * The channels of one capture file, filled a capture (row) at a time
+     */
+    class Table
+    {
+    private:
+        std::unordered_map<std::string, size_t> channelIndices;
+
+        Channel &getChannel(const std::string &name, bool isText, uint32_t count)
+        {
+            const auto found = channelIndices.find(name);
+            if (found != channelIndices.end())
+                return channels[found->second];
+            channelIndices[name] = channels.size();
+            channels.emplace_back();
+            Channel &channel = channels.back();
+            channel.name = name;
+            channel.isText = isText;
+            channel.count = count;
+            return channel;
+        }
+
+        // NaN or empty for the rows before the current one that didn't carry the channel
+        void padRows(Channel &channel, size_t numRows)
+        {
+            if (channel.isText)
+                channel.texts.resize(numRows);
+            else
+                channel.values.resize(numRows * channel.count, NAN);
+        }
+
+        // Longer rows than the ones so far, e.g. another sampling length in a later capture: the earlier rows are padded
+        void widen(Channel &channel, uint32_t count, size_t numRows)
+        {
+            std::vector<float> values(numRows * count, NAN);
+            for (size_t row = 0; row < numRows; row++)
+                std::copy_n(channel.values.begin() + row * channel.count, channel.count, values.begin() + row * count);
+            channel.values.swap(values);
+            channel.count = count;
+        }
+
+    public:
+        std::vector<uint32_t> timestamps;
+        std::vector<Channel> channels;
+
+        void beginRow(uint32_t timestamp)
+        {
+            timestamps.push_back(timestamp);
+        }
+
+        void setTimestamp(uint32_t timestamp)
+        {
+            timestamps.back() = timestamp;
+        }
+
+        /**
+         * Set a channel of the current row. Every row has the count of the longest one, the shorter ones are padded with NaN
+         */
+        void addValues(const std::string &name, const float *values, uint32_t count)
+        {
+            Channel &channel = getChannel(name, false, count);
+            if (channel.isText)
+                return;
+            padRows(channel, timestamps.size() - 1);
+            if (count > channel.count)
+                widen(channel, count, timestamps.size() - 1);
+            channel.values.insert(channel.values.end(), values, values + count);
+            channel.values.resize(timestamps.size() * channel.count, NAN);
+        }
+
+        void addText(const std::string &name, std::string_view text)
+        {
+            Channel &channel = getChannel(name, true, 1);
+            if (!channel.isText)
+                return;
+            padRows(channel, timestamps.size() - 1);
+            channel.texts.emplace_back(text);
+        }
+
+        /**
+         * Pad the channels the last rows didn't carry
+         */
+        void end()
+        {
+            for (Channel &channel : channels)
+                padRows(channel, timestamps.size());
+        }
+    };
+
+    /**
+     * Parser of the JSON documents of JsonCaptureWriter, {"samples":[{...},...]}, straight from the mapped file.
+     * A capture's numbers and nulls become scalar channels, its arrays one channel of all their numbers in order
+     * (the peaks' [frequency, magnitude, bin] triples one after the other), its strings text channels and its
+     * objects are flattened, e.g. summaryX.mean. The device doesn't escape its strings, so neither does this.
+     */
+    class JsonParser
+    {
+    private:
+        const char *position;
+        const char *end;
+        Table *table;
+        std::vector<float> arrayValues;
+
+        void skipSpace()
+        {
+            while (position < end && (*position == ' ' || *position == '\n' || *position == '\r' || *position == '\t'))
+                position++;
+        }
+
+        bool consume(char c)
+        {
+            skipSpace();
+            if (position < end && *position == c)
+            {
+                position++;
+                return true;
+            }
+            return false;
+        }
+
+        bool consumeWord(const char *word)
+        {
+            const size_t length = strlen(word);
+            if (static_cast<size_t>(end - position) < length || memcmp(position, word, length) != 0)
+                return false;
+            position += length;
+            return true;
+        }
+
+        bool parseString(std::string_view *text)
+        {
+            if (!consume('"'))
+                return false;
+            const char *start = position;
+            const char *quote = static_cast<const char *>(memchr(position, '"', end - position));
+            if (quote == nullptr)
+                return false;
+            position = quote + 1;
+            *text = std::string_view(start, quote - start);
+            return true;
+        }
+
+        /**
+         * A number, null for the non finite ones, or a boolean as 1 or 0
+         */
+        bool parseNumber(float *value)
+        {
+            skipSpace();
+            if (consumeWord("null"))
+                *value = NAN;
+            else if (consumeWord("true"))
+                *value = 1.0f;
+            else if (consumeWord("false"))
+                *value = 0.0f;
+            else
+            {
+                const std::from_chars_result result = std::from_chars(position, end, *value);
+                if (result.ec == std::errc::result_out_of_range)
+                    // Past the float range or below its normal numbers, rare enough for the slower path to round them
+                    *value = strtof(std::string(position, result.ptr).c_str(), nullptr);
+                else if (result.ec != std::errc())
+                    return false;
+                position = result.ptr;
+            }
+            return true;
+        }
+
+        bool parseArray()
+        {
+            if (consume(']'))
+                return true;
+            do
+            {
+                skipSpace();
+                float value;
+                if (position < end && *position == '[')
+                {
+                    position++;
+                    if (!parseArray())
+                        return false;
+                }
+                else if (!parseNumber(&value))
+                    return false;
+                else
+                    arrayValues.push_back(value);
+            } while (consume(','));
+            return consume(']');
+        }
+
+        bool parseValue(const std::string &name)
+        {
+            skipSpace();
+            if (position >= end)
+                return false;
+            if (*position == '{')
+            {
+                position++;
+                return parseObject(name + ".");
+            }
+            if (*position == '[')
+            {
+                position++;
+                arrayValues.clear();
+                if (!parseArray())
+                    return false;
+                table->addValues(name, arrayValues.data(), static_cast<uint32_t>(arrayValues.size()));
+                return true;
+            }
+            if (*position == '"')
+            {
+                std::string_view text;
+                if (!parseString(&text))
+                    return false;
+                table->addText(name, text);
+                return true;
+            }
+            if (name == "timestamp")
+            {
+                // An integer, a float only holds millis() exactly for the first 4.7 hours
+                uint32_t timestamp;
+                const std::from_chars_result result = std::from_chars(position, end, timestamp);
+                if (result.ec != std::errc())
+                    return false;
+                position = result.ptr;
+                table->setTimestamp(timestamp);
+                return true;
+            }
+            float value;
+            if (!parseNumber(&value))
+                return false;
+            table->addValues(name, &value, 1);
+            return true;
+        }
+
+        // After the opening brace
+        bool parseObject(const std::string &prefix)
+        {
+            if (consume('}'))
+                return true;
+            do
+            {
+                std::string_view key;
+                if (!parseString(&key) || !consume(':') || !parseValue(prefix + std::string(key)))
+                    return false;
+            } while (consume(','));
+            return consume('}');
+        }
+
+    public:
+        /**
+         * @return false when the document isn't one of JsonCaptureWriter, the captures before the error are kept
+         */
+        bool parse(const uint8_t *data, size_t size, Table *_table)
+        {
+            position = reinterpret_cast<const char *>(data);
+            end = position + size;
+            table = _table;
+
+            std::string_view key;
+            if (!consume('{') || !parseString(&key) || key != "samples" || !consume(':') || !consume('['))
+                return false;
+            if (consume(']'))
+                return consume('}');
+            do
+            {
+                if (!consume('{'))
+                    return false;
+                table->beginRow(0);
+                if (!parseObject(""))
+                    return false;
+            } while (consume(','));
+            return consume(']') && consume('}');
+        }
+    };
+
+    bool readBinary(const uint8_t *data, size_t size, Table *table, std::string *error)
+    {
+        capture_decoder::CaptureReader reader;
+        if (!reader.open(data, size))
+        {
+            *error = reader.getError();
+            return false;
+        }
+        const std::vector<capture_decoder::Column> &columns = reader.getColumns();
+        capture_decoder::Capture capture;
+        while (reader.next(&capture))
+        {
+            table->beginRow(capture.timestamp);
+            // As the JSON key, the flag is in the capture header here
+            const float isCompact = capture.isCompact ? 1.0f : 0.0f;
+            table->addValues("compact", &isCompact, 1);
+            for (size_t column = 0; column < columns.size(); column++)
+            {
+                if (!reader.hasColumn(capture, static_cast<int>(column)))
+                    continue;
+                if (columns[column].type == capture_format::ColumnType::Text)
+                {
+                    table->addText(columns[column].name, reader.getText(capture, static_cast<int>(column)));
+                    continue;
+                }
+                const std::vector<float> values = reader.getValues(capture, static_cast<int>(column));
+                // Empty for a corrupt packed stream, which stays NaN
+                if (!values.empty())
+                    table->addValues(columns[column].name, values.data(), static_cast<uint32_t>(values.size()));
+            }
+        }
+        *error = reader.getError();
+        return error->empty();
+    }
+
+    bool readPayload(const uint8_t *data, size_t size, Table *table, std::string *error)
+    {
+        uint32_t magic = 0;
+        memcpy(&magic, data, std::min(size, sizeof(magic)));
+        if (magic == capture_format::fileMagic)
+            return readBinary(data, size, table, error);
+
+        JsonParser parser;
+        if (!parser.parse(data, size, table))
+        {
+            *error = "not a capture document";
+            return false;
+        }
+        return true;
+    }
+
+    bool writeNpy(const std::filesystem::path &path, const std::string &descr, const std::vector<size_t> &shape, const void *data, size_t size)
+    {
+        std::string header = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': (";
+        for (size_t dimension : shape)
+            header += std::to_string(dimension) + ", ";
+        if (shape.size() > 1)
+            header.resize(header.size() - 1);
+        header += "), }";
+        // Version 1.0: magic, version and header length take 10 bytes, and the data starts 64 byte aligned
+        const size_t headerSize = (10 + header.size() + 1 + 63) / 64 * 64 - 10;
+        header.resize(headerSize - 1, ' ');
+        header += '\n';
+
+        std::ofstream file(path, std::ios::binary);
+        const uint16_t headerLength = static_cast<uint16_t>(header.size());
+        file.write("\x93NUMPY\x01\x00", 8);
+        file.write(reinterpret_cast<const char *>(&headerLength), sizeof(headerLength));
+        file.write(header.data(), header.size());
+        file.write(static_cast<const char *>(data), size);
+        return static_cast<bool>(file);
+    }
+
+    bool writeTable(Table &table, const std::filesystem::path &directory)
+    {
+        table.end();
+        std::filesystem::create_directories(directory);
+        const size_t numRows = table.timestamps.size();
+        bool isWritten = writeNpy(directory / "timestamp.npy", "<u4", {numRows}, table.timestamps.data(), numRows * sizeof(uint32_t));
+        for (const Channel &channel : table.channels)
+        {
+            const std::filesystem::path path = directory / (channel.name + ".npy");
+            if (!channel.isText)
+            {
+                const std::vector<size_t> shape = channel.count == 1 ? std::vector<size_t>{numRows} : std::vector<size_t>{numRows, channel.count};
+                isWritten = writeNpy(path, "<f4", shape, channel.values.data(), channel.values.size() * sizeof(float)) && isWritten;
+                continue;
+            }
+            // Fixed width UTF-32, the strings are ASCII file names
+            size_t width = 1;
+            for (const std::string &text : channel.texts)
+                width = std::max(width, text.size());
+            std::vector<uint32_t> characters(numRows * width, 0);
+            for (size_t row = 0; row < numRows; row++)
+            {
+                for (size_t i = 0; i < channel.texts[row].size(); i++)
+                    characters[row * width + i] = static_cast<uint8_t>(channel.texts[row][i]);
+            }
+            isWritten = writeNpy(path, "<U" + std::to_string(width), {numRows}, characters.data(), characters.size() * sizeof(uint32_t)) && isWritten;
+        }
+        return isWritten;
+    }
+
+    struct Totals
+    {
+        std::atomic<uint64_t> numBytes{0};
+        std::atomic<uint64_t> numCaptures{0};
+        std::atomic<int> numConverted{0};
+        std::atomic<int> numFailed{0};
+        std::mutex printMutex;
+    };
+
+    void reportError(Totals *totals, const std::filesystem::path &path, const std::string &error)
+    {
+        std::lock_guard<std::mutex> lock(totals->printMutex);
+        fprintf(stderr, "%s: %s\n", path.string().c_str(), error.c_str());
+    }
+
+    /**
+     * Convert each committed record of a capture log, see capture_format.h
+     */
+    bool convertLog(const MappedFile &mapped, const std::filesystem::path &outputDirectory, Totals *totals, std::string *error)
+    {
+        bool isConverted = true;
+        for (size_t offset = 0; offset + sizeof(capture_format::LogRecordHeader) <= mapped.getSize();)
+        {
+            capture_format::LogRecordHeader header;
+            memcpy(&header, mapped.getData() + offset, sizeof(header));
+            if (header.magic != capture_format::logRecordMagic ||
+                header.headerCrc != checksum::crc32(&header, offsetof(capture_format::LogRecordHeader, headerCrc)) ||
+                offset + sizeof(header) + header.size > mapped.getSize())
+                break;
+
+            const uint8_t *payload = mapped.getData() + offset + sizeof(header);
+            offset += (sizeof(header) + header.size + capture_format::logBlockSize - 1) / capture_format::logBlockSize * capture_format::logBlockSize;
+            if (checksum::crc32(payload, header.size) != header.payloadCrc)
+            {
+                *error = "record " + std::to_string(header.sequence) + " is corrupt, skipped";
+                isConverted = false;
+                continue;
+            }
+
+            Table table;
+            std::string recordError;
+            const bool isRead = readPayload(payload, header.size, &table, &recordError);
+            if (!isRead)
+            {
+                *error = "record " + std::to_string(header.sequence) + ": " + recordError;
+                isConverted = false;
+            }
+            totals->numCaptures += table.timestamps.size();
+            if (!writeTable(table, outputDirectory / std::to_string(header.sequence)))
+            {
+                *error = "can't write record " + std::to_string(header.sequence);
+                isConverted = false;
+            }
+        }
+        return isConverted;
+    }
+
+    void convertFile(const std::filesystem::path &path, const Options &options, Totals *totals)
+    {
+        MappedFile mapped;
+        if (!mapped.open(path.string()))
+        {
+            reportError(totals, path, "can't map it");
+            totals->numFailed++;
+            return;
+        }
+        totals->numBytes += mapped.getSize();
+
+        const std::filesystem::path relative = std::filesystem::relative(path, options.inputDirectory);
+        // With the extension, as the same capture can be saved as both .bin and .txt
+        const std::filesystem::path outputDirectory = std::filesystem::path(options.outputDirectory) / relative;
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c)
+                       { return static_cast<char>(tolower(c)); });
+
+        std::string error;
+        bool isConverted;
+        if (extension == ".log")
+        {
+            isConverted = convertLog(mapped, outputDirectory, totals, &error);
+        }
+        else
+        {
+            Table table;
+            isConverted = readPayload(mapped.getData(), mapped.getSize(), &table, &error);
+            totals->numCaptures += table.timestamps.size();
+            // What was read before an error, e.g. a file cut short by a reset, is still written
+            if (!writeTable(table, outputDirectory))
+            {
+                error = "can't write " + outputDirectory.string();
+                isConverted = false;
+            }
+        }
+
+        if (isConverted)
+            totals->numConverted++;
+        else
+        {
+            reportError(totals, path, error);
+            totals->numFailed++;
+        }
+    }
+
+    /**
+     * The capture files under a directory, by their extension and leading bytes, so the other files the device
+     * writes there (manifest, WAV, boot count...) are left out
+     */
+    std::vector<std::filesystem::path> findCaptureFiles(const char *directory)
+    {
+        std::vector<std::filesystem::path> paths;
+        for (const auto &entry : std::filesystem::recursive_directory_iterator(directory))
+        {
+            if (!entry.is_regular_file())
+                continue;
+            std::string extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](char c)
+                           { return static_cast<char>(tolower(c)); });
+            if (extension != ".bin" && extension != ".txt" && extension != ".json" && extension != ".log")
+                continue;
+
+            uint32_t magic = 0;
+            std::ifstream file(entry.path(), std::ios::binary);
+            file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+            const bool isCapture = extension == ".log" ? magic == capture_format::logRecordMagic
+                                                       : magic == capture_format::fileMagic || (magic & 0xff) == '{';
+            if (isCapture)
+                paths.push_back(entry.path());
+        }
+        // Largest first, so a big file doesn't start last and keep one thread busy after the others are done
+        std::sort(paths.begin(), paths.end(), [](const std::filesystem::path &a, const std::filesystem::path &b)
+                  { return std::filesystem::file_size(a) > std::filesystem::file_size(b); });
+        return paths;
+    }
+
+    /**
+     * Convert every file on a pool of threads, each one taking the next file as it's done with its last
+     * @return false when a file failed
+     */
+    bool convertAll(const std::vector<std::filesystem::path> &paths, const Options &options, int numThreads)
+    {
+        Totals totals;
+        std::atomic<size_t> nextFile{0};
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < numThreads; i++)
+        {
+            threads.emplace_back([&]()
+                                 {
+                for (size_t file = nextFile++; file < paths.size(); file = nextFile++)
+                    convertFile(paths[file], options, &totals); });
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const double megabytes = totals.numBytes / 1e6;
+        printf("%2d threads: %d files converted, %d failed, %llu captures, %.1f MB in %.2f s, %.1f MB/s\n",
+               numThreads, totals.numConverted.load(), totals.numFailed.load(), static_cast<unsigned long long>(totals.numCaptures.load()),
+               megabytes, seconds, seconds > 0.0 ? megabytes / seconds : 0.0);
+        return totals.numFailed == 0;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options) || !std::filesystem::is_directory(options.inputDirectory))
+    {
+        fprintf(stderr, "Usage: %s <input dir> <output dir> [--threads count] [--scaling]\n", argv[0]);
+        return 2;
+    }
+
+    const std::vector<std::filesystem::path> paths = findCaptureFiles(options.inputDirectory);
+    if (paths.empty())
+    {
+        fprintf(stderr, "No capture files in %s\n", options.inputDirectory);
+        return 1;
+    }
+
+    if (options.isScaling)
+    {
+        for (int numThreads = 1; numThreads < options.numThreads; numThreads *= 2)
+            convertAll(paths, options, numThreads);
+    }
+    return convertAll(paths, options, options.numThreads) ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+/**
+ * Host benchmark and lossless gate of the acc packing (AccStorageMode::Packed, delta_codec.h) over recorded data.
+ * Takes the accX, accY and accZ columns of every binary capture file in a directory, quantizes them to IMU counts,
+ * then reports the compression ratio, the block modes picked and the encode and decode throughput.
+ * Exits with 1 when a stream doesn't decode to its exact input, or when the recorded samples aren't whole counts,
+ * i.e. packing them with this --counts-per-g would lose data.
+ *
+ *   pio run -e delta_codec_check && .pio/build/delta_codec_check/program <captures dir> [--counts-per-g 8192] [--repeats 200]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <vector>
+
+#include "capture_decoder.h"
+#include "delta_codec.h"
+
+namespace
+{
+    struct Options
+    {
+        const char *capturesDirectory = nullptr;
+        float countsPerG = 8192.0f; // AccOptions default
+        int repeats = 200;          // Timed passes over the streams, to get past the timer resolution
+    };
+
+    struct Stream
+    {
+        std::vector<int16_t> counts;
+        std::vector<uint8_t> packed;
+    };
+
+    bool parseOptions(int argc, char **argv, Options *options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const bool hasValue = i + 1 < argc;
+            if (strcmp(argv[i], "--counts-per-g") == 0 && hasValue)
+                options->countsPerG = strtof(argv[++i], nullptr);
+            else if (strcmp(argv[i], "--repeats") == 0 && hasValue)
+                options->repeats = std::max(1, atoi(argv[++i]));
+            else if (argv[i][0] != '-' && options->capturesDirectory == nullptr)
+                options->capturesDirectory = argv[i];
+            else
+                return false;
+        }
+        return options->capturesDirectory != nullptr && options->countsPerG > 0.0f;
+    }
+
+    /**
+     * Read the acc axes of every full capture of a file as count streams
+     * @return The number of samples that weren't a whole number of counts
+     */
+    size_t readStreams(capture_decoder::CaptureReader &reader, float countsPerG, std::vector<Stream> *streams)
+    {
+        const int axes[3] = {reader.findColumn("accX"), reader.findColumn("accY"), reader.findColumn("accZ")};
+        size_t numInexact = 0;
+        capture_decoder::Capture capture;
+        while (reader.next(&capture))
+        {
+            for (int axis : axes)
+            {
+                const std::vector<float> values = reader.getValues(capture, axis);
+                if (values.empty())
+                    continue;
+
+                Stream stream;
+                stream.counts.resize(values.size());
+                for (size_t i = 0; i < values.size(); i++)
+                {
+                    const long counts = lroundf(values[i] * countsPerG);
+                    stream.counts[i] = static_cast<int16_t>(std::min<long>(std::max<long>(counts, INT16_MIN), INT16_MAX));
+                    if (stream.counts[i] / countsPerG != values[i])
+                        numInexact++;
+                }
+                streams->push_back(stream);
+            }
+        }
+        return numInexact;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options))
+    {
+        fprintf(stderr, "Usage: %s <captures dir> [--counts-per-g counts] [--repeats passes]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<std::filesystem::path> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(options.capturesDirectory))
+    {
+        if (entry.is_regular_file())
+            paths.push_back(entry.path());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<Stream> streams;
+    size_t numInexact = 0;
+    for (const auto &path : paths)
+    {
+        capture_decoder::CaptureReader reader;
+        if (!reader.open(path.string()))
+        {
+            printf("Skipping %s, %s\n", path.c_str(), reader.getError().c_str());
+            continue;
+        }
+        numInexact += readStreams(reader, options.countsPerG, &streams);
+        if (!reader.getError().empty())
+            printf("%s: %s\n", path.c_str(), reader.getError().c_str());
+    }
+    if (streams.empty())
+    {
+        fprintf(stderr, "No acc samples found in %s\n", options.capturesDirectory);
+        return 1;
+    }
+
+    size_t numValues = 0;
+    size_t packedBytes = 0;
+    int modeBlocks[3] = {0, 0, 0};
+    for (Stream &stream : streams)
+    {
+        const int count = static_cast<int>(stream.counts.size());
+        stream.packed.resize(delta_codec::maxEncodedSize(count));
+        stream.packed.resize(delta_codec::encode(stream.counts.data(), count, stream.packed.data()));
+        numValues += count;
+        packedBytes += stream.packed.size();
+
+        // Walk the block headers for the mode mix
+        size_t position = 0;
+        while (position < stream.packed.size())
+        {
+            const uint8_t mode = stream.packed[position++];
+            uint32_t payloadSize = 0;
+            for (int shift = 0; position < stream.packed.size(); shift += 7)
+            {
+                const uint8_t byte = stream.packed[position++];
+                payloadSize |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                    break;
+            }
+            if (mode < 3)
+                modeBlocks[mode]++;
+            position += payloadSize;
+        }
+    }
+
+    // Timed passes over every stream, checking the last decode of each
+    std::vector<uint8_t> packedScratch;
+    std::vector<int16_t> decoded;
+    double encodeSeconds = 0.0;
+    double decodeSeconds = 0.0;
+    int numMismatches = 0;
+    for (const Stream &stream : streams)
+    {
+        const int count = static_cast<int>(stream.counts.size());
+        packedScratch.resize(std::max(packedScratch.size(), delta_codec::maxEncodedSize(count)));
+        decoded.assign(count, 0);
+
+        const auto encodeStart = std::chrono::steady_clock::now();
+        for (int r = 0; r < options.repeats; r++)
+            delta_codec::encode(stream.counts.data(), count, packedScratch.data());
+        const auto decodeStart = std::chrono::steady_clock::now();
+        bool isDecoded = true;
+        for (int r = 0; r < options.repeats; r++)
+            isDecoded = delta_codec::decode(stream.packed.data(), stream.packed.size(), decoded.data(), count) && isDecoded;
+        const auto decodeEnd = std::chrono::steady_clock::now();
+
+        encodeSeconds += std::chrono::duration<double>(decodeStart - encodeStart).count();
+        decodeSeconds += std::chrono::duration<double>(decodeEnd - decodeStart).count();
+        if (!isDecoded || decoded != stream.counts)
+            numMismatches++;
+    }
+
+    const double rawMegabytes = static_cast<double>(numValues) * sizeof(int16_t) * options.repeats / 1e6;
+    const double bytesPerValue = static_cast<double>(packedBytes) / numValues;
+    printf("Streams: %zu axes, %zu samples, %zu not whole counts at %.0f counts/g\n", streams.size(), numValues, numInexact, options.countsPerG);
+    printf("Packed: %zu bytes, %.3f bytes/sample\n", packedBytes, bytesPerValue);
+    printf("Ratio: %.2fx int16, %.2fx float32 (Raw file), %.2fx double (Raw RAM)\n",
+           sizeof(int16_t) / bytesPerValue, sizeof(float) / bytesPerValue, sizeof(double) / bytesPerValue);
+    printf("Blocks: %d verbatim, %d delta, %d second order\n", modeBlocks[0], modeBlocks[1], modeBlocks[2]);
+    printf("Throughput (int16 in and out): encode %.1f MB/s, decode %.1f MB/s\n", rawMegabytes / encodeSeconds, rawMegabytes / decodeSeconds);
+
+    const bool isPassing = numMismatches == 0 && numInexact == 0;
+    printf("delta codec: %s\n", isPassing ? "PASS (lossless)" : (numMismatches > 0 ? "FAIL (round trip mismatch)" : "FAIL (samples aren't whole counts)"));
+    return isPassing ? 0 : 1;
+}
@@ -0,0 +1,377 @@
+/**
+ * Host check and benchmark of the DSP kernels the audio and vibration paths use.
+ * The q15 kernels run the same packed code as on the device, with the M4 instructions emulated, and must match
+ * dsp::reference bit by bit on random blocks (odd lengths, unaligned starts) and full scale ones. The float block kernels
+ * must match a sample by sample loop split anywhere, and the FFT a direct DFT. Then every q15 kernel is timed against
+ * its reference; on the host that's the emulation, so the numbers only compare builds of the same machine.
+ * Exits with 1 when anything mismatches.
+ *
+ *   pio run -e dsp_kernels_check && .pio/build/dsp_kernels_check/program
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "dsp_kernels.h"
+
+namespace
+{
+    uint32_t randomState = 0x12345678;
+
+    // Fixed seed LCG, so every run sees the same cases
+    uint32_t nextRandom()
+    {
+        randomState = randomState * 1664525u + 1013904223u;
+        return randomState >> 8;
+    }
+
+    int randomInt(int low, int high)
+    {
+        return low + static_cast<int>(nextRandom() % static_cast<uint32_t>(high - low + 1));
+    }
+
+    bool checkEnergy(const int16_t *input, size_t length, const char *name)
+    {
+        const uint64_t energy = dsp::energyQ15(input, length);
+        const uint64_t referenceEnergy = dsp::reference::energyQ15(input, length);
+        if (energy != referenceEnergy)
+        {
+            printf("energyQ15 %s: MISMATCH (length %zu, %llu instead of %llu)\n", name, length,
+                   static_cast<unsigned long long>(energy), static_cast<unsigned long long>(referenceEnergy));
+        }
+        return energy == referenceEnergy;
+    }
+
+    std::vector<int16_t> randomQ15(size_t length)
+    {
+        std::vector<int16_t> samples(length);
+        for (size_t i = 0; i < length; i++)
+        {
+            samples[i] = static_cast<int16_t>(randomInt(-32768, 32767));
+        }
+        return samples;
+    }
+
+    bool report(bool isEqual, const char *kernel, size_t length)
+    {
+        if (!isEqual)
+        {
+            printf("%s: MISMATCH (length %zu)\n", kernel, length);
+        }
+        return isEqual;
+    }
+
+    /**
+     * The q15 kernels other than the energy on one block, bit by bit
+     */
+    bool checkQ15(const int16_t *a, const int16_t *b, size_t length)
+    {
+        bool isEqual = report(dsp::dotProductQ15(a, b, length) == dsp::reference::dotProductQ15(a, b, length), "dotProductQ15", length);
+        isEqual = report(dsp::absMaxQ15(a, length) == dsp::reference::absMaxQ15(a, length), "absMaxQ15", length) && isEqual;
+
+        std::vector<int16_t> output(length);
+        std::vector<int16_t> referenceOutput(length);
+        const int16_t scaleFract = static_cast<int16_t>(randomInt(-32768, 32767));
+        const int8_t shift = static_cast<int8_t>(randomInt(-16, 15));
+        dsp::scaleQ15(a, output.data(), length, scaleFract, shift);
+        dsp::reference::scaleQ15(a, referenceOutput.data(), length, scaleFract, shift);
+        isEqual = report(output == referenceOutput, "scaleQ15", length) && isEqual;
+
+        // Scaled so part of the input saturates
+        std::vector<float> floats(length);
+        for (size_t i = 0; i < length; i++)
+        {
+            floats[i] = b[i] / 16384.0f;
+        }
+        dsp::floatToQ15(floats.data(), output.data(), length, 24576.0f);
+        dsp::reference::floatToQ15(floats.data(), referenceOutput.data(), length, 24576.0f);
+        isEqual = report(output == referenceOutput, "floatToQ15", length) && isEqual;
+
+        // Back to float and q15 again is lossless at full scale
+        dsp::q15ToFloat(a, floats.data(), length, 1.0f / 32768);
+        dsp::floatToQ15(floats.data(), output.data(), length, 32768.0f);
+        isEqual = report(memcmp(output.data(), a, length * sizeof(int16_t)) == 0, "q15ToFloat", length) && isEqual;
+        return isEqual;
+    }
+
+    /**
+     * firQ15 over a stream cut in random blocks, against the reference on the same blocks
+     */
+    bool checkFir(size_t numTaps)
+    {
+        const size_t length = randomInt(0, 300);
+        const std::vector<int16_t> input = randomQ15(length);
+        std::vector<int16_t> coefficients = randomQ15(numTaps);
+        for (size_t i = 0; i < numTaps; i++)
+        {
+            coefficients[i] /= static_cast<int16_t>(numTaps < 4 ? 1 : numTaps / 4);
+        }
+
+        const size_t history = numTaps > 0 ? numTaps - 1 : 0;
+        std::vector<int16_t> state(history + length, 0);
+        std::vector<int16_t> referenceState(history + length, 0);
+        std::vector<int16_t> output(length, 1);
+        std::vector<int16_t> referenceOutput(length, 2);
+        for (size_t start = 0; start < length;)
+        {
+            const size_t count = std::min(length - start, static_cast<size_t>(randomInt(1, 64)));
+            dsp::firQ15(&input[start], &output[start], count, coefficients.data(), numTaps, state.data());
+            dsp::reference::firQ15(&input[start], &referenceOutput[start], count, coefficients.data(), numTaps, referenceState.data());
+            start += count;
+        }
+        return report(output == referenceOutput, "firQ15", numTaps);
+    }
+
+    bool checkInterleave(size_t length)
+    {
+        std::vector<float> channels(3 * length);
+        for (size_t i = 0; i < channels.size(); i++)
+        {
+            channels[i] = static_cast<float>(randomInt(-1000, 1000));
+        }
+        std::vector<float> frames(3 * length);
+        dsp::interleave3(&channels[0], &channels[length], &channels[2 * length], frames.data(), length);
+
+        bool isEqual = true;
+        for (size_t i = 0; i < length; i++)
+        {
+            isEqual = isEqual && frames[3 * i] == channels[i] && frames[3 * i + 1] == channels[length + i] && frames[3 * i + 2] == channels[2 * length + i];
+        }
+        std::vector<float> roundTrip(3 * length);
+        dsp::deinterleave3(frames.data(), &roundTrip[0], &roundTrip[length], &roundTrip[2 * length], length);
+        return report(isEqual && roundTrip == channels, "interleave3/deinterleave3", length);
+    }
+
+    /**
+     * The float block kernels against a sample by sample loop over the same stream, cut in random blocks.
+     * The operations are the same, so they must match exactly
+     */
+    bool checkFloatBlocks(size_t length)
+    {
+        std::vector<float> input(length);
+        for (size_t i = 0; i < length; i++)
+        {
+            input[i] = 1.0f + randomInt(-32768, 32767) / 32768.0f;
+        }
+
+        dsp::Biquad section;
+        section.setBandPass(50.0f, 2.0f, 400.0f);
+        dsp::Biquad expectedSection = section;
+        const float coefficient = 2.0f * cosf(2.0f * static_cast<float>(M_PI) * 10.0f / 400.0f);
+        float s1 = 0.0f, s2 = 0.0f;
+        float expectedS1 = 0.0f, expectedS2 = 0.0f;
+        std::vector<float> output(length);
+        std::vector<float> expected(length);
+        for (size_t start = 0; start < length;)
+        {
+            const size_t count = std::min(length - start, static_cast<size_t>(randomInt(1, dsp::blockSize)));
+            dsp::biquad(section, &input[start], &output[start], count);
+            dsp::goertzel(&input[start], count, coefficient, &s1, &s2);
+            start += count;
+        }
+        for (size_t i = 0; i < length; i++)
+        {
+            const float y = expectedSection.b0 * input[i] + expectedSection.z1;
+            expectedSection.z1 = expectedSection.b1 * input[i] - expectedSection.a1 * y + expectedSection.z2;
+            expectedSection.z2 = expectedSection.b2 * input[i] - expectedSection.a2 * y;
+            expected[i] = y;
+
+            const float s0 = input[i] + coefficient * expectedS1 - expectedS2;
+            expectedS2 = expectedS1;
+            expectedS1 = s0;
+        }
+        bool isEqual = report(output == expected, "biquad", length);
+        isEqual = report(s1 == expectedS1 && s2 == expectedS2, "goertzel", length) && isEqual;
+
+        // The statistics kernels against double sums, within float rounding
+        double sum = 0.0, sumSquares = 0.0;
+        for (size_t i = 0; i < length; i++)
+        {
+            sum += input[i];
+            sumSquares += input[i] * input[i];
+        }
+        const double mean = sum / length;
+        double expectedM2 = 0.0, expectedM3 = 0.0, expectedM4 = 0.0;
+        for (size_t i = 0; i < length; i++)
+        {
+            const double deviation = input[i] - mean;
+            expectedM2 += deviation * deviation;
+            expectedM3 += deviation * deviation * deviation;
+            expectedM4 += deviation * deviation * deviation * deviation;
+        }
+        float m2, m3, m4;
+        dsp::centralMoments(input.data(), length, static_cast<float>(mean), &m2, &m3, &m4);
+        float minValue, maxValue;
+        dsp::minMax(input.data(), length, &minValue, &maxValue);
+        const double tolerance = 1e-4 * length;
+        isEqual = report(fabs(dsp::sum(input.data(), length) - sum) <= tolerance && fabs(dsp::energy(input.data(), length) - sumSquares) <= tolerance,
+                         "sum/energy", length) && isEqual;
+        isEqual = report(fabs(m2 - expectedM2) <= tolerance && fabs(m3 - expectedM3) <= tolerance && fabs(m4 - expectedM4) <= tolerance,
+                         "centralMoments", length) && isEqual;
+        isEqual = report(minValue == *std::min_element(input.begin(), input.end()) && maxValue == *std::max_element(input.begin(), input.end()),
+                         "minMax", length) && isEqual;
+        return isEqual;
+    }
+
+    template <typename Kernel>
+    double timeNsPerSample(Kernel kernel, size_t length)
+    {
+        constexpr int iterations = 200;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            kernel();
+        }
+        const auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / (iterations * length);
+    }
+
+    /**
+     * Time each q15 kernel and its reference on the same 1024 samples
+     */
+    void runBenchmark()
+    {
+        constexpr size_t length = 1024;
+        constexpr size_t numTaps = 32;
+        const std::vector<int16_t> a = randomQ15(length);
+        const std::vector<int16_t> b = randomQ15(length);
+        const std::vector<int16_t> coefficients = randomQ15(numTaps);
+        std::vector<float> floats(length);
+        dsp::q15ToFloat(a.data(), floats.data(), length, 1.0f / 16384);
+        std::vector<int16_t> output(length);
+        std::vector<int16_t> state(numTaps - 1 + length, 0);
+        // Keeps the results alive, so the timed calls aren't optimized out
+        volatile int64_t sink = 0;
+
+        printf("%-16s %12s %12s  (ns per sample)\n", "kernel", "kernel", "reference");
+        const auto print = [](const char *name, double kernelNs, double referenceNs) {
+            printf("%-16s %12.2f %12.2f\n", name, kernelNs, referenceNs);
+        };
+        print("dotProductQ15",
+              timeNsPerSample([&] { sink = sink + dsp::dotProductQ15(a.data(), b.data(), length); }, length),
+              timeNsPerSample([&] { sink = sink + dsp::reference::dotProductQ15(a.data(), b.data(), length); }, length));
+        print("energyQ15",
+              timeNsPerSample([&] { sink = sink + static_cast<int64_t>(dsp::energyQ15(a.data(), length)); }, length),
+              timeNsPerSample([&] { sink = sink + static_cast<int64_t>(dsp::reference::energyQ15(a.data(), length)); }, length));
+        print("absMaxQ15",
+              timeNsPerSample([&] { sink = sink + dsp::absMaxQ15(a.data(), length); }, length),
+              timeNsPerSample([&] { sink = sink + dsp::reference::absMaxQ15(a.data(), length); }, length));
+        print("firQ15",
+              timeNsPerSample([&] { dsp::firQ15(a.data(), output.data(), length, coefficients.data(), numTaps, state.data()); }, length),
+              timeNsPerSample([&] { dsp::reference::firQ15(a.data(), output.data(), length, coefficients.data(), numTaps, state.data()); }, length));
+        print("scaleQ15",
+              timeNsPerSample([&] { dsp::scaleQ15(a.data(), output.data(), length, 24576, 1); }, length),
+              timeNsPerSample([&] { dsp::reference::scaleQ15(a.data(), output.data(), length, 24576, 1); }, length));
+        print("floatToQ15",
+              timeNsPerSample([&] { dsp::floatToQ15(floats.data(), output.data(), length, 24576.0f); }, length),
+              timeNsPerSample([&] { dsp::reference::floatToQ15(floats.data(), output.data(), length, 24576.0f); }, length));
+    }
+
+    /**
+     * fftRadix2 against the DFT sums, within float rounding of the largest bin
+     */
+    bool checkFft(size_t length)
+    {
+        std::vector<float> real(length);
+        std::vector<float> imag(length);
+        for (size_t i = 0; i < length; i++)
+        {
+            real[i] = randomInt(-32768, 32767) / 32768.0f;
+            imag[i] = 0.0f;
+        }
+        const std::vector<float> input = real;
+        dsp::fftRadix2(real.data(), imag.data(), length);
+
+        double maxError = 0.0;
+        double maxMagnitude = 0.0;
+        for (size_t k = 0; k < length; k++)
+        {
+            double expectedReal = 0.0;
+            double expectedImag = 0.0;
+            for (size_t n = 0; n < length; n++)
+            {
+                const double angle = -2.0 * M_PI * static_cast<double>((k * n) % length) / length;
+                expectedReal += input[n] * cos(angle);
+                expectedImag += input[n] * sin(angle);
+            }
+            maxError = fmax(maxError, hypot(real[k] - expectedReal, imag[k] - expectedImag));
+            maxMagnitude = fmax(maxMagnitude, hypot(expectedReal, expectedImag));
+        }
+
+        const bool isEqual = maxError <= 1e-4 * fmax(maxMagnitude, 1.0);
+        if (!isEqual)
+        {
+            printf("fftRadix2: MISMATCH (length %zu, error %g of %g)\n", length, maxError, maxMagnitude);
+        }
+        return isEqual;
+    }
+} // namespace
+
+int main()
+{
+    bool isAllEqual = true;
+
+    // Full scale, where every square is 2^30 and the sum needs the 64 bit accumulator
+    std::vector<int16_t> block(4097, INT16_MIN);
+    isAllEqual = checkEnergy(block.data(), block.size(), "INT16_MIN") && isAllEqual;
+    for (size_t i = 0; i < block.size(); i++)
+    {
+        block[i] = (i & 1) ? INT16_MAX : INT16_MIN;
+    }
+    isAllEqual = checkEnergy(block.data(), block.size(), "alternating") && isAllEqual;
+
+    // Random blocks, covering the non multiple of 4 tails and the unaligned pairs
+    const int numRandomCases = 1000;
+    for (int i = 0; i < numRandomCases; i++)
+    {
+        const size_t length = randomInt(0, 600);
+        const size_t start = randomInt(0, 3);
+        std::vector<int16_t> samples(start + length);
+        for (size_t j = 0; j < samples.size(); j++)
+        {
+            samples[j] = static_cast<int16_t>(randomInt(-32768, 32767));
+        }
+        isAllEqual = checkEnergy(samples.data() + start, length, "random") && isAllEqual;
+    }
+
+    for (int i = 0; i < numRandomCases; i++)
+    {
+        const size_t length = randomInt(0, 600);
+        const size_t start = randomInt(0, 3);
+        const std::vector<int16_t> a = randomQ15(start + length);
+        const std::vector<int16_t> b = randomQ15(start + length);
+        isAllEqual = checkQ15(a.data() + start, b.data() + start, length) && isAllEqual;
+    }
+    // Full scale, where the 32 bit products and the saturation are at their limits
+    isAllEqual = checkQ15(block.data(), block.data(), block.size()) && isAllEqual;
+    std::fill(block.begin(), block.end(), INT16_MIN);
+    isAllEqual = checkQ15(block.data(), block.data(), block.size()) && isAllEqual;
+
+    // Without taps, where the history length would wrap around, a single tap and longer filters
+    for (size_t numTaps : {0, 1, 2, 3, 4, 5, 17, 32, 64})
+    {
+        isAllEqual = checkFir(numTaps) && isAllEqual;
+    }
+
+    for (size_t length : {0, 1, 31, 32, 33, 257})
+    {
+        isAllEqual = checkInterleave(length) && isAllEqual;
+    }
+    for (size_t length : {1, 2, 31, 32, 33, 256, 1000})
+    {
+        isAllEqual = checkFloatBlocks(length) && isAllEqual;
+    }
+
+    for (size_t length = 2; length <= 1024; length <<= 1)
+    {
+        isAllEqual = checkFft(length) && isAllEqual;
+    }
+
+    printf("dsp kernels: %s\n\n", isAllEqual ? "all match" : "MISMATCH");
+    runBenchmark();
+    return isAllEqual ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+/**
+ * Host SNR and speed benchmark of the audio encoding (MicEncoding::ImaAdpcm, ima_adpcm.h) over recorded data.
+ * Takes the PCM audio column of every binary capture file in a directory, encodes and decodes it with the firmware code,
+ * and compares it with plain requantization to 4 bits, the naive encoding of the same size.
+ * Exits with 1 when the overall SNR of IMA ADPCM is below --min-snr.
+ *
+ *   pio run -e ima_adpcm_check && .pio/build/ima_adpcm_check/program <captures dir> [--min-snr 20] [--repeats 20]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <vector>
+
+#include "capture_decoder.h"
+#include "ima_adpcm.h"
+
+namespace
+{
+    struct Options
+    {
+        const char *capturesDirectory = nullptr;
+        float minSnrDb = 20.0f;
+        int repeats = 20; // Timed passes over the recordings, to get past the timer resolution
+    };
+
+    // Signal and error energy, for the SNR over every recording
+    struct Accuracy
+    {
+        double signalEnergy = 0.0;
+        double noiseEnergy = 0.0;
+        double worstSnrDb = INFINITY;
+
+        void add(const std::vector<int16_t> &original, const std::vector<int16_t> &decoded)
+        {
+            double signal = 0.0;
+            double noise = 0.0;
+            for (size_t i = 0; i < original.size(); i++)
+            {
+                const double error = static_cast<double>(original[i]) - decoded[i];
+                signal += static_cast<double>(original[i]) * original[i];
+                noise += error * error;
+            }
+            signalEnergy += signal;
+            noiseEnergy += noise;
+            worstSnrDb = std::min(worstSnrDb, snrDb(signal, noise));
+        }
+
+        static double snrDb(double signal, double noise)
+        {
+            return noise > 0.0 ? 10.0 * log10(signal / noise) : INFINITY;
+        }
+    };
+
+    bool parseOptions(int argc, char **argv, Options *options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const bool hasValue = i + 1 < argc;
+            if (strcmp(argv[i], "--min-snr") == 0 && hasValue)
+                options->minSnrDb = strtof(argv[++i], nullptr);
+            else if (strcmp(argv[i], "--repeats") == 0 && hasValue)
+                options->repeats = std::max(1, atoi(argv[++i]));
+            else if (argv[i][0] != '-' && options->capturesDirectory == nullptr)
+                options->capturesDirectory = argv[i];
+            else
+                return false;
+        }
+        return options->capturesDirectory != nullptr;
+    }
+
+    /**
+     * Keep the 4 most significant bits, rounding to the nearest step
+     */
+    void requantize4Bits(const std::vector<int16_t> &samples, std::vector<int16_t> *decoded)
+    {
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            const int32_t rounded = (samples[i] + 2048) & ~4095;
+            (*decoded)[i] = static_cast<int16_t>(std::min<int32_t>(rounded, INT16_MAX));
+        }
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options))
+    {
+        fprintf(stderr, "Usage: %s <captures dir> [--min-snr dB] [--repeats passes]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<std::filesystem::path> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(options.capturesDirectory))
+    {
+        if (entry.is_regular_file())
+            paths.push_back(entry.path());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    // Only PCM recordings, an already encoded column would only measure the loss of a second pass
+    std::vector<std::vector<int16_t>> recordings;
+    float samplingRate = 0.0f;
+    for (const auto &path : paths)
+    {
+        capture_decoder::CaptureReader reader;
+        if (!reader.open(path.string()))
+        {
+            printf("Skipping %s, %s\n", path.c_str(), reader.getError().c_str());
+            continue;
+        }
+        const int audio = reader.findColumn("audio");
+        if (audio < 0 || reader.getColumns()[audio].type != capture_format::ColumnType::Int16)
+            continue;
+        samplingRate = reader.getFileHeader().micSamplingRate;
+
+        capture_decoder::Capture capture;
+        while (reader.next(&capture))
+        {
+            const std::vector<float> values = reader.getValues(capture, audio);
+            if (values.empty())
+                continue;
+            std::vector<int16_t> samples(values.size());
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                samples[i] = static_cast<int16_t>(lroundf(values[i] / reader.getColumns()[audio].scale));
+            }
+            recordings.push_back(samples);
+        }
+    }
+    if (recordings.empty())
+    {
+        fprintf(stderr, "No PCM audio found in %s\n", options.capturesDirectory);
+        return 1;
+    }
+
+    size_t numSamples = 0;
+    size_t encodedBytes = 0;
+    double encodeSeconds = 0.0;
+    double decodeSeconds = 0.0;
+    double requantizeSeconds = 0.0;
+    Accuracy adpcmAccuracy;
+    Accuracy requantizedAccuracy;
+    for (const std::vector<int16_t> &samples : recordings)
+    {
+        const int count = static_cast<int>(samples.size());
+        std::vector<uint8_t> encoded(ima_adpcm::encodedSize(count));
+        std::vector<int16_t> decoded(count);
+        std::vector<int16_t> requantized(count);
+        ima_adpcm::Encoder encoder;
+
+        const auto encodeStart = std::chrono::steady_clock::now();
+        for (int r = 0; r < options.repeats; r++)
+        {
+            encoder.begin(encoded.data());
+            encoder.add(samples.data(), count);
+        }
+        const auto decodeStart = std::chrono::steady_clock::now();
+        bool isDecoded = true;
+        for (int r = 0; r < options.repeats; r++)
+            isDecoded = ima_adpcm::decode(encoded.data(), encoder.getSize(), decoded.data(), count) && isDecoded;
+        const auto requantizeStart = std::chrono::steady_clock::now();
+        for (int r = 0; r < options.repeats; r++)
+            requantize4Bits(samples, &requantized);
+        const auto requantizeEnd = std::chrono::steady_clock::now();
+
+        if (!isDecoded)
+        {
+            fprintf(stderr, "A recording of %d samples didn't decode\n", count);
+            return 1;
+        }
+        encodeSeconds += std::chrono::duration<double>(decodeStart - encodeStart).count();
+        decodeSeconds += std::chrono::duration<double>(requantizeStart - decodeStart).count();
+        requantizeSeconds += std::chrono::duration<double>(requantizeEnd - requantizeStart).count();
+        numSamples += count;
+        encodedBytes += encoder.getSize();
+        adpcmAccuracy.add(samples, decoded);
+        requantizedAccuracy.add(samples, requantized);
+    }
+
+    const double megasamples = static_cast<double>(numSamples) * options.repeats / 1e6;
+    const double adpcmSnrDb = Accuracy::snrDb(adpcmAccuracy.signalEnergy, adpcmAccuracy.noiseEnergy);
+    printf("Recordings: %zu, %zu samples at %.0f Hz\n", recordings.size(), numSamples, samplingRate);
+    printf("IMA ADPCM: %.2fx smaller, SNR %.1f dB (worst recording %.1f dB), encode %.1f Msamples/s, decode %.1f Msamples/s\n",
+           static_cast<double>(numSamples * sizeof(int16_t)) / encodedBytes, adpcmSnrDb, adpcmAccuracy.worstSnrDb,
+           megasamples / encodeSeconds, megasamples / decodeSeconds);
+    printf("4 bit requantization: 4.00x smaller, SNR %.1f dB (worst recording %.1f dB), %.1f Msamples/s\n",
+           Accuracy::snrDb(requantizedAccuracy.signalEnergy, requantizedAccuracy.noiseEnergy), requantizedAccuracy.worstSnrDb,
+           megasamples / requantizeSeconds);
+
+    const bool isPassing = adpcmSnrDb >= options.minSnrDb;
+    printf("ima adpcm: %s (minimum SNR %.1f dB)\n", isPassing ? "PASS" : "FAIL", options.minSnrDb);
+    return isPassing ? 0 : 1;
+}
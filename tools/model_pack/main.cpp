@@ -0,0 +1,64 @@
+/**
+ * Packs a .tflite vibration model into the model file the firmware loads from the SD card (see model_file.h),
+ * i.e. prepends the header with its size, version and CRC. Copy the output to the card under ModelOptions::modelFileName.
+ *
+ *   pio run -e model_pack && .pio/build/model_pack/program <model.tflite> <model version> <output file>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "checksum.h"
+#include "model_file.h"
+
+int main(int argc, char **argv)
+{
+    if (argc != 4)
+    {
+        fprintf(stderr, "Usage: %s <model.tflite> <model version> <output file>\n", argv[0]);
+        return 2;
+    }
+
+    FILE *input = fopen(argv[1], "rb");
+    if (input == nullptr)
+    {
+        fprintf(stderr, "Failed to open %s\n", argv[1]);
+        return 1;
+    }
+    std::vector<uint8_t> model;
+    uint8_t buffer[4096];
+    size_t numRead;
+    while ((numRead = fread(buffer, 1, sizeof(buffer), input)) > 0)
+    {
+        model.insert(model.end(), buffer, buffer + numRead);
+    }
+    fclose(input);
+
+    model_file::Header header;
+    header.magic = model_file::magic;
+    header.formatVersion = model_file::formatVersion;
+    header.headerSize = sizeof(header);
+    header.modelSize = model.size();
+    header.modelVersion = strtoul(argv[2], nullptr, 10);
+    header.modelCrc = checksum::crc32(model.data(), model.size());
+    if (!model_file::isValidHeader(header, sizeof(header) + model.size()))
+    {
+        fprintf(stderr, "%s is empty or larger than %u bytes\n", argv[1], model_file::maxModelSize);
+        return 1;
+    }
+
+    // The header is written as is, both the host and the nRF52840 are little endian
+    FILE *output = fopen(argv[3], "wb");
+    if (output == nullptr ||
+        fwrite(&header, sizeof(header), 1, output) != 1 ||
+        fwrite(model.data(), 1, model.size(), output) != model.size())
+    {
+        fprintf(stderr, "Failed to write %s\n", argv[3]);
+        return 1;
+    }
+    fclose(output);
+
+    printf("%s: model version %u, %u bytes, CRC %08x\n", argv[3], header.modelVersion, header.modelSize, header.modelCrc);
+    return 0;
+}
@@ -0,0 +1,239 @@
+/**
+ * Host check of the optimized int8 kernels against the TensorFlow Lite reference kernels
+ * (tflite::reference_integer_ops::ConvPerChannel and FullyConnected), the ones TFLM runs without the custom ops.
+ * Runs the vibration model's layer shapes plus random shapes (odd depths, padding, strides, biasless), checks
+ * nn::quantizeMultiplier against tflite::QuantizeMultiplier, and exits with 1 on the first output that isn't bit-exact.
+ *
+ *   pio run -e nn_kernels_check && .pio/build/nn_kernels_check/program
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "tensorflow/lite/kernels/internal/quantization_util.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/conv.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/fully_connected.h"
+#include "tensorflow/lite/kernels/internal/types.h"
+
+#include "nn_kernels.h"
+
+namespace
+{
+    uint32_t randomState = 0x12345678;
+
+    // Fixed seed LCG, so every run sees the same cases
+    uint32_t nextRandom()
+    {
+        randomState = randomState * 1664525u + 1013904223u;
+        return randomState >> 8;
+    }
+
+    int randomInt(int low, int high)
+    {
+        return low + static_cast<int>(nextRandom() % static_cast<uint32_t>(high - low + 1));
+    }
+
+    void fillInt8(std::vector<int8_t> &values)
+    {
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            values[i] = static_cast<int8_t>(randomInt(-128, 127));
+        }
+    }
+
+    void fillQuantization(std::vector<int32_t> &multipliers, std::vector<int32_t> &shifts)
+    {
+        for (size_t i = 0; i < multipliers.size(); i++)
+        {
+            // Typical effective scales, input * filter / output, land between 1e-5 and 1
+            const double scale = randomInt(1, 100000) * 1e-5;
+            nn::quantizeMultiplier(scale, &multipliers[i], &shifts[i]);
+        }
+    }
+
+    bool checkQuantizeMultiplier(double realMultiplier)
+    {
+        int32_t multiplier;
+        int32_t shift;
+        nn::quantizeMultiplier(realMultiplier, &multiplier, &shift);
+        int32_t referenceMultiplier;
+        int referenceShift;
+        tflite::QuantizeMultiplier(realMultiplier, &referenceMultiplier, &referenceShift);
+
+        const bool isEqual = multiplier == referenceMultiplier && shift == referenceShift;
+        if (!isEqual)
+        {
+            printf("quantizeMultiplier %g: MISMATCH (%d, %d instead of %d, %d)\n", realMultiplier,
+                   multiplier, shift, referenceMultiplier, referenceShift);
+        }
+        return isEqual;
+    }
+
+    bool checkConv(const nn::ConvParams &params, bool hasBias, const char *name)
+    {
+        std::vector<int8_t> input(params.inputHeight * params.inputWidth * params.inputDepth);
+        std::vector<int8_t> filter(params.outputDepth * params.filterHeight * params.filterWidth * params.inputDepth);
+        std::vector<int32_t> bias(params.outputDepth);
+        std::vector<int32_t> multipliers(params.outputDepth);
+        std::vector<int32_t> shifts(params.outputDepth);
+        std::vector<int8_t> output(params.outputHeight * params.outputWidth * params.outputDepth);
+        std::vector<int8_t> referenceOutput(output.size());
+        std::vector<int16_t> scratch(nn::conv2dScratchSize(params));
+
+        fillInt8(input);
+        fillInt8(filter);
+        for (size_t i = 0; i < bias.size(); i++)
+        {
+            bias[i] = randomInt(-20000, 20000);
+        }
+        fillQuantization(multipliers, shifts);
+
+        nn::conv2dInt8(params, multipliers.data(), shifts.data(), input.data(), filter.data(), hasBias ? bias.data() : nullptr, output.data(), scratch.data());
+
+        tflite::ConvParams referenceParams = {};
+        referenceParams.padding_type = tflite::PaddingType::kSame;
+        referenceParams.padding_values.width = params.padWidth;
+        referenceParams.padding_values.height = params.padHeight;
+        referenceParams.stride_width = params.strideWidth;
+        referenceParams.stride_height = params.strideHeight;
+        referenceParams.dilation_width_factor = 1;
+        referenceParams.dilation_height_factor = 1;
+        referenceParams.input_offset = params.inputOffset;
+        referenceParams.output_offset = params.outputOffset;
+        referenceParams.quantized_activation_min = params.activationMin;
+        referenceParams.quantized_activation_max = params.activationMax;
+        tflite::reference_integer_ops::ConvPerChannel(
+            referenceParams, multipliers.data(), shifts.data(),
+            tflite::RuntimeShape({1, params.inputHeight, params.inputWidth, params.inputDepth}), input.data(),
+            tflite::RuntimeShape({params.outputDepth, params.filterHeight, params.filterWidth, params.inputDepth}), filter.data(),
+            tflite::RuntimeShape({params.outputDepth}), hasBias ? bias.data() : nullptr,
+            tflite::RuntimeShape({1, params.outputHeight, params.outputWidth, params.outputDepth}), referenceOutput.data());
+
+        const bool isEqual = memcmp(output.data(), referenceOutput.data(), output.size()) == 0;
+        if (!isEqual)
+        {
+            printf("conv2dInt8 %s: MISMATCH (input %dx%dx%d, filter %dx%d, output %dx%dx%d, stride %d, pad %d)\n", name,
+                   params.inputHeight, params.inputWidth, params.inputDepth, params.filterHeight, params.filterWidth,
+                   params.outputHeight, params.outputWidth, params.outputDepth, params.strideHeight, params.padHeight);
+        }
+        return isEqual;
+    }
+
+    bool checkFullyConnected(const nn::FullyConnectedParams &params, bool hasBias, const char *name)
+    {
+        std::vector<int8_t> input(params.inputDepth);
+        std::vector<int8_t> filter(params.outputDepth * params.inputDepth);
+        std::vector<int32_t> bias(params.outputDepth);
+        std::vector<int8_t> output(params.outputDepth);
+        std::vector<int8_t> referenceOutput(params.outputDepth);
+        std::vector<int16_t> scratch(nn::fullyConnectedScratchSize(params));
+
+        fillInt8(input);
+        fillInt8(filter);
+        for (size_t i = 0; i < bias.size(); i++)
+        {
+            bias[i] = randomInt(-20000, 20000);
+        }
+
+        nn::fullyConnectedInt8(params, input.data(), filter.data(), hasBias ? bias.data() : nullptr, output.data(), scratch.data());
+
+        tflite::FullyConnectedParams referenceParams = {};
+        referenceParams.input_offset = params.inputOffset;
+        referenceParams.output_offset = params.outputOffset;
+        referenceParams.output_multiplier = params.outputMultiplier;
+        referenceParams.output_shift = params.outputShift;
+        referenceParams.quantized_activation_min = params.activationMin;
+        referenceParams.quantized_activation_max = params.activationMax;
+        tflite::reference_integer_ops::FullyConnected(
+            referenceParams,
+            tflite::RuntimeShape({1, params.inputDepth}), input.data(),
+            tflite::RuntimeShape({params.outputDepth, params.inputDepth}), filter.data(),
+            tflite::RuntimeShape({params.outputDepth}), hasBias ? bias.data() : nullptr,
+            tflite::RuntimeShape({1, params.outputDepth}), referenceOutput.data());
+
+        const bool isEqual = memcmp(output.data(), referenceOutput.data(), output.size()) == 0;
+        if (!isEqual)
+        {
+            printf("fullyConnectedInt8 %s: MISMATCH (input %d, output %d)\n", name, params.inputDepth, params.outputDepth);
+        }
+        return isEqual;
+    }
+
+    nn::ConvParams makeConv(int inputSize, int inputDepth, int filterSize, int stride, int outputDepth, bool isSamePadding)
+    {
+        nn::ConvParams params;
+        params.inputHeight = inputSize;
+        params.inputWidth = inputSize;
+        params.inputDepth = inputDepth;
+        params.filterHeight = filterSize;
+        params.filterWidth = filterSize;
+        params.strideHeight = stride;
+        params.strideWidth = stride;
+        params.outputDepth = outputDepth;
+        if (isSamePadding)
+        {
+            params.outputHeight = (inputSize + stride - 1) / stride;
+            const int totalPadding = (params.outputHeight - 1) * stride + filterSize - inputSize;
+            params.padHeight = totalPadding > 0 ? totalPadding / 2 : 0;
+        }
+        else
+        {
+            params.outputHeight = (inputSize - filterSize) / stride + 1;
+            params.padHeight = 0;
+        }
+        params.outputWidth = params.outputHeight;
+        params.padWidth = params.padHeight;
+        params.inputOffset = randomInt(-127, 128);
+        params.outputOffset = randomInt(-128, 127);
+        // Fused ReLU like the model, or no activation
+        params.activationMin = (nextRandom() & 1) ? params.outputOffset : -128;
+        params.activationMax = 127;
+        return params;
+    }
+} // namespace
+
+int main()
+{
+    bool isAllEqual = true;
+
+    // The vibration model layers: 3 stride 2 SAME convs with ReLU and the classifier head
+    isAllEqual = checkConv(makeConv(32, 3, 3, 2, 16, true), true, "conv2d_3") && isAllEqual;
+    isAllEqual = checkConv(makeConv(16, 16, 3, 2, 32, true), true, "conv2d_4") && isAllEqual;
+    isAllEqual = checkConv(makeConv(8, 32, 3, 2, 64, true), true, "conv2d_5") && isAllEqual;
+
+    nn::FullyConnectedParams dense;
+    dense.inputDepth = 64;
+    dense.outputDepth = 10;
+    dense.inputOffset = 128;
+    dense.outputOffset = 91;
+    nn::quantizeMultiplier(0.009 * 0.0134 / 0.164, &dense.outputMultiplier, &dense.outputShift);
+    dense.activationMin = -128;
+    dense.activationMax = 127;
+    isAllEqual = checkFullyConnected(dense, true, "dense_1") && isAllEqual;
+
+    // Random shapes, covering the non multiple of 4 tails, odd sizes and padding on every side
+    const int numRandomCases = 300;
+    for (int i = 0; i < numRandomCases; i++)
+    {
+        const int filterSize = randomInt(1, 5);
+        const int inputSize = randomInt(filterSize, 12);
+        nn::ConvParams params = makeConv(inputSize, randomInt(1, 19), filterSize, randomInt(1, 3), randomInt(1, 9), (nextRandom() & 1) != 0);
+        isAllEqual = checkConv(params, (nextRandom() & 3) != 0, "random") && isAllEqual;
+
+        nn::FullyConnectedParams fullyConnected;
+        fullyConnected.inputDepth = randomInt(1, 130);
+        fullyConnected.outputDepth = randomInt(1, 20);
+        fullyConnected.inputOffset = randomInt(-127, 128);
+        fullyConnected.outputOffset = randomInt(-128, 127);
+        nn::quantizeMultiplier(randomInt(1, 100000) * 1e-5, &fullyConnected.outputMultiplier, &fullyConnected.outputShift);
+        fullyConnected.activationMin = -128;
+        fullyConnected.activationMax = 127;
+        isAllEqual = checkFullyConnected(fullyConnected, (nextRandom() & 3) != 0, "random") && isAllEqual;
+
+        isAllEqual = checkQuantizeMultiplier(randomInt(1, 1000000) * 1e-6) && isAllEqual;
+    }
+
+    printf("nn kernels: %s\n", isAllEqual ? "all bit-exact" : "MISMATCH");
+    return isAllEqual ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+/**
+ * Host run of the SD card benchmark (sd_benchmark.h) against a directory standing in for the card (the capture_log
+ * host SD.h), e.g. a card or a file-backed card image mounted with "-o sync", so the writes reach it as they're made
+ * instead of the page cache. Prints the throughput and latency of every write size and strategy, then checks that
+ * the saved result loads back as the firmware does at boot, and exits with 1 when it doesn't.
+ *
+ *   pio run -e sd_benchmark && .pio/build/sd_benchmark/program <card dir>
+ */
+#include <stdio.h>
+
+#include <filesystem>
+
+#include "SD.h"
+#include "sd_benchmark.h"
+
+int main(int argc, char **argv)
+{
+    if (argc != 2 || !SD.begin(argv[1]))
+    {
+        fprintf(stderr, "Usage: %s <card dir>\n", argv[0]);
+        return 2;
+    }
+
+    const uint32_t writeSize = sd_benchmark::run(LogLevel::Info);
+    if (writeSize == 0)
+        return 1;
+
+    const uint32_t loadedWriteSize = sd_benchmark::loadWriteSize();
+    printf("%s: %s\n", sd_benchmark::resultFileName, loadedWriteSize == writeSize ? "loads back" : "DOESN'T load back");
+    printf("Card writes: %lu whole blocks, %lu partial\n", SD.stats.numBlockWrites, SD.stats.numPartialWrites);
+    return loadedWriteSize == writeSize ? 0 : 1;
+}
@@ -0,0 +1,433 @@
+/**
+ * Host benchmark and parity gate of the vibration model, g_vibration_model_data or with --model a model file
+ * as tools/model_pack writes it for the SD card (ModelOptions::modelFileName), checked like the firmware loads it.
+ * Runs every raw capture saved by the sampler in a directory through the firmware preprocessing
+ * and the firmware int8 kernels, then reports the inference latency, the tensor arena high-water mark
+ * and how the scores agree with the reference ones. Exits with 1 when the model fails the gate.
+ * Reads the JSON documents, the binary capture files (Raw or Packed acc, through capture_decoder.h)
+ * and the capture logs, a record at a time.
+ *
+ * The reference scores of a capture are its "referenceScores" (e.g. added by the training pipeline)
+ * or else the "modelScores" the device recorded. Compact records, Peaks captures and captures with the
+ * envelope spectrum instead of the raw acc samples have no raw data and are skipped.
+ *
+ *   pio run -e vibration_model_check && .pio/build/vibration_model_check/program <captures dir>
+ *       [--model VIBMODEL.BIN] [--floor-db -80] [--tolerance 0.0039] [--min-agreement 1.0] [--arena-limit 24576]
+ *
+ * The env links TensorFlow Lite Micro built for the host, see platformio.ini.
+ */
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <ArduinoJson.h>
+
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+#include "capture_decoder.h"
+#include "checksum.h"
+#include "model_file.h"
+#include "nn_ops.h"
+#include "vibration_features.h"
+#include "vibration_model_data.h"
+
+namespace
+{
+    // Big enough for any model the device could fit, the actual usage is what's reported
+    constexpr size_t tensorArenaSize = 256 * 1024;
+    alignas(16) uint8_t tensorArena[tensorArenaSize];
+    // TensorFlow Lite Micro reads the flatbuffer in place
+    alignas(model_file::modelAlignment) uint8_t modelData[model_file::maxModelSize];
+
+    struct Options
+    {
+        const char *capturesDirectory = nullptr;
+        const char *modelPath = nullptr; // The compiled-in model without it
+        float floorDb = -80.0f;       // ModelOptions default
+        float tolerance = 1.0f / 256; // One output quantization step
+        float minAgreement = 1.0f;    // Fraction of captures with the same top class
+        size_t arenaLimit = 24 * 1024; // tensorArenaSize of the firmware
+    };
+
+    struct Results
+    {
+        std::vector<double> inferenceUs;
+        double totalPreprocessingUs = 0.0;
+        int numCompared = 0;
+        int numAgreeing = 0;
+        float maxScoreDifference = 0.0f;
+        int numSkipped = 0;
+    };
+
+    bool parseOptions(int argc, char **argv, Options *options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const bool hasValue = i + 1 < argc;
+            if (strcmp(argv[i], "--model") == 0 && hasValue)
+                options->modelPath = argv[++i];
+            else if (strcmp(argv[i], "--floor-db") == 0 && hasValue)
+                options->floorDb = strtof(argv[++i], nullptr);
+            else if (strcmp(argv[i], "--tolerance") == 0 && hasValue)
+                options->tolerance = strtof(argv[++i], nullptr);
+            else if (strcmp(argv[i], "--min-agreement") == 0 && hasValue)
+                options->minAgreement = strtof(argv[++i], nullptr);
+            else if (strcmp(argv[i], "--arena-limit") == 0 && hasValue)
+                options->arenaLimit = strtoul(argv[++i], nullptr, 10);
+            else if (argv[i][0] != '-' && options->capturesDirectory == nullptr)
+                options->capturesDirectory = argv[i];
+            else
+                return false;
+        }
+        return options->capturesDirectory != nullptr;
+    }
+
+    /**
+     * Read a model file into modelData, with the checks of the firmware: header, size and CRC
+     * @return false when the firmware would fall back to the compiled-in model, see error
+     */
+    bool loadModelFile(const char *path, model_file::Header *header, std::string *error)
+    {
+        std::ifstream file(path, std::ios::binary);
+        const std::vector<uint8_t> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (contents.size() < sizeof(*header))
+        {
+            *error = "can't be read or is shorter than the header";
+            return false;
+        }
+        memcpy(header, contents.data(), sizeof(*header));
+        if (!model_file::isValidHeader(*header, static_cast<uint32_t>(std::min(contents.size(), static_cast<size_t>(UINT32_MAX)))))
+        {
+            *error = "header is not valid";
+            return false;
+        }
+        memcpy(modelData, contents.data() + header->headerSize, header->modelSize);
+        if (checksum::crc32(modelData, header->modelSize) != header->modelCrc)
+        {
+            *error = "CRC doesn't match";
+            return false;
+        }
+        return true;
+    }
+
+    int argMax(const float *values, int length)
+    {
+        return static_cast<int>(std::max_element(values, values + length) - values);
+    }
+
+    /**
+     * Classify one capture and compare it with its reference scores
+     * @param referenceScores Empty when the capture has none
+     */
+    void checkCapture(const std::vector<double> &x, const std::vector<double> &y, const std::vector<double> &z,
+                      const std::vector<float> &referenceScores, const Options &options,
+                      tflite::MicroInterpreter &interpreter, Results *results)
+    {
+        TfLiteTensor *input = interpreter.input(0);
+        TfLiteTensor *output = interpreter.output(0);
+        std::vector<float> scratch(vibration_features::scratchSize);
+
+        const auto preprocessingStart = std::chrono::steady_clock::now();
+        vibration_features::computeInput(x.data(), y.data(), z.data(), static_cast<int>(x.size()), options.floorDb,
+                                         input->params.scale, input->params.zero_point, input->data.int8, scratch.data());
+        const auto inferenceStart = std::chrono::steady_clock::now();
+        if (interpreter.Invoke() != kTfLiteOk)
+        {
+            fprintf(stderr, "Invoke failed\n");
+            exit(1);
+        }
+        const auto inferenceEnd = std::chrono::steady_clock::now();
+
+        results->totalPreprocessingUs += std::chrono::duration<double, std::micro>(inferenceStart - preprocessingStart).count();
+        results->inferenceUs.push_back(std::chrono::duration<double, std::micro>(inferenceEnd - inferenceStart).count());
+
+        const int numClasses = output->dims->data[output->dims->size - 1];
+        if (static_cast<int>(referenceScores.size()) != numClasses)
+        {
+            return;
+        }
+
+        std::vector<float> scores(numClasses);
+        for (int i = 0; i < numClasses; i++)
+        {
+            scores[i] = (output->data.int8[i] - output->params.zero_point) * output->params.scale;
+            results->maxScoreDifference = std::max(results->maxScoreDifference, fabsf(scores[i] - referenceScores[i]));
+        }
+        results->numCompared++;
+        if (argMax(scores.data(), numClasses) == argMax(referenceScores.data(), numClasses))
+        {
+            results->numAgreeing++;
+        }
+    }
+
+    /**
+     * Classify one sample of a JSON capture file
+     */
+    void checkJsonSample(JsonObject jsonSample, const Options &options, tflite::MicroInterpreter &interpreter, Results *results)
+    {
+        JsonArray frequenciesX = jsonSample["frequenciesX"];
+        JsonArray frequenciesY = jsonSample["frequenciesY"];
+        JsonArray frequenciesZ = jsonSample["frequenciesZ"];
+        if (frequenciesX.isNull() || frequenciesY.isNull() || frequenciesZ.isNull())
+        {
+            results->numSkipped++;
+            return;
+        }
+
+        const int numSamples = frequenciesX.size();
+        std::vector<double> x(numSamples), y(numSamples), z(numSamples);
+        for (int i = 0; i < numSamples; i++)
+        {
+            x[i] = frequenciesX[i];
+            y[i] = frequenciesY[i];
+            z[i] = frequenciesZ[i];
+        }
+
+        JsonArray jsonScores = jsonSample["referenceScores"];
+        if (jsonScores.isNull())
+        {
+            jsonScores = jsonSample["modelScores"];
+        }
+        std::vector<float> referenceScores;
+        for (JsonVariant score : jsonScores)
+        {
+            referenceScores.push_back(score.as<float>());
+        }
+
+        checkCapture(x, y, z, referenceScores, options, interpreter, results);
+    }
+
+    /**
+     * Classify every capture of a binary capture file, the acc columns are unpacked to g by the reader
+     * @return false when it can't be read, see error
+     */
+    bool checkBinary(const uint8_t *data, size_t size, const Options &options, tflite::MicroInterpreter &interpreter,
+                     Results *results, std::string *error)
+    {
+        capture_decoder::CaptureReader reader;
+        if (!reader.open(data, size))
+        {
+            *error = reader.getError();
+            return false;
+        }
+        const int columnX = reader.findColumn("accX");
+        const int columnY = reader.findColumn("accY");
+        const int columnZ = reader.findColumn("accZ");
+        int columnScores = reader.findColumn("referenceScores");
+        if (columnScores < 0)
+        {
+            columnScores = reader.findColumn("modelScores");
+        }
+
+        capture_decoder::Capture capture;
+        while (reader.next(&capture))
+        {
+            const std::vector<float> valuesX = columnX >= 0 ? reader.getValues(capture, columnX) : std::vector<float>();
+            const std::vector<float> valuesY = columnY >= 0 ? reader.getValues(capture, columnY) : std::vector<float>();
+            const std::vector<float> valuesZ = columnZ >= 0 ? reader.getValues(capture, columnZ) : std::vector<float>();
+            // Also empty for a compact capture or a corrupt packed stream
+            if (valuesX.empty() || valuesX.size() != valuesY.size() || valuesX.size() != valuesZ.size())
+            {
+                results->numSkipped++;
+                continue;
+            }
+
+            const std::vector<double> x(valuesX.begin(), valuesX.end());
+            const std::vector<double> y(valuesY.begin(), valuesY.end());
+            const std::vector<double> z(valuesZ.begin(), valuesZ.end());
+            const std::vector<float> referenceScores = columnScores >= 0 ? reader.getValues(capture, columnScores) : std::vector<float>();
+            checkCapture(x, y, z, referenceScores, options, interpreter, results);
+        }
+        *error = reader.getError();
+        return error->empty();
+    }
+
+    /**
+     * Classify every capture of a JSON capture file
+     * @return false when it isn't one
+     */
+    bool checkJson(const uint8_t *data, size_t size, const Options &options, tflite::MicroInterpreter &interpreter, Results *results)
+    {
+        JsonDocument jsonDoc;
+        if (deserializeJson(jsonDoc, reinterpret_cast<const char *>(data), size) != DeserializationError::Ok ||
+            !jsonDoc["samples"].is<JsonArray>())
+        {
+            return false;
+        }
+        for (JsonObject jsonSample : jsonDoc["samples"].as<JsonArray>())
+        {
+            checkJsonSample(jsonSample, options, interpreter, results);
+        }
+        return true;
+    }
+
+    /**
+     * Classify the captures of a binary capture file or JSON document, whichever the payload is
+     */
+    bool checkPayload(const uint8_t *data, size_t size, const Options &options, tflite::MicroInterpreter &interpreter,
+                      Results *results, std::string *error)
+    {
+        uint32_t magic = 0;
+        memcpy(&magic, data, std::min(size, sizeof(magic)));
+        if (magic == capture_format::fileMagic)
+        {
+            return checkBinary(data, size, options, interpreter, results, error);
+        }
+        if (!checkJson(data, size, options, interpreter, results))
+        {
+            *error = "not a capture file";
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Classify the captures of each committed record of a capture log, see capture_format.h
+     */
+    bool checkLog(const std::vector<uint8_t> &log, const Options &options, tflite::MicroInterpreter &interpreter,
+                  Results *results, std::string *error)
+    {
+        bool isChecked = true;
+        for (size_t offset = 0; offset + sizeof(capture_format::LogRecordHeader) <= log.size();)
+        {
+            capture_format::LogRecordHeader header;
+            memcpy(&header, log.data() + offset, sizeof(header));
+            if (header.magic != capture_format::logRecordMagic ||
+                header.headerCrc != checksum::crc32(&header, offsetof(capture_format::LogRecordHeader, headerCrc)) ||
+                offset + sizeof(header) + header.size > log.size())
+                break;
+
+            const uint8_t *payload = log.data() + offset + sizeof(header);
+            offset += (sizeof(header) + header.size + capture_format::logBlockSize - 1) / capture_format::logBlockSize * capture_format::logBlockSize;
+            std::string recordError;
+            if (checksum::crc32(payload, header.size) != header.payloadCrc)
+            {
+                recordError = "corrupt";
+            }
+            else if (checkPayload(payload, header.size, options, interpreter, results, &recordError))
+            {
+                continue;
+            }
+            *error = "record " + std::to_string(header.sequence) + ": " + recordError;
+            isChecked = false;
+        }
+        return isChecked;
+    }
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options))
+    {
+        fprintf(stderr, "Usage: %s <captures dir> [--model file] [--floor-db dB] [--tolerance score] [--min-agreement fraction] [--arena-limit bytes]\n", argv[0]);
+        return 2;
+    }
+
+    const uint8_t *modelBytes = g_vibration_model_data;
+    if (options.modelPath != nullptr)
+    {
+        model_file::Header header;
+        std::string error;
+        if (!loadModelFile(options.modelPath, &header, &error))
+        {
+            fprintf(stderr, "%s: %s\n", options.modelPath, error.c_str());
+            printf("vibration model: FAIL\n");
+            return 1;
+        }
+        printf("Model file %s: version %u, %u bytes\n", options.modelPath, header.modelVersion, header.modelSize);
+        modelBytes = modelData;
+    }
+
+    const tflite::Model *model = tflite::GetModel(modelBytes);
+    if (model->version() != TFLITE_SCHEMA_VERSION)
+    {
+        fprintf(stderr, "Vibration model schema version not supported\n");
+        return 1;
+    }
+
+    // Same resolver as the firmware, so the parity covers the device kernels
+    tflite::MicroMutableOpResolver<4> opResolver;
+    opResolver.AddConv2D(nn::registerConv2D());
+    opResolver.AddMean();
+    opResolver.AddFullyConnected(nn::registerFullyConnected());
+    opResolver.AddSoftmax();
+
+    tflite::MicroInterpreter interpreter(model, opResolver, tensorArena, tensorArenaSize);
+    if (interpreter.AllocateTensors() != kTfLiteOk)
+    {
+        fprintf(stderr, "Failed to allocate the vibration model tensors\n");
+        return 1;
+    }
+
+    Results results;
+    std::vector<std::filesystem::path> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(options.capturesDirectory))
+    {
+        if (entry.is_regular_file())
+            paths.push_back(entry.path());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    for (const auto &path : paths)
+    {
+        std::ifstream file(path, std::ios::binary);
+        const std::vector<uint8_t> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (contents.empty())
+        {
+            continue;
+        }
+
+        uint32_t magic = 0;
+        memcpy(&magic, contents.data(), std::min(contents.size(), sizeof(magic)));
+        std::string error;
+        const bool isChecked = magic == capture_format::logRecordMagic
+                                   ? checkLog(contents, options, interpreter, &results, &error)
+                                   : checkPayload(contents.data(), contents.size(), options, interpreter, &results, &error);
+        if (!isChecked)
+        {
+            printf("Skipping %s, %s\n", path.c_str(), error.c_str());
+        }
+    }
+
+    if (results.inferenceUs.empty())
+    {
+        fprintf(stderr, "No raw captures found in %s\n", options.capturesDirectory);
+        return 1;
+    }
+
+    std::vector<double> sortedUs = results.inferenceUs;
+    std::sort(sortedUs.begin(), sortedUs.end());
+    double totalUs = 0.0;
+    for (double us : sortedUs)
+        totalUs += us;
+    const size_t numInferences = sortedUs.size();
+    // Arena usage on a 64 bit host is a bit above the device's, pointers are twice as large
+    const size_t arenaUsedBytes = interpreter.arena_used_bytes();
+    const float agreement = results.numCompared > 0 ? static_cast<float>(results.numAgreeing) / results.numCompared : 1.0f;
+
+    printf("Captures: %zu classified, %d skipped (no raw data), %d with reference scores\n", numInferences, results.numSkipped, results.numCompared);
+    printf("Preprocessing: %.1f us average\n", results.totalPreprocessingUs / numInferences);
+    printf("Inference: %.1f us average, %.1f min, %.1f p95, %.1f max\n", totalUs / numInferences,
+           sortedUs.front(), sortedUs[(numInferences - 1) * 95 / 100], sortedUs.back());
+    printf("Arena high-water mark: %zu bytes (limit %zu)\n", arenaUsedBytes, options.arenaLimit);
+    printf("Top class agreement: %.2f%% (minimum %.2f%%), max score difference %.4f (tolerance %.4f)\n",
+           100.0f * agreement, 100.0f * options.minAgreement, results.maxScoreDifference, options.tolerance);
+
+    const bool isPassing = arenaUsedBytes <= options.arenaLimit && agreement >= options.minAgreement &&
+                           results.maxScoreDifference <= options.tolerance;
+    printf("vibration model: %s\n", isPassing ? "PASS" : "FAIL");
+    return isPassing ? 0 : 1;
+}